@@ -0,0 +1,308 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <execinfo.h>
+#endif
+
+// glibc exports its allocator under these names as well, so the interposed malloc family can forward to it
+#if defined(__GLIBC__)
+#define INTERPOSE_MALLOC 1
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* memory, size_t size);
+extern "C" void __libc_free(void* memory);
+#endif
+
+static const int MAX_SCOPE_DEPTH = 32;
+// in ALLOCATION_REPORT mode, later violations are only counted
+static const uint64_t MAX_REPORTED_VIOLATIONS = 8;
+
+struct AtomicCounts
+{
+    std::atomic<uint64_t> NewAllocations;
+    std::atomic<uint64_t> NewBytes;
+    std::atomic<uint64_t> MallocAllocations;
+    std::atomic<uint64_t> MallocBytes;
+    std::atomic<uint64_t> Frees;
+    std::atomic<uint64_t> Violations;
+
+    AllocationCounts Load() const
+    {
+        AllocationCounts counts;
+        counts.NewAllocations = NewAllocations.load(std::memory_order_relaxed);
+        counts.NewBytes = NewBytes.load(std::memory_order_relaxed);
+        counts.MallocAllocations = MallocAllocations.load(std::memory_order_relaxed);
+        counts.MallocBytes = MallocBytes.load(std::memory_order_relaxed);
+        counts.Frees = Frees.load(std::memory_order_relaxed);
+        counts.Violations = Violations.load(std::memory_order_relaxed);
+        return counts;
+    }
+};
+
+struct ScopeSlot
+{
+    std::atomic<const char*> Name;
+    AtomicCounts Counts;
+};
+
+// all of it is zero initialized before any constructor runs, allocations can arrive that early
+struct ThreadState
+{
+    const char* Scopes[MAX_SCOPE_DEPTH];
+    int ScopeDepth;
+    const char* NoAllocationName;
+    int NoAllocationDepth;
+    // set while recording, allocations made by the tracker itself (callstacks, printing) are ignored
+    bool InHook;
+};
+
+static std::atomic<bool> trackingEnabled;
+static std::atomic<int> violationMode;
+static AtomicCounts totals;
+static ScopeSlot scopes[MAX_ALLOCATION_SCOPES];
+static thread_local ThreadState threadState;
+
+static ScopeSlot* findScope(const char* name)
+{
+    for (ScopeSlot& slot : scopes)
+    {
+        const char* current = slot.Name.load(std::memory_order_acquire);
+        if (current == NULL)
+        {
+            // claim the free slot, or find out which name beat us to it
+            slot.Name.compare_exchange_strong(current, name, std::memory_order_acq_rel);
+            if (current == NULL)
+                return &slot;
+        }
+        if (current == name)
+            return &slot;
+    }
+    return NULL;
+}
+
+static void printCallstack()
+{
+    void* frames[32];
+#ifdef _WIN32
+    USHORT count = CaptureStackBackTrace(2, 32, frames, NULL);
+    for (USHORT i = 0; i < count; i++)
+        std::fprintf(stderr, "    %p\n", frames[i]);
+#else
+    int count = backtrace(frames, 32);
+    backtrace_symbols_fd(frames, count, 2);
+#endif
+}
+
+static void reportViolation(const ThreadState& state, size_t size)
+{
+    uint64_t violations = totals.Violations.fetch_add(1, std::memory_order_relaxed) + 1;
+    bool fatal = violationMode.load(std::memory_order_relaxed) == ALLOCATION_ASSERT;
+    if (!fatal && violations > MAX_REPORTED_VIOLATIONS)
+        return;
+    const char* scope = state.ScopeDepth > 0 ? state.Scopes[std::min(state.ScopeDepth, MAX_SCOPE_DEPTH) - 1] : "none";
+    std::fprintf(stderr, "ERROR::ALLOCATION:: operator new of %llu bytes inside no-alloc region \"%s\", scope \"%s\"\n",
+        (unsigned long long)size, state.NoAllocationName, scope);
+    printCallstack();
+    if (fatal)
+        std::abort();
+}
+
+static void recordAllocation(size_t size, bool fromNew)
+{
+    if (!trackingEnabled.load(std::memory_order_relaxed))
+        return;
+    ThreadState& state = threadState;
+    if (state.InHook)
+        return;
+    state.InHook = true;
+
+    std::atomic<uint64_t>& allocations = fromNew ? totals.NewAllocations : totals.MallocAllocations;
+    std::atomic<uint64_t>& bytes = fromNew ? totals.NewBytes : totals.MallocBytes;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    if (state.ScopeDepth > 0 && state.ScopeDepth <= MAX_SCOPE_DEPTH)
+    {
+        ScopeSlot* slot = findScope(state.Scopes[state.ScopeDepth - 1]);
+        if (slot != NULL)
+        {
+            (fromNew ? slot->Counts.NewAllocations : slot->Counts.MallocAllocations).fetch_add(1, std::memory_order_relaxed);
+            (fromNew ? slot->Counts.NewBytes : slot->Counts.MallocBytes).fetch_add(size, std::memory_order_relaxed);
+            if (fromNew && state.NoAllocationDepth > 0)
+                slot->Counts.Violations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // GL drivers malloc inside ordinary draw calls, so only operator new is held to no-alloc regions. malloc is still
+    // counted and attributed to the scope
+    if (fromNew && state.NoAllocationDepth > 0)
+        reportViolation(state, size);
+
+    state.InHook = false;
+}
+
+static void recordFree()
+{
+    if (trackingEnabled.load(std::memory_order_relaxed))
+        totals.Frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* rawMalloc(size_t size)
+{
+#ifdef INTERPOSE_MALLOC
+    return __libc_malloc(size);
+#else
+    return std::malloc(size);
+#endif
+}
+
+static void rawFree(void* memory)
+{
+#ifdef INTERPOSE_MALLOC
+    __libc_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+static void* trackedNew(size_t size)
+{
+    recordAllocation(size, true);
+    void* memory = rawMalloc(size == 0 ? 1 : size);
+    if (memory == NULL)
+        throw std::bad_alloc();
+    return memory;
+}
+
+static void trackedDelete(void* memory)
+{
+    if (memory == NULL)
+        return;
+    recordFree();
+    rawFree(memory);
+}
+
+
+void EnableAllocationTracking(bool enabled)
+{
+    trackingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool IsAllocationTrackingEnabled()
+{
+    return trackingEnabled.load(std::memory_order_relaxed);
+}
+
+void SetAllocationViolationMode(Allocation_Violation_Mode mode)
+{
+    violationMode.store(mode, std::memory_order_relaxed);
+}
+
+AllocationCounts GetAllocationCounts()
+{
+    return totals.Load();
+}
+
+int GetAllocationScopeCounts(AllocationScopeCounts* result, int maxScopes)
+{
+    int count = 0;
+    for (const ScopeSlot& slot : scopes)
+    {
+        const char* name = slot.Name.load(std::memory_order_acquire);
+        if (name == NULL || count == maxScopes)
+            break;
+        result[count].Name = name;
+        result[count].Counts = slot.Counts.Load();
+        count++;
+    }
+    return count;
+}
+
+void PushAllocationScope(const char* name)
+{
+    ThreadState& state = threadState;
+    if (state.ScopeDepth < MAX_SCOPE_DEPTH)
+        state.Scopes[state.ScopeDepth] = name;
+    state.ScopeDepth++;
+}
+
+void PopAllocationScope()
+{
+    threadState.ScopeDepth--;
+}
+
+void BeginNoAllocationRegion(const char* name)
+{
+    ThreadState& state = threadState;
+    if (state.NoAllocationDepth++ == 0)
+        state.NoAllocationName = name;
+    PushAllocationScope(name);
+}
+
+void EndNoAllocationRegion()
+{
+    PopAllocationScope();
+    threadState.NoAllocationDepth--;
+}
+
+
+// Global replacements, they must not be inline and live in exactly one translation unit
+void* operator new(size_t size) { return trackedNew(size); }
+void* operator new[](size_t size) { return trackedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try { return trackedNew(size); }
+    catch (const std::bad_alloc&) { return NULL; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try { return trackedNew(size); }
+    catch (const std::bad_alloc&) { return NULL; }
+}
+void operator delete(void* memory) noexcept { trackedDelete(memory); }
+void operator delete[](void* memory) noexcept { trackedDelete(memory); }
+void operator delete(void* memory, size_t) noexcept { trackedDelete(memory); }
+void operator delete[](void* memory, size_t) noexcept { trackedDelete(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { trackedDelete(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { trackedDelete(memory); }
+
+#ifdef INTERPOSE_MALLOC
+// Definitions in the executable take precedence over libc's for every shared library, GL drivers included
+extern "C" void* malloc(size_t size)
+{
+    recordAllocation(size, false);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    recordAllocation(count * size, false);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* memory, size_t size)
+{
+    if (size > 0)
+        recordAllocation(size, false);
+    return __libc_realloc(memory, size);
+}
+
+extern "C" void free(void* memory)
+{
+    if (memory != NULL)
+        recordFree();
+    __libc_free(memory);
+}
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation instrumentation. AllocationTracker.cpp replaces the global operator new/delete and, on Linux with
+// glibc, interposes malloc/calloc/realloc/free, so allocations from C code and the GL driver are seen as well.
+// Nothing is recorded until EnableAllocationTracking(true), after which every allocation is counted, attributed
+// to the innermost AllocationScope of its thread, and checked against NoAllocationScope regions
+
+enum Allocation_Violation_Mode {
+    ALLOCATION_REPORT,  // print the scope and callstack of the first few, count the rest
+    ALLOCATION_ASSERT   // print the scope and callstack and abort
+};
+
+// Where an allocation came from: operator new is engine and standard library C++ code, malloc everything in C,
+// which includes the GL driver
+struct AllocationCounts
+{
+    uint64_t NewAllocations = 0;
+    uint64_t NewBytes = 0;
+    uint64_t MallocAllocations = 0;
+    uint64_t MallocBytes = 0;
+    uint64_t Frees = 0;
+    // operator new inside a NoAllocationScope
+    uint64_t Violations = 0;
+
+    uint64_t Allocations() const { return NewAllocations + MallocAllocations; }
+};
+
+inline AllocationCounts operator-(const AllocationCounts& a, const AllocationCounts& b)
+{
+    AllocationCounts result;
+    result.NewAllocations = a.NewAllocations - b.NewAllocations;
+    result.NewBytes = a.NewBytes - b.NewBytes;
+    result.MallocAllocations = a.MallocAllocations - b.MallocAllocations;
+    result.MallocBytes = a.MallocBytes - b.MallocBytes;
+    result.Frees = a.Frees - b.Frees;
+    result.Violations = a.Violations - b.Violations;
+    return result;
+}
+
+struct AllocationScopeCounts
+{
+    const char* Name;
+    AllocationCounts Counts;
+};
+
+const int MAX_ALLOCATION_SCOPES = 64;
+
+void EnableAllocationTracking(bool enabled);
+bool IsAllocationTrackingEnabled();
+void SetAllocationViolationMode(Allocation_Violation_Mode mode);
+
+// Totals on all threads since tracking was enabled. Per-frame numbers are the difference of two snapshots
+AllocationCounts GetAllocationCounts();
+// Totals per scope name, fills at most maxScopes entries and returns how many
+int GetAllocationScopeCounts(AllocationScopeCounts* scopes, int maxScopes);
+
+void PushAllocationScope(const char* name);
+void PopAllocationScope();
+void BeginNoAllocationRegion(const char* name);
+void EndNoAllocationRegion();
+
+// Attributes allocations on this thread to name until the end of the C++ scope. name must be a string literal or
+// otherwise outlive the program, scopes are told apart by pointer
+class AllocationScope
+{
+public:
+    explicit AllocationScope(const char* name) { PushAllocationScope(name); }
+    ~AllocationScope() { PopAllocationScope(); }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+};
+
+// Marks code on this thread that must not allocate, e.g. the body of a steady-state frame. operator new inside is a
+// violation, reported or fatal depending on the violation mode; malloc isn't, the GL driver uses it in draw calls.
+// Also opens an AllocationScope of the same name
+class NoAllocationScope
+{
+public:
+    // with enforce false it only attributes, e.g. for warmup frames that are allowed to allocate
+    explicit NoAllocationScope(const char* name, bool enforce = true) : enforce(enforce)
+    {
+        if (enforce)
+            BeginNoAllocationRegion(name);
+        else
+            PushAllocationScope(name);
+    }
+
+    ~NoAllocationScope()
+    {
+        if (enforce)
+            EndNoAllocationRegion();
+        else
+            PopAllocationScope();
+    }
+
+    NoAllocationScope(const NoAllocationScope&) = delete;
+    NoAllocationScope& operator=(const NoAllocationScope&) = delete;
+
+private:
+    bool enforce;
+};
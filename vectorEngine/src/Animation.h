@@ -0,0 +1,826 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "ClusteredLighting.h"
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Shader.h"
+#include "TransformBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Texture unit of the bone palette buffer, after the shadow map
+const int BONE_PALETTE_UNIT = 8;
+// skinned vertices reference joints with a byte
+const int MAX_JOINTS = 256;
+// characters animated per job
+const int ANIMATION_CHUNK = 8;
+
+
+// Joint hierarchy. Parents always come before their children, so resolving model space poses is one forward pass
+struct Skeleton
+{
+    std::vector<int> Parents;           // -1 for a root
+    std::vector<glm::mat4> InverseBind; // model space to joint space in the rest pose
+
+    int JointCount() const { return (int)Parents.size(); }
+};
+
+
+// Smallest-three quaternion packing into 48 bits: the largest component is dropped, its index goes into the top bits
+// of the first two words, and the other three, which lie in [-1/sqrt(2), 1/sqrt(2)], are quantized to 15 bits
+inline void PackQuaternion(glm::quat q, uint16_t* packed)
+{
+    float c[4] = { q.x, q.y, q.z, q.w };
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+    {
+        if (std::abs(c[i]) > std::abs(c[largest]))
+            largest = i;
+    }
+    // q and -q are the same rotation, the dropped component is always positive
+    float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+    uint16_t v[3];
+    for (int i = 0, k = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+        float x = glm::clamp(c[i] * sign * glm::root_two<float>() * 0.5f + 0.5f, 0.0f, 1.0f);
+        v[k++] = (uint16_t)(x * 32767.0f + 0.5f);
+    }
+    packed[0] = (uint16_t)(v[0] | ((largest & 1) << 15));
+    packed[1] = (uint16_t)(v[1] | ((largest >> 1) << 15));
+    packed[2] = v[2];
+}
+
+inline glm::quat UnpackQuaternion(const uint16_t* packed)
+{
+    int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+    float v[3];
+    float sum = 0.0f;
+    for (int k = 0; k < 3; k++)
+    {
+        v[k] = ((packed[k] & 0x7FFF) * (1.0f / 32767.0f) * 2.0f - 1.0f) * glm::one_over_root_two<float>();
+        sum += v[k] * v[k];
+    }
+    float c[4];
+    for (int i = 0, k = 0; i < 4; i++)
+        c[i] = i == largest ? std::sqrt(std::max(0.0f, 1.0f - sum)) : v[k++];
+    return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+
+// A clip sampled at a fixed rate. Tracks that never move store a single full precision value; the animated ones are
+// stored frame-major, so sampling a time reads two contiguous runs of keys. Rotations take 6 bytes per key
+// (smallest-three), translations 6 (16 bit per axis within the track's range). Clips don't animate scale
+struct AnimationClip
+{
+    float Duration = 0.0f;
+    float SampleRate = 30.0f;
+    int FrameCount = 0;
+    int JointCount = 0;
+
+    // per joint: the slot among the animated tracks, or -1 - index into the constant values
+    std::vector<int> RotationTracks;
+    std::vector<int> TranslationTracks;
+    std::vector<glm::quat> ConstantRotations;
+    std::vector<glm::vec3> ConstantTranslations;
+
+    int AnimatedRotations = 0;
+    int AnimatedTranslations = 0;
+    // FrameCount * AnimatedRotations * 3 words
+    std::vector<uint16_t> RotationKeys;
+    // FrameCount * AnimatedTranslations * 3 words, dequantized with the per track range
+    std::vector<uint16_t> TranslationKeys;
+    std::vector<glm::vec3> TranslationMin;
+    std::vector<glm::vec3> TranslationExtent;
+
+    size_t Bytes() const
+    {
+        return (RotationKeys.size() + TranslationKeys.size()) * sizeof(uint16_t) + ConstantRotations.size() * sizeof(glm::quat) +
+            (ConstantTranslations.size() + TranslationMin.size() + TranslationExtent.size()) * sizeof(glm::vec3) +
+            (RotationTracks.size() + TranslationTracks.size()) * sizeof(int);
+    }
+};
+
+// Builds a clip from local poses sampled at sampleRate. Tracks within tolerance of their first value for the whole
+// clip become constant, tolerance is in radians for rotations and units for translations
+inline AnimationClip CompressClip(const std::vector<TransformSoA>& frames, float sampleRate, float tolerance = 1e-4f)
+{
+    AnimationClip clip;
+    clip.SampleRate = sampleRate;
+    clip.FrameCount = (int)frames.size();
+    clip.Duration = clip.FrameCount > 1 ? (clip.FrameCount - 1) / sampleRate : 0.0f;
+    clip.JointCount = frames.empty() ? 0 : (int)frames[0].Size();
+
+    auto rotation = [&](int frame, int joint) { const TransformSoA& p = frames[frame]; return glm::quat(p.QW[joint], p.QX[joint], p.QY[joint], p.QZ[joint]); };
+    auto translation = [&](int frame, int joint) { const TransformSoA& p = frames[frame]; return glm::vec3(p.PX[joint], p.PY[joint], p.PZ[joint]); };
+
+    std::vector<int> animatedRotations, animatedTranslations;
+    for (int joint = 0; joint < clip.JointCount; joint++)
+    {
+        bool rotates = false, moves = false;
+        glm::vec3 low = translation(0, joint), high = low;
+        for (int frame = 1; frame < clip.FrameCount; frame++)
+        {
+            float angle = 2.0f * std::acos(std::min(1.0f, std::abs(glm::dot(rotation(0, joint), rotation(frame, joint)))));
+            rotates |= angle > tolerance;
+            glm::vec3 t = translation(frame, joint);
+            moves |= glm::length(t - translation(0, joint)) > tolerance;
+            low = glm::min(low, t);
+            high = glm::max(high, t);
+        }
+        if (rotates)
+        {
+            clip.RotationTracks.push_back(clip.AnimatedRotations++);
+            animatedRotations.push_back(joint);
+        }
+        else
+        {
+            clip.RotationTracks.push_back(-1 - (int)clip.ConstantRotations.size());
+            clip.ConstantRotations.push_back(rotation(0, joint));
+        }
+        if (moves)
+        {
+            clip.TranslationTracks.push_back(clip.AnimatedTranslations++);
+            animatedTranslations.push_back(joint);
+            clip.TranslationMin.push_back(low);
+            clip.TranslationExtent.push_back(high - low);
+        }
+        else
+        {
+            clip.TranslationTracks.push_back(-1 - (int)clip.ConstantTranslations.size());
+            clip.ConstantTranslations.push_back(translation(0, joint));
+        }
+    }
+
+    clip.RotationKeys.resize((size_t)clip.FrameCount * clip.AnimatedRotations * 3);
+    clip.TranslationKeys.resize((size_t)clip.FrameCount * clip.AnimatedTranslations * 3);
+    for (int frame = 0; frame < clip.FrameCount; frame++)
+    {
+        for (int slot = 0; slot < clip.AnimatedRotations; slot++)
+            PackQuaternion(rotation(frame, animatedRotations[slot]), &clip.RotationKeys[((size_t)frame * clip.AnimatedRotations + slot) * 3]);
+        for (int slot = 0; slot < clip.AnimatedTranslations; slot++)
+        {
+            glm::vec3 t = translation(frame, animatedTranslations[slot]);
+            uint16_t* key = &clip.TranslationKeys[((size_t)frame * clip.AnimatedTranslations + slot) * 3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float extent = clip.TranslationExtent[slot][axis];
+                key[axis] = extent > 0.0f ? (uint16_t)((t[axis] - clip.TranslationMin[slot][axis]) / extent * 65535.0f + 0.5f) : 0;
+            }
+        }
+    }
+    return clip;
+}
+
+// Samples the clip at time into pose, which must have the clip's joint count. Looping clips wrap, others clamp.
+// Keys are interpolated linearly, rotations with a normalized lerp along the shorter arc
+inline void SampleClip(const AnimationClip& clip, float time, bool loop, TransformSoA& pose)
+{
+    float frame = 0.0f;
+    if (clip.Duration > 0.0f)
+    {
+        time = loop ? time - std::floor(time / clip.Duration) * clip.Duration : glm::clamp(time, 0.0f, clip.Duration);
+        frame = time * clip.SampleRate;
+    }
+    int f0 = std::min((int)frame, std::max(clip.FrameCount - 1, 0));
+    int f1 = std::min(f0 + 1, std::max(clip.FrameCount - 1, 0));
+    float alpha = frame - f0;
+    const uint16_t* rotations0 = clip.RotationKeys.data() + (size_t)f0 * clip.AnimatedRotations * 3;
+    const uint16_t* rotations1 = clip.RotationKeys.data() + (size_t)f1 * clip.AnimatedRotations * 3;
+    const uint16_t* translations0 = clip.TranslationKeys.data() + (size_t)f0 * clip.AnimatedTranslations * 3;
+    const uint16_t* translations1 = clip.TranslationKeys.data() + (size_t)f1 * clip.AnimatedTranslations * 3;
+
+    for (int joint = 0; joint < clip.JointCount; joint++)
+    {
+        int track = clip.RotationTracks[joint];
+        glm::quat q;
+        if (track >= 0)
+        {
+            glm::quat a = UnpackQuaternion(rotations0 + track * 3);
+            glm::quat b = UnpackQuaternion(rotations1 + track * 3);
+            if (glm::dot(a, b) < 0.0f)
+                b = -b;
+            q = glm::normalize(a * (1.0f - alpha) + b * alpha);
+        }
+        else
+        {
+            q = clip.ConstantRotations[-1 - track];
+        }
+        pose.QX[joint] = q.x; pose.QY[joint] = q.y; pose.QZ[joint] = q.z; pose.QW[joint] = q.w;
+
+        track = clip.TranslationTracks[joint];
+        glm::vec3 t;
+        if (track >= 0)
+        {
+            const uint16_t* a = translations0 + track * 3;
+            const uint16_t* b = translations1 + track * 3;
+            glm::vec3 key0(a[0], a[1], a[2]), key1(b[0], b[1], b[2]);
+            t = clip.TranslationMin[track] + glm::mix(key0, key1, alpha) * (clip.TranslationExtent[track] / 65535.0f);
+        }
+        else
+        {
+            t = clip.ConstantTranslations[-1 - track];
+        }
+        pose.PX[joint] = t.x; pose.PY[joint] = t.y; pose.PZ[joint] = t.z;
+    }
+}
+
+
+// Reference path of BlendPoses, joints [begin, end)
+inline void BlendPosesScalar(const TransformSoA& a, const TransformSoA& b, float weight, TransformSoA& out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        out.PX[i] = a.PX[i] + (b.PX[i] - a.PX[i]) * weight;
+        out.PY[i] = a.PY[i] + (b.PY[i] - a.PY[i]) * weight;
+        out.PZ[i] = a.PZ[i] + (b.PZ[i] - a.PZ[i]) * weight;
+        out.SX[i] = a.SX[i] + (b.SX[i] - a.SX[i]) * weight;
+        out.SY[i] = a.SY[i] + (b.SY[i] - a.SY[i]) * weight;
+        out.SZ[i] = a.SZ[i] + (b.SZ[i] - a.SZ[i]) * weight;
+        float d = a.QX[i] * b.QX[i] + a.QY[i] * b.QY[i] + a.QZ[i] * b.QZ[i] + a.QW[i] * b.QW[i];
+        float wb = d < 0.0f ? -weight : weight;
+        float x = a.QX[i] * (1.0f - weight) + b.QX[i] * wb, y = a.QY[i] * (1.0f - weight) + b.QY[i] * wb;
+        float z = a.QZ[i] * (1.0f - weight) + b.QZ[i] * wb, w = a.QW[i] * (1.0f - weight) + b.QW[i] * wb;
+        float scale = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+        out.QX[i] = x * scale; out.QY[i] = y * scale; out.QZ[i] = z * scale; out.QW[i] = w * scale;
+    }
+}
+
+// out = a blended towards b by weight: translation and scale lerp, rotation nlerp along the shorter arc. Four joints
+// per iteration with SSE; out may alias a or b
+inline void BlendPoses(const TransformSoA& a, const TransformSoA& b, float weight, TransformSoA& out)
+{
+    size_t i = 0, count = a.Size();
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 w = _mm_set1_ps(weight);
+    const __m128 iw = _mm_set1_ps(1.0f - weight);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const std::vector<float>* linearA[6] = { &a.PX, &a.PY, &a.PZ, &a.SX, &a.SY, &a.SZ };
+    const std::vector<float>* linearB[6] = { &b.PX, &b.PY, &b.PZ, &b.SX, &b.SY, &b.SZ };
+    std::vector<float>* linearOut[6] = { &out.PX, &out.PY, &out.PZ, &out.SX, &out.SY, &out.SZ };
+    for (; i + 4 <= count; i += 4)
+    {
+        for (int s = 0; s < 6; s++)
+        {
+            __m128 va = _mm_loadu_ps(linearA[s]->data() + i);
+            __m128 vb = _mm_loadu_ps(linearB[s]->data() + i);
+            _mm_storeu_ps(linearOut[s]->data() + i, _mm_add_ps(_mm_mul_ps(va, iw), _mm_mul_ps(vb, w)));
+        }
+        __m128 ax = _mm_loadu_ps(&a.QX[i]), ay = _mm_loadu_ps(&a.QY[i]), az = _mm_loadu_ps(&a.QZ[i]), aw = _mm_loadu_ps(&a.QW[i]);
+        __m128 bx = _mm_loadu_ps(&b.QX[i]), by = _mm_loadu_ps(&b.QY[i]), bz = _mm_loadu_ps(&b.QZ[i]), bw = _mm_loadu_ps(&b.QW[i]);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        // flip b where the dot product is negative
+        __m128 wb = _mm_xor_ps(w, _mm_and_ps(d, signBit));
+        __m128 x = _mm_add_ps(_mm_mul_ps(ax, iw), _mm_mul_ps(bx, wb));
+        __m128 y = _mm_add_ps(_mm_mul_ps(ay, iw), _mm_mul_ps(by, wb));
+        __m128 z = _mm_add_ps(_mm_mul_ps(az, iw), _mm_mul_ps(bz, wb));
+        __m128 qw = _mm_add_ps(_mm_mul_ps(aw, iw), _mm_mul_ps(bw, wb));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(qw, qw))));
+        __m128 scale = _mm_div_ps(one, length);
+        _mm_storeu_ps(&out.QX[i], _mm_mul_ps(x, scale));
+        _mm_storeu_ps(&out.QY[i], _mm_mul_ps(y, scale));
+        _mm_storeu_ps(&out.QZ[i], _mm_mul_ps(z, scale));
+        _mm_storeu_ps(&out.QW[i], _mm_mul_ps(qw, scale));
+    }
+#endif
+    BlendPosesScalar(a, b, weight, out, i, count);
+}
+
+// Local poses to model space skinning matrices: world * model[joint] * inverseBind[joint]. local receives the
+// composed local matrices and model the model space ones, both sized to the joint count
+inline void BuildSkinningPalette(const Skeleton& skeleton, const TransformSoA& pose, const glm::mat4& world, glm::mat4* local, glm::mat4* model, glm::mat4* palette)
+{
+    int count = skeleton.JointCount();
+    ComposeTransforms(pose, 0, count, local);
+    // parents come first, so their model matrix is always ready
+    for (int joint = 0; joint < count; joint++)
+    {
+        int parent = skeleton.Parents[joint];
+        MultiplyTransforms(parent < 0 ? world : model[parent], &local[joint], 1, &model[joint]);
+    }
+    for (int joint = 0; joint < count; joint++)
+        MultiplyTransforms(model[joint], &skeleton.InverseBind[joint], 1, &palette[joint]);
+}
+
+
+// A skinned vertex, up to four joint influences with weights summing to 255
+struct SkinnedVertex
+{
+    float Position[3];
+    float Normal[3];
+    float TexCoord[2];
+    uint8_t Joints[4];
+    uint8_t Weights[4];
+};
+
+// Linear blend skinning of vertices [begin, end) on the CPU into 8 floats per vertex: position, normal and the
+// texture coordinates copied through. The normal is not renormalized, the fragment shaders do that
+inline void SkinVertices(const SkinnedVertex* vertices, size_t begin, size_t end, const glm::mat4* palette, float* out)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 toWeight = _mm_set1_ps(1.0f / 255.0f);
+    for (size_t v = begin; v < end; v++)
+    {
+        const SkinnedVertex& vertex = vertices[v];
+        // blend the columns of the influencing matrices, glm::mat4 is column-major so each column is one load
+        __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+        for (int k = 0; k < 4; k++)
+        {
+            __m128 weight = _mm_mul_ps(_mm_set1_ps((float)vertex.Weights[k]), toWeight);
+            const float* m = &palette[vertex.Joints[k]][0][0];
+            c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), weight));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), weight));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), weight));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), weight));
+        }
+        __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.Position[0])), _mm_mul_ps(c1, _mm_set1_ps(vertex.Position[1]))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(vertex.Position[2])), c3));
+        __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.Normal[0])), _mm_mul_ps(c1, _mm_set1_ps(vertex.Normal[1]))),
+            _mm_mul_ps(c2, _mm_set1_ps(vertex.Normal[2])));
+        // the normal's store overlaps the position's w, the texture coordinates its own
+        float* o = out + v * 8;
+        _mm_storeu_ps(o, p);
+        _mm_storeu_ps(o + 3, n);
+        o[6] = vertex.TexCoord[0];
+        o[7] = vertex.TexCoord[1];
+    }
+#else
+    for (size_t v = begin; v < end; v++)
+    {
+        const SkinnedVertex& vertex = vertices[v];
+        glm::mat4 m(0.0f);
+        for (int k = 0; k < 4; k++)
+            m += palette[vertex.Joints[k]] * (vertex.Weights[k] / 255.0f);
+        glm::vec4 p = m * glm::vec4(vertex.Position[0], vertex.Position[1], vertex.Position[2], 1.0f);
+        glm::vec4 n = m * glm::vec4(vertex.Normal[0], vertex.Normal[1], vertex.Normal[2], 0.0f);
+        float* o = out + v * 8;
+        o[0] = p.x; o[1] = p.y; o[2] = p.z;
+        o[3] = n.x; o[4] = n.y; o[5] = n.z;
+        o[6] = vertex.TexCoord[0]; o[7] = vertex.TexCoord[1];
+    }
+#endif
+}
+
+
+// One skinned mesh with its skeleton and clips
+struct CharacterRig
+{
+    Skeleton Bones;
+    std::vector<SkinnedVertex> Vertices;
+    std::vector<unsigned int> Indices;
+    std::vector<AnimationClip> Clips;
+};
+
+// A placed character. Every frame it plays clip BaseClip blended towards BlendClip by a weight that oscillates
+// with BlendSpeed, both at its own phase
+struct CharacterInstance
+{
+    glm::mat4 World = glm::mat4(1.0f);
+    int BaseClip = 0;
+    int BlendClip = 0;
+    float Phase = 0.0f;
+    float Speed = 1.0f;
+    float BlendSpeed = 0.5f;
+};
+
+// What the renderer needs of one CrowdAnimation::Update, copied out for a renderer on another thread: the palettes
+// as the rows the shader reads, or the CPU skinned vertices
+struct CrowdPose
+{
+    std::vector<glm::vec4> PaletteRows;
+    std::vector<float> Skinned;
+    size_t InstanceCount = 0;
+};
+
+// Many instances of one rig, CPU side only. Update samples, blends and builds skinning palettes for every instance
+// in parallel chunks on the job system, and with CpuSkinning also skins them with SIMD
+class CrowdAnimation
+{
+public:
+    std::vector<CharacterInstance> Instances;
+    bool CpuSkinning = false;
+    // time the last Update spent sampling and building palettes, and skinning on the CPU
+    double AnimateMs = 0.0;
+    double SkinMs = 0.0;
+
+    CrowdAnimation(const CharacterRig& rig, const std::vector<CharacterInstance>& instances) : Instances(instances), rig(rig)
+    {
+        int joints = rig.Bones.JointCount();
+        palettes.resize(instances.size() * joints);
+        paletteRows.resize(instances.size() * joints * 3);
+        int chunks = (int)((instances.size() + ANIMATION_CHUNK - 1) / ANIMATION_CHUNK);
+        scratch.resize(chunks);
+        for (ChunkScratch& s : scratch)
+        {
+            s.Base.Resize(joints);
+            s.Blend.Resize(joints);
+            s.Local.resize(joints);
+            s.Model.resize(joints);
+        }
+    }
+
+    CrowdAnimation(const CrowdAnimation&) = delete;
+    CrowdAnimation& operator=(const CrowdAnimation&) = delete;
+
+    int JointCount() const { return rig.Bones.JointCount(); }
+    const CharacterRig& Rig() const { return rig; }
+
+    // Poses every instance at time and builds its palette, then skins on the CPU when CpuSkinning is set
+    void Update(float time)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        updateTime = time;
+        int chunks = (int)scratch.size();
+        GetJobSystem().ParallelFor(chunks, 1, [this](int begin, int end)
+        {
+            for (int chunk = begin; chunk < end; chunk++)
+                animateChunk(chunk);
+        });
+        std::chrono::high_resolution_clock::time_point animated = std::chrono::high_resolution_clock::now();
+        AnimateMs = std::chrono::duration<double, std::milli>(animated - start).count();
+        SkinMs = 0.0;
+        if (CpuSkinning)
+        {
+            skinned.resize(Instances.size() * rig.Vertices.size() * 8);
+            GetJobSystem().ParallelFor((int)Instances.size(), 4, [this](int begin, int end)
+            {
+                size_t vertexCount = rig.Vertices.size();
+                for (int instance = begin; instance < end; instance++)
+                {
+                    SkinVertices(rig.Vertices.data(), 0, vertexCount, &palettes[(size_t)instance * rig.Bones.JointCount()],
+                        skinned.data() + (size_t)instance * vertexCount * 8);
+                }
+            });
+            SkinMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - animated).count();
+        }
+    }
+
+    // Copies the result of the last Update, only the half the renderer draws from. Reusing out allocates only the
+    // first time
+    void CopyPose(CrowdPose& out) const
+    {
+        if (CpuSkinning)
+            out.Skinned.assign(skinned.begin(), skinned.end());
+        else
+            out.PaletteRows.assign(paletteRows.begin(), paletteRows.end());
+        out.InstanceCount = Instances.size();
+    }
+
+protected:
+    CharacterRig rig;
+    // the palettes as the three rows the shader reads
+    std::vector<glm::vec4> paletteRows;
+    // CPU skinned vertices of all instances, 8 floats each
+    std::vector<float> skinned;
+
+private:
+    struct ChunkScratch
+    {
+        TransformSoA Base;
+        TransformSoA Blend;
+        std::vector<glm::mat4> Local;
+        std::vector<glm::mat4> Model;
+    };
+
+    // per instance, JointCount matrices each
+    std::vector<glm::mat4> palettes;
+    std::vector<ChunkScratch> scratch;
+    // read by the jobs, so their lambdas only capture this
+    float updateTime = 0.0f;
+
+    void animateChunk(int chunk)
+    {
+        ChunkScratch& s = scratch[chunk];
+        int joints = rig.Bones.JointCount();
+        size_t last = std::min(Instances.size(), (size_t)(chunk + 1) * ANIMATION_CHUNK);
+        for (size_t i = (size_t)chunk * ANIMATION_CHUNK; i < last; i++)
+        {
+            const CharacterInstance& instance = Instances[i];
+            float time = instance.Phase + updateTime * instance.Speed;
+            SampleClip(rig.Clips[instance.BaseClip], time, true, s.Base);
+            if (instance.BlendClip != instance.BaseClip)
+            {
+                SampleClip(rig.Clips[instance.BlendClip], time, true, s.Blend);
+                float weight = 0.5f + 0.5f * std::sin((instance.Phase + updateTime) * instance.BlendSpeed * glm::two_pi<float>());
+                BlendPoses(s.Base, s.Blend, weight, s.Base);
+            }
+            glm::mat4* palette = &palettes[i * joints];
+            BuildSkinningPalette(rig.Bones, s.Base, instance.World, s.Local.data(), s.Model.data(), palette);
+            glm::vec4* rows = &paletteRows[i * joints * 3];
+            for (int joint = 0; joint < joints; joint++)
+            {
+                const glm::mat4& m = palette[joint];
+                for (int r = 0; r < 3; r++)
+                    rows[joint * 3 + r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+            }
+        }
+    }
+};
+
+// Draws instances of one rig. Either skins on the GPU, one instanced draw reading the palettes from a texture
+// buffer, or draws CPU skinned vertices from a streamed vertex buffer, one draw per instance. Both use vSkinned.glsl
+class CrowdRenderer
+{
+public:
+    // with fShader.glsl for forward shading, and with fGBuffer.glsl for the deferred geometry pass
+    Shader ForwardShader;
+    Shader GeometryShader;
+
+    CrowdRenderer(const CharacterRig& rig, size_t instanceCount)
+        : ForwardShader("src/vSkinned.glsl", "src/fShader.glsl"), GeometryShader("src/vSkinned.glsl", "src/fGBuffer.glsl"),
+          vertexCount(rig.Vertices.size()), indexCount(rig.Indices.size()), instanceCapacity(instanceCount), jointCount(rig.Bones.JointCount())
+    {
+        int joints = jointCount;
+        paletteRowCount = instanceCapacity * joints * 3;
+        Shader* shaders[] = { &ForwardShader, &GeometryShader };
+        for (Shader* shader : shaders)
+        {
+            shader->use();
+            shader->setInt("texture1", 0);
+            shader->setInt("texture2", 1);
+            shader->setFloat("roughness", DEFAULT_ROUGHNESS);
+            shader->setFloat("metalness", DEFAULT_METALNESS);
+            shader->setInt("bonePalette", BONE_PALETTE_UNIT);
+            shader->setInt("jointCount", joints);
+        }
+        ForwardShader.use();
+        LightClusters::SetSamplerUnits(ForwardShader);
+
+        size_t vertexBytes = rig.Vertices.size() * sizeof(SkinnedVertex);
+        glGenBuffers(1, &meshBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, rig.Vertices.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &indexBuffer);
+        glGenBuffers(1, &skinnedBuffer);
+        glGenBuffers(1, &paletteBuffer);
+        glGenTextures(1, &paletteTexture);
+
+        // GPU path: everything from the static mesh
+        glGenVertexArrays(1, &gpuVAO);
+        glBindVertexArray(gpuVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, rig.Indices.size() * sizeof(unsigned int), rig.Indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, TexCoord));
+        glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Joints));
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Weights));
+        for (int i = 0; i < 5; i++)
+            glEnableVertexAttribArray(i);
+
+        // CPU path: every instance's vertices in the streamed buffer, the base vertex of each draw selects one.
+        // The base vertex offsets all attributes, so the texture coordinates are streamed with them
+        glGenVertexArrays(1, &cpuVAO);
+        glBindVertexArray(cpuVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, skinnedBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        for (int i = 0; i < 3; i++)
+            glEnableVertexAttribArray(i);
+        glBindVertexArray(0);
+
+        // the palette texture buffer needs a data store before it can be attached
+        glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, paletteRowCount * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        GetRenderStats().BufferBytes += vertexBytes + indexCount * sizeof(unsigned int) + paletteRowCount * sizeof(glm::vec4);
+    }
+
+    ~CrowdRenderer()
+    {
+        unsigned int buffers[] = { meshBuffer, indexBuffer, skinnedBuffer, paletteBuffer };
+        glDeleteBuffers(4, buffers);
+        glDeleteTextures(1, &paletteTexture);
+        glDeleteVertexArrays(1, &gpuVAO);
+        glDeleteVertexArrays(1, &cpuVAO);
+        GetRenderStats().BufferBytes -= vertexCount * sizeof(SkinnedVertex) + indexCount * sizeof(unsigned int) +
+            paletteRowCount * sizeof(glm::vec4) + skinnedCapacity;
+    }
+
+    CrowdRenderer(const CrowdRenderer&) = delete;
+    CrowdRenderer& operator=(const CrowdRenderer&) = delete;
+
+    // Draws instanceCount instances with shader, ForwardShader or GeometryShader, which the caller has bound with its
+    // lighting uniforms set. With skinned the vertices are already skinned, 8 floats each, otherwise paletteRows holds
+    // the palettes. Material textures are whatever is bound to units 0 and 1
+    void Draw(Shader& shader, const glm::vec4* paletteRows, const float* skinned, size_t instanceCount, const glm::mat4& view, const glm::mat4& projection)
+    {
+        instanceCount = std::min(instanceCount, instanceCapacity);
+        if (instanceCount == 0)
+            return;
+        shader.use();
+        shader.setMat4("view", view);
+        shader.setMat4("projection", projection);
+        shader.setBool("preSkinned", skinned != NULL);
+        GLsizei indices = (GLsizei)indexCount;
+
+        if (skinned != NULL)
+        {
+            size_t bytes = instanceCount * vertexCount * 8 * sizeof(float);
+            glBindBuffer(GL_ARRAY_BUFFER, skinnedBuffer);
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, skinned);
+            GetRenderStats().BufferBytes += bytes - skinnedCapacity;
+            skinnedCapacity = bytes;
+            glBindVertexArray(cpuVAO);
+            for (size_t instance = 0; instance < instanceCount; instance++)
+            {
+                glDrawElementsBaseVertex(GL_TRIANGLES, indices, GL_UNSIGNED_INT, NULL, (GLint)(instance * vertexCount));
+                GetRenderStats().CountDraw(indices);
+            }
+        }
+        else
+        {
+            size_t bytes = instanceCount * jointCount * 3 * sizeof(glm::vec4);
+            glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, paletteRowCount * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, paletteRows);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            glActiveTexture(GL_TEXTURE0 + BONE_PALETTE_UNIT);
+            glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+            glActiveTexture(GL_TEXTURE0);
+            glBindVertexArray(gpuVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, indices, GL_UNSIGNED_INT, NULL, (GLsizei)instanceCount);
+            GetRenderStats().CountDraw(indices, instanceCount);
+        }
+        glBindVertexArray(0);
+    }
+
+    void Draw(Shader& shader, const CrowdPose& pose, const glm::mat4& view, const glm::mat4& projection)
+    {
+        const float* skinned = pose.Skinned.empty() ? NULL : pose.Skinned.data();
+        if (skinned == NULL && pose.PaletteRows.empty())
+            return;
+        Draw(shader, pose.PaletteRows.data(), skinned, pose.InstanceCount, view, projection);
+    }
+
+private:
+    size_t vertexCount;
+    size_t indexCount;
+    size_t instanceCapacity;
+    int jointCount;
+    size_t paletteRowCount = 0;
+    size_t skinnedCapacity = 0;
+
+    unsigned int meshBuffer = 0;
+    unsigned int indexBuffer = 0;
+    unsigned int skinnedBuffer = 0;
+    unsigned int paletteBuffer = 0;
+    unsigned int paletteTexture = 0;
+    unsigned int gpuVAO = 0;
+    unsigned int cpuVAO = 0;
+};
+
+// An animation drawn on the same thread
+class AnimatedCrowd : public CrowdAnimation
+{
+public:
+    CrowdRenderer Renderer;
+
+    AnimatedCrowd(const CharacterRig& rig, const std::vector<CharacterInstance>& instances)
+        : CrowdAnimation(rig, instances), Renderer(rig, instances.size()) {}
+
+    // Draws the last Update, see CrowdRenderer::Draw
+    void Draw(Shader& shader, const glm::mat4& view, const glm::mat4& projection)
+    {
+        // nothing skinned before the first Update
+        if (CpuSkinning && skinned.empty())
+            return;
+        Renderer.Draw(shader, paletteRows.data(), CpuSkinning ? skinned.data() : NULL, Instances.size(), view, projection);
+    }
+};
+
+// A procedural test creature: a trunk of joints rising along +y with two arms branching off halfway, skinned as
+// tubes whose rings blend between neighbouring joints. Two looping clips, a sway and a curl, to blend between
+inline CharacterRig CreateTentacleRig(int trunkJoints = 8, int armJoints = 5, float segment = 0.25f, int sides = 8)
+{
+    CharacterRig rig;
+    Skeleton& skeleton = rig.Bones;
+    std::vector<glm::vec3> offsets;      // rest translation relative to the parent
+    std::vector<std::vector<int>> chains; // joint lists the tubes follow
+    std::vector<float> radii;            // tube radius at the first joint of each chain
+
+    chains.push_back(std::vector<int>());
+    for (int i = 0; i < trunkJoints; i++)
+    {
+        skeleton.Parents.push_back(i - 1);
+        offsets.push_back(i == 0 ? glm::vec3(0.0f) : glm::vec3(0.0f, segment, 0.0f));
+        chains[0].push_back(i);
+    }
+    radii.push_back(segment * 0.6f);
+    int branch = trunkJoints / 2;
+    for (int side = -1; side <= 1; side += 2)
+    {
+        std::vector<int> chain(1, branch);
+        for (int i = 0; i < armJoints; i++)
+        {
+            skeleton.Parents.push_back(i == 0 ? branch : skeleton.JointCount() - 1);
+            offsets.push_back(glm::vec3(side * segment * 0.8f, segment * 0.2f, 0.0f));
+            chain.push_back(skeleton.JointCount() - 1);
+        }
+        chains.push_back(chain);
+        radii.push_back(segment * 0.3f);
+    }
+
+    int joints = skeleton.JointCount();
+    std::vector<glm::vec3> rest(joints);
+    for (int j = 0; j < joints; j++)
+    {
+        rest[j] = (skeleton.Parents[j] < 0 ? glm::vec3(0.0f) : rest[skeleton.Parents[j]]) + offsets[j];
+        skeleton.InverseBind.push_back(glm::translate(glm::mat4(1.0f), -rest[j]));
+    }
+
+    // tubes: a ring at every joint and halfway between, weighted between the two joints of its segment
+    for (size_t c = 0; c < chains.size(); c++)
+    {
+        const std::vector<int>& chain = chains[c];
+        int rings = (int)(chain.size() - 1) * 2 + 1;
+        unsigned int first = (unsigned int)rig.Vertices.size();
+        for (int ring = 0; ring < rings; ring++)
+        {
+            int k = std::min(ring / 2, (int)chain.size() - 2);
+            float f = ring / 2.0f - k;
+            glm::vec3 a = rest[chain[k]], b = rest[chain[k + 1]];
+            glm::vec3 axis = glm::normalize(b - a);
+            glm::vec3 u = glm::normalize(glm::cross(axis, std::abs(axis.z) < 0.9f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+            glm::vec3 v = glm::cross(axis, u);
+            glm::vec3 center = glm::mix(a, b, f);
+            float radius = radii[c] * (1.0f - 0.6f * ring / (float)(rings - 1));
+            for (int s = 0; s <= sides; s++)
+            {
+                float angle = s * glm::two_pi<float>() / sides;
+                glm::vec3 normal = u * std::cos(angle) + v * std::sin(angle);
+                glm::vec3 position = center + normal * radius;
+                SkinnedVertex vertex = {};
+                vertex.Position[0] = position.x; vertex.Position[1] = position.y; vertex.Position[2] = position.z;
+                vertex.Normal[0] = normal.x; vertex.Normal[1] = normal.y; vertex.Normal[2] = normal.z;
+                vertex.TexCoord[0] = s / (float)sides;
+                vertex.TexCoord[1] = ring / (float)(rings - 1) * 2.0f;
+                vertex.Joints[0] = (uint8_t)chain[k];
+                vertex.Joints[1] = (uint8_t)chain[k + 1];
+                vertex.Weights[1] = (uint8_t)(f * 255.0f + 0.5f);
+                vertex.Weights[0] = (uint8_t)(255 - vertex.Weights[1]);
+                rig.Vertices.push_back(vertex);
+            }
+        }
+        for (int ring = 0; ring + 1 < rings; ring++)
+        {
+            for (int s = 0; s < sides; s++)
+            {
+                unsigned int i0 = first + ring * (sides + 1) + s, i1 = i0 + sides + 1;
+                unsigned int quad[6] = { i0, i0 + 1, i1, i1, i0 + 1, i1 + 1 };
+                rig.Indices.insert(rig.Indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    // clips sampled from closed form motions, two seconds at 30 Hz
+    const float rate = 30.0f, duration = 2.0f;
+    for (int clip = 0; clip < 2; clip++)
+    {
+        std::vector<TransformSoA> frames;
+        for (int frame = 0; frame <= (int)(duration * rate); frame++)
+        {
+            float phase = frame / rate / duration * glm::two_pi<float>();
+            TransformSoA pose;
+            pose.Resize(joints);
+            for (int j = 0; j < joints; j++)
+            {
+                pose.SetPosition(j, offsets[j]);
+                bool arm = j >= trunkJoints;
+                glm::quat q;
+                if (clip == 0)
+                    q = glm::angleAxis(0.25f * std::sin(phase + j * 0.6f), glm::vec3(0.0f, 0.0f, 1.0f));
+                else
+                    q = glm::angleAxis(0.35f * std::sin(phase - j * 0.4f), arm ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+                // the root only turns in the curl
+                if (j == 0 && clip == 0)
+                    q = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+                pose.SetRotation(j, q);
+            }
+            frames.push_back(pose);
+        }
+        rig.Clips.push_back(CompressClip(frames, rate));
+    }
+    return rig;
+}
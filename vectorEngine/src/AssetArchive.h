@@ -0,0 +1,514 @@
+#pragma once
+
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Archive layout, little endian: the header, a hash table of BucketCount directory slots, the entry names, then the
+// entry data with every entry starting on a 4K boundary so it can be used straight from the mapping
+const char ARCHIVE_MAGIC[4] = { 'V', 'E', 'P', 'K' };
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+enum Archive_Entry_Flags {
+    ENTRY_USED = 1,
+    ENTRY_DEFLATE = 2   // raw deflate stream, inflated on first use
+};
+
+struct ArchiveHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t EntryCount;
+    uint32_t BucketCount; // power of two
+    uint64_t DirectoryOffset;
+    uint64_t NamesOffset;
+    uint64_t NamesSize;
+};
+
+struct ArchiveEntry
+{
+    uint64_t NameHash;
+    uint64_t Offset;
+    uint64_t Size;       // after inflating
+    uint64_t StoredSize; // in the file
+    uint32_t NameOffset;
+    uint32_t NameLength;
+    uint32_t Flags;
+    uint32_t Reserved;
+};
+
+static_assert(sizeof(ArchiveHeader) == 40 && sizeof(ArchiveEntry) == 48, "archive structs are read straight from the file");
+
+// Entries are looked up by their path relative to the working directory, with forward slashes
+inline std::string NormalizeAssetPath(const std::string& path)
+{
+    std::string name = path;
+    std::replace(name.begin(), name.end(), '\\', '/');
+    while (name.compare(0, 2, "./") == 0)
+        name.erase(0, 2);
+    return name;
+}
+
+// 64 bit FNV-1a
+inline uint64_t HashAssetPath(const std::string& name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name)
+    {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// A whole file mapped read-only into memory. The pages are read in on first touch, so mapping a large file is cheap
+// and only the parts that are used cost I/O
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // fails for missing and empty files
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            file = NULL;
+            return false;
+        }
+        LARGE_INTEGER size;
+        mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        base = mapping != NULL ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (base == NULL)
+        {
+            if (mapping != NULL)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            mapping = file = NULL;
+            return false;
+        }
+        fileSize = (uint64_t)size.QuadPart;
+        return true;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void* view = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file alive
+        close(fd);
+        if (view == MAP_FAILED)
+            return false;
+        base = (const unsigned char*)view;
+        fileSize = (uint64_t)info.st_size;
+        return true;
+#endif
+    }
+
+    void Close()
+    {
+        if (base == NULL)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        mapping = file = NULL;
+#else
+        munmap((void*)base, fileSize);
+#endif
+        base = NULL;
+        fileSize = 0;
+    }
+
+    bool IsOpen() const { return base != NULL; }
+    const unsigned char* Data() const { return base; }
+    uint64_t Size() const { return fileSize; }
+
+private:
+    const unsigned char* base = NULL;
+    uint64_t fileSize = 0;
+#ifdef _WIN32
+    HANDLE file = NULL;
+    HANDLE mapping = NULL;
+#endif
+};
+
+
+// Bytes of an archive entry. Points into the mapping, or into the inflated copy for compressed entries, and stays
+// valid until the archive is closed
+struct AssetData
+{
+    const unsigned char* Data = NULL;
+    size_t Size = 0;
+};
+
+
+// A packed asset file mapped read-only into memory. Find is safe to call from any thread
+class AssetArchive
+{
+public:
+    AssetArchive() {}
+    ~AssetArchive() { Close(); }
+
+    AssetArchive(const AssetArchive&) = delete;
+    AssetArchive& operator=(const AssetArchive&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        Close();
+        if (!mapped.Open(path))
+        {
+            std::cout << "ERROR::ARCHIVE:: Failed to map \"" << path << "\"" << std::endl;
+            return false;
+        }
+        base = mapped.Data();
+        fileSize = mapped.Size();
+        header = (const ArchiveHeader*)base;
+        bool valid = fileSize >= sizeof(ArchiveHeader) && std::memcmp(header->Magic, ARCHIVE_MAGIC, 4) == 0 && header->Version == ARCHIVE_VERSION
+            && header->BucketCount > 0 && (header->BucketCount & (header->BucketCount - 1)) == 0
+            && header->DirectoryOffset + (uint64_t)header->BucketCount * sizeof(ArchiveEntry) <= fileSize
+            && header->NamesOffset + header->NamesSize <= fileSize;
+        if (valid)
+        {
+            directory = (const ArchiveEntry*)(base + header->DirectoryOffset);
+            names = (const char*)(base + header->NamesOffset);
+            for (uint32_t i = 0; i < header->BucketCount && valid; i++)
+            {
+                const ArchiveEntry& entry = directory[i];
+                if (entry.Flags & ENTRY_USED)
+                    valid = entry.Offset + entry.StoredSize <= fileSize && (uint64_t)entry.NameOffset + entry.NameLength <= header->NamesSize;
+            }
+        }
+        if (!valid)
+        {
+            std::cout << "ERROR::ARCHIVE:: \"" << path << "\" is not a valid asset archive" << std::endl;
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (base == NULL)
+            return;
+        mapped.Close();
+        base = NULL;
+        fileSize = 0;
+        header = NULL;
+        directory = NULL;
+        names = NULL;
+        std::lock_guard<std::mutex> lock(inflateMutex);
+        inflated.clear();
+    }
+
+    bool IsOpen() const { return base != NULL; }
+    uint32_t EntryCount() const { return header != NULL ? header->EntryCount : 0; }
+
+    // Looks path up in the directory. Stored entries are returned in place without any copy
+    bool Find(const std::string& path, AssetData& data)
+    {
+        if (base == NULL)
+            return false;
+        std::string name = NormalizeAssetPath(path);
+        uint64_t hash = HashAssetPath(name);
+        uint32_t mask = header->BucketCount - 1;
+        for (uint32_t probe = 0; probe <= mask; probe++)
+        {
+            uint32_t bucket = (uint32_t)(hash + probe) & mask;
+            const ArchiveEntry& entry = directory[bucket];
+            if (!(entry.Flags & ENTRY_USED))
+                return false;
+            if (entry.NameHash != hash || entry.NameLength != name.size() || std::memcmp(names + entry.NameOffset, name.data(), name.size()) != 0)
+                continue;
+
+            if (!(entry.Flags & ENTRY_DEFLATE))
+            {
+                data.Data = base + entry.Offset;
+                data.Size = (size_t)entry.Size;
+                return true;
+            }
+            std::lock_guard<std::mutex> lock(inflateMutex);
+            std::vector<unsigned char>& bytes = inflated[bucket];
+            if (bytes.size() != entry.Size)
+            {
+                bytes.resize((size_t)entry.Size);
+                int written = stbi_zlib_decode_noheader_buffer((char*)bytes.data(), (int)bytes.size(), (const char*)(base + entry.Offset), (int)entry.StoredSize);
+                if (written != (int)entry.Size)
+                {
+                    std::cout << "ERROR::ARCHIVE:: Failed to inflate \"" << name << "\"" << std::endl;
+                    bytes.clear();
+                    return false;
+                }
+            }
+            data.Data = bytes.data();
+            data.Size = bytes.size();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const unsigned char* base = NULL;
+    uint64_t fileSize = 0;
+    const ArchiveHeader* header = NULL;
+    const ArchiveEntry* directory = NULL;
+    const char* names = NULL;
+    std::mutex inflateMutex;
+    std::unordered_map<uint32_t, std::vector<unsigned char>> inflated;
+    MappedFile mapped;
+};
+
+// The archive assets are loaded from, opened with --archive. Lookups fall back to plain files while it is closed
+inline AssetArchive& GetAssetArchive()
+{
+    static AssetArchive archive;
+    return archive;
+}
+
+// stbi_load that reads from the asset archive when the image is packed
+inline unsigned char* LoadAssetImage(const char* filePath, int* width, int* height, int* channels, int desiredChannels)
+{
+    AssetData asset;
+    if (GetAssetArchive().Find(filePath, asset))
+        return stbi_load_from_memory(asset.Data, (int)asset.Size, width, height, channels, desiredChannels);
+    return stbi_load(filePath, width, height, channels, desiredChannels);
+}
+
+
+// Raw deflate with the fixed Huffman tables and a hash chain match finder. Simple rather than small, but shaders
+// and uncompressed vertex data still shrink to around a third
+inline void DeflateFixed(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+        4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const int WINDOW = 32768, HASH_SIZE = 1 << 15, MAX_CHAIN = 32, MAX_MATCH = 258;
+
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    auto putBits = [&](uint32_t value, int count)
+    {
+        bitBuffer |= value << bitCount;
+        bitCount += count;
+        while (bitCount >= 8)
+        {
+            out.push_back((unsigned char)bitBuffer);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    };
+    // Huffman codes go out most significant bit first
+    auto putCode = [&](uint32_t code, int count)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++)
+            reversed |= ((code >> i) & 1) << (count - 1 - i);
+        putBits(reversed, count);
+    };
+    auto putLiteral = [&](int symbol)
+    {
+        if (symbol < 144) putCode(0x30 + symbol, 8);
+        else if (symbol < 256) putCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280) putCode(symbol - 256, 7);
+        else putCode(0xC0 + symbol - 280, 8);
+    };
+
+    // final block, fixed Huffman
+    putBits(1, 1);
+    putBits(1, 2);
+    std::vector<int> head(HASH_SIZE, -1), previous(WINDOW, -1);
+    auto hash3 = [&](size_t i) { return (int)(((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH_SIZE - 1)); };
+    auto insert = [&](size_t i)
+    {
+        if (i + 2 >= size)
+            return;
+        int h = hash3(i);
+        previous[i & (WINDOW - 1)] = head[h];
+        head[h] = (int)i;
+    };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int bestLength = 0, bestDistance = 0;
+        if (i + 2 < size)
+        {
+            int maxLength = (int)std::min<size_t>(MAX_MATCH, size - i);
+            int candidate = head[hash3(i)];
+            for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN && (int)i - candidate <= WINDOW; chain++)
+            {
+                int length = 0;
+                while (length < maxLength && data[candidate + length] == data[i + length])
+                    length++;
+                if (length > bestLength)
+                {
+                    bestLength = length;
+                    bestDistance = (int)i - candidate;
+                    if (length == maxLength)
+                        break;
+                }
+                int next = previous[candidate & (WINDOW - 1)];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= 3)
+        {
+            int code = 0;
+            while (code < 28 && lengthBase[code + 1] <= bestLength)
+                code++;
+            putLiteral(257 + code);
+            putBits(bestLength - lengthBase[code], lengthExtra[code]);
+            int distanceCode = 0;
+            while (distanceCode < 29 && distanceBase[distanceCode + 1] <= bestDistance)
+                distanceCode++;
+            putCode(distanceCode, 5);
+            putBits(bestDistance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+            for (int k = 0; k < bestLength; k++)
+                insert(i + k);
+            i += bestLength;
+        }
+        else
+        {
+            putLiteral(data[i]);
+            insert(i);
+            i++;
+        }
+    }
+    putLiteral(256);
+    if (bitCount > 0)
+        putBits(0, 8 - bitCount);
+}
+
+// Packs files into an archive at path, under their normalized paths. With compress, entries are deflated when that
+// saves at least an eighth; images that are already compressed stay stored and zero-copy
+inline bool WriteAssetArchive(const std::string& path, const std::vector<std::string>& files, bool compress)
+{
+    uint32_t bucketCount = 1;
+    while (bucketCount < files.size() * 2)
+        bucketCount *= 2;
+    std::vector<ArchiveEntry> directory(bucketCount);
+    std::memset(directory.data(), 0, directory.size() * sizeof(ArchiveEntry));
+    std::string nameBlob;
+    std::vector<std::vector<unsigned char>> contents;
+    std::vector<uint32_t> buckets;
+
+    for (const std::string& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+        {
+            std::cout << "ERROR::ARCHIVE:: Failed to read \"" << file << "\"" << std::endl;
+            return false;
+        }
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string name = NormalizeAssetPath(file);
+        uint64_t hash = HashAssetPath(name);
+        uint32_t bucket = (uint32_t)hash & (bucketCount - 1);
+        while (directory[bucket].Flags & ENTRY_USED)
+        {
+            if (directory[bucket].NameHash == hash && nameBlob.compare(directory[bucket].NameOffset, directory[bucket].NameLength, name) == 0)
+            {
+                std::cout << "ERROR::ARCHIVE:: \"" << name << "\" is listed twice" << std::endl;
+                return false;
+            }
+            bucket = (bucket + 1) & (bucketCount - 1);
+        }
+
+        ArchiveEntry& entry = directory[bucket];
+        entry.NameHash = hash;
+        entry.NameOffset = (uint32_t)nameBlob.size();
+        entry.NameLength = (uint32_t)name.size();
+        entry.Flags = ENTRY_USED;
+        entry.Size = entry.StoredSize = bytes.size();
+        nameBlob += name;
+        if (compress && !bytes.empty())
+        {
+            std::vector<unsigned char> deflated;
+            DeflateFixed(bytes.data(), bytes.size(), deflated);
+            if (deflated.size() <= bytes.size() - bytes.size() / 8)
+            {
+                bytes.swap(deflated);
+                entry.Flags |= ENTRY_DEFLATE;
+                entry.StoredSize = bytes.size();
+            }
+        }
+        contents.push_back(std::move(bytes));
+        buckets.push_back(bucket);
+    }
+
+    ArchiveHeader header;
+    std::memcpy(header.Magic, ARCHIVE_MAGIC, 4);
+    header.Version = ARCHIVE_VERSION;
+    header.EntryCount = (uint32_t)files.size();
+    header.BucketCount = bucketCount;
+    header.DirectoryOffset = sizeof(ArchiveHeader);
+    header.NamesOffset = header.DirectoryOffset + bucketCount * sizeof(ArchiveEntry);
+    header.NamesSize = nameBlob.size();
+    uint64_t offset = header.NamesOffset + header.NamesSize;
+    for (size_t f = 0; f < contents.size(); f++)
+    {
+        offset = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+        directory[buckets[f]].Offset = offset;
+        offset += contents[f].size();
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)directory.data(), directory.size() * sizeof(ArchiveEntry));
+    out.write(nameBlob.data(), nameBlob.size());
+    uint64_t written = header.NamesOffset + header.NamesSize;
+    const std::vector<char> padding(ARCHIVE_ALIGNMENT, 0);
+    for (size_t f = 0; f < contents.size(); f++)
+    {
+        uint64_t start = directory[buckets[f]].Offset;
+        out.write(padding.data(), (std::streamsize)(start - written));
+        out.write((const char*)contents[f].data(), contents[f].size());
+        written = start + contents[f].size();
+    }
+    if (!out)
+    {
+        std::cout << "ERROR::ARCHIVE:: Failed to write \"" << path << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
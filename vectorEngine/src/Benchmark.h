@@ -0,0 +1,537 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "AllocationTracker.h"
+#include "ClusteredLighting.h"
+#include "DepthPrepass.h"
+#include "GltfLoader.h"
+#include "MeshImport.h"
+#include "Headless.h"
+#include "Memory.h"
+#include "Physics.h"
+#include "RenderStats.h"
+#include "Terrain.h"
+#include "TransformBatch.h"
+#include "VoxelWorld.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+enum Scene_Distribution {
+    DISTRIBUTION_UNIFORM,   // uniformly inside a cube
+    DISTRIBUTION_CLUSTERED, // gaussian blobs around a few centres, lots of overlap and overdraw
+    DISTRIBUTION_GRID       // regular lattice, best case for culling and batching
+};
+
+// Workload parameters for --benchmark. Every run with the same options renders the same frames
+struct BenchmarkOptions
+{
+    int ObjectCount = 1000;
+    Scene_Distribution Distribution = DISTRIBUTION_UNIFORM;
+    float AnimatedFraction = 0.3f;
+    int MaterialCount = 4;
+    int TextureSize = 256;
+    int Frames = 600;
+    // rendered before measuring so shader compilation, first-use uploads and clocks settle
+    int WarmupFrames = 30;
+    int Width = 1280;
+    int Height = 720;
+    uint32_t Seed = 1;
+    std::string OutputPath; // JSON goes to stdout when empty
+    // build model matrices with chained glm::translate/glm::rotate instead of the batch kernel, for A/B runs
+    bool GlmTransforms = false;
+    bool DepthPrepass = false;
+    // measures shaded fragments per pixel on the first recorded frame
+    bool Overdraw = false;
+    // point and spot lights for clustered shading, 0 renders unlit
+    int LightCount = 0;
+    // G-buffer and deferred lighting instead of the forward shader
+    bool Deferred = false;
+    // sun with cascaded shadow maps, static objects are cached in the far cascades
+    bool Shadows = false;
+    // stream material mips into this many MiB of texture memory, 0 keeps every texture fully resident
+    int TextureBudgetMB = 0;
+    // live particles in a fountain over the scene, 0 for none
+    int ParticleCount = 0;
+    // animated skinned characters in a grid under the scene, 0 for none
+    int CharacterCount = 0;
+    // skin with SIMD on the CPU instead of in the vertex shader
+    bool CpuSkinning = false;
+    // a .glb model placed in the middle of the scene, its load times are reported
+    std::string GltfPath;
+    // an .obj or .ply mesh placed in the middle of the scene, its import times are reported
+    std::string MeshPath;
+    // the objects are boxes dropped onto a floor under the scene and simulated as rigid bodies instead of spinning
+    bool Physics = false;
+    // side in metres of a streamed landscape under the scene, 0 for none. Its cost should not grow with the size
+    float TerrainSize = 0.0f;
+    // chunk columns along each side of a voxel world under the scene, 0 for none. A pit is dug and filled in every frame
+    int VoxelColumns = 0;
+    // draw the performance overlay, its cost is the overlay phase
+    bool Overlay = false;
+    // every object's box and every light as debug lines, appended from the job system and flushed in two draws
+    bool DebugDraw = false;
+};
+
+inline const char* DistributionName(Scene_Distribution distribution)
+{
+    switch (distribution)
+    {
+    case DISTRIBUTION_CLUSTERED: return "clustered";
+    case DISTRIBUTION_GRID: return "grid";
+    default: return "uniform";
+    }
+}
+
+// Returns true if --benchmark was passed, in which case options holds the parsed settings
+inline bool ParseBenchmarkOptions(int argc, char const *argv[], BenchmarkOptions& options)
+{
+    bool benchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark") benchmark = true;
+        else if (arg == "--objects" && hasValue) options.ObjectCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--animated" && hasValue) options.AnimatedFraction = glm::clamp((float)std::atof(argv[++i]), 0.0f, 1.0f);
+        else if (arg == "--materials" && hasValue) options.MaterialCount = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--texture-size" && hasValue) options.TextureSize = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--frames" && hasValue) options.Frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue) options.WarmupFrames = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--width" && hasValue) options.Width = std::atoi(argv[++i]);
+        else if (arg == "--height" && hasValue) options.Height = std::atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue) options.Seed = (uint32_t)std::strtoul(argv[++i], NULL, 10);
+        else if (arg == "--glm-transforms") options.GlmTransforms = true;
+        else if (arg == "--depth-prepass") options.DepthPrepass = true;
+        else if (arg == "--overdraw") options.Overdraw = true;
+        else if (arg == "--deferred") options.Deferred = true;
+        else if (arg == "--shadows") options.Shadows = true;
+        else if (arg == "--texture-budget" && hasValue) options.TextureBudgetMB = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--lights" && hasValue) options.LightCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--particles" && hasValue) options.ParticleCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--characters" && hasValue) options.CharacterCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--cpu-skinning") options.CpuSkinning = true;
+        else if (arg == "--gltf" && hasValue) options.GltfPath = argv[++i];
+        else if (arg == "--mesh" && hasValue) options.MeshPath = argv[++i];
+        else if (arg == "--physics") options.Physics = true;
+        else if (arg == "--terrain" && hasValue) options.TerrainSize = std::max(0.0f, (float)std::atof(argv[++i]));
+        else if (arg == "--voxels" && hasValue) options.VoxelColumns = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--overlay") options.Overlay = true;
+        else if (arg == "--debug-draw") options.DebugDraw = true;
+        else if (arg == "--out" && hasValue) options.OutputPath = argv[++i];
+        else if (arg == "--distribution" && hasValue)
+        {
+            std::string name = argv[++i];
+            options.Distribution = name == "clustered" ? DISTRIBUTION_CLUSTERED : name == "grid" ? DISTRIBUTION_GRID : DISTRIBUTION_UNIFORM;
+        }
+    }
+    return benchmark;
+}
+
+
+// Small PCG32 generator. std::uniform_real_distribution differs between standard libraries, and benchmark scenes
+// have to be identical on every platform
+class BenchmarkRandom
+{
+public:
+    explicit BenchmarkRandom(uint64_t seed) : state(0)
+    {
+        Next();
+        state += seed;
+        Next();
+    }
+
+    uint32_t Next()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // [0, 1)
+    float Float()
+    {
+        return (Next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float Range(float lo, float hi)
+    {
+        return lo + (hi - lo) * Float();
+    }
+
+    glm::vec3 UnitVector()
+    {
+        float z = Range(-1.0f, 1.0f);
+        float a = Range(0.0f, glm::two_pi<float>());
+        float r = std::sqrt(1.0f - z * z);
+        return glm::vec3(r * std::cos(a), r * std::sin(a), z);
+    }
+
+private:
+    uint64_t state;
+};
+
+
+// A procedurally generated set of cube instances. Static objects have a zero AngularSpeed. Transforms mirrors
+// the rotations as quaternions for the batch kernel, only the Animated entries change per frame
+struct BenchmarkScene
+{
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Axes;
+    std::vector<float> Angles;
+    std::vector<float> AngularSpeeds;
+    std::vector<int> Materials;
+    std::vector<unsigned int> Animated;
+    TransformSoA Transforms;
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 1.0f;
+
+    size_t Size() const { return Positions.size(); }
+
+    void UpdateRotations(float time)
+    {
+        for (unsigned int i : Animated)
+            Transforms.SetAxisAngle(i, Axes[i], glm::radians(Angles[i] + AngularSpeeds[i] * time));
+    }
+};
+
+inline BenchmarkScene GenerateBenchmarkScene(const BenchmarkOptions& options)
+{
+    BenchmarkScene scene;
+    BenchmarkRandom random(options.Seed);
+    const int count = options.ObjectCount;
+    // keep the density roughly constant so object count scales the visible load rather than the spacing
+    const float extent = std::max(2.0f, std::cbrt((float)count) * 2.5f);
+
+    std::vector<glm::vec3> clusters;
+    if (options.Distribution == DISTRIBUTION_CLUSTERED)
+    {
+        int clusterCount = std::max(1, (int)std::cbrt((float)count) / 2);
+        for (int c = 0; c < clusterCount; c++)
+            clusters.push_back(glm::vec3(random.Range(-extent, extent), random.Range(-extent, extent), random.Range(-extent, extent)) * 0.5f);
+    }
+    const int gridSide = std::max(1, (int)std::ceil(std::cbrt((float)count)));
+
+    scene.Positions.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        glm::vec3 p;
+        switch (options.Distribution)
+        {
+        case DISTRIBUTION_CLUSTERED:
+        {
+            // Box-Muller gives a normally distributed offset around the cluster centre
+            const glm::vec3& centre = clusters[random.Next() % clusters.size()];
+            float r = std::sqrt(-2.0f * std::log(std::max(random.Float(), 1e-7f))) * extent * 0.08f;
+            p = centre + random.UnitVector() * r;
+            break;
+        }
+        case DISTRIBUTION_GRID:
+        {
+            glm::vec3 cell((float)(i % gridSide), (float)((i / gridSide) % gridSide), (float)(i / (gridSide * gridSide)));
+            p = (cell - glm::vec3((gridSide - 1) * 0.5f)) * (2.0f * extent / gridSide);
+            break;
+        }
+        default:
+            p = glm::vec3(random.Range(-extent, extent), random.Range(-extent, extent), random.Range(-extent, extent));
+            break;
+        }
+        scene.Positions.push_back(p);
+        scene.Axes.push_back(random.UnitVector());
+        scene.Angles.push_back(random.Range(0.0f, 360.0f));
+        scene.AngularSpeeds.push_back(random.Float() < options.AnimatedFraction ? random.Range(10.0f, 90.0f) : 0.0f);
+        scene.Materials.push_back((int)(random.Next() % options.MaterialCount));
+    }
+    scene.Transforms.Resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        scene.Transforms.SetPosition(i, scene.Positions[i]);
+        scene.Transforms.SetAxisAngle(i, scene.Axes[i], glm::radians(scene.Angles[i]));
+        if (scene.AngularSpeeds[i] != 0.0f)
+            scene.Animated.push_back(i);
+    }
+    scene.Radius = extent * 1.75f;
+    return scene;
+}
+
+// RGB checkerboard with a per-material tint, so every material is a distinct texture of the requested size
+inline std::vector<unsigned char> GenerateMaterialTexture(int material, int size)
+{
+    BenchmarkRandom random(0x9E3779B9u + material);
+    glm::vec3 tint(random.Range(0.3f, 1.0f), random.Range(0.3f, 1.0f), random.Range(0.3f, 1.0f));
+    std::vector<unsigned char> rgb((size_t)size * size * 3);
+    const int check = std::max(1, size / 8);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            float shade = ((x / check + y / check) & 1) ? 1.0f : 0.55f;
+            unsigned char* p = &rgb[((size_t)y * size + x) * 3];
+            p[0] = (unsigned char)(tint.r * shade * 255.0f);
+            p[1] = (unsigned char)(tint.g * shade * 255.0f);
+            p[2] = (unsigned char)(tint.b * shade * 255.0f);
+        }
+    }
+    return rgb;
+}
+
+// Small coloured lights placed next to random objects, a quarter of them spots aimed back at the scene. Radii shrink
+// with the light density so any point is reached by a handful of lights whatever the count
+inline std::vector<Light> GenerateBenchmarkLights(const BenchmarkOptions& options, const BenchmarkScene& scene)
+{
+    std::vector<Light> lights;
+    if (scene.Size() == 0)
+        return lights;
+    BenchmarkRandom random(options.Seed * 7919u + 17u);
+    const float extent = scene.Radius / 1.75f;
+    const float spacing = extent / std::max(1.0f, std::cbrt((float)scene.Size()));
+    const float lightSpacing = 2.0f * extent / std::max(1.0f, std::cbrt((float)options.LightCount));
+    lights.reserve(options.LightCount);
+    for (int i = 0; i < options.LightCount; i++)
+    {
+        glm::vec3 position = scene.Positions[random.Next() % scene.Size()] + random.UnitVector() * (spacing * random.Range(0.8f, 2.0f));
+        glm::vec3 color(random.Range(0.2f, 1.0f), random.Range(0.2f, 1.0f), random.Range(0.2f, 1.0f));
+        float radius = lightSpacing * random.Range(0.75f, 1.5f);
+        if (random.Float() < 0.25f)
+            lights.push_back(Light::Spot(position, scene.Center - position, radius * 1.5f, 20.0f, 35.0f, color, 3.0f));
+        else
+            lights.push_back(Light::Point(position, radius, color, 2.0f));
+    }
+    return lights;
+}
+
+
+// CPU time of named per-frame phases, reported next to the frame times in the order they were first added
+struct PhaseTimings
+{
+    std::vector<std::string> Names;
+    std::vector<std::vector<double>> Ms;
+    // reserved per phase, so recording doesn't allocate inside no-alloc frames
+    size_t FrameCapacity = 0;
+
+    void Add(const char* name, double ms)
+    {
+        size_t i = 0;
+        while (i < Names.size() && Names[i] != name)
+            i++;
+        if (i == Names.size())
+        {
+            Names.push_back(name);
+            Ms.push_back(std::vector<double>());
+            Ms.back().reserve(FrameCapacity);
+        }
+        Ms[i].push_back(ms);
+    }
+
+    void Clear()
+    {
+        for (std::vector<double>& values : Ms)
+            values.clear();
+    }
+};
+
+
+// Adds the per-frame counters of every engine allocator to totals, one entry per allocator in registration order
+inline void AccumulateAllocatorStats(std::vector<AllocatorStats>& totals)
+{
+    const std::vector<AllocatorStats*>& allocators = GetAllocatorStats();
+    if (totals.size() != allocators.size())
+    {
+        totals.clear();
+        for (const AllocatorStats* stats : allocators)
+            totals.push_back(AllocatorStats(stats->Name));
+    }
+    for (size_t i = 0; i < allocators.size(); i++)
+    {
+        totals[i].FrameAllocations += allocators[i]->FrameAllocations;
+        totals[i].FrameBytes += allocators[i]->FrameBytes;
+        totals[i].FrameOverflows += allocators[i]->FrameOverflows;
+        totals[i].PeakBytes = allocators[i]->PeakBytes;
+    }
+}
+
+// Heap allocations over the recorded frames, written when allocation tracking is enabled
+struct HeapReport
+{
+    AllocationCounts Frames;
+    std::vector<AllocationScopeCounts> Scopes;
+
+    // Snapshots the counters at the start of the recorded frames
+    void Begin()
+    {
+        Frames = GetAllocationCounts();
+        Scopes = loadScopes();
+    }
+
+    // Turns the snapshot into the totals since Begin
+    void End()
+    {
+        Frames = GetAllocationCounts() - Frames;
+        std::vector<AllocationScopeCounts> current = loadScopes();
+        for (AllocationScopeCounts& scope : current)
+        {
+            for (const AllocationScopeCounts& start : Scopes)
+            {
+                if (start.Name == scope.Name)
+                    scope.Counts = scope.Counts - start.Counts;
+            }
+        }
+        Scopes.swap(current);
+    }
+
+private:
+    static std::vector<AllocationScopeCounts> loadScopes()
+    {
+        std::vector<AllocationScopeCounts> scopes(MAX_ALLOCATION_SCOPES);
+        scopes.resize(GetAllocationScopeCounts(scopes.data(), MAX_ALLOCATION_SCOPES));
+        return scopes;
+    }
+};
+
+// Writes the benchmark result as a single JSON object
+inline void WriteBenchmarkJson(std::ostream& out, const BenchmarkOptions& options, const FrameTimings& timings,
+    const PhaseTimings& phases, const std::vector<RenderStats>& frameStats, const std::vector<AllocatorStats>& allocators,
+    const HeapReport* heap, const OverdrawResult* overdraw, const GltfLoadStats* gltf, const MeshImportStats* mesh,
+    const PhysicsStats* physics, const TerrainStats* terrain, const VoxelStats* voxels, uint64_t peakProcessBytes)
+{
+    uint64_t drawCalls = 0, shadowDrawCalls = 0, textureUploadBytes = 0, triangles = 0, uniformUploads = 0, bufferBytes = 0, textureBytes = 0;
+    for (const RenderStats& stats : frameStats)
+    {
+        drawCalls += stats.DrawCalls;
+        shadowDrawCalls += stats.ShadowDrawCalls;
+        textureUploadBytes += stats.TextureUploadBytes;
+        triangles += stats.Triangles;
+        uniformUploads += stats.UniformUploads;
+        bufferBytes = std::max(bufferBytes, stats.BufferBytes);
+        textureBytes = std::max(textureBytes, stats.TextureBytes);
+    }
+    const double frames = std::max<size_t>(1, frameStats.size());
+
+    auto percentiles = [&out](const char* name, const std::vector<double>& values)
+    {
+        double sum = 0.0;
+        for (double v : values)
+            sum += v;
+        out << "    \"" << name << "\": { \"mean\": " << (values.empty() ? 0.0 : sum / values.size())
+            << ", \"p50\": " << FrameTimings::Percentile(values, 50.0)
+            << ", \"p90\": " << FrameTimings::Percentile(values, 90.0)
+            << ", \"p99\": " << FrameTimings::Percentile(values, 99.0)
+            << ", \"max\": " << FrameTimings::Percentile(values, 100.0) << " }";
+    };
+
+    out << "{\n";
+    out << "  \"scene\": { \"objects\": " << options.ObjectCount
+        << ", \"distribution\": \"" << DistributionName(options.Distribution) << "\""
+        << ", \"animated_fraction\": " << options.AnimatedFraction
+        << ", \"materials\": " << options.MaterialCount
+        << ", \"texture_size\": " << options.TextureSize
+        << ", \"lights\": " << options.LightCount
+        << ", \"particles\": " << options.ParticleCount
+        << ", \"characters\": " << options.CharacterCount
+        << ", \"seed\": " << options.Seed << " },\n";
+    out << "  \"transforms\": \"" << (options.GlmTransforms ? "glm" : "batch") << "\",\n";
+    out << "  \"depth_prepass\": " << (options.DepthPrepass ? "true" : "false") << ",\n";
+    out << "  \"shading\": \"" << (options.Deferred ? "deferred" : "forward") << "\",\n";
+    out << "  \"shadows\": " << (options.Shadows ? "true" : "false") << ",\n";
+    out << "  \"skinning\": \"" << (options.CpuSkinning ? "cpu" : "gpu") << "\",\n";
+    out << "  \"texture_budget_mb\": " << options.TextureBudgetMB << ",\n";
+    if (physics != NULL)
+    {
+        // the state after the last frame, the step times are in frame_time_ms
+        out << "  \"physics\": { \"bodies\": " << physics->Bodies << ", \"awake\": " << physics->AwakeBodies << ", \"pairs\": " << physics->Pairs
+            << ", \"contacts\": " << physics->Contacts << ", \"islands\": " << physics->Islands << ", \"largest_island\": " << physics->LargestIsland
+            << ", \"broadphase_ms\": " << physics->BroadphaseMs << ", \"narrowphase_ms\": " << physics->NarrowphaseMs << ", \"solve_ms\": " << physics->SolveMs << " },\n";
+    }
+    if (terrain != NULL)
+    {
+        // the selection after the last frame, its times are in frame_time_ms
+        out << "  \"terrain\": { \"size_m\": " << options.TerrainSize << ", \"levels\": " << terrain->Levels << ", \"instances\": " << terrain->Instances
+            << ", \"triangles\": " << terrain->Triangles << ", \"resident_tiles\": " << terrain->ResidentTiles << ", \"pending_tiles\": " << terrain->PendingTiles
+            << ", \"generated_tiles\": " << terrain->GeneratedTiles << " },\n";
+    }
+    if (voxels != NULL)
+    {
+        // the world after the last frame, meshing and upload times are in frame_time_ms
+        out << "  \"voxels\": { \"chunks\": " << voxels->Chunks << ", \"solid_voxels\": " << voxels->SolidVoxels << ", \"storage_bytes\": " << voxels->StorageBytes
+            << ", \"dense_bytes\": " << voxels->DenseBytes << ", \"quads\": " << voxels->Quads << ", \"draws\": " << voxels->Draws
+            << ", \"chunks_meshed\": " << voxels->ChunksMeshed << ", \"dirty_chunks\": " << voxels->DirtyChunks << " },\n";
+    }
+    if (overdraw != NULL)
+    {
+        out << "  \"overdraw\": { \"average\": " << overdraw->Average << ", \"max\": " << overdraw->Max
+            << ", \"coverage\": " << overdraw->Coverage << " },\n";
+    }
+    if (gltf != NULL)
+    {
+        out << "  \"gltf\": { \"file_bytes\": " << gltf->FileBytes << ", \"uploaded_bytes\": " << gltf->UploadedBytes
+            << ", \"buffer_views\": " << gltf->BufferViews << ", \"buffers\": " << gltf->Buffers << ", \"vertex_arrays\": " << gltf->VertexArrays
+            << ", \"parse_ms\": " << gltf->ParseMs << ", \"upload_ms\": " << gltf->UploadMs << ", \"texture_ms\": " << gltf->TextureMs << " },\n";
+    }
+    if (mesh != NULL)
+    {
+        out << "  \"mesh_import\": { \"file_bytes\": " << mesh->FileBytes << ", \"vertices\": " << mesh->Vertices << ", \"triangles\": " << mesh->Triangles
+            << ", \"indexed\": " << (mesh->Indexed ? "true" : "false") << ", \"chunks\": " << mesh->Chunks << ", \"threads\": " << mesh->Threads
+            << ", \"scan_ms\": " << mesh->ScanMs << ", \"parse_ms\": " << mesh->ParseMs << ", \"upload_ms\": " << mesh->UploadMs << " },\n";
+    }
+    out << "  \"frames\": " << frameStats.size() << ",\n";
+    out << "  \"resolution\": [" << options.Width << ", " << options.Height << "],\n";
+    out << "  \"frame_time_ms\": {\n";
+    percentiles("cpu", timings.CpuMs);
+    out << ",\n";
+    percentiles("gpu", timings.GpuMs);
+    for (size_t i = 0; i < phases.Names.size(); i++)
+    {
+        out << ",\n";
+        percentiles(phases.Names[i].c_str(), phases.Ms[i]);
+    }
+    out << "\n  },\n";
+    out << "  \"per_frame\": { \"draw_calls\": " << drawCalls / frames
+        << ", \"shadow_draw_calls\": " << shadowDrawCalls / frames
+        << ", \"triangles\": " << triangles / frames
+        << ", \"uniform_uploads\": " << uniformUploads / frames
+        << ", \"texture_upload_bytes\": " << textureUploadBytes / frames << " },\n";
+    out << "  \"allocators\": {";
+    for (size_t i = 0; i < allocators.size(); i++)
+    {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << allocators[i].Name << "\": { \"peak_bytes\": " << allocators[i].PeakBytes
+            << ", \"allocations_per_frame\": " << allocators[i].FrameAllocations / frames
+            << ", \"bytes_per_frame\": " << allocators[i].FrameBytes / frames
+            << ", \"overflows_per_frame\": " << allocators[i].FrameOverflows / frames << " }";
+    }
+    out << (allocators.empty() ? "},\n" : "\n  },\n");
+    if (heap != NULL)
+    {
+        auto counts = [&out, frames](const AllocationCounts& counts)
+        {
+            out << "{ \"new\": " << counts.NewAllocations / frames << ", \"new_bytes\": " << counts.NewBytes / frames
+                << ", \"malloc\": " << counts.MallocAllocations / frames << ", \"malloc_bytes\": " << counts.MallocBytes / frames
+                << ", \"violations\": " << counts.Violations / frames << " }";
+        };
+        out << "  \"heap_per_frame\": ";
+        counts(heap->Frames);
+        out << ",\n  \"heap_per_frame_by_scope\": {";
+        for (size_t i = 0; i < heap->Scopes.size(); i++)
+        {
+            out << (i == 0 ? "\n" : ",\n") << "    \"" << heap->Scopes[i].Name << "\": ";
+            counts(heap->Scopes[i].Counts);
+        }
+        out << (heap->Scopes.empty() ? "},\n" : "\n  },\n");
+    }
+    out << "  \"memory_bytes\": { \"gpu_buffers\": " << bufferBytes
+        << ", \"gpu_textures\": " << textureBytes
+        << ", \"process_peak\": " << peakProcessBytes << " }\n";
+    out << "}\n";
+}
@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 
@@ -20,9 +21,59 @@ const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 
-// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+// Six planes (left, right, bottom, top, near, far) pointing into the frustum, with xyz normalized so the plane
+// equation gives a signed distance
+struct Frustum
+{
+    glm::vec4 Planes[6];
+
+    // Extracts the planes of a (projection * view) matrix, which gives world space planes (Gribb/Hartmann)
+    void FromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        Planes[0] = row3 + row0;
+        Planes[1] = row3 - row0;
+        Planes[2] = row3 + row1;
+        Planes[3] = row3 - row1;
+        Planes[4] = row3 + row2;
+        Planes[5] = row3 - row2;
+        for (int i = 0; i < 6; i++)
+            Planes[i] /= glm::length(glm::vec3(Planes[i]));
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            if (glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            // the box corner furthest along the plane normal
+            glm::vec3 p(Planes[i].x >= 0.0f ? boxMax.x : boxMin.x, Planes[i].y >= 0.0f ? boxMax.y : boxMin.y, Planes[i].z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(glm::vec3(Planes[i]), p) + Planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+
+// An abstract camera class that processes input and calculates the corresponding orientation, vectors and matrices for use in OpenGL.
+// Mouse input is accumulated and applied once per frame, and every matrix is cached until something it depends on changes
 class Camera
 {
 public:
@@ -32,7 +83,8 @@ public:
     glm::vec3 Up;
     glm::vec3 Right;
     glm::vec3 WorldUp;
-    // Euler Angles
+    glm::quat Orientation;
+    // Euler Angles, the input model for mouse look. Orientation is derived from them
     float Yaw;
     float Pitch;
     // Camera options
@@ -59,15 +111,87 @@ public:
         updateCameraVectors();
     }
 
-    // Returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 GetViewMatrix()
+    // Applies the mouse movement accumulated since the last call. Call once per frame before reading Front/Right/Up directly,
+    // the matrix getters do it themselves
+    void Update()
+    {
+        if (pendingX == 0.0f && pendingY == 0.0f)
+            return;
+
+        Yaw += pendingX * MouseSensitivity;
+        Pitch += pendingY * MouseSensitivity;
+        pendingX = pendingY = 0.0f;
+
+        // Make sure that when pitch is out of bounds, screen doesn't get flipped
+        if (pendingConstrainPitch)
+        {
+            if (Pitch > 89.0f)
+                Pitch = 89.0f;
+            if (Pitch < -89.0f)
+                Pitch = -89.0f;
+        }
+
+        updateCameraVectors();
+    }
+
+    // Sets the parameters of the perspective projection, the field of view comes from Zoom
+    void SetProjection(float aspectRatio, float nearPlane = NEAR_PLANE, float farPlane = FAR_PLANE)
     {
-        return glm::lookAt(Position, Position + Front, Up);
+        if (aspectRatio != aspect || nearPlane != zNear || farPlane != zFar)
+        {
+            aspect = aspectRatio;
+            zNear = nearPlane;
+            zFar = farPlane;
+            projectionDirty = true;
+        }
     }
 
+    // Returns the view matrix calculated from the orientation quaternion and position
+    const glm::mat4& GetViewMatrix()
+    {
+        refresh();
+        return view;
+    }
+
+    const glm::mat4& GetProjectionMatrix()
+    {
+        refresh();
+        return projection;
+    }
+
+    const glm::mat4& GetViewProjectionMatrix()
+    {
+        refresh();
+        return viewProjection;
+    }
+
+    const glm::mat4& GetInverseViewMatrix()
+    {
+        refresh();
+        return inverseView;
+    }
+
+    const glm::mat4& GetInverseProjectionMatrix()
+    {
+        refresh();
+        return inverseProjection;
+    }
+
+    // World space frustum of the current view and projection, for culling
+    const Frustum& GetFrustum()
+    {
+        refresh();
+        return frustum;
+    }
+
+    float GetAspectRatio() const { return aspect; }
+    float GetNearPlane() const { return zNear; }
+    float GetFarPlane() const { return zFar; }
+
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
+        Update();
         float velocity = MovementSpeed * deltaTime;
         if (direction == FORWARD)
             Position += Front * velocity;
@@ -80,25 +204,12 @@ public:
     }
 
     // Processes input received from a mouse input system. Expects the offset value in both the x and y direction.
+    // Only accumulates, so high polling rate mice don't cost any math per event
     void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
     {
-        xoffset *= MouseSensitivity;
-        yoffset *= MouseSensitivity;
-
-        Yaw += xoffset;
-        Pitch += yoffset;
-
-        // Make sure that when pitch is out of bounds, screen doesn't get flipped
-        if (constrainPitch)
-        {
-            if (Pitch > 89.0f)
-                Pitch = 89.0f;
-            if (Pitch < -89.0f)
-                Pitch = -89.0f;
-        }
-
-        // Update Front, Right and Up Vectors using the updated Euler angles
-        updateCameraVectors();
+        pendingX += xoffset;
+        pendingY += yoffset;
+        pendingConstrainPitch = constrainPitch != 0;
     }
 
     // Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
@@ -113,17 +224,73 @@ public:
     }
 
 private:
-    // Calculates the front vector from the Camera's (updated) Euler Angles
+    // accumulated mouse movement not yet applied
+    float pendingX = 0.0f;
+    float pendingY = 0.0f;
+    bool pendingConstrainPitch = true;
+
+    float aspect = 800.0f / 600.0f;
+    float zNear = NEAR_PLANE;
+    float zFar = FAR_PLANE;
+
+    // cached matrices and the state they were built from. Position and Zoom are public, so changes to them are
+    // detected by comparison instead of flags
+    bool viewDirty = true;
+    bool projectionDirty = true;
+    glm::vec3 viewPosition;
+    float projectionZoom = 0.0f;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 inverseView;
+    glm::mat4 inverseProjection;
+    Frustum frustum;
+
+    // Calculates the orientation and the Front, Right and Up vectors from the Camera's (updated) Euler Angles
     void updateCameraVectors()
     {
-        // Calculate the new Front vector
-        glm::vec3 front;
-        front.x = cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        front.y = sin(glm::radians(Pitch));
-        front.z = sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        Front = glm::normalize(front);
-        // Also re-calculate the Right and Up vector
-        Right = glm::normalize(glm::cross(Front, WorldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-        Up = glm::normalize(glm::cross(Right, Front));
+        // yaw turns around the world up axis, -90 degrees looks down -Z; pitch then tilts around the camera's right axis
+        glm::quat yawRotation = glm::angleAxis(glm::radians(-(Yaw + 90.0f)), glm::normalize(WorldUp));
+        glm::quat pitchRotation = glm::angleAxis(glm::radians(Pitch), glm::vec3(1.0f, 0.0f, 0.0f));
+        Orientation = yawRotation * pitchRotation;
+
+        glm::mat3 basis = glm::mat3_cast(Orientation);
+        Right = basis[0];
+        Up = basis[1];
+        Front = -basis[2];
+        viewDirty = true;
+    }
+
+    void refresh()
+    {
+        Update();
+        if (Position != viewPosition)
+            viewDirty = true;
+        if (Zoom != projectionZoom)
+            projectionDirty = true;
+        if (!viewDirty && !projectionDirty)
+            return;
+
+        if (viewDirty)
+        {
+            // the view matrix is the inverse of the camera's rigid transform: transpose the rotation, negate the translation
+            glm::mat3 rotation = glm::mat3_cast(Orientation);
+            glm::mat3 inverseRotation = glm::transpose(rotation);
+            view = glm::mat4(inverseRotation);
+            view[3] = glm::vec4(-(inverseRotation * Position), 1.0f);
+            inverseView = glm::mat4(rotation);
+            inverseView[3] = glm::vec4(Position, 1.0f);
+            viewPosition = Position;
+            viewDirty = false;
+        }
+        if (projectionDirty)
+        {
+            projection = glm::perspective(glm::radians(Zoom), aspect, zNear, zFar);
+            inverseProjection = glm::inverse(projection);
+            projectionZoom = Zoom;
+            projectionDirty = false;
+        }
+        viewProjection = projection * view;
+        frustum.FromMatrix(viewProjection);
     }
 };
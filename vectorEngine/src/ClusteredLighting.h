@@ -0,0 +1,416 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum Light_Type {
+    POINT_LIGHT,
+    SPOT_LIGHT
+};
+
+// Froxel grid: screen tiles in x/y, exponentially spaced depth slices in z. X is a multiple of 4 for the SSE path
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// further lights touching an already full cluster are dropped and counted in OverflowClusters
+const int MAX_LIGHTS_PER_CLUSTER = 256;
+// light indices are uploaded as 16 bit
+const int MAX_LIGHTS = 65535;
+
+// Surface parameters for meshes without their own, shared by the forward and G-buffer shaders
+const float DEFAULT_ROUGHNESS = 0.5f;
+const float DEFAULT_METALNESS = 0.0f;
+
+// Texture units of the light buffers, after the material textures
+const int LIGHT_DATA_UNIT = 2;
+const int CLUSTER_GRID_UNIT = 3;
+const int LIGHT_INDEX_UNIT = 4;
+// cascaded shadow map array of the sun, see ShadowMaps.h
+const int SHADOW_MAP_UNIT = 7;
+
+
+// A point or spot light in world space. Lights have a finite Radius so each one only touches a few clusters
+struct Light
+{
+    Light_Type Type;
+    glm::vec3 Position;
+    float Radius;
+    glm::vec3 Color;
+    float Intensity;
+    // spot lights only, Direction is normalized and the cones are half angles in degrees
+    glm::vec3 Direction;
+    float InnerCone;
+    float OuterCone;
+
+    static Light Point(const glm::vec3& position, float radius, const glm::vec3& color, float intensity = 1.0f)
+    {
+        return Light{ POINT_LIGHT, position, radius, color, intensity, glm::vec3(0.0f, -1.0f, 0.0f), 180.0f, 180.0f };
+    }
+
+    static Light Spot(const glm::vec3& position, const glm::vec3& direction, float radius, float innerCone, float outerCone, const glm::vec3& color, float intensity = 1.0f)
+    {
+        return Light{ SPOT_LIGHT, position, radius, color, intensity, glm::normalize(direction), innerCone, outerCone };
+    }
+
+    // Smallest sphere around the lit volume. For narrow spots it is centred along the cone instead of on the light
+    glm::vec4 BoundingSphere() const
+    {
+        if (Type == SPOT_LIGHT && OuterCone < 90.0f)
+        {
+            float angle = glm::radians(OuterCone);
+            float c = std::cos(angle);
+            if (angle > glm::quarter_pi<float>())
+                return glm::vec4(Position + Direction * (c * Radius), std::sin(angle) * Radius);
+            float r = Radius / (2.0f * c);
+            return glm::vec4(Position + Direction * r, r);
+        }
+        return glm::vec4(Position, Radius);
+    }
+};
+
+
+// Clustered forward lighting. Every frame Update assigns the lights to the clusters they touch on the job system and
+// uploads three texture buffers: the light data, an (offset, count) pair per cluster and the compact light index
+// lists. fShader.glsl finds its cluster from gl_FragCoord and the linear depth and only loops over that list
+class LightClusters
+{
+public:
+    // CPU time of the last Update
+    double AssignMs = 0.0;
+    int LightCount = 0;
+    int IndexCount = 0;
+    int OverflowClusters = 0;
+
+    LightClusters()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        for (int i = 0; i < 3; i++)
+        {
+            // a texture buffer needs a data store before it can be attached
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            capacities[i] = 16;
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        GetRenderStats().BufferBytes += 3 * 16;
+
+        clusterLights.resize((size_t)CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        clusterCounts.resize(CLUSTER_COUNT);
+        for (int axis = 0; axis < 6; axis++)
+            clusterBounds[axis].resize(CLUSTER_COUNT);
+    }
+
+    ~LightClusters()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+        GetRenderStats().BufferBytes -= capacities[0] + capacities[1] + capacities[2];
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Every program that declares the light samplers needs them on their own units, even while lighting is off,
+    // because samplers of different types may not share a unit
+    static void SetSamplerUnits(const Shader& shader)
+    {
+        shader.setInt("lightData", LIGHT_DATA_UNIT);
+        shader.setInt("clusterGrid", CLUSTER_GRID_UNIT);
+        shader.setInt("lightIndices", LIGHT_INDEX_UNIT);
+        shader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    }
+
+    // Assigns lights to the clusters of the given camera and uploads the result. nearPlane/farPlane must match projection
+    void Update(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, int width, int height)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        if (projection != clusterProjection || nearPlane != zNear || farPlane != zFar)
+        {
+            zNear = nearPlane;
+            zFar = farPlane;
+            clusterProjection = projection;
+            buildClusterBounds();
+        }
+        screenSize = glm::vec2((float)width, (float)height);
+
+        LightCount = (int)std::min(lights.size(), (size_t)MAX_LIGHTS);
+        cullLights(lights, view, projection);
+
+        // each job owns whole depth slices, so the per-cluster lists are written without synchronisation
+        std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+        GetJobSystem().ParallelFor(CLUSTER_Z, 1, [this](int begin, int end)
+        {
+            for (int z = begin; z < end; z++)
+                assignSlice(z);
+        });
+
+        compactAndUpload(lights);
+        AssignMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Binds the light buffers and sets the cluster lookup uniforms on a shader that is in use. viewPos is the world
+    // space camera position for specular
+    void Bind(const Shader& shader, const glm::vec3& viewPos, const glm::vec3& ambient) const
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        // slice = log(depth) * scale + bias
+        float logRatio = std::log(zFar / zNear);
+        shader.setBool("clusteredLighting", true);
+        shader.setVec3("clusterSize", (float)CLUSTER_X, (float)CLUSTER_Y, (float)CLUSTER_Z);
+        shader.setVec2("clusterTileSize", screenSize.x / CLUSTER_X, screenSize.y / CLUSTER_Y);
+        shader.setVec2("clusterDepthScaleBias", CLUSTER_Z / logRatio, -CLUSTER_Z * std::log(zNear) / logRatio);
+        shader.setVec2("depthPlanes", zNear, zFar);
+        shader.setVec3("viewPos", viewPos);
+        shader.setVec3("ambientLight", ambient);
+    }
+
+    static void Unbind(const Shader& shader)
+    {
+        shader.setBool("clusteredLighting", false);
+    }
+
+private:
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    size_t capacities[3];
+
+    float zNear = 0.0f;
+    float zFar = 0.0f;
+    glm::mat4 clusterProjection = glm::mat4(0.0f);
+    glm::vec2 screenSize;
+
+    // view space cluster boxes as structure-of-arrays: min x/y/z, max x/y/z
+    std::vector<float> clusterBounds[6];
+
+    // visible lights, view space bounding sphere and the cluster range it can touch
+    struct LightRange
+    {
+        int Index;
+        glm::vec4 Sphere;
+        int X0, X1, Y0, Y1, Z0, Z1;
+    };
+    std::vector<LightRange> visible;
+
+    std::vector<uint16_t> clusterLights;
+    std::vector<int> clusterCounts;
+    std::vector<glm::vec4> lightTexels;
+    std::vector<uint32_t> gridTexels;
+    std::vector<uint16_t> indexTexels;
+
+    int sliceOf(float depth) const
+    {
+        int slice = (int)std::floor(std::log(depth / zNear) / std::log(zFar / zNear) * CLUSTER_Z);
+        return glm::clamp(slice, 0, CLUSTER_Z - 1);
+    }
+
+    // Corners of each tile on the near plane, pushed out to the slice depths
+    void buildClusterBounds()
+    {
+        glm::mat4 inverseProjection = glm::inverse(clusterProjection);
+        for (int z = 0; z < CLUSTER_Z; z++)
+        {
+            float sliceNear = zNear * std::pow(zFar / zNear, (float)z / CLUSTER_Z);
+            float sliceFar = zNear * std::pow(zFar / zNear, (float)(z + 1) / CLUSTER_Z);
+            for (int y = 0; y < CLUSTER_Y; y++)
+            {
+                for (int x = 0; x < CLUSTER_X; x++)
+                {
+                    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+                    for (int corner = 0; corner < 4; corner++)
+                    {
+                        glm::vec2 ndc(((x + (corner & 1)) / (float)CLUSTER_X) * 2.0f - 1.0f, ((y + (corner >> 1)) / (float)CLUSTER_Y) * 2.0f - 1.0f);
+                        glm::vec4 p = inverseProjection * glm::vec4(ndc, -1.0f, 1.0f);
+                        glm::vec3 ray = glm::vec3(p) / p.w;
+                        ray /= -ray.z;
+                        boxMin = glm::min(boxMin, glm::min(ray * sliceNear, ray * sliceFar));
+                        boxMax = glm::max(boxMax, glm::max(ray * sliceNear, ray * sliceFar));
+                    }
+                    int cluster = x + CLUSTER_X * (y + CLUSTER_Y * z);
+                    clusterBounds[0][cluster] = boxMin.x;
+                    clusterBounds[1][cluster] = boxMin.y;
+                    clusterBounds[2][cluster] = boxMin.z;
+                    clusterBounds[3][cluster] = boxMax.x;
+                    clusterBounds[4][cluster] = boxMax.y;
+                    clusterBounds[5][cluster] = boxMax.z;
+                }
+            }
+        }
+    }
+
+    // Moves the bounding spheres to view space, drops lights outside the depth range and finds the tiles each one
+    // projects onto
+    void cullLights(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection)
+    {
+        visible.clear();
+        for (int i = 0; i < LightCount; i++)
+        {
+            glm::vec4 world = lights[i].BoundingSphere();
+            glm::vec3 c = glm::vec3(view * glm::vec4(glm::vec3(world), 1.0f));
+            float r = world.w;
+            float depthMin = -c.z - r, depthMax = -c.z + r;
+            if (depthMax < zNear || depthMin > zFar)
+                continue;
+
+            LightRange range;
+            range.Index = i;
+            range.Sphere = glm::vec4(c, r);
+            range.Z0 = sliceOf(std::max(depthMin, zNear));
+            range.Z1 = sliceOf(std::min(depthMax, zFar));
+            range.X0 = 0; range.X1 = CLUSTER_X - 1;
+            range.Y0 = 0; range.Y1 = CLUSTER_Y - 1;
+
+            // the projected box is only meaningful when the sphere is entirely in front of the camera
+            if (depthMin > zNear)
+            {
+                glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    glm::vec3 p = c + glm::vec3(corner & 1 ? r : -r, corner & 2 ? r : -r, corner & 4 ? r : -r);
+                    glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+                    glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                    ndcMin = glm::min(ndcMin, ndc);
+                    ndcMax = glm::max(ndcMax, ndc);
+                }
+                if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+                    continue;
+                range.X0 = glm::clamp((int)std::floor((ndcMin.x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+                range.X1 = glm::clamp((int)std::floor((ndcMax.x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+                range.Y0 = glm::clamp((int)std::floor((ndcMin.y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+                range.Y1 = glm::clamp((int)std::floor((ndcMax.y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+            }
+            visible.push_back(range);
+        }
+    }
+
+    void addLight(int cluster, int light)
+    {
+        int& count = clusterCounts[cluster];
+        if (count < MAX_LIGHTS_PER_CLUSTER)
+            clusterLights[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER + count] = (uint16_t)light;
+        count++;
+    }
+
+    // Exact sphere against box test for every cluster of the slice inside each light's tile range
+    void assignSlice(int z)
+    {
+        for (const LightRange& range : visible)
+        {
+            if (z < range.Z0 || z > range.Z1)
+                continue;
+            const float cx = range.Sphere.x, cy = range.Sphere.y, cz = range.Sphere.z, r2 = range.Sphere.w * range.Sphere.w;
+            for (int y = range.Y0; y <= range.Y1; y++)
+            {
+                const int row = CLUSTER_X * (y + CLUSTER_Y * z);
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+                // four neighbouring clusters of the row per test
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 vx = _mm_set1_ps(cx), vy = _mm_set1_ps(cy), vz = _mm_set1_ps(cz), vr2 = _mm_set1_ps(r2);
+                for (int x = range.X0 & ~3; x <= range.X1; x += 4)
+                {
+                    const int c = row + x;
+                    __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds[0][c]), vx), zero), _mm_max_ps(_mm_sub_ps(vx, _mm_loadu_ps(&clusterBounds[3][c])), zero));
+                    __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds[1][c]), vy), zero), _mm_max_ps(_mm_sub_ps(vy, _mm_loadu_ps(&clusterBounds[4][c])), zero));
+                    __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterBounds[2][c]), vz), zero), _mm_max_ps(_mm_sub_ps(vz, _mm_loadu_ps(&clusterBounds[5][c])), zero));
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, vr2));
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if ((mask & (1 << lane)) && x + lane >= range.X0 && x + lane <= range.X1)
+                            addLight(c + lane, range.Index);
+                    }
+                }
+#else
+                for (int x = range.X0; x <= range.X1; x++)
+                {
+                    const int c = row + x;
+                    float dx = std::max(clusterBounds[0][c] - cx, 0.0f) + std::max(cx - clusterBounds[3][c], 0.0f);
+                    float dy = std::max(clusterBounds[1][c] - cy, 0.0f) + std::max(cy - clusterBounds[4][c], 0.0f);
+                    float dz = std::max(clusterBounds[2][c] - cz, 0.0f) + std::max(cz - clusterBounds[5][c], 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= r2)
+                        addLight(c, range.Index);
+                }
+#endif
+            }
+        }
+    }
+
+    // Orphans and refills a buffer, growing it to the next power of two when needed
+    void upload(int buffer, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        if (bytes > capacities[buffer])
+        {
+            size_t capacity = capacities[buffer];
+            while (capacity < bytes)
+                capacity *= 2;
+            GetRenderStats().BufferBytes += capacity - capacities[buffer];
+            capacities[buffer] = capacity;
+        }
+        glBufferData(GL_TEXTURE_BUFFER, capacities[buffer], NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    }
+
+    void compactAndUpload(const std::vector<Light>& lights)
+    {
+        // 3 texels per light: position + radius, colour * intensity + cos(inner), direction + cos(outer).
+        // Point lights get cone cosines below -1 so the spot term is always 1
+        lightTexels.resize((size_t)LightCount * 3);
+        for (int i = 0; i < LightCount; i++)
+        {
+            const Light& light = lights[i];
+            bool spot = light.Type == SPOT_LIGHT;
+            lightTexels[i * 3 + 0] = glm::vec4(light.Position, light.Radius);
+            lightTexels[i * 3 + 1] = glm::vec4(light.Color * light.Intensity, spot ? std::cos(glm::radians(light.InnerCone)) : -2.0f);
+            lightTexels[i * 3 + 2] = glm::vec4(light.Direction, spot ? std::cos(glm::radians(light.OuterCone)) : -3.0f);
+        }
+
+        gridTexels.resize((size_t)CLUSTER_COUNT * 2);
+        indexTexels.clear();
+        OverflowClusters = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            int count = clusterCounts[cluster];
+            if (count > MAX_LIGHTS_PER_CLUSTER)
+            {
+                OverflowClusters++;
+                count = MAX_LIGHTS_PER_CLUSTER;
+            }
+            gridTexels[cluster * 2] = (uint32_t)indexTexels.size();
+            gridTexels[cluster * 2 + 1] = (uint32_t)count;
+            const uint16_t* list = &clusterLights[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER];
+            indexTexels.insert(indexTexels.end(), list, list + count);
+        }
+        IndexCount = (int)indexTexels.size();
+
+        upload(0, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        upload(1, gridTexels.data(), gridTexels.size() * sizeof(uint32_t));
+        upload(2, indexTexels.data(), indexTexels.size() * sizeof(uint16_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
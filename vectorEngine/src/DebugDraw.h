@@ -0,0 +1,314 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "RenderStats.h"
+#include "Shader.h"
+#include "TextRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// lines per frame of each kind, more are dropped and counted
+const int DEBUG_MAX_LINES = 1 << 18;
+const int DEBUG_MAX_OVERLAY_LINES = 1 << 14;
+const int DEBUG_MAX_LABELS = 1024;
+const int DEBUG_LABEL_LENGTH = 32;
+const int DEBUG_CIRCLE_SEGMENTS = 16;
+
+// Immediate mode debug shapes for one frame. Every call appends lines to preallocated arrays, reserving its range with
+// a compare and swap, so any thread can draw while others do; DebugRenderer flushes them once everything is in. Depth
+// tested lines are hidden by the scene, overlay lines are drawn over it. Calls return right away while disabled
+class DebugDraw
+{
+public:
+    struct Vertex
+    {
+        glm::vec3 Position;
+        uint32_t Color;
+    };
+
+    struct Label
+    {
+        glm::vec3 Position;
+        uint32_t Color;
+        char Text[DEBUG_LABEL_LENGTH];
+    };
+
+    // Allocates the arrays, the first frame that draws would otherwise pay for it
+    void Enable()
+    {
+        if (lines[0].empty())
+        {
+            lines[0].resize(DEBUG_MAX_LINES * 2);
+            lines[1].resize(DEBUG_MAX_OVERLAY_LINES * 2);
+            labels.resize(DEBUG_MAX_LABELS);
+        }
+        enabled = true;
+    }
+
+    bool Enabled() const { return enabled; }
+
+    void Line(const glm::vec3& a, const glm::vec3& b, const glm::vec4& color, bool overlay = false)
+    {
+        Vertex* v = reserve(1, overlay);
+        if (v == NULL)
+            return;
+        uint32_t packed = packColor(color);
+        v[0] = { a, packed };
+        v[1] = { b, packed };
+    }
+
+    // the edges of the box transform maps the unit cube from -0.5 to 0.5 to
+    void Box(const glm::mat4& transform, const glm::vec4& color, bool overlay = false)
+    {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = glm::vec3(transform * glm::vec4((i & 1) - 0.5f, ((i >> 1) & 1) - 0.5f, ((i >> 2) & 1) - 0.5f, 1.0f));
+        boxEdges(corners, color, overlay);
+    }
+
+    void Box(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec4& color, bool overlay = false)
+    {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = glm::vec3(i & 1 ? boxMax.x : boxMin.x, i & 2 ? boxMax.y : boxMin.y, i & 4 ? boxMax.z : boxMin.z);
+        boxEdges(corners, color, overlay);
+    }
+
+    // three great circles
+    void Sphere(const glm::vec3& center, float radius, const glm::vec4& color, bool overlay = false)
+    {
+        Vertex* v = reserve(3 * DEBUG_CIRCLE_SEGMENTS, overlay);
+        if (v == NULL)
+            return;
+        uint32_t packed = packColor(color);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++)
+            {
+                for (int end = 0; end < 2; end++)
+                {
+                    float angle = (i + end) * glm::two_pi<float>() / DEBUG_CIRCLE_SEGMENTS;
+                    glm::vec3 offset(0.0f);
+                    offset[(axis + 1) % 3] = std::cos(angle) * radius;
+                    offset[(axis + 2) % 3] = std::sin(angle) * radius;
+                    *v++ = { center + offset, packed };
+                }
+            }
+        }
+    }
+
+    // the frustum of a camera with this view and projection
+    void Frustum(const glm::mat4& viewProjection, const glm::vec4& color, bool overlay = false)
+    {
+        glm::mat4 inverse = glm::inverse(viewProjection);
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner = inverse * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+            corners[i] = glm::vec3(corner) / corner.w;
+        }
+        boxEdges(corners, color, overlay);
+    }
+
+    // Text drawn over the scene where position projects to, cut to DEBUG_LABEL_LENGTH - 1 characters
+    void Text(const glm::vec3& position, const char* text, const glm::vec4& color)
+    {
+        if (!enabled)
+            return;
+        int index = labelCount.fetch_add(1, std::memory_order_relaxed);
+        if (index >= DEBUG_MAX_LABELS)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Label& label = labels[index];
+        label.Position = position;
+        label.Color = packColor(color);
+        std::strncpy(label.Text, text, DEBUG_LABEL_LENGTH - 1);
+        label.Text[DEBUG_LABEL_LENGTH - 1] = '\0';
+    }
+
+    // What was drawn since the last Reset. Only once every thread is done drawing
+    int LineCount(bool overlay) const { return counts[overlay].load(std::memory_order_relaxed) / 2; }
+    const Vertex* LineVertices(bool overlay) const { return lines[overlay].data(); }
+    int LabelCount() const { return std::min(labelCount.load(std::memory_order_relaxed), (int)labels.size()); }
+    const Label* Labels() const { return labels.data(); }
+    // lines and labels that didn't fit since the last Reset
+    int Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    void Reset()
+    {
+        counts[0] = 0;
+        counts[1] = 0;
+        labelCount = 0;
+        dropped = 0;
+    }
+
+private:
+    bool enabled = false;
+    // depth tested and overlay lines, two vertices each
+    std::vector<Vertex> lines[2];
+    // vertices reserved, never past the end of the array so every one of them is written
+    std::atomic<int> counts[2] = {};
+    std::vector<Label> labels;
+    std::atomic<int> labelCount{ 0 };
+    std::atomic<int> dropped{ 0 };
+
+    static uint32_t packColor(const glm::vec4& color)
+    {
+        glm::uvec4 c = glm::uvec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+        return c.r | c.g << 8 | c.b << 16 | c.a << 24;
+    }
+
+    // room for lineCount lines, or NULL if disabled or full
+    Vertex* reserve(int lineCount, bool overlay)
+    {
+        if (!enabled)
+            return NULL;
+        // an add would move the count past the end for a call that then drops its lines, and the smaller calls after
+        // it would too, leaving the range up to the end unwritten
+        int first = counts[overlay].load(std::memory_order_relaxed);
+        do
+        {
+            if (first + lineCount * 2 > (int)lines[overlay].size())
+            {
+                dropped.fetch_add(lineCount, std::memory_order_relaxed);
+                return NULL;
+            }
+        } while (!counts[overlay].compare_exchange_weak(first, first + lineCount * 2, std::memory_order_relaxed));
+        return lines[overlay].data() + first;
+    }
+
+    // corners are indexed by their x, y and z in bits 0, 1 and 2
+    void boxEdges(const glm::vec3* corners, const glm::vec4& color, bool overlay)
+    {
+        Vertex* v = reserve(12, overlay);
+        if (v == NULL)
+            return;
+        uint32_t packed = packColor(color);
+        for (int i = 0; i < 8; i++)
+        {
+            for (int bit = 1; bit < 8; bit <<= 1)
+            {
+                if ((i & bit) == 0)
+                {
+                    *v++ = { corners[i], packed };
+                    *v++ = { corners[i | bit], packed };
+                }
+            }
+        }
+    }
+};
+
+inline DebugDraw& GetDebugDraw()
+{
+    static DebugDraw debugDraw;
+    return debugDraw;
+}
+
+// Draws what DebugDraw collected: the depth tested lines in one call, the overlay lines in another and the labels
+// with the text renderer, then clears it for the next frame
+class DebugRenderer
+{
+public:
+    Shader LineShader;
+    TextRenderer Text;
+    // the last Flush, from uploading to submitting
+    double FlushMs = 0.0;
+
+    DebugRenderer()
+        : LineShader("src/vDebug.glsl", "src/fDebug.glsl")
+    {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vertexBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, BUFFER_BYTES, NULL, GL_STREAM_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugDraw::Vertex), (void*)offsetof(DebugDraw::Vertex, Position));
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugDraw::Vertex), (void*)offsetof(DebugDraw::Vertex, Color));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        GetRenderStats().BufferBytes += BUFFER_BYTES;
+    }
+
+    ~DebugRenderer()
+    {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteVertexArrays(1, &vao);
+        GetRenderStats().BufferBytes -= BUFFER_BYTES;
+    }
+
+    DebugRenderer(const DebugRenderer&) = delete;
+    DebugRenderer& operator=(const DebugRenderer&) = delete;
+
+    // Draws everything in draw over the current framebuffer of width by height pixels, then resets it
+    void Flush(DebugDraw& draw, const glm::mat4& view, const glm::mat4& projection, int width, int height)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        int depthLines = draw.LineCount(false), overlayLines = draw.LineCount(true);
+        if (depthLines + overlayLines > 0)
+        {
+            // both kinds share the buffer, overlay lines after the depth tested ones. Invalidating the mapping lets
+            // the driver hand back storage the last frame's draw is not still reading
+            size_t depthBytes = depthLines * 2 * sizeof(DebugDraw::Vertex), overlayBytes = overlayLines * 2 * sizeof(DebugDraw::Vertex);
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            char* mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, depthBytes + overlayBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            std::memcpy(mapped, draw.LineVertices(false), depthBytes);
+            std::memcpy(mapped + depthBytes, draw.LineVertices(true), overlayBytes);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            LineShader.use();
+            LineShader.setMat4("viewProjection", projection * view);
+            glBindVertexArray(vao);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            if (depthLines > 0)
+            {
+                glDrawArrays(GL_LINES, 0, depthLines * 2);
+                GetRenderStats().DrawCalls++;
+            }
+            if (overlayLines > 0)
+            {
+                glDisable(GL_DEPTH_TEST);
+                glDrawArrays(GL_LINES, depthLines * 2, overlayLines * 2);
+                GetRenderStats().DrawCalls++;
+                glEnable(GL_DEPTH_TEST);
+            }
+            glDisable(GL_BLEND);
+            glBindVertexArray(0);
+        }
+
+        glm::mat4 viewProjection = projection * view;
+        const DebugDraw::Label* labels = draw.Labels();
+        for (int i = 0; i < draw.LabelCount(); i++)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(labels[i].Position, 1.0f);
+            if (clip.w <= 0.0f || std::abs(clip.x) > clip.w || std::abs(clip.y) > clip.w)
+                continue;
+            glm::vec2 pixel((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+            uint32_t c = labels[i].Color;
+            Text.Add(labels[i].Text, pixel.x, pixel.y, 10.0f, glm::vec4(c & 255, c >> 8 & 255, c >> 16 & 255, c >> 24) / 255.0f);
+        }
+        Text.Draw(width, height);
+        draw.Reset();
+        FlushMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+private:
+    unsigned int vao = 0, vertexBuffer = 0;
+    // room for every line DebugDraw can hold, so a flush never reallocates
+    static const size_t BUFFER_BYTES = (DEBUG_MAX_LINES + DEBUG_MAX_OVERLAY_LINES) * 2 * sizeof(DebugDraw::Vertex);
+};
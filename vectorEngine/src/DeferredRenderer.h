@@ -0,0 +1,229 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ClusteredLighting.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <iostream>
+
+// What the composite pass writes, matches debugView in fComposite.glsl
+enum Deferred_View {
+    DEFERRED_LIT,
+    DEFERRED_ALBEDO,
+    DEFERRED_PACKED_NORMAL,  // the raw 2x12 bit octahedral bytes
+    DEFERRED_ROUGHNESS_METALNESS,
+    DEFERRED_DEPTH
+};
+
+// Texture units used by the lighting and composite passes
+const int GBUFFER_ALBEDO_UNIT = 0;
+const int GBUFFER_NORMAL_UNIT = 1;
+const int GBUFFER_DEPTH_UNIT = 5;
+const int LIGHT_ACCUMULATION_UNIT = 6;
+
+
+// Deferred shading alongside the forward path. The geometry pass writes two RGBA8 targets (albedo + roughness,
+// octahedral normal + metalness) and D24S8 depth, 12 bytes per pixel; the lighting pass reconstructs positions from
+// depth, runs the clustered light lists per pixel into an RGBA16F accumulation target, and the composite pass writes
+// the result and the scene depth to whatever framebuffer was bound before BeginGeometryPass
+class DeferredRenderer
+{
+public:
+    Shader GeometryShader;
+    Shader LightingShader;
+    Shader CompositeShader;
+    Deferred_View View = DEFERRED_LIT;
+
+    DeferredRenderer(int width, int height)
+        : GeometryShader("src/vShader.glsl", "src/fGBuffer.glsl"),
+          LightingShader("src/vFullscreen.glsl", "src/fDeferredLighting.glsl"),
+          CompositeShader("src/vFullscreen.glsl", "src/fComposite.glsl")
+    {
+        GeometryShader.use();
+        GeometryShader.setInt("texture1", 0);
+        GeometryShader.setInt("texture2", 1);
+        GeometryShader.setFloat("roughness", DEFAULT_ROUGHNESS);
+        GeometryShader.setFloat("metalness", DEFAULT_METALNESS);
+
+        LightingShader.use();
+        LightingShader.setInt("gAlbedoRoughness", GBUFFER_ALBEDO_UNIT);
+        LightingShader.setInt("gNormalMetalness", GBUFFER_NORMAL_UNIT);
+        LightingShader.setInt("gDepth", GBUFFER_DEPTH_UNIT);
+        LightClusters::SetSamplerUnits(LightingShader);
+
+        CompositeShader.use();
+        CompositeShader.setInt("gAlbedoRoughness", GBUFFER_ALBEDO_UNIT);
+        CompositeShader.setInt("gNormalMetalness", GBUFFER_NORMAL_UNIT);
+        CompositeShader.setInt("gDepth", GBUFFER_DEPTH_UNIT);
+        CompositeShader.setInt("lightAccumulation", LIGHT_ACCUMULATION_UNIT);
+
+        // the fullscreen triangle has no attributes, but core profile still needs a VAO bound to draw
+        glGenVertexArrays(1, &emptyVAO);
+        Resize(width, height);
+    }
+
+    ~DeferredRenderer()
+    {
+        destroyTargets();
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    void Resize(int width, int height)
+    {
+        if (width == targetWidth && height == targetHeight)
+            return;
+        destroyTargets();
+        createTargets(width, height);
+    }
+
+    // Bytes written per pixel by the geometry pass
+    static int GBufferBytesPerPixel()
+    {
+        return 4 + 4 + 4;
+    }
+
+    // Redirects drawing into the G-buffer and clears it. Draw the scene with GeometryShader afterwards, the
+    // material textures and per-mesh uniforms are set by the caller as in the forward path
+    void BeginGeometryPass(const glm::mat4& view, const glm::mat4& projection)
+    {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glViewport(0, 0, targetWidth, targetHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        GeometryShader.use();
+        GeometryShader.setMat4("view", view);
+        GeometryShader.setMat4("projection", projection);
+    }
+
+    // Lights the G-buffer with clusters (unlit albedo when NULL) and composites into the framebuffer that was bound
+    // before BeginGeometryPass. clusters must have been updated for the same camera
+    void Resolve(const LightClusters* clusters, const glm::mat4& inverseView, const glm::mat4& inverseProjection, const glm::vec3& viewPos,
+        const glm::vec3& ambient, const glm::vec4& background, float nearPlane, float farPlane)
+    {
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+        bindTexture(GBUFFER_ALBEDO_UNIT, albedoTexture);
+        bindTexture(GBUFFER_NORMAL_UNIT, normalTexture);
+        bindTexture(GBUFFER_DEPTH_UNIT, depthTexture);
+
+        // light accumulation, background pixels are discarded
+        glBindFramebuffer(GL_FRAMEBUFFER, lightBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (View == DEFERRED_LIT)
+        {
+            LightingShader.use();
+            LightingShader.setMat4("inverseView", inverseView);
+            LightingShader.setMat4("inverseProjection", inverseProjection);
+            if (clusters != NULL)
+                clusters->Bind(LightingShader, viewPos, ambient);
+            else
+                LightClusters::Unbind(LightingShader);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            GetRenderStats().CountDraw(3);
+        }
+
+        // composite, also restores the scene depth for anything drawn forward afterwards
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        bindTexture(LIGHT_ACCUMULATION_UNIT, lightTexture);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        CompositeShader.use();
+        CompositeShader.setInt("debugView", (int)View);
+        CompositeShader.setVec4("background", background);
+        CompositeShader.setVec2("depthPlanes", nearPlane, farPlane);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        GetRenderStats().CountDraw(3);
+        glDepthFunc(GL_LESS);
+        if (!depthTest)
+            glDisable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    unsigned int gBuffer = 0;
+    unsigned int albedoTexture = 0;
+    unsigned int normalTexture = 0;
+    unsigned int depthTexture = 0;
+    unsigned int lightBuffer = 0;
+    unsigned int lightTexture = 0;
+    unsigned int emptyVAO = 0;
+    int targetWidth = 0;
+    int targetHeight = 0;
+    GLint previousFramebuffer = 0;
+
+    static void bindTexture(int unit, unsigned int texture)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    static unsigned int createTexture(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        // only ever read with texelFetch
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void createTargets(int width, int height)
+    {
+        targetWidth = width;
+        targetHeight = height;
+        albedoTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        normalTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        depthTexture = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+        lightTexture = createTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+        GetRenderStats().TextureBytes += targetBytes();
+
+        glGenFramebuffers(1, &gBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete" << std::endl;
+
+        glGenFramebuffers(1, &lightBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Light accumulation target is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroyTargets()
+    {
+        if (gBuffer == 0)
+            return;
+        GetRenderStats().TextureBytes -= targetBytes();
+        glDeleteFramebuffers(1, &gBuffer);
+        glDeleteFramebuffers(1, &lightBuffer);
+        unsigned int textures[4] = { albedoTexture, normalTexture, depthTexture, lightTexture };
+        glDeleteTextures(4, textures);
+        gBuffer = lightBuffer = albedoTexture = normalTexture = depthTexture = lightTexture = 0;
+        targetWidth = targetHeight = 0;
+    }
+
+    uint64_t targetBytes() const
+    {
+        return (uint64_t)targetWidth * targetHeight * (GBufferBytesPerPixel() + 8);
+    }
+};
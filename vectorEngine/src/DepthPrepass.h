@@ -0,0 +1,157 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <vector>
+
+
+// Depth-only pre-pass followed by a GL_EQUAL shading pass, so every pixel runs the expensive fragment shader once.
+// The depth pass uses vShader.glsl with fDepth.glsl and should be fed the position-only stream of each mesh
+class DepthPrepass
+{
+public:
+    Shader DepthShader;
+
+    DepthPrepass() : DepthShader("src/vShader.glsl", "src/fDepth.glsl")
+    {
+    }
+
+    // Binds the depth shader and masks colour writes. Model and dequantization uniforms are set by the caller per draw
+    void BeginDepthPass(const glm::mat4& view, const glm::mat4& projection)
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        DepthShader.use();
+        DepthShader.setMat4("view", view);
+        DepthShader.setMat4("projection", projection);
+    }
+
+    // Depth is complete, only fragments that won the depth pass get shaded
+    void BeginShadingPass()
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+    }
+
+    void End()
+    {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+};
+
+
+struct OverdrawResult
+{
+    // shaded fragments per covered pixel, 1.0 means no overdraw
+    float Average = 0.0f;
+    float Max = 0.0f;
+    // fraction of the screen covered by at least one fragment
+    float Coverage = 0.0f;
+    double ShadedFragments = 0.0;
+};
+
+// Counts shaded fragments per pixel by drawing with CountShader into an R32F target with additive blending.
+// Render the scene between Begin and End exactly as usual, just with CountShader in place of the material shader
+class OverdrawMeter
+{
+public:
+    Shader CountShader;
+
+    OverdrawMeter() : CountShader("src/vShader.glsl", "src/fOverdraw.glsl")
+    {
+    }
+
+    ~OverdrawMeter()
+    {
+        destroyTarget();
+    }
+
+    void Begin(int width, int height)
+    {
+        if (width != targetWidth || height != targetHeight)
+        {
+            destroyTarget();
+            createTarget(width, height);
+        }
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
+    // Reads the counts back, this stalls until the GPU has finished the frame
+    OverdrawResult End()
+    {
+        glDisable(GL_BLEND);
+        counts.resize((size_t)targetWidth * targetHeight);
+        glReadPixels(0, 0, targetWidth, targetHeight, GL_RED, GL_FLOAT, counts.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+        OverdrawResult result;
+        size_t covered = 0;
+        for (float c : counts)
+        {
+            if (c > 0.0f)
+            {
+                covered++;
+                result.ShadedFragments += c;
+                result.Max = std::max(result.Max, c);
+            }
+        }
+        result.Coverage = counts.empty() ? 0.0f : (float)covered / counts.size();
+        result.Average = covered == 0 ? 0.0f : (float)(result.ShadedFragments / covered);
+        return result;
+    }
+
+private:
+    unsigned int fbo = 0;
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+    int targetWidth = 0;
+    int targetHeight = 0;
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    std::vector<float> counts;
+
+    void createTarget(int width, int height)
+    {
+        targetWidth = width;
+        targetHeight = height;
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R32F, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Overdraw target is not complete" << std::endl;
+    }
+
+    void destroyTarget()
+    {
+        if (fbo == 0)
+            return;
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        fbo = colorRBO = depthRBO = 0;
+        targetWidth = targetHeight = 0;
+    }
+};
@@ -0,0 +1,1602 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Headless.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// A capture is a header naming the captured functions followed by one stream of records: a 16 bit index into that
+// list and the arguments at their own size, pointers that are offsets into a bound buffer as 64 bits. Data behind a
+// pointer is written once as a blob record and referenced by index after that, so a buffer or texture that is
+// uploaded again unchanged costs four bytes. Small arrays such as uniform values are written inline
+const char GL_CAPTURE_MAGIC[8] = { 'V', 'E', 'G', 'L', 'C', 'A', 'P', '1' };
+const uint16_t GL_RECORD_FRAME = 0xFFFF;    // end of a frame
+const uint16_t GL_RECORD_BLOB = 0xFFFE;     // u64 size, padding to 8 bytes, the data
+const uint16_t GL_RECORD_END = 0xFFFD;
+const uint32_t GL_NO_BLOB = 0xFFFFFFFF;     // a NULL data pointer
+// the captured stream is written out at the end of every frame or when this much is buffered
+const size_t GL_CAPTURE_FLUSH_BYTES = 16 << 20;
+// per argument of the replayed call, room for any query result or info log the engine asks for
+const size_t GL_REPLAY_SCRATCH_BYTES = 64 << 10;
+const int GL_REPLAY_MAX_ARGUMENTS = 16;
+const int GL_REPLAY_SLOWEST_CALLS = 16;
+
+// What the replay does with an argument that was recorded as it was passed
+enum Capture_Argument {
+    CAPTURE_VALUE,          // passed unchanged
+    CAPTURE_BUFFER,         // object names, translated to the ones the replaying driver handed out
+    CAPTURE_TEXTURE,
+    CAPTURE_VERTEX_ARRAY,
+    CAPTURE_FRAMEBUFFER,
+    CAPTURE_RENDERBUFFER,
+    CAPTURE_QUERY,
+    CAPTURE_PROGRAM,        // shaders and programs share their names
+    CAPTURE_NAME_KINDS,
+    CAPTURE_USE_PROGRAM = CAPTURE_NAME_KINDS,   // program name that becomes the one CAPTURE_LOCATION refers to
+    CAPTURE_LOCATION,       // uniform location in the current program
+    CAPTURE_OUT             // memory the driver writes results into, replayed into scratch memory
+};
+
+// Packs one Capture_Argument per argument into four bits each, first argument lowest
+inline constexpr uint64_t CaptureArgs()
+{
+    return 0;
+}
+
+template <typename... Kinds>
+inline constexpr uint64_t CaptureArgs(Capture_Argument first, Kinds... rest)
+{
+    return (uint64_t)first | CaptureArgs(rest...) << 4;
+}
+
+inline constexpr Capture_Argument CaptureArg(uint64_t args, size_t index)
+{
+    return (Capture_Argument)(args >> 4 * index & 15);
+}
+
+// Bytes glTexImage* reads from or glReadPixels writes to client memory for an image of that size and format
+inline size_t GLImageBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, GLint alignment)
+{
+    if (width <= 0 || height <= 0 || depth <= 0)
+        return 0;
+    size_t components = format == GL_RGBA || format == GL_BGRA || format == GL_RGBA_INTEGER ? 4
+        : format == GL_RGB || format == GL_BGR || format == GL_RGB_INTEGER ? 3
+        : format == GL_RG || format == GL_RG_INTEGER || format == GL_DEPTH_STENCIL ? 2 : 1;
+    size_t pixel;
+    switch (type)
+    {
+    case GL_UNSIGNED_BYTE: case GL_BYTE: pixel = components; break;
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: pixel = components * 2; break;
+    case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_10F_11F_11F_REV: case GL_UNSIGNED_INT_2_10_10_10_REV: pixel = 4; break;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV: pixel = 8; break;
+    default: pixel = components * 4; break;
+    }
+    size_t row = width * pixel;
+    size_t alignedRow = (row + alignment - 1) / alignment * alignment;
+    return alignedRow * ((size_t)height * depth - 1) + row;
+}
+
+
+class GLReplayer;
+
+// One GL entry point that can be captured and replayed
+struct GLCapturedFunction
+{
+    const char* Name;
+    // swaps the glad pointer for the recording hook, or back
+    void (*Hook)(bool install);
+    // reads the call's arguments from the replayer and makes it
+    void (*Replay)(GLReplayer& replayer);
+};
+
+const std::vector<GLCapturedFunction>& GLCapturedFunctions();
+
+
+// Records every GL call made through glad into a file GLReplayer executes again, from Begin until the last frame
+// of the range has ended. Frames before that are recorded too, since they create and fill what the captured frames
+// draw with, but only the range is timed on replay. Hooks are installed by swapping glad's function pointers, so
+// nothing is recorded and nothing costs anything outside a capture. Recording runs on the thread that owns the
+// context and allocates, so it does not go together with --assert-no-alloc
+class GLCapture
+{
+public:
+    // GL_UNPACK_ALIGNMENT as the application set it, to size texture uploads
+    GLint UnpackAlignment = 4;
+
+    ~GLCapture()
+    {
+        End();
+    }
+
+    bool Begin(const std::string& path, int firstFrame, int frameCount, int width, int height);
+
+    // Counts a frame, and ends the capture after the last one of the range
+    void EndFrame()
+    {
+        if (!Active())
+            return;
+        Write(GL_RECORD_FRAME);
+        frame++;
+        if (frame >= lastFrame)
+            End();
+        else
+            flush();
+    }
+
+    // Writes what is left and restores glad's function pointers. Called when the application exits early too
+    void End();
+
+    bool Active() const { return file.is_open(); }
+
+    void BeginCall(int function)
+    {
+        Write((uint16_t)function);
+        calls++;
+    }
+
+    template <typename T>
+    void Write(T value)
+    {
+        size_t at = buffer.size();
+        buffer.resize(at + sizeof(T));
+        std::memcpy(buffer.data() + at, &value, sizeof(T));
+    }
+
+    // a pointer that is an offset into a bound buffer, or one the driver writes into and the replay ignores
+    template <typename T>
+    void Write(T* pointer)
+    {
+        Write((uint64_t)(uintptr_t)pointer);
+    }
+
+    // bytes inline in the stream, 4 byte aligned so the replay can hand them to GL where they are
+    void WriteArray(const void* data, size_t bytes)
+    {
+        pad(4);
+        size_t at = buffer.size();
+        buffer.resize(at + bytes);
+        if (bytes > 0)
+            std::memcpy(buffer.data() + at, data, bytes);
+    }
+
+    // Index of the blob holding these bytes, writing it first unless the same bytes were written before
+    uint32_t Blob(const void* data, size_t bytes)
+    {
+        if (data == NULL)
+            return GL_NO_BLOB;
+        // the hash only finds a candidate, which is compared byte for byte before it is reused, since replaying the
+        // wrong data would go unnoticed
+        uint64_t hash = blobHash(data, bytes);
+        std::unordered_map<uint64_t, StoredBlob>::const_iterator found = blobs.find(hash);
+        if (found != blobs.end() && storedEquals(found->second, data, bytes))
+        {
+            sharedBlobBytes += bytes;
+            return found->second.Index;
+        }
+        uint32_t index = blobCount++;
+        Write(GL_RECORD_BLOB);
+        Write((uint64_t)bytes);
+        pad(8);
+        size_t at = buffer.size();
+        blobs[hash] = { written + at, bytes, index };
+        buffer.resize(at + bytes);
+        std::memcpy(buffer.data() + at, data, bytes);
+        blobBytes += bytes;
+        if (buffer.size() >= GL_CAPTURE_FLUSH_BYTES)
+            flush();
+        return index;
+    }
+
+    // glMapBufferRange returned pointer for target. What was written there is recorded when it is unmapped
+    void Mapped(GLenum target, void* pointer, GLsizeiptr length, GLbitfield access)
+    {
+        if (pointer != NULL)
+            mappings.push_back({ target, pointer, length, access });
+    }
+
+    // The blob of what the application wrote into the range mapped for target, or GL_NO_BLOB
+    uint32_t Unmapped(GLenum target)
+    {
+        for (size_t i = 0; i < mappings.size(); i++)
+        {
+            if (mappings[i].Target != target)
+                continue;
+            Mapping mapping = mappings[i];
+            mappings.erase(mappings.begin() + i);
+            return (mapping.Access & GL_MAP_WRITE_BIT) != 0 ? Blob(mapping.Pointer, (size_t)mapping.Length) : GL_NO_BLOB;
+        }
+        return GL_NO_BLOB;
+    }
+
+    // joined glShaderSource pieces, kept so recording a shader does not allocate a new string each time
+    std::string Source;
+
+private:
+    struct Mapping
+    {
+        GLenum Target;
+        void* Pointer;
+        GLsizeiptr Length;
+        GLbitfield Access;
+    };
+
+    // where a blob is in the file, to compare against when the same hash comes again
+    struct StoredBlob
+    {
+        uint64_t Offset;
+        size_t Bytes;
+        uint32_t Index;
+    };
+
+    // read back as well as written, blobs that are already flushed are compared from the file
+    std::fstream file;
+    std::string path;
+    std::vector<char> buffer;
+    // bytes already in the file, so padding can be computed from the position in the file
+    uint64_t written = 0;
+    std::unordered_map<uint64_t, StoredBlob> blobs;
+    uint32_t blobCount = 0;
+    std::vector<char> compared;
+    std::vector<Mapping> mappings;
+    int frame = 0;
+    int firstFrame = 0;
+    int lastFrame = 0;
+    uint64_t calls = 0;
+    uint64_t blobBytes = 0;
+    uint64_t sharedBlobBytes = 0;
+
+    void pad(size_t alignment)
+    {
+        size_t offset = (size_t)((written + buffer.size()) % alignment);
+        if (offset != 0)
+            buffer.resize(buffer.size() + alignment - offset, 0);
+    }
+
+    static uint64_t rotateLeft(uint64_t value, int bits)
+    {
+        return value << bits | value >> (64 - bits);
+    }
+
+    // MurmurHash3 style: every word is multiplied and rotated on its own before it goes into the hash, so no bit of
+    // it cancels against the same bit of another word, and the size is mixed in
+    static uint64_t blobHash(const void* data, size_t bytes)
+    {
+        const unsigned char* bytePointer = (const unsigned char*)data;
+        uint64_t hash = bytes * 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < bytes; i += 8)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bytePointer + i, std::min<size_t>(8, bytes - i));
+            word = rotateLeft(word * 0x87C37B91114253D5ull, 31) * 0x4CF5AD432745937Full;
+            hash = rotateLeft(hash ^ word, 27) * 5 + 0x52DCE729;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        return hash ^ hash >> 33;
+    }
+
+    bool storedEquals(const StoredBlob& stored, const void* data, size_t bytes)
+    {
+        if (stored.Bytes != bytes)
+            return false;
+        // a blob is flushed whole, so it is either still buffered or all in the file
+        if (stored.Offset >= written)
+            return std::memcmp(buffer.data() + (stored.Offset - written), data, bytes) == 0;
+        compared.resize(std::min<size_t>(bytes, 1 << 20));
+        file.flush();
+        file.seekg((std::streamoff)stored.Offset);
+        bool equal = true;
+        for (size_t i = 0; i < bytes && equal; i += compared.size())
+        {
+            size_t chunk = std::min(compared.size(), bytes - i);
+            equal = file.read(compared.data(), chunk) && std::memcmp(compared.data(), (const char*)data + i, chunk) == 0;
+        }
+        file.clear();
+        file.seekp(0, std::ios::end);
+        return equal;
+    }
+
+    void flush()
+    {
+        file.write(buffer.data(), buffer.size());
+        written += buffer.size();
+        buffer.clear();
+    }
+};
+
+inline GLCapture& GetGLCapture()
+{
+    static GLCapture capture;
+    return capture;
+}
+
+
+// Executes a capture on the current context: every frame before the captured range untimed, as setup, then the
+// range timed per frame and per call. Object names and uniform locations are translated to the ones this driver
+// hands out, and the default framebuffer is DefaultFramebuffer, since a replay runs without a window
+class GLReplayer
+{
+public:
+    struct FunctionTiming
+    {
+        const char* Name = NULL;
+        uint64_t Calls = 0;
+        double Ms = 0.0;
+        double MaxMs = 0.0;
+    };
+
+    struct CallTiming
+    {
+        int Frame = 0;
+        // position of the call within its frame
+        uint64_t Call = 0;
+        const char* Name = NULL;
+        double Ms = 0.0;
+    };
+
+    // size of the default framebuffer and the frames captured
+    int Width = 0;
+    int Height = 0;
+    int FirstFrame = 0;
+    int FrameCount = 0;
+    unsigned int DefaultFramebuffer = 0;
+    // off to time whole frames without two clock reads around every call
+    bool CallTimings = true;
+    // GL_UNPACK_ALIGNMENT as the capture set it, to size the texture uploads it replays
+    GLint UnpackAlignment = 4;
+
+    // per captured frame: issuing its calls, and the glFinish after them
+    std::vector<double> SubmitMs;
+    std::vector<double> FinishMs;
+    // indexed like the capture's function list, over the captured frames only
+    std::vector<FunctionTiming> Functions;
+    // the slowest single calls of the captured frames, slowest first
+    CallTiming Slowest[GL_REPLAY_SLOWEST_CALLS];
+    uint64_t Calls = 0;
+    uint64_t SetupCalls = 0;
+    uint64_t FileBytes = 0;
+    // glGetError results at the ends of frames. Some are expected when the driver differs from the captured one
+    uint64_t Errors = 0;
+
+    bool Load(const std::string& path);
+    bool Run();
+
+    template <typename T>
+    T Read()
+    {
+        T value = T();
+        if (cursor + sizeof(T) > end)
+        {
+            failed = true;
+            return value;
+        }
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    const void* ReadArray(size_t bytes)
+    {
+        align(4);
+        if (cursor + bytes > end)
+        {
+            failed = true;
+            return scratch.data();
+        }
+        const void* data = cursor;
+        cursor += bytes;
+        return data;
+    }
+
+    // The data of a call that reads bytes from it, NULL for a call recorded without data. A blob that is missing or
+    // holds fewer bytes fails the replay, so a broken capture never has GL read past the file
+    const void* Blob(uint32_t index, size_t bytes)
+    {
+        if (index == GL_NO_BLOB)
+            return NULL;
+        size_t stored = 0;
+        const void* blob = Blob(index, &stored);
+        if (blob == NULL || stored < bytes)
+        {
+            Fail();
+            return NULL;
+        }
+        return blob;
+    }
+
+    // a call that finds the capture broken makes no GL call, and the replay stops after it
+    void Fail() { failed = true; }
+    bool Failed() const { return failed; }
+
+    const void* Blob(uint32_t index, size_t* bytes = NULL) const
+    {
+        if (index >= blobs.size())
+        {
+            if (bytes != NULL)
+                *bytes = 0;
+            return NULL;
+        }
+        if (bytes != NULL)
+            *bytes = blobs[index].second;
+        return blobs[index].first;
+    }
+
+    template <typename T>
+    T Translate(Capture_Argument kind, T captured)
+    {
+        if (kind == CAPTURE_VALUE)
+            return captured;
+        if (kind == CAPTURE_LOCATION)
+            return (T)location((GLint)captured);
+        if (kind == CAPTURE_USE_PROGRAM)
+        {
+            currentProgram = (GLuint)captured;
+            kind = CAPTURE_PROGRAM;
+        }
+        if (kind >= CAPTURE_NAME_KINDS)
+            return captured;
+        GLuint name = (GLuint)captured;
+        if (kind == CAPTURE_FRAMEBUFFER && name == 0)
+            return (T)DefaultFramebuffer;
+        return (T)(name < names[kind].size() ? names[kind][name] : name);
+    }
+
+    // A call that returns a new object gave this driver's name for the captured one
+    template <typename T>
+    void Created(Capture_Argument kind, T captured, T created)
+    {
+        if (kind == CAPTURE_VALUE || kind >= CAPTURE_NAME_KINDS)
+            return;
+        // GL hands out small names, so a table indexed by the captured name will do
+        std::vector<GLuint>& table = names[kind];
+        if ((GLuint)captured >= table.size())
+        {
+            size_t size = table.size();
+            table.resize((GLuint)captured + 1);
+            for (size_t i = size; i < table.size(); i++)
+                table[i] = (GLuint)i;
+        }
+        table[(GLuint)captured] = (GLuint)created;
+    }
+
+    void Located(GLuint program, GLint captured, GLint found)
+    {
+        if (captured != -1)
+            locations[(uint64_t)program << 32 | (uint32_t)captured] = found;
+    }
+
+    void* Scratch(size_t argument)
+    {
+        return scratch.data() + std::min<size_t>(argument, GL_REPLAY_MAX_ARGUMENTS - 1) * GL_REPLAY_SCRATCH_BYTES;
+    }
+
+    // for glReadPixels, which can write far more than a scratch slice
+    void* Pixels(size_t bytes)
+    {
+        if (pixels.size() < bytes)
+            pixels.resize(bytes);
+        return pixels.data();
+    }
+
+    void Mapped(GLenum target, void* pointer, size_t length)
+    {
+        if (pointer != NULL)
+            mapped.push_back({ target, pointer, length });
+    }
+
+    // the range mapped for target, NULL if there is none
+    void* Unmapped(GLenum target, size_t* length)
+    {
+        for (size_t i = 0; i < mapped.size(); i++)
+        {
+            if (mapped[i].Target != target)
+                continue;
+            void* pointer = mapped[i].Pointer;
+            *length = mapped[i].Length;
+            mapped.erase(mapped.begin() + i);
+            return pointer;
+        }
+        *length = 0;
+        return NULL;
+    }
+
+private:
+    struct Mapping
+    {
+        GLenum Target;
+        void* Pointer;
+        size_t Length;
+    };
+
+    std::vector<char> data;
+    const char* cursor = NULL;
+    const char* end = NULL;
+    const char* stream = NULL;
+    bool failed = false;
+    // the capture's function list resolved against this build's, indexed by the recorded function index
+    std::vector<const GLCapturedFunction*> functions;
+    std::vector<std::pair<const char*, size_t>> blobs;
+    std::vector<GLuint> names[CAPTURE_NAME_KINDS];
+    std::unordered_map<uint64_t, GLint> locations;
+    GLuint currentProgram = 0;
+    std::vector<char> scratch;
+    std::vector<char> pixels;
+    std::vector<Mapping> mapped;
+
+    void align(size_t alignment)
+    {
+        size_t offset = (size_t)(cursor - data.data()) % alignment;
+        if (offset != 0)
+            cursor += alignment - offset;
+    }
+
+    GLint location(GLint captured)
+    {
+        if (captured == -1)
+            return -1;
+        std::unordered_map<uint64_t, GLint>::const_iterator found = locations.find((uint64_t)currentProgram << 32 | (uint32_t)captured);
+        return found != locations.end() ? found->second : captured;
+    }
+
+    void recordSlowest(int frame, uint64_t call, const char* name, double ms)
+    {
+        if (ms <= Slowest[GL_REPLAY_SLOWEST_CALLS - 1].Ms)
+            return;
+        int i = GL_REPLAY_SLOWEST_CALLS - 1;
+        for (; i > 0 && Slowest[i - 1].Ms < ms; i--)
+            Slowest[i] = Slowest[i - 1];
+        Slowest[i].Frame = frame;
+        Slowest[i].Call = call;
+        Slowest[i].Name = name;
+        Slowest[i].Ms = ms;
+    }
+};
+
+
+// Install and the id in the capture's function list for a call wrapper, kept per glad pointer. The wrappers are
+// templates on that pointer so these statics can live in this header
+template <typename Call, typename Pfn, Pfn* SLOT>
+struct GLHooked
+{
+    static int Id;
+    static Pfn Original;
+
+    static void Hook(bool install)
+    {
+        if (install)
+        {
+            Original = *SLOT;
+            *SLOT = &Call::Record;
+        }
+        else if (Original != NULL)
+        {
+            *SLOT = Original;
+        }
+    }
+};
+
+template <typename Call, typename Pfn, Pfn* SLOT>
+int GLHooked<Call, Pfn, SLOT>::Id = -1;
+template <typename Call, typename Pfn, Pfn* SLOT>
+Pfn GLHooked<Call, Pfn, SLOT>::Original = NULL;
+
+// The return value of a call, recorded after it so a replay can map the objects it creates
+template <typename R>
+struct GLResult
+{
+    template <typename Pfn, typename... A>
+    static R Record(GLCapture& capture, Pfn function, A... args)
+    {
+        R result = function(args...);
+        capture.Write(result);
+        return result;
+    }
+
+    template <typename Pfn, typename... A>
+    static void Replay(GLReplayer& replayer, Capture_Argument kind, Pfn function, A... args)
+    {
+        R captured = replayer.Read<R>();
+        replayer.Created(kind, captured, function(args...));
+    }
+};
+
+template <>
+struct GLResult<void>
+{
+    template <typename Pfn, typename... A>
+    static void Record(GLCapture&, Pfn function, A... args)
+    {
+        function(args...);
+    }
+
+    template <typename Pfn, typename... A>
+    static void Replay(GLReplayer&, Capture_Argument, Pfn function, A... args)
+    {
+        function(args...);
+    }
+};
+
+template <typename T>
+struct GLArgument
+{
+    static T Read(GLReplayer& replayer, Capture_Argument kind, size_t)
+    {
+        return replayer.Translate(kind, replayer.Read<T>());
+    }
+};
+
+template <typename T>
+struct GLArgument<T*>
+{
+    static T* Read(GLReplayer& replayer, Capture_Argument kind, size_t index)
+    {
+        uint64_t offset = replayer.Read<uint64_t>();
+        return kind == CAPTURE_OUT ? (T*)replayer.Scratch(index) : (T*)(uintptr_t)offset;
+    }
+};
+
+// A call whose arguments are all values, object names, uniform locations, offsets or results, recorded as passed.
+// ARGS says per argument how a replay translates it, RESULT the same for the return value
+template <typename Pfn, Pfn* SLOT, uint64_t ARGS = 0, Capture_Argument RESULT = CAPTURE_VALUE>
+struct GLCall;
+
+template <typename R, typename... A, R (APIENTRYP* SLOT)(A...), uint64_t ARGS, Capture_Argument RESULT>
+struct GLCall<R (APIENTRYP)(A...), SLOT, ARGS, RESULT> : GLHooked<GLCall<R (APIENTRYP)(A...), SLOT, ARGS, RESULT>, R (APIENTRYP)(A...), SLOT>
+{
+    typedef GLHooked<GLCall<R (APIENTRYP)(A...), SLOT, ARGS, RESULT>, R (APIENTRYP)(A...), SLOT> Hooked;
+
+    static R APIENTRY Record(A... args)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        int order[] = { 0, (capture.Write(args), 0)... };
+        (void)order;
+        return GLResult<R>::Record(capture, Hooked::Original, args...);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        replay(replayer, std::index_sequence_for<A...>());
+    }
+
+private:
+    template <size_t... I>
+    static void replay(GLReplayer& replayer, std::index_sequence<I...>)
+    {
+        // read in a braced list, which is the one place the order of evaluation is fixed
+        std::tuple<A...> args;
+        int order[] = { 0, (std::get<I>(args) = GLArgument<A>::Read(replayer, CaptureArg(ARGS, I), I), 0)... };
+        (void)order;
+        GLResult<R>::Replay(replayer, RESULT, *SLOT, std::get<I>(args)...);
+    }
+};
+
+// glGen*: the names are recorded after the call, the replay generates as many and maps them
+template <PFNGLGENBUFFERSPROC* SLOT, Capture_Argument KIND>
+struct GLGenCall : GLHooked<GLGenCall<SLOT, KIND>, PFNGLGENBUFFERSPROC, SLOT>
+{
+    typedef GLHooked<GLGenCall<SLOT, KIND>, PFNGLGENBUFFERSPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLsizei n, GLuint* names)
+    {
+        Hooked::Original(n, names);
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(n);
+        capture.WriteArray(names, n * sizeof(GLuint));
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLsizei n = replayer.Read<GLsizei>();
+        const GLuint* captured = (const GLuint*)replayer.ReadArray(n * sizeof(GLuint));
+        GLuint* names = (GLuint*)replayer.Scratch(0);
+        (*SLOT)(n, names);
+        for (GLsizei i = 0; i < n; i++)
+            replayer.Created(KIND, captured[i], names[i]);
+    }
+};
+
+template <PFNGLDELETEBUFFERSPROC* SLOT, Capture_Argument KIND>
+struct GLDeleteCall : GLHooked<GLDeleteCall<SLOT, KIND>, PFNGLDELETEBUFFERSPROC, SLOT>
+{
+    typedef GLHooked<GLDeleteCall<SLOT, KIND>, PFNGLDELETEBUFFERSPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLsizei n, const GLuint* names)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(n);
+        capture.WriteArray(names, n * sizeof(GLuint));
+        Hooked::Original(n, names);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLsizei n = replayer.Read<GLsizei>();
+        const GLuint* captured = (const GLuint*)replayer.ReadArray(n * sizeof(GLuint));
+        GLuint* names = (GLuint*)replayer.Scratch(0);
+        for (GLsizei i = 0; i < n; i++)
+            names[i] = replayer.Translate(KIND, captured[i]);
+        (*SLOT)(n, names);
+    }
+};
+
+// glUniform{2,3,4}fv with COMPONENTS floats per element
+template <PFNGLUNIFORM2FVPROC* SLOT, int COMPONENTS>
+struct GLUniformCall : GLHooked<GLUniformCall<SLOT, COMPONENTS>, PFNGLUNIFORM2FVPROC, SLOT>
+{
+    typedef GLHooked<GLUniformCall<SLOT, COMPONENTS>, PFNGLUNIFORM2FVPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLint location, GLsizei count, const GLfloat* value)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(location);
+        capture.Write(count);
+        capture.WriteArray(value, count * COMPONENTS * sizeof(GLfloat));
+        Hooked::Original(location, count, value);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLint location = replayer.Translate(CAPTURE_LOCATION, replayer.Read<GLint>());
+        GLsizei count = replayer.Read<GLsizei>();
+        const GLfloat* value = (const GLfloat*)replayer.ReadArray(count * COMPONENTS * sizeof(GLfloat));
+        (*SLOT)(location, count, value);
+    }
+};
+
+// glUniformMatrix{2,3,4}fv with COMPONENTS floats per matrix
+template <PFNGLUNIFORMMATRIX2FVPROC* SLOT, int COMPONENTS>
+struct GLUniformMatrixCall : GLHooked<GLUniformMatrixCall<SLOT, COMPONENTS>, PFNGLUNIFORMMATRIX2FVPROC, SLOT>
+{
+    typedef GLHooked<GLUniformMatrixCall<SLOT, COMPONENTS>, PFNGLUNIFORMMATRIX2FVPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(location);
+        capture.Write(count);
+        capture.Write(transpose);
+        capture.WriteArray(value, count * COMPONENTS * sizeof(GLfloat));
+        Hooked::Original(location, count, transpose, value);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLint location = replayer.Translate(CAPTURE_LOCATION, replayer.Read<GLint>());
+        GLsizei count = replayer.Read<GLsizei>();
+        GLboolean transpose = replayer.Read<GLboolean>();
+        const GLfloat* value = (const GLfloat*)replayer.ReadArray(count * COMPONENTS * sizeof(GLfloat));
+        (*SLOT)(location, count, transpose, value);
+    }
+};
+
+template <PFNGLBUFFERDATAPROC* SLOT>
+struct GLBufferDataCall : GLHooked<GLBufferDataCall<SLOT>, PFNGLBUFFERDATAPROC, SLOT>
+{
+    typedef GLHooked<GLBufferDataCall<SLOT>, PFNGLBUFFERDATAPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(data, (size_t)size);
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(size);
+        capture.Write(blob);
+        capture.Write(usage);
+        Hooked::Original(target, size, data, usage);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLsizeiptr size = replayer.Read<GLsizeiptr>();
+        uint32_t blob = replayer.Read<uint32_t>();
+        GLenum usage = replayer.Read<GLenum>();
+        const void* data = replayer.Blob(blob, (size_t)size);
+        if (replayer.Failed())
+            return;
+        (*SLOT)(target, size, data, usage);
+    }
+};
+
+template <PFNGLBUFFERSUBDATAPROC* SLOT>
+struct GLBufferSubDataCall : GLHooked<GLBufferSubDataCall<SLOT>, PFNGLBUFFERSUBDATAPROC, SLOT>
+{
+    typedef GLHooked<GLBufferSubDataCall<SLOT>, PFNGLBUFFERSUBDATAPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(data, (size_t)size);
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(offset);
+        capture.Write(size);
+        capture.Write(blob);
+        Hooked::Original(target, offset, size, data);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLintptr offset = replayer.Read<GLintptr>();
+        GLsizeiptr size = replayer.Read<GLsizeiptr>();
+        uint32_t blob = replayer.Read<uint32_t>();
+        const void* data = replayer.Blob(blob, (size_t)size);
+        if (replayer.Failed())
+            return;
+        (*SLOT)(target, offset, size, data);
+    }
+};
+
+template <PFNGLTEXIMAGE2DPROC* SLOT>
+struct GLTexImage2DCall : GLHooked<GLTexImage2DCall<SLOT>, PFNGLTEXIMAGE2DPROC, SLOT>
+{
+    typedef GLHooked<GLTexImage2DCall<SLOT>, PFNGLTEXIMAGE2DPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(pixels, GLImageBytes(width, height, 1, format, type, capture.UnpackAlignment));
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(level);
+        capture.Write(internalformat);
+        capture.Write(width);
+        capture.Write(height);
+        capture.Write(border);
+        capture.Write(format);
+        capture.Write(type);
+        capture.Write(blob);
+        Hooked::Original(target, level, internalformat, width, height, border, format, type, pixels);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLint level = replayer.Read<GLint>();
+        GLint internalformat = replayer.Read<GLint>();
+        GLsizei width = replayer.Read<GLsizei>();
+        GLsizei height = replayer.Read<GLsizei>();
+        GLint border = replayer.Read<GLint>();
+        GLenum format = replayer.Read<GLenum>();
+        GLenum type = replayer.Read<GLenum>();
+        uint32_t blob = replayer.Read<uint32_t>();
+        const void* pixels = replayer.Blob(blob, GLImageBytes(width, height, 1, format, type, replayer.UnpackAlignment));
+        if (replayer.Failed())
+            return;
+        (*SLOT)(target, level, internalformat, width, height, border, format, type, pixels);
+    }
+};
+
+template <PFNGLTEXSUBIMAGE2DPROC* SLOT>
+struct GLTexSubImage2DCall : GLHooked<GLTexSubImage2DCall<SLOT>, PFNGLTEXSUBIMAGE2DPROC, SLOT>
+{
+    typedef GLHooked<GLTexSubImage2DCall<SLOT>, PFNGLTEXSUBIMAGE2DPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(pixels, GLImageBytes(width, height, 1, format, type, capture.UnpackAlignment));
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(level);
+        capture.Write(xoffset);
+        capture.Write(yoffset);
+        capture.Write(width);
+        capture.Write(height);
+        capture.Write(format);
+        capture.Write(type);
+        capture.Write(blob);
+        Hooked::Original(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLint level = replayer.Read<GLint>();
+        GLint xoffset = replayer.Read<GLint>();
+        GLint yoffset = replayer.Read<GLint>();
+        GLsizei width = replayer.Read<GLsizei>();
+        GLsizei height = replayer.Read<GLsizei>();
+        GLenum format = replayer.Read<GLenum>();
+        GLenum type = replayer.Read<GLenum>();
+        uint32_t blob = replayer.Read<uint32_t>();
+        const void* pixels = replayer.Blob(blob, GLImageBytes(width, height, 1, format, type, replayer.UnpackAlignment));
+        if (replayer.Failed())
+            return;
+        (*SLOT)(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    }
+};
+
+template <PFNGLTEXIMAGE3DPROC* SLOT>
+struct GLTexImage3DCall : GLHooked<GLTexImage3DCall<SLOT>, PFNGLTEXIMAGE3DPROC, SLOT>
+{
+    typedef GLHooked<GLTexImage3DCall<SLOT>, PFNGLTEXIMAGE3DPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(pixels, GLImageBytes(width, height, depth, format, type, capture.UnpackAlignment));
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(level);
+        capture.Write(internalformat);
+        capture.Write(width);
+        capture.Write(height);
+        capture.Write(depth);
+        capture.Write(border);
+        capture.Write(format);
+        capture.Write(type);
+        capture.Write(blob);
+        Hooked::Original(target, level, internalformat, width, height, depth, border, format, type, pixels);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLint level = replayer.Read<GLint>();
+        GLint internalformat = replayer.Read<GLint>();
+        GLsizei width = replayer.Read<GLsizei>();
+        GLsizei height = replayer.Read<GLsizei>();
+        GLsizei depth = replayer.Read<GLsizei>();
+        GLint border = replayer.Read<GLint>();
+        GLenum format = replayer.Read<GLenum>();
+        GLenum type = replayer.Read<GLenum>();
+        uint32_t blob = replayer.Read<uint32_t>();
+        const void* pixels = replayer.Blob(blob, GLImageBytes(width, height, depth, format, type, replayer.UnpackAlignment));
+        if (replayer.Failed())
+            return;
+        (*SLOT)(target, level, internalformat, width, height, depth, border, format, type, pixels);
+    }
+};
+
+// recorded as passed, and remembers the unpack alignment to size texture uploads
+template <PFNGLPIXELSTOREIPROC* SLOT>
+struct GLPixelStoreCall : GLHooked<GLPixelStoreCall<SLOT>, PFNGLPIXELSTOREIPROC, SLOT>
+{
+    typedef GLHooked<GLPixelStoreCall<SLOT>, PFNGLPIXELSTOREIPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLenum pname, GLint param)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(pname);
+        capture.Write(param);
+        if (pname == GL_UNPACK_ALIGNMENT)
+            capture.UnpackAlignment = param;
+        Hooked::Original(pname, param);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum pname = replayer.Read<GLenum>();
+        GLint param = replayer.Read<GLint>();
+        // GL keeps the old alignment for any other value
+        if (pname == GL_UNPACK_ALIGNMENT && (param == 1 || param == 2 || param == 4 || param == 8))
+            replayer.UnpackAlignment = param;
+        (*SLOT)(pname, param);
+    }
+};
+
+// the pieces are joined into one string, replayed as a single piece
+template <PFNGLSHADERSOURCEPROC* SLOT>
+struct GLShaderSourceCall : GLHooked<GLShaderSourceCall<SLOT>, PFNGLSHADERSOURCEPROC, SLOT>
+{
+    typedef GLHooked<GLShaderSourceCall<SLOT>, PFNGLSHADERSOURCEPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.Source.clear();
+        for (GLsizei i = 0; i < count; i++)
+            capture.Source.append(string[i], length != NULL && length[i] >= 0 ? (size_t)length[i] : std::strlen(string[i]));
+        uint32_t blob = capture.Blob(capture.Source.data(), capture.Source.size());
+        capture.BeginCall(Hooked::Id);
+        capture.Write(shader);
+        capture.Write(blob);
+        Hooked::Original(shader, count, string, length);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLuint shader = replayer.Translate(CAPTURE_PROGRAM, replayer.Read<GLuint>());
+        size_t bytes = 0;
+        const GLchar* source = (const GLchar*)replayer.Blob(replayer.Read<uint32_t>(), &bytes);
+        GLint length = (GLint)bytes;
+        (*SLOT)(shader, 1, &source, &length);
+    }
+};
+
+template <PFNGLDRAWBUFFERSPROC* SLOT>
+struct GLDrawBuffersCall : GLHooked<GLDrawBuffersCall<SLOT>, PFNGLDRAWBUFFERSPROC, SLOT>
+{
+    typedef GLHooked<GLDrawBuffersCall<SLOT>, PFNGLDRAWBUFFERSPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLsizei n, const GLenum* bufs)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(n);
+        capture.WriteArray(bufs, n * sizeof(GLenum));
+        Hooked::Original(n, bufs);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLsizei n = replayer.Read<GLsizei>();
+        const GLenum* bufs = (const GLenum*)replayer.ReadArray(n * sizeof(GLenum));
+        (*SLOT)(n, bufs);
+    }
+};
+
+// the location is recorded after the call, so the replay can map it per program
+template <PFNGLGETUNIFORMLOCATIONPROC* SLOT>
+struct GLUniformLocationCall : GLHooked<GLUniformLocationCall<SLOT>, PFNGLGETUNIFORMLOCATIONPROC, SLOT>
+{
+    typedef GLHooked<GLUniformLocationCall<SLOT>, PFNGLGETUNIFORMLOCATIONPROC, SLOT> Hooked;
+
+    static GLint APIENTRY Record(GLuint program, const GLchar* name)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Blob(name, std::strlen(name) + 1);
+        capture.BeginCall(Hooked::Id);
+        capture.Write(program);
+        capture.Write(blob);
+        GLint location = Hooked::Original(program, name);
+        capture.Write(location);
+        return location;
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLuint program = replayer.Read<GLuint>();
+        size_t bytes = 0;
+        const GLchar* name = (const GLchar*)replayer.Blob(replayer.Read<uint32_t>(), &bytes);
+        GLint captured = replayer.Read<GLint>();
+        // recorded with its terminator, GL would read on past a name without one
+        if (name == NULL || bytes == 0 || name[bytes - 1] != '\0')
+        {
+            replayer.Fail();
+            return;
+        }
+        replayer.Located(program, captured, (*SLOT)(replayer.Translate(CAPTURE_PROGRAM, program), name));
+    }
+};
+
+template <PFNGLMAPBUFFERRANGEPROC* SLOT>
+struct GLMapBufferRangeCall : GLHooked<GLMapBufferRangeCall<SLOT>, PFNGLMAPBUFFERRANGEPROC, SLOT>
+{
+    typedef GLHooked<GLMapBufferRangeCall<SLOT>, PFNGLMAPBUFFERRANGEPROC, SLOT> Hooked;
+
+    static void* APIENTRY Record(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(offset);
+        capture.Write(length);
+        capture.Write(access);
+        void* pointer = Hooked::Original(target, offset, length, access);
+        capture.Mapped(target, pointer, length, access);
+        return pointer;
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        GLintptr offset = replayer.Read<GLintptr>();
+        GLsizeiptr length = replayer.Read<GLsizeiptr>();
+        GLbitfield access = replayer.Read<GLbitfield>();
+        replayer.Mapped(target, (*SLOT)(target, offset, length, access), (size_t)length);
+    }
+};
+
+// what the application wrote into the mapping is recorded here and copied in before the replay unmaps, so the
+// replayed unmap includes that copy
+template <PFNGLUNMAPBUFFERPROC* SLOT>
+struct GLUnmapBufferCall : GLHooked<GLUnmapBufferCall<SLOT>, PFNGLUNMAPBUFFERPROC, SLOT>
+{
+    typedef GLHooked<GLUnmapBufferCall<SLOT>, PFNGLUNMAPBUFFERPROC, SLOT> Hooked;
+
+    static GLboolean APIENTRY Record(GLenum target)
+    {
+        GLCapture& capture = GetGLCapture();
+        uint32_t blob = capture.Unmapped(target);
+        capture.BeginCall(Hooked::Id);
+        capture.Write(target);
+        capture.Write(blob);
+        return Hooked::Original(target);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLenum target = replayer.Read<GLenum>();
+        size_t bytes = 0;
+        const void* written = replayer.Blob(replayer.Read<uint32_t>(), &bytes);
+        size_t length = 0;
+        void* pointer = replayer.Unmapped(target, &length);
+        if (pointer != NULL && written != NULL)
+            std::memcpy(pointer, written, std::min(bytes, length));
+        (*SLOT)(target);
+    }
+};
+
+template <PFNGLREADPIXELSPROC* SLOT>
+struct GLReadPixelsCall : GLHooked<GLReadPixelsCall<SLOT>, PFNGLREADPIXELSPROC, SLOT>
+{
+    typedef GLHooked<GLReadPixelsCall<SLOT>, PFNGLREADPIXELSPROC, SLOT> Hooked;
+
+    static void APIENTRY Record(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
+    {
+        GLCapture& capture = GetGLCapture();
+        capture.BeginCall(Hooked::Id);
+        capture.Write(x);
+        capture.Write(y);
+        capture.Write(width);
+        capture.Write(height);
+        capture.Write(format);
+        capture.Write(type);
+        Hooked::Original(x, y, width, height, format, type, pixels);
+    }
+
+    static void Replay(GLReplayer& replayer)
+    {
+        GLint x = replayer.Read<GLint>();
+        GLint y = replayer.Read<GLint>();
+        GLsizei width = replayer.Read<GLsizei>();
+        GLsizei height = replayer.Read<GLsizei>();
+        GLenum format = replayer.Read<GLenum>();
+        GLenum type = replayer.Read<GLenum>();
+        // the largest pack alignment GL allows, whatever the capture set
+        (*SLOT)(x, y, width, height, format, type, replayer.Pixels(GLImageBytes(width, height, 1, format, type, 8)));
+    }
+};
+
+
+template <typename Call>
+void addCapturedFunction(std::vector<GLCapturedFunction>& functions, const char* name)
+{
+    Call::Id = (int)functions.size();
+    functions.push_back({ name, &Call::Hook, &Call::Replay });
+}
+
+// the type and address of a glad function pointer, as the call wrappers take them
+#define GL_CAPTURED(name) decltype(glad_##name), &glad_##name
+
+// Every GL function the engine calls. One missing here still works, but is neither captured nor replayed
+inline std::vector<GLCapturedFunction> createCapturedFunctions()
+{
+    const Capture_Argument value = CAPTURE_VALUE, out = CAPTURE_OUT, program = CAPTURE_PROGRAM;
+    std::vector<GLCapturedFunction> functions;
+    addCapturedFunction<GLCall<GL_CAPTURED(glActiveTexture)>>(functions, "glActiveTexture");
+    addCapturedFunction<GLCall<GL_CAPTURED(glAttachShader), CaptureArgs(program, program)>>(functions, "glAttachShader");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBeginQuery), CaptureArgs(value, CAPTURE_QUERY)>>(functions, "glBeginQuery");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBindBuffer), CaptureArgs(value, CAPTURE_BUFFER)>>(functions, "glBindBuffer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBindFramebuffer), CaptureArgs(value, CAPTURE_FRAMEBUFFER)>>(functions, "glBindFramebuffer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBindRenderbuffer), CaptureArgs(value, CAPTURE_RENDERBUFFER)>>(functions, "glBindRenderbuffer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBindTexture), CaptureArgs(value, CAPTURE_TEXTURE)>>(functions, "glBindTexture");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBindVertexArray), CaptureArgs(CAPTURE_VERTEX_ARRAY)>>(functions, "glBindVertexArray");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBlendFunc)>>(functions, "glBlendFunc");
+    addCapturedFunction<GLCall<GL_CAPTURED(glBlitFramebuffer)>>(functions, "glBlitFramebuffer");
+    addCapturedFunction<GLBufferDataCall<&glad_glBufferData>>(functions, "glBufferData");
+    addCapturedFunction<GLBufferSubDataCall<&glad_glBufferSubData>>(functions, "glBufferSubData");
+    addCapturedFunction<GLCall<GL_CAPTURED(glCheckFramebufferStatus)>>(functions, "glCheckFramebufferStatus");
+    addCapturedFunction<GLCall<GL_CAPTURED(glClear)>>(functions, "glClear");
+    addCapturedFunction<GLCall<GL_CAPTURED(glClearColor)>>(functions, "glClearColor");
+    addCapturedFunction<GLCall<GL_CAPTURED(glColorMask)>>(functions, "glColorMask");
+    addCapturedFunction<GLCall<GL_CAPTURED(glCompileShader), CaptureArgs(program)>>(functions, "glCompileShader");
+    addCapturedFunction<GLCall<GL_CAPTURED(glCreateProgram), CaptureArgs(), program>>(functions, "glCreateProgram");
+    addCapturedFunction<GLCall<GL_CAPTURED(glCreateShader), CaptureArgs(), program>>(functions, "glCreateShader");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteBuffers, CAPTURE_BUFFER>>(functions, "glDeleteBuffers");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteFramebuffers, CAPTURE_FRAMEBUFFER>>(functions, "glDeleteFramebuffers");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteQueries, CAPTURE_QUERY>>(functions, "glDeleteQueries");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteRenderbuffers, CAPTURE_RENDERBUFFER>>(functions, "glDeleteRenderbuffers");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDeleteShader), CaptureArgs(program)>>(functions, "glDeleteShader");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteTextures, CAPTURE_TEXTURE>>(functions, "glDeleteTextures");
+    addCapturedFunction<GLDeleteCall<&glad_glDeleteVertexArrays, CAPTURE_VERTEX_ARRAY>>(functions, "glDeleteVertexArrays");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDepthFunc)>>(functions, "glDepthFunc");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDepthMask)>>(functions, "glDepthMask");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDisable)>>(functions, "glDisable");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawArrays)>>(functions, "glDrawArrays");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawArraysInstanced)>>(functions, "glDrawArraysInstanced");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawBuffer)>>(functions, "glDrawBuffer");
+    addCapturedFunction<GLDrawBuffersCall<&glad_glDrawBuffers>>(functions, "glDrawBuffers");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawElements)>>(functions, "glDrawElements");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawElementsBaseVertex)>>(functions, "glDrawElementsBaseVertex");
+    addCapturedFunction<GLCall<GL_CAPTURED(glDrawElementsInstanced)>>(functions, "glDrawElementsInstanced");
+    addCapturedFunction<GLCall<GL_CAPTURED(glEnable)>>(functions, "glEnable");
+    addCapturedFunction<GLCall<GL_CAPTURED(glEnableVertexAttribArray)>>(functions, "glEnableVertexAttribArray");
+    addCapturedFunction<GLCall<GL_CAPTURED(glEndQuery)>>(functions, "glEndQuery");
+    addCapturedFunction<GLCall<GL_CAPTURED(glFramebufferRenderbuffer), CaptureArgs(value, value, value, CAPTURE_RENDERBUFFER)>>(functions, "glFramebufferRenderbuffer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glFramebufferTexture2D), CaptureArgs(value, value, value, CAPTURE_TEXTURE)>>(functions, "glFramebufferTexture2D");
+    addCapturedFunction<GLCall<GL_CAPTURED(glFramebufferTextureLayer), CaptureArgs(value, value, CAPTURE_TEXTURE)>>(functions, "glFramebufferTextureLayer");
+    addCapturedFunction<GLGenCall<&glad_glGenBuffers, CAPTURE_BUFFER>>(functions, "glGenBuffers");
+    addCapturedFunction<GLGenCall<&glad_glGenFramebuffers, CAPTURE_FRAMEBUFFER>>(functions, "glGenFramebuffers");
+    addCapturedFunction<GLGenCall<&glad_glGenQueries, CAPTURE_QUERY>>(functions, "glGenQueries");
+    addCapturedFunction<GLGenCall<&glad_glGenRenderbuffers, CAPTURE_RENDERBUFFER>>(functions, "glGenRenderbuffers");
+    addCapturedFunction<GLGenCall<&glad_glGenTextures, CAPTURE_TEXTURE>>(functions, "glGenTextures");
+    addCapturedFunction<GLGenCall<&glad_glGenVertexArrays, CAPTURE_VERTEX_ARRAY>>(functions, "glGenVertexArrays");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGenerateMipmap)>>(functions, "glGenerateMipmap");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetIntegerv), CaptureArgs(value, out)>>(functions, "glGetIntegerv");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetProgramInfoLog), CaptureArgs(program, value, out, out)>>(functions, "glGetProgramInfoLog");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetProgramiv), CaptureArgs(program, value, out)>>(functions, "glGetProgramiv");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetQueryObjectui64v), CaptureArgs(CAPTURE_QUERY, value, out)>>(functions, "glGetQueryObjectui64v");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetShaderInfoLog), CaptureArgs(program, value, out, out)>>(functions, "glGetShaderInfoLog");
+    addCapturedFunction<GLCall<GL_CAPTURED(glGetShaderiv), CaptureArgs(program, value, out)>>(functions, "glGetShaderiv");
+    addCapturedFunction<GLUniformLocationCall<&glad_glGetUniformLocation>>(functions, "glGetUniformLocation");
+    addCapturedFunction<GLCall<GL_CAPTURED(glIsEnabled)>>(functions, "glIsEnabled");
+    addCapturedFunction<GLCall<GL_CAPTURED(glLinkProgram), CaptureArgs(program)>>(functions, "glLinkProgram");
+    addCapturedFunction<GLMapBufferRangeCall<&glad_glMapBufferRange>>(functions, "glMapBufferRange");
+    addCapturedFunction<GLPixelStoreCall<&glad_glPixelStorei>>(functions, "glPixelStorei");
+    addCapturedFunction<GLCall<GL_CAPTURED(glPolygonMode)>>(functions, "glPolygonMode");
+    addCapturedFunction<GLCall<GL_CAPTURED(glPolygonOffset)>>(functions, "glPolygonOffset");
+    addCapturedFunction<GLCall<GL_CAPTURED(glReadBuffer)>>(functions, "glReadBuffer");
+    addCapturedFunction<GLReadPixelsCall<&glad_glReadPixels>>(functions, "glReadPixels");
+    addCapturedFunction<GLCall<GL_CAPTURED(glRenderbufferStorage)>>(functions, "glRenderbufferStorage");
+    addCapturedFunction<GLShaderSourceCall<&glad_glShaderSource>>(functions, "glShaderSource");
+    addCapturedFunction<GLCall<GL_CAPTURED(glTexBuffer), CaptureArgs(value, value, CAPTURE_BUFFER)>>(functions, "glTexBuffer");
+    addCapturedFunction<GLTexImage2DCall<&glad_glTexImage2D>>(functions, "glTexImage2D");
+    addCapturedFunction<GLTexImage3DCall<&glad_glTexImage3D>>(functions, "glTexImage3D");
+    addCapturedFunction<GLCall<GL_CAPTURED(glTexParameteri)>>(functions, "glTexParameteri");
+    addCapturedFunction<GLTexSubImage2DCall<&glad_glTexSubImage2D>>(functions, "glTexSubImage2D");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUniform1f), CaptureArgs(CAPTURE_LOCATION)>>(functions, "glUniform1f");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUniform1i), CaptureArgs(CAPTURE_LOCATION)>>(functions, "glUniform1i");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUniform2f), CaptureArgs(CAPTURE_LOCATION)>>(functions, "glUniform2f");
+    addCapturedFunction<GLUniformCall<&glad_glUniform2fv, 2>>(functions, "glUniform2fv");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUniform3f), CaptureArgs(CAPTURE_LOCATION)>>(functions, "glUniform3f");
+    addCapturedFunction<GLUniformCall<&glad_glUniform3fv, 3>>(functions, "glUniform3fv");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUniform4f), CaptureArgs(CAPTURE_LOCATION)>>(functions, "glUniform4f");
+    addCapturedFunction<GLUniformCall<&glad_glUniform4fv, 4>>(functions, "glUniform4fv");
+    addCapturedFunction<GLUniformMatrixCall<&glad_glUniformMatrix2fv, 4>>(functions, "glUniformMatrix2fv");
+    addCapturedFunction<GLUniformMatrixCall<&glad_glUniformMatrix3fv, 9>>(functions, "glUniformMatrix3fv");
+    addCapturedFunction<GLUniformMatrixCall<&glad_glUniformMatrix4fv, 16>>(functions, "glUniformMatrix4fv");
+    addCapturedFunction<GLUnmapBufferCall<&glad_glUnmapBuffer>>(functions, "glUnmapBuffer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glUseProgram), CaptureArgs(CAPTURE_USE_PROGRAM)>>(functions, "glUseProgram");
+    addCapturedFunction<GLCall<GL_CAPTURED(glVertexAttrib2f)>>(functions, "glVertexAttrib2f");
+    addCapturedFunction<GLCall<GL_CAPTURED(glVertexAttrib3f)>>(functions, "glVertexAttrib3f");
+    addCapturedFunction<GLCall<GL_CAPTURED(glVertexAttribDivisor)>>(functions, "glVertexAttribDivisor");
+    addCapturedFunction<GLCall<GL_CAPTURED(glVertexAttribIPointer)>>(functions, "glVertexAttribIPointer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glVertexAttribPointer)>>(functions, "glVertexAttribPointer");
+    addCapturedFunction<GLCall<GL_CAPTURED(glViewport)>>(functions, "glViewport");
+    return functions;
+}
+
+#undef GL_CAPTURED
+
+inline const std::vector<GLCapturedFunction>& GLCapturedFunctions()
+{
+    static const std::vector<GLCapturedFunction> functions = createCapturedFunctions();
+    return functions;
+}
+
+
+inline bool GLCapture::Begin(const std::string& capturePath, int captureFirstFrame, int frameCount, int width, int height)
+{
+    End();
+    file.open(capturePath, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open GL capture \"" << capturePath << "\"" << std::endl;
+        return false;
+    }
+    path = capturePath;
+    frame = 0;
+    firstFrame = std::max(0, captureFirstFrame);
+    lastFrame = firstFrame + std::max(1, frameCount);
+    written = 0;
+    calls = 0;
+    blobBytes = 0;
+    sharedBlobBytes = 0;
+    blobs.clear();
+    blobCount = 0;
+    mappings.clear();
+    UnpackAlignment = 4;
+    buffer.clear();
+    buffer.reserve(GL_CAPTURE_FLUSH_BYTES);
+
+    const std::vector<GLCapturedFunction>& functions = GLCapturedFunctions();
+    buffer.insert(buffer.end(), GL_CAPTURE_MAGIC, GL_CAPTURE_MAGIC + sizeof(GL_CAPTURE_MAGIC));
+    Write((int32_t)width);
+    Write((int32_t)height);
+    Write((int32_t)firstFrame);
+    Write((int32_t)(lastFrame - firstFrame));
+    Write((uint32_t)functions.size());
+    for (const GLCapturedFunction& function : functions)
+    {
+        uint8_t length = (uint8_t)std::strlen(function.Name);
+        Write(length);
+        buffer.insert(buffer.end(), function.Name, function.Name + length);
+    }
+    for (const GLCapturedFunction& function : functions)
+        function.Hook(true);
+    std::cout << "Capturing GL calls into \"" << path << "\", frames " << firstFrame << " to " << lastFrame - 1 << " timed on replay" << std::endl;
+    return true;
+}
+
+inline void GLCapture::End()
+{
+    if (!Active())
+        return;
+    for (const GLCapturedFunction& function : GLCapturedFunctions())
+        function.Hook(false);
+    Write(GL_RECORD_END);
+    flush();
+    file.close();
+    std::cout << "GL capture \"" << path << "\": " << frame << " frames, " << calls << " calls, " << written / 1024 << " KiB with "
+        << blobBytes / 1024 << " KiB of data, " << sharedBlobBytes / 1024 << " KiB more written again unchanged and stored once" << std::endl;
+}
+
+
+inline bool GLReplayer::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        std::cerr << "Failed to open GL capture \"" << path << "\"" << std::endl;
+        return false;
+    }
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    FileBytes = data.size();
+    cursor = data.data();
+    end = data.data() + data.size();
+    failed = false;
+    if (data.size() < sizeof(GL_CAPTURE_MAGIC) || std::memcmp(cursor, GL_CAPTURE_MAGIC, sizeof(GL_CAPTURE_MAGIC)) != 0)
+    {
+        std::cerr << "\"" << path << "\" is not a GL capture" << std::endl;
+        return false;
+    }
+    cursor += sizeof(GL_CAPTURE_MAGIC);
+    Width = Read<int32_t>();
+    Height = Read<int32_t>();
+    FirstFrame = Read<int32_t>();
+    FrameCount = Read<int32_t>();
+
+    // functions are matched by name, so a capture stays readable when the list above changes
+    const std::vector<GLCapturedFunction>& known = GLCapturedFunctions();
+    uint32_t count = Read<uint32_t>();
+    functions.assign(count, NULL);
+    Functions.assign(count, FunctionTiming());
+    for (uint32_t i = 0; i < count && !failed; i++)
+    {
+        uint8_t length = Read<uint8_t>();
+        if (cursor + length > end)
+        {
+            failed = true;
+            break;
+        }
+        std::string name(cursor, length);
+        cursor += length;
+        for (const GLCapturedFunction& function : known)
+        {
+            if (name == function.Name)
+            {
+                functions[i] = &function;
+                Functions[i].Name = function.Name;
+            }
+        }
+        if (functions[i] == NULL)
+        {
+            std::cerr << "GL capture \"" << path << "\" calls " << name << ", which this build does not replay" << std::endl;
+            return false;
+        }
+    }
+    if (failed || Width <= 0 || Height <= 0)
+    {
+        std::cerr << "GL capture \"" << path << "\" has a broken header" << std::endl;
+        return false;
+    }
+    stream = cursor;
+    scratch.assign(GL_REPLAY_MAX_ARGUMENTS * GL_REPLAY_SCRATCH_BYTES, 0);
+    return true;
+}
+
+inline bool GLReplayer::Run()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    cursor = stream;
+    failed = false;
+    blobs.clear();
+    for (std::vector<GLuint>& table : names)
+        table.clear();
+    locations.clear();
+    mapped.clear();
+    currentProgram = 0;
+    UnpackAlignment = 4;
+    SubmitMs.clear();
+    FinishMs.clear();
+    for (FunctionTiming& timing : Functions)
+    {
+        timing.Calls = 0;
+        timing.Ms = timing.MaxMs = 0.0;
+    }
+    for (CallTiming& timing : Slowest)
+        timing = CallTiming();
+    Calls = SetupCalls = Errors = 0;
+
+    int frame = 0;
+    uint64_t call = 0;
+    Clock::time_point frameStart = Clock::now();
+    while (!failed)
+    {
+        uint16_t id = Read<uint16_t>();
+        if (failed || id == GL_RECORD_END)
+            break;
+        if (id == GL_RECORD_BLOB)
+        {
+            uint64_t bytes = Read<uint64_t>();
+            align(8);
+            if (cursor + bytes > end)
+            {
+                failed = true;
+                break;
+            }
+            blobs.push_back(std::make_pair(cursor, (size_t)bytes));
+            cursor += bytes;
+            continue;
+        }
+        if (id == GL_RECORD_FRAME)
+        {
+            if (frame >= FirstFrame)
+            {
+                Clock::time_point submitted = Clock::now();
+                glFinish();
+                SubmitMs.push_back(std::chrono::duration<double, std::milli>(submitted - frameStart).count());
+                FinishMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - submitted).count());
+            }
+            for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError())
+                Errors++;
+            frame++;
+            call = 0;
+            frameStart = Clock::now();
+            continue;
+        }
+        if (id >= functions.size())
+        {
+            failed = true;
+            break;
+        }
+
+        if (frame < FirstFrame)
+        {
+            functions[id]->Replay(*this);
+            SetupCalls++;
+        }
+        else if (!CallTimings)
+        {
+            functions[id]->Replay(*this);
+            Calls++;
+        }
+        else
+        {
+            Clock::time_point start = Clock::now();
+            functions[id]->Replay(*this);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            FunctionTiming& timing = Functions[id];
+            timing.Calls++;
+            timing.Ms += ms;
+            timing.MaxMs = std::max(timing.MaxMs, ms);
+            recordSlowest(frame, call, timing.Name, ms);
+            Calls++;
+        }
+        call++;
+    }
+    if (failed)
+    {
+        std::cerr << "GL capture is cut off or broken in frame " << frame << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+// Settings of --replay
+struct ReplayOptions
+{
+    std::string CapturePath;
+    std::string OutputPath; // JSON goes to stdout when empty
+    // time every call on its own. Off, the frame times are free of the two clock reads per call
+    bool CallTimings = true;
+};
+
+// Returns true if --replay was passed, in which case options holds the parsed settings
+inline bool ParseReplayOptions(int argc, char const *argv[], ReplayOptions& options)
+{
+    bool replay = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--replay" && hasValue)
+        {
+            replay = true;
+            options.CapturePath = argv[++i];
+        }
+        else if (arg == "--out" && hasValue) options.OutputPath = argv[++i];
+        else if (arg == "--no-call-timings") options.CallTimings = false;
+    }
+    return replay;
+}
+
+inline void WriteReplayJson(std::ostream& out, const ReplayOptions& options, const GLReplayer& replayer)
+{
+    auto percentiles = [&out](const char* name, const std::vector<double>& values)
+    {
+        double sum = 0.0;
+        for (double v : values)
+            sum += v;
+        out << "    \"" << name << "\": { \"mean\": " << (values.empty() ? 0.0 : sum / values.size())
+            << ", \"p50\": " << FrameTimings::Percentile(values, 50.0)
+            << ", \"p90\": " << FrameTimings::Percentile(values, 90.0)
+            << ", \"p99\": " << FrameTimings::Percentile(values, 99.0)
+            << ", \"max\": " << FrameTimings::Percentile(values, 100.0) << " }";
+    };
+
+    std::vector<double> totalMs(replayer.SubmitMs.size());
+    for (size_t i = 0; i < totalMs.size(); i++)
+        totalMs[i] = replayer.SubmitMs[i] + replayer.FinishMs[i];
+    out << "{\n";
+    out << "  \"capture\": { \"path\": \"" << options.CapturePath << "\", \"bytes\": " << replayer.FileBytes
+        << ", \"width\": " << replayer.Width << ", \"height\": " << replayer.Height
+        << ", \"first_frame\": " << replayer.FirstFrame << ", \"frames\": " << replayer.SubmitMs.size()
+        << ", \"setup_calls\": " << replayer.SetupCalls << ", \"calls\": " << replayer.Calls << " },\n";
+    out << "  \"call_timings\": " << (replayer.CallTimings ? "true" : "false") << ",\n";
+    out << "  \"gl_errors\": " << replayer.Errors << ",\n";
+    out << "  \"frame_time_ms\": {\n";
+    percentiles("submit", replayer.SubmitMs);
+    out << ",\n";
+    percentiles("finish", replayer.FinishMs);
+    out << ",\n";
+    percentiles("total", totalMs);
+    out << "\n  },\n";
+
+    // most expensive first, functions the captured frames never call are left out
+    std::vector<const GLReplayer::FunctionTiming*> functions;
+    for (const GLReplayer::FunctionTiming& timing : replayer.Functions)
+    {
+        if (timing.Calls > 0)
+            functions.push_back(&timing);
+    }
+    std::sort(functions.begin(), functions.end(), [](const GLReplayer::FunctionTiming* a, const GLReplayer::FunctionTiming* b) { return a->Ms > b->Ms; });
+    const double frames = std::max<size_t>(1, replayer.SubmitMs.size());
+    out << "  \"functions\": [";
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        const GLReplayer::FunctionTiming& timing = *functions[i];
+        out << (i > 0 ? ",\n" : "\n") << "    { \"name\": \"" << timing.Name << "\", \"calls_per_frame\": " << timing.Calls / frames
+            << ", \"ms_per_frame\": " << timing.Ms / frames << ", \"mean_us\": " << timing.Ms * 1000.0 / timing.Calls
+            << ", \"max_us\": " << timing.MaxMs * 1000.0 << " }";
+    }
+    out << "\n  ],\n";
+    out << "  \"slowest_calls\": [";
+    for (int i = 0; i < GL_REPLAY_SLOWEST_CALLS && replayer.Slowest[i].Name != NULL; i++)
+    {
+        const GLReplayer::CallTiming& timing = replayer.Slowest[i];
+        out << (i > 0 ? ",\n" : "\n") << "    { \"frame\": " << timing.Frame << ", \"call\": " << timing.Call
+            << ", \"name\": \"" << timing.Name << "\", \"us\": " << timing.Ms * 1000.0 << " }";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
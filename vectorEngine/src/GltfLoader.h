@@ -0,0 +1,715 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <stb/stb_image.h>
+
+#include "AssetArchive.h"
+#include "ClusteredLighting.h"
+#include "Json.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// GLB container, little endian: a 12 byte header, then a JSON chunk and an optional binary chunk, each with an
+// 8 byte chunk header and 4 byte aligned
+const uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+const uint32_t GLB_VERSION = 2;
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+// buffer views closer than this in the binary chunk share one GL buffer, the gap is uploaded with them
+const uint64_t GLTF_MERGE_GAP = 64 * 1024;
+
+// Attribute locations in vMesh.glsl
+const unsigned int MESH_POSITION_LOCATION = 0;
+const unsigned int MESH_NORMAL_LOCATION = 1;
+const unsigned int MESH_TEXCOORD_LOCATION = 2;
+
+// One glTF primitive, ready to draw
+struct GltfPrimitive
+{
+    unsigned int VAO = 0;
+    GLenum Mode = GL_TRIANGLES;
+    // index count, or vertex count when IndexType is 0
+    GLsizei Count = 0;
+    GLenum IndexType = 0;
+    size_t IndexOffset = 0;
+    int Material = -1;
+    bool HasNormals = false;
+    bool HasTexCoords = false;
+};
+
+struct GltfMesh
+{
+    int FirstPrimitive = 0;
+    int PrimitiveCount = 0;
+};
+
+// Metallic-roughness material, the base color factor is baked into a 1x1 texture when there is no texture
+struct GltfMaterial
+{
+    unsigned int Texture = 0;
+    float Roughness = 1.0f;
+    float Metalness = 1.0f;
+};
+
+// A mesh placed by the node hierarchy of the default scene
+struct GltfDraw
+{
+    int Mesh = 0;
+    glm::mat4 World = glm::mat4(1.0f);
+};
+
+struct GltfLoadStats
+{
+    uint64_t FileBytes = 0;
+    // bytes handed to glBufferData, includes the gaps of merged views
+    uint64_t UploadedBytes = 0;
+    int BufferViews = 0;
+    int Buffers = 0;
+    int VertexArrays = 0;
+    double ParseMs = 0.0;
+    double UploadMs = 0.0;
+    double TextureMs = 0.0;
+};
+
+
+// Static geometry from a binary glTF 2.0 (.glb) file. The file is memory mapped, or used in place when it is
+// stored in the asset archive, the JSON chunk is parsed once into a flat document, and vertex and index data go
+// straight from the mapped binary chunk into GL buffers: accessors become glVertexAttribPointer layouts over the
+// buffer views as they are, with no conversion or intermediate copy. Buffer views used by geometry that lie close
+// together are merged into one GL buffer, accessors sharing a view share its buffer, and primitives with the same
+// attributes and indices share a VAO. Embedded PNG/JPEG images are decoded from the mapping as well.
+// Not supported: external or data URI buffers and images, sparse accessors, skins, morph targets and animation
+class GltfModel
+{
+public:
+    // with fShader.glsl for forward shading, and with fGBuffer.glsl for the deferred geometry pass
+    Shader ForwardShader;
+    Shader GeometryShader;
+    std::vector<GltfPrimitive> Primitives;
+    std::vector<GltfMesh> Meshes;
+    std::vector<GltfMaterial> Materials;
+    std::vector<GltfDraw> Draws;
+    // world space bounds of all draws
+    glm::vec3 BoundsMin = glm::vec3(0.0f);
+    glm::vec3 BoundsMax = glm::vec3(0.0f);
+    GltfLoadStats Stats;
+
+    GltfModel()
+        : ForwardShader("src/vMesh.glsl", "src/fShader.glsl"), GeometryShader("src/vMesh.glsl", "src/fGBuffer.glsl")
+    {
+        Shader* shaders[] = { &ForwardShader, &GeometryShader };
+        for (Shader* shader : shaders)
+        {
+            // there is one base color texture, sampled by both material slots
+            shader->use();
+            shader->setInt("texture1", 0);
+            shader->setInt("texture2", 0);
+        }
+        ForwardShader.use();
+        LightClusters::SetSamplerUnits(ForwardShader);
+    }
+
+    ~GltfModel() { release(); }
+
+    GltfModel(const GltfModel&) = delete;
+    GltfModel& operator=(const GltfModel&) = delete;
+
+    bool Load(const std::string& path)
+    {
+        release();
+        Stats = GltfLoadStats();
+        MappedFile file;
+        AssetData asset;
+        if (!GetAssetArchive().Find(path, asset))
+        {
+            if (!file.Open(path))
+            {
+                std::cout << "ERROR::GLTF:: Failed to map \"" << path << "\"" << std::endl;
+                return false;
+            }
+            asset.Data = file.Data();
+            asset.Size = (size_t)file.Size();
+        }
+        Stats.FileBytes = asset.Size;
+        bool loaded = load(asset.Data, asset.Size);
+        if (!loaded)
+        {
+            std::cout << "ERROR::GLTF:: Failed to load \"" << path << "\": " << error << std::endl;
+            release();
+        }
+        return loaded;
+    }
+
+    // Draws every mesh with shader, ForwardShader or GeometryShader, which the caller has bound with its lighting
+    // uniforms set. root places the whole model
+    void Draw(Shader& shader, const glm::mat4& root, const glm::mat4& view, const glm::mat4& projection)
+    {
+        shader.use();
+        shader.setMat4("view", view);
+        shader.setMat4("projection", projection);
+        glActiveTexture(GL_TEXTURE0);
+        int boundMaterial = -2;
+        for (const GltfDraw& draw : Draws)
+        {
+            shader.setMat4("model", root * draw.World);
+            const GltfMesh& mesh = Meshes[draw.Mesh];
+            for (int p = mesh.FirstPrimitive; p < mesh.FirstPrimitive + mesh.PrimitiveCount; p++)
+            {
+                const GltfPrimitive& primitive = Primitives[p];
+                if (primitive.Material != boundMaterial)
+                {
+                    boundMaterial = primitive.Material;
+                    const GltfMaterial& material = boundMaterial >= 0 ? Materials[boundMaterial] : defaultMaterial;
+                    glBindTexture(GL_TEXTURE_2D, material.Texture);
+                    shader.setFloat("roughness", material.Roughness);
+                    shader.setFloat("metalness", material.Metalness);
+                }
+                glBindVertexArray(primitive.VAO);
+                // missing attributes read the current generic value, which isn't part of the VAO
+                if (!primitive.HasNormals)
+                    glVertexAttrib3f(MESH_NORMAL_LOCATION, 0.0f, 1.0f, 0.0f);
+                if (!primitive.HasTexCoords)
+                    glVertexAttrib2f(MESH_TEXCOORD_LOCATION, 0.0f, 0.0f);
+                if (primitive.IndexType != 0)
+                    glDrawElements(primitive.Mode, primitive.Count, primitive.IndexType, (void*)primitive.IndexOffset);
+                else
+                    glDrawArrays(primitive.Mode, 0, primitive.Count);
+                GetRenderStats().CountDraw(primitive.Count);
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+private:
+    struct BufferView
+    {
+        uint64_t Offset = 0;
+        uint64_t Length = 0;
+        int Stride = 0;
+        // the merged GL buffer holding it and where
+        int Buffer = -1;
+        uint64_t BufferOffset = 0;
+    };
+
+    struct Accessor
+    {
+        int View = -1;
+        uint64_t Offset = 0;
+        GLenum ComponentType = GL_FLOAT;
+        bool Normalized = false;
+        int Count = 0;
+        int Components = 1;
+        glm::vec3 Min = glm::vec3(0.0f);
+        glm::vec3 Max = glm::vec3(0.0f);
+        bool HasBounds = false;
+    };
+
+    std::vector<unsigned int> buffers;
+    std::vector<uint64_t> bufferBytes;
+    std::vector<unsigned int> vertexArrays;
+    std::vector<unsigned int> textures;
+    GltfMaterial defaultMaterial;
+    const char* error = "";
+
+    bool fail(const char* message)
+    {
+        error = message;
+        return false;
+    }
+
+    void release()
+    {
+        if (!buffers.empty())
+            glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+        if (!vertexArrays.empty())
+            glDeleteVertexArrays((GLsizei)vertexArrays.size(), vertexArrays.data());
+        if (!textures.empty())
+            glDeleteTextures((GLsizei)textures.size(), textures.data());
+        for (uint64_t bytes : bufferBytes)
+            GetRenderStats().BufferBytes -= bytes;
+        buffers.clear();
+        bufferBytes.clear();
+        vertexArrays.clear();
+        textures.clear();
+        Primitives.clear();
+        Meshes.clear();
+        Materials.clear();
+        Draws.clear();
+        BoundsMin = BoundsMax = glm::vec3(0.0f);
+    }
+
+    static int componentCount(const JsonValue& type)
+    {
+        static const char* names[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+        static const int counts[] = { 1, 2, 3, 4, 4, 9, 16 };
+        for (int i = 0; i < 7; i++)
+        {
+            if (type.Length == std::strlen(names[i]) && std::memcmp(type.String, names[i], type.Length) == 0)
+                return counts[i];
+        }
+        return 0;
+    }
+
+    static int componentSize(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    unsigned int createTexture(const unsigned char* pixels, int width, int height)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GetRenderStats().TextureBytes += (uint64_t)width * height * 4 * 4 / 3;
+        textures.push_back(texture);
+        return texture;
+    }
+
+    unsigned int createColorTexture(const glm::vec4& color)
+    {
+        unsigned char pixel[4];
+        for (int i = 0; i < 4; i++)
+            pixel[i] = (unsigned char)(glm::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+        return createTexture(pixel, 1, 1);
+    }
+
+    bool load(const unsigned char* data, size_t size)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        uint32_t header[3];
+        if (size < sizeof(header) + 8)
+            return fail("too small for a GLB file");
+        std::memcpy(header, data, sizeof(header));
+        if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || header[2] > size)
+            return fail("not a glTF 2.0 binary file");
+        size = header[2];
+
+        uint32_t chunk[2];
+        std::memcpy(chunk, data + 12, sizeof(chunk));
+        if (chunk[1] != GLB_CHUNK_JSON || 20 + (uint64_t)chunk[0] > size)
+            return fail("missing JSON chunk");
+        const char* json = (const char*)data + 20;
+        size_t jsonLength = chunk[0];
+        const unsigned char* bin = NULL;
+        uint64_t binLength = 0;
+        uint64_t next = 20 + (((uint64_t)jsonLength + 3) & ~3ull);
+        if (next + 8 <= size)
+        {
+            std::memcpy(chunk, data + next, sizeof(chunk));
+            if (chunk[1] == GLB_CHUNK_BIN && next + 8 + chunk[0] <= size)
+            {
+                bin = data + next + 8;
+                binLength = chunk[0];
+            }
+        }
+
+        JsonDocument doc;
+        if (!doc.Parse(json, jsonLength))
+            return fail(doc.Error());
+        std::vector<uint32_t> items, members;
+
+        // only the GLB binary chunk can back a buffer
+        int list = doc.Find(0, "buffers");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t buffer : items)
+            {
+                if (doc.Find(buffer, "uri") >= 0)
+                    return fail("external buffers are not supported");
+            }
+            if (items.size() > 1)
+                return fail("only the binary chunk buffer is supported");
+        }
+
+        std::vector<BufferView> views;
+        list = doc.Find(0, "bufferViews");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                BufferView view;
+                view.Offset = (uint64_t)doc.GetNumber(item, "byteOffset", 0.0);
+                view.Length = (uint64_t)doc.GetNumber(item, "byteLength", 0.0);
+                view.Stride = doc.GetInt(item, "byteStride", 0);
+                if (doc.GetInt(item, "buffer", 0) != 0 || view.Offset + view.Length > binLength)
+                    return fail("buffer view outside the binary chunk");
+                views.push_back(view);
+            }
+        }
+
+        std::vector<Accessor> accessors;
+        list = doc.Find(0, "accessors");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                Accessor accessor;
+                accessor.View = doc.GetInt(item, "bufferView", -1);
+                accessor.Offset = (uint64_t)doc.GetNumber(item, "byteOffset", 0.0);
+                accessor.ComponentType = (GLenum)doc.GetInt(item, "componentType", GL_FLOAT);
+                accessor.Normalized = doc.GetBool(item, "normalized", false);
+                accessor.Count = doc.GetInt(item, "count", 0);
+                int type = doc.Find(item, "type");
+                accessor.Components = type >= 0 && doc[type].Type == JSON_STRING ? componentCount(doc[type]) : 0;
+                if (accessor.Components == 0 || componentSize(accessor.ComponentType) == 0)
+                    return fail("accessor with an unknown type");
+                if (doc.Find(item, "sparse") >= 0)
+                    return fail("sparse accessors are not supported");
+                if (accessor.View >= (int)views.size())
+                    return fail("accessor references a missing buffer view");
+                accessor.HasBounds = doc.GetNumbers(item, "min", &accessor.Min[0], 3) == 3 && doc.GetNumbers(item, "max", &accessor.Max[0], 3) == 3;
+                accessors.push_back(accessor);
+            }
+        }
+
+        // primitives, with the accessors each attribute comes from
+        struct PrimitiveSource
+        {
+            int Position, Normal, TexCoord, Indices;
+        };
+        std::vector<PrimitiveSource> sources;
+        list = doc.Find(0, "meshes");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                GltfMesh mesh;
+                mesh.FirstPrimitive = (int)Primitives.size();
+                int primitives = doc.Find(item, "primitives");
+                doc.Children(primitives >= 0 ? (uint32_t)primitives : (uint32_t)doc.Size(), members);
+                for (uint32_t p : members)
+                {
+                    int attributes = doc.Find(p, "attributes");
+                    PrimitiveSource source;
+                    source.Position = doc.GetInt(attributes, "POSITION", -1);
+                    source.Normal = doc.GetInt(attributes, "NORMAL", -1);
+                    source.TexCoord = doc.GetInt(attributes, "TEXCOORD_0", -1);
+                    source.Indices = doc.GetInt(p, "indices", -1);
+                    int used[] = { source.Position, source.Normal, source.TexCoord, source.Indices };
+                    for (int accessor : used)
+                    {
+                        if (accessor >= (int)accessors.size() || (accessor >= 0 && accessors[accessor].View < 0))
+                            return fail("primitive with a missing or unbacked accessor");
+                    }
+                    if (source.Position < 0)
+                        continue;
+                    GltfPrimitive primitive;
+                    primitive.Mode = (GLenum)doc.GetInt(p, "mode", GL_TRIANGLES);
+                    primitive.Material = doc.GetInt(p, "material", -1);
+                    primitive.HasNormals = source.Normal >= 0;
+                    primitive.HasTexCoords = source.TexCoord >= 0;
+                    Primitives.push_back(primitive);
+                    sources.push_back(source);
+                }
+                mesh.PrimitiveCount = (int)Primitives.size() - mesh.FirstPrimitive;
+                Meshes.push_back(mesh);
+            }
+        }
+
+        // nodes of the default scene, parents before children
+        std::vector<glm::mat4> locals;
+        std::vector<int> nodeMeshes;
+        std::vector<std::vector<int>> children;
+        list = doc.Find(0, "nodes");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                float m[16];
+                glm::mat4 local(1.0f);
+                if (doc.GetNumbers(item, "matrix", m, 16) == 16)
+                {
+                    local = glm::make_mat4(m);
+                }
+                else
+                {
+                    float t[3] = { 0.0f, 0.0f, 0.0f }, r[4] = { 0.0f, 0.0f, 0.0f, 1.0f }, s[3] = { 1.0f, 1.0f, 1.0f };
+                    doc.GetNumbers(item, "translation", t, 3);
+                    doc.GetNumbers(item, "rotation", r, 4);
+                    doc.GetNumbers(item, "scale", s, 3);
+                    local = glm::translate(glm::mat4(1.0f), glm::make_vec3(t)) * glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2])) *
+                        glm::scale(glm::mat4(1.0f), glm::make_vec3(s));
+                }
+                locals.push_back(local);
+                nodeMeshes.push_back(doc.GetInt(item, "mesh", -1));
+                children.push_back(std::vector<int>());
+                int childList = doc.Find(item, "children");
+                doc.Children(childList >= 0 ? (uint32_t)childList : (uint32_t)doc.Size(), members);
+                for (uint32_t child : members)
+                    children.back().push_back((int)doc[child].Number);
+            }
+        }
+        std::vector<std::pair<int, glm::mat4>> stack;
+        int scenes = doc.Find(0, "scenes");
+        if (scenes >= 0 && doc[scenes].Count > 0)
+        {
+            doc.Children(scenes, items);
+            uint32_t scene = items[std::min((size_t)std::max(doc.GetInt(0, "scene", 0), 0), items.size() - 1)];
+            int roots = doc.Find(scene, "nodes");
+            doc.Children(roots >= 0 ? (uint32_t)roots : (uint32_t)doc.Size(), members);
+            for (uint32_t root : members)
+                stack.push_back(std::make_pair((int)doc[root].Number, glm::mat4(1.0f)));
+        }
+        else
+        {
+            // no scene, every node that is nobody's child is a root
+            std::vector<bool> isChild(locals.size(), false);
+            for (const std::vector<int>& nodeChildren : children)
+            {
+                for (int child : nodeChildren)
+                {
+                    if (child >= 0 && child < (int)isChild.size())
+                        isChild[child] = true;
+                }
+            }
+            for (int node = 0; node < (int)locals.size(); node++)
+            {
+                if (!isChild[node])
+                    stack.push_back(std::make_pair(node, glm::mat4(1.0f)));
+            }
+        }
+        // a valid glTF hierarchy is a forest, the depth limit only guards against cycles in a broken one
+        size_t visited = 0;
+        while (!stack.empty())
+        {
+            std::pair<int, glm::mat4> entry = stack.back();
+            stack.pop_back();
+            if (entry.first < 0 || entry.first >= (int)locals.size() || ++visited > locals.size() * 4)
+                return fail("invalid node hierarchy");
+            glm::mat4 world = entry.second * locals[entry.first];
+            int mesh = nodeMeshes[entry.first];
+            if (mesh >= 0 && mesh < (int)Meshes.size())
+            {
+                GltfDraw draw;
+                draw.Mesh = mesh;
+                draw.World = world;
+                Draws.push_back(draw);
+            }
+            for (int child : children[entry.first])
+                stack.push_back(std::make_pair(child, world));
+        }
+        Stats.ParseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // geometry views sorted by offset, runs of them closer than the merge gap become one GL buffer
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<int> used;
+        for (const PrimitiveSource& source : sources)
+        {
+            int accessorList[] = { source.Position, source.Normal, source.TexCoord, source.Indices };
+            for (int accessor : accessorList)
+            {
+                if (accessor >= 0)
+                    used.push_back(accessors[accessor].View);
+            }
+        }
+        std::sort(used.begin(), used.end(), [&](int a, int b) { return views[a].Offset < views[b].Offset || (views[a].Offset == views[b].Offset && a < b); });
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+        Stats.BufferViews = (int)used.size();
+        for (size_t first = 0; first < used.size();)
+        {
+            uint64_t begin = views[used[first]].Offset, end = begin + views[used[first]].Length;
+            size_t last = first + 1;
+            while (last < used.size() && views[used[last]].Offset <= end + GLTF_MERGE_GAP)
+            {
+                end = std::max(end, views[used[last]].Offset + views[used[last]].Length);
+                last++;
+            }
+            for (size_t i = first; i < last; i++)
+            {
+                views[used[i]].Buffer = (int)buffers.size();
+                views[used[i]].BufferOffset = views[used[i]].Offset - begin;
+            }
+            // straight from the mapping, the driver's copy is the only one
+            unsigned int buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(end - begin), bin + begin, GL_STATIC_DRAW);
+            buffers.push_back(buffer);
+            bufferBytes.push_back(end - begin);
+            GetRenderStats().BufferBytes += end - begin;
+            Stats.UploadedBytes += end - begin;
+            first = last;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // primitives with the same accessors share a vertex array
+        std::map<std::tuple<int, int, int, int>, unsigned int> arrays;
+        for (size_t p = 0; p < Primitives.size(); p++)
+        {
+            const PrimitiveSource& source = sources[p];
+            GltfPrimitive& primitive = Primitives[p];
+            if (source.Indices >= 0)
+            {
+                const Accessor& indices = accessors[source.Indices];
+                if (indices.Components != 1 || (indices.ComponentType != GL_UNSIGNED_BYTE && indices.ComponentType != GL_UNSIGNED_SHORT && indices.ComponentType != GL_UNSIGNED_INT))
+                    return fail("invalid index accessor");
+                primitive.IndexType = indices.ComponentType;
+                primitive.IndexOffset = (size_t)(views[indices.View].BufferOffset + indices.Offset);
+                primitive.Count = indices.Count;
+            }
+            else
+            {
+                primitive.Count = accessors[source.Position].Count;
+            }
+
+            std::tuple<int, int, int, int> key(source.Position, source.Normal, source.TexCoord, source.Indices >= 0 ? views[accessors[source.Indices].View].Buffer : -1);
+            std::map<std::tuple<int, int, int, int>, unsigned int>::iterator found = arrays.find(key);
+            if (found != arrays.end())
+            {
+                primitive.VAO = found->second;
+                continue;
+            }
+            glGenVertexArrays(1, &primitive.VAO);
+            glBindVertexArray(primitive.VAO);
+            std::pair<int, unsigned int> attributes[] = {
+                std::make_pair(source.Position, MESH_POSITION_LOCATION),
+                std::make_pair(source.Normal, MESH_NORMAL_LOCATION),
+                std::make_pair(source.TexCoord, MESH_TEXCOORD_LOCATION)
+            };
+            for (const std::pair<int, unsigned int>& attribute : attributes)
+            {
+                if (attribute.first < 0)
+                    continue;
+                const Accessor& accessor = accessors[attribute.first];
+                const BufferView& view = views[accessor.View];
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[view.Buffer]);
+                // integer components without normalized stay integer values converted to float, which is what
+                // KHR_mesh_quantization expects
+                glVertexAttribPointer(attribute.second, std::min(accessor.Components, 4), accessor.ComponentType, accessor.Normalized ? GL_TRUE : GL_FALSE,
+                    view.Stride, (void*)(size_t)(view.BufferOffset + accessor.Offset));
+                glEnableVertexAttribArray(attribute.second);
+            }
+            if (source.Indices >= 0)
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[views[accessors[source.Indices].View].Buffer]);
+            vertexArrays.push_back(primitive.VAO);
+            arrays[key] = primitive.VAO;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        Stats.Buffers = (int)buffers.size();
+        Stats.VertexArrays = (int)vertexArrays.size();
+        Stats.UploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // images embedded in buffer views, decoded from the mapping
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<unsigned int> imageTextures;
+        list = doc.Find(0, "images");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                int view = doc.GetInt(item, "bufferView", -1);
+                unsigned int texture = 0;
+                // always expanded to RGBA, uploading grey or grey-alpha as GL_RED or GL_RG would sample as red
+                int width, height, channels;
+                unsigned char* pixels = view >= 0 && view < (int)views.size()
+                    ? stbi_load_from_memory(bin + views[view].Offset, (int)views[view].Length, &width, &height, &channels, 4) : NULL;
+                if (pixels != NULL)
+                {
+                    texture = createTexture(pixels, width, height);
+                    stbi_image_free(pixels);
+                }
+                else
+                {
+                    std::cout << "ERROR::GLTF:: Skipping an image that isn't embedded or can't be decoded" << std::endl;
+                }
+                imageTextures.push_back(texture);
+            }
+        }
+        std::vector<int> textureImages;
+        list = doc.Find(0, "textures");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+                textureImages.push_back(doc.GetInt(item, "source", -1));
+        }
+        list = doc.Find(0, "materials");
+        if (list >= 0)
+        {
+            doc.Children(list, items);
+            for (uint32_t item : items)
+            {
+                GltfMaterial material;
+                int pbr = doc.Find(item, "pbrMetallicRoughness");
+                glm::vec4 baseColor(1.0f);
+                doc.GetNumbers(pbr, "baseColorFactor", &baseColor[0], 4);
+                material.Roughness = (float)doc.GetNumber(pbr, "roughnessFactor", 1.0);
+                material.Metalness = (float)doc.GetNumber(pbr, "metallicFactor", 1.0);
+                int baseTexture = doc.Find(pbr, "baseColorTexture");
+                int texture = baseTexture >= 0 ? doc.GetInt(baseTexture, "index", -1) : -1;
+                int image = texture >= 0 && texture < (int)textureImages.size() ? textureImages[texture] : -1;
+                material.Texture = image >= 0 && image < (int)imageTextures.size() ? imageTextures[image] : 0;
+                if (material.Texture == 0)
+                    material.Texture = createColorTexture(baseColor);
+                Materials.push_back(material);
+            }
+        }
+        for (GltfPrimitive& primitive : Primitives)
+        {
+            if (primitive.Material >= (int)Materials.size())
+                primitive.Material = -1;
+        }
+        defaultMaterial.Texture = createColorTexture(glm::vec4(1.0f));
+        defaultMaterial.Roughness = DEFAULT_ROUGHNESS;
+        defaultMaterial.Metalness = DEFAULT_METALNESS;
+        Stats.TextureMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // bounds from the position accessors' min and max, which glTF requires
+        bool first = true;
+        for (const GltfDraw& draw : Draws)
+        {
+            const GltfMesh& mesh = Meshes[draw.Mesh];
+            for (int p = mesh.FirstPrimitive; p < mesh.FirstPrimitive + mesh.PrimitiveCount; p++)
+            {
+                const Accessor& positions = accessors[sources[p].Position];
+                if (!positions.HasBounds)
+                    continue;
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    glm::vec3 local((corner & 1) ? positions.Max.x : positions.Min.x, (corner & 2) ? positions.Max.y : positions.Min.y, (corner & 4) ? positions.Max.z : positions.Min.z);
+                    glm::vec3 world = glm::vec3(draw.World * glm::vec4(local, 1.0f));
+                    BoundsMin = first ? world : glm::min(BoundsMin, world);
+                    BoundsMax = first ? world : glm::max(BoundsMax, world);
+                    first = false;
+                }
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <glad/glad.h>
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "Camera.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Settings for rendering without a visible window, filled in from the command line
+struct HeadlessOptions
+{
+    int Width = 800;
+    int Height = 600;
+    int Frames = 240;
+    // every GoldenInterval-th frame is read back and compared against GoldenDir/frame_NNNN.ppm. Drivers rasterize
+    // differently enough that the images are not part of the repository: a CI machine records its own once with
+    // --update-golden, from a commit known to be good, keeps GoldenDir between runs and compares every later run
+    int GoldenInterval = 60;
+    std::string GoldenDir = "res/golden";
+    bool UpdateGolden = false;
+    // a frame without a golden image only warns instead of failing the run, for a scene that has none recorded yet
+    bool AllowMissingGolden = false;
+    // per-pixel CIE76 delta E above which a pixel counts as different, and the fraction of such pixels allowed
+    float DeltaEThreshold = 3.0f;
+    float MaxFailFraction = 0.001f;
+    std::string TimingsPath;
+    bool DepthPrepass = false;
+    // reports shaded fragments per pixel on every golden frame
+    bool Overdraw = false;
+    // clustered lights around the scene. Off by default so the golden images stay unlit
+    int LightCount = 0;
+    // G-buffer and deferred lighting instead of the forward shader
+    bool Deferred = false;
+    // sun with cascaded shadow maps
+    bool Shadows = false;
+    // live particles in a fountain among the cubes
+    int ParticleCount = 0;
+    // skinned characters behind the cubes, and whether they are skinned on the CPU instead of in the vertex shader
+    int CharacterCount = 0;
+    bool CpuSkinning = false;
+    // a .glb model drawn among the cubes
+    std::string GltfPath;
+    // an .obj or .ply mesh drawn among the cubes
+    std::string MeshPath;
+    // the cubes fall onto a floor as rigid bodies, one fixed step per frame
+    bool Physics = false;
+    // side in metres of the landscape under the cubes, 0 for none. Its tiles are generated as the frames need them
+    float TerrainSize = 0.0f;
+    // chunk columns along each side of a voxel world under the cubes, 0 for none
+    int VoxelColumns = 0;
+    // frame time, draw calls and memory drawn over the scene. The numbers differ from run to run
+    bool Overlay = false;
+    // the cubes' boxes and names and the lights as debug lines
+    bool DebugDraw = false;
+    // every GL call from startup until CaptureStart + CaptureFrames goes into this file for --replay
+    std::string CapturePath;
+    int CaptureStart = 0;
+    int CaptureFrames = 10;
+};
+
+// Returns true if --headless was passed, in which case options holds the parsed settings
+inline bool ParseHeadlessOptions(int argc, char const *argv[], HeadlessOptions& options)
+{
+    bool headless = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") headless = true;
+        else if (arg == "--update-golden") options.UpdateGolden = true;
+        else if (arg == "--allow-missing-golden") options.AllowMissingGolden = true;
+        else if (arg == "--width" && hasValue) options.Width = std::atoi(argv[++i]);
+        else if (arg == "--height" && hasValue) options.Height = std::atoi(argv[++i]);
+        else if (arg == "--frames" && hasValue) options.Frames = std::atoi(argv[++i]);
+        else if (arg == "--golden-interval" && hasValue) options.GoldenInterval = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--golden-dir" && hasValue) options.GoldenDir = argv[++i];
+        else if (arg == "--delta-e" && hasValue) options.DeltaEThreshold = (float)std::atof(argv[++i]);
+        else if (arg == "--max-fail" && hasValue) options.MaxFailFraction = (float)std::atof(argv[++i]);
+        else if (arg == "--timings" && hasValue) options.TimingsPath = argv[++i];
+        else if (arg == "--depth-prepass") options.DepthPrepass = true;
+        else if (arg == "--overdraw") options.Overdraw = true;
+        else if (arg == "--deferred") options.Deferred = true;
+        else if (arg == "--shadows") options.Shadows = true;
+        else if (arg == "--lights" && hasValue) options.LightCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--particles" && hasValue) options.ParticleCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--characters" && hasValue) options.CharacterCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--cpu-skinning") options.CpuSkinning = true;
+        else if (arg == "--gltf" && hasValue) options.GltfPath = argv[++i];
+        else if (arg == "--mesh" && hasValue) options.MeshPath = argv[++i];
+        else if (arg == "--physics") options.Physics = true;
+        else if (arg == "--terrain" && hasValue) options.TerrainSize = std::max(0.0f, (float)std::atof(argv[++i]));
+        else if (arg == "--voxels" && hasValue) options.VoxelColumns = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--overlay") options.Overlay = true;
+        else if (arg == "--debug-draw") options.DebugDraw = true;
+        else if (arg == "--capture" && hasValue) options.CapturePath = argv[++i];
+        else if (arg == "--capture-start" && hasValue) options.CaptureStart = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--capture-frames" && hasValue) options.CaptureFrames = std::max(1, std::atoi(argv[++i]));
+    }
+    return headless;
+}
+
+
+// A GL 3.3 core context without a window. Uses a surfaceless EGL display on Linux (works on Mesa llvmpipe without
+// a GPU or X server) and a hidden GLFW window elsewhere. Rendering must go into an FBO
+class OffscreenContext
+{
+public:
+    ~OffscreenContext()
+    {
+        Destroy();
+    }
+
+    bool Create(int width, int height)
+    {
+#ifdef __linux__
+        // surfaceless, only the hidden window elsewhere has a size
+        (void)width;
+        (void)height;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        // surfaceless displays may expose no configs at all, EGL_KHR_no_config_context covers that
+        EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = (EGLConfig)0;
+        EGLint numConfigs = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+        EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "Failed to create surfaceless EGL context" << std::endl;
+            return false;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+#else
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(width, height, "vectorEngine headless", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create hidden GLFW window" << std::endl;
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+#endif
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void Destroy()
+    {
+#ifdef __linux__
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#else
+        if (window != NULL)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+        window = NULL;
+#endif
+    }
+
+private:
+#ifdef __linux__
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#else
+    GLFWwindow* window = NULL;
+#endif
+};
+
+
+// An RGBA8 colour + depth framebuffer to render into when there is no default framebuffer
+class RenderTarget
+{
+public:
+    unsigned int FBO = 0;
+    unsigned int ColorRBO = 0;
+    unsigned int DepthRBO = 0;
+    int Width = 0;
+    int Height = 0;
+
+    bool Create(int width, int height)
+    {
+        Width = width;
+        Height = height;
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &ColorRBO);
+        glGenRenderbuffers(1, &DepthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, ColorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, DepthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorRBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, DepthRBO);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Offscreen render target is not complete" << std::endl;
+        return complete;
+    }
+
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, Width, Height);
+    }
+
+    // Reads the colour attachment back as tightly packed RGB, top row first
+    void ReadPixels(std::vector<unsigned char>& rgb) const
+    {
+        rgb.resize((size_t)Width * Height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+        // GL rows start at the bottom
+        const size_t rowSize = (size_t)Width * 3;
+        std::vector<unsigned char> row(rowSize);
+        for (int y = 0; y < Height / 2; y++)
+        {
+            unsigned char* a = rgb.data() + y * rowSize;
+            unsigned char* b = rgb.data() + (Height - 1 - y) * rowSize;
+            memcpy(row.data(), a, rowSize);
+            memcpy(a, b, rowSize);
+            memcpy(b, row.data(), rowSize);
+        }
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &ColorRBO);
+        glDeleteRenderbuffers(1, &DepthRBO);
+        FBO = ColorRBO = DepthRBO = 0;
+    }
+};
+
+
+// Binary PPM (P6) is used for golden images so no image writer library is needed
+// Creates path and any parents it lacks. True if it exists afterwards. std::filesystem needs C++17, which the
+// engine does not build with
+inline bool CreateDirectories(const std::string& path)
+{
+    for (size_t end = 1; end <= path.size(); end++)
+    {
+        if (end < path.size() && path[end] != '/' && path[end] != '\\')
+            continue;
+        std::string parent = path.substr(0, end);
+#ifdef _WIN32
+        int result = _mkdir(parent.c_str());
+#else
+        int result = mkdir(parent.c_str(), 0755);
+#endif
+        // a parent such as a drive may refuse to be created while existing, only the path itself has to
+        if (end == path.size() && result != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+inline bool WritePPM(const std::string& filePath, int width, int height, const std::vector<unsigned char>& rgb)
+{
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write((const char*)rgb.data(), rgb.size());
+    return (bool)file;
+}
+
+inline bool ReadPPM(const std::string& filePath, int& width, int& height, std::vector<unsigned char>& rgb)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+    if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255)
+        return false;
+    file.get(); // single whitespace before the pixel data
+    rgb.resize((size_t)width * height * 3);
+    file.read((char*)rgb.data(), rgb.size());
+    return (bool)file;
+}
+
+
+struct ImageDiff
+{
+    float MeanDeltaE = 0.0f;
+    float MaxDeltaE = 0.0f;
+    float FailFraction = 1.0f;
+};
+
+inline glm::vec3 SrgbToLab(const unsigned char* rgb)
+{
+    glm::vec3 c(rgb[0] / 255.0f, rgb[1] / 255.0f, rgb[2] / 255.0f);
+    for (int i = 0; i < 3; i++)
+        c[i] = c[i] <= 0.04045f ? c[i] / 12.92f : std::pow((c[i] + 0.055f) / 1.055f, 2.4f);
+    // linear sRGB -> XYZ normalised by the D65 white point
+    glm::vec3 xyz(
+        (0.4124f * c.r + 0.3576f * c.g + 0.1805f * c.b) / 0.95047f,
+        (0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b),
+        (0.0193f * c.r + 0.1192f * c.g + 0.9505f * c.b) / 1.08883f);
+    for (int i = 0; i < 3; i++)
+        xyz[i] = xyz[i] > 0.008856f ? std::cbrt(xyz[i]) : 7.787f * xyz[i] + 16.0f / 116.0f;
+    return glm::vec3(116.0f * xyz.y - 16.0f, 500.0f * (xyz.x - xyz.y), 200.0f * (xyz.y - xyz.z));
+}
+
+// Compares two RGB images in CIELAB so the tolerance follows perceived rather than numeric difference.
+// Rasterisation differences between drivers show up as isolated edge pixels, hence the fail fraction
+inline ImageDiff CompareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, float deltaEThreshold)
+{
+    ImageDiff diff;
+    if (a.size() != b.size() || a.empty())
+        return diff;
+    const size_t pixels = a.size() / 3;
+    size_t failed = 0;
+    double total = 0.0;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const unsigned char* pa = &a[i * 3];
+        const unsigned char* pb = &b[i * 3];
+        if (pa[0] == pb[0] && pa[1] == pb[1] && pa[2] == pb[2])
+            continue;
+        float deltaE = glm::length(SrgbToLab(pa) - SrgbToLab(pb));
+        total += deltaE;
+        diff.MaxDeltaE = std::max(diff.MaxDeltaE, deltaE);
+        if (deltaE > deltaEThreshold)
+            failed++;
+    }
+    diff.MeanDeltaE = (float)(total / pixels);
+    diff.FailFraction = (float)failed / pixels;
+    return diff;
+}
+
+
+// Deterministic camera path used by every offscreen run: a slow orbit around target with a gentle bob. The defaults
+// frame the cube cluster in cubePositions
+inline Camera CameraPathPose(int frame, int frameCount, glm::vec3 target = glm::vec3(0.0f, 0.0f, -6.0f), float radius = 11.0f)
+{
+    float t = frameCount > 1 ? (float)frame / (float)frameCount : 0.0f;
+    float angle = t * glm::two_pi<float>();
+    glm::vec3 position = target + glm::vec3(std::sin(angle) * radius, radius * 0.14f * std::sin(angle * 2.0f), std::cos(angle) * radius);
+    glm::vec3 dir = glm::normalize(target - position);
+    float yaw = glm::degrees(std::atan2(dir.z, dir.x));
+    float pitch = glm::degrees(std::asin(dir.y));
+    return Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
+}
+
+
+// Per-frame CPU and GPU timings. GPU time comes from GL_TIME_ELAPSED queries that are read a few frames late so
+// the measurement never stalls the pipeline
+class FrameTimings
+{
+public:
+    std::vector<double> CpuMs;
+    std::vector<double> GpuMs;
+
+    FrameTimings()
+    {
+        glGenQueries(QUERY_LATENCY, queries);
+    }
+
+    ~FrameTimings()
+    {
+        glDeleteQueries(QUERY_LATENCY, queries);
+    }
+
+    void BeginFrame()
+    {
+        cpuStart = std::chrono::high_resolution_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % QUERY_LATENCY]);
+    }
+
+    void EndFrame()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        CpuMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cpuStart).count());
+        frame++;
+        if (frame >= QUERY_LATENCY)
+            collect(frame - QUERY_LATENCY);
+    }
+
+    // Waits for the outstanding queries, call once after the last frame
+    void Finish()
+    {
+        for (int f = std::max(0, frame - QUERY_LATENCY + 1); f < frame; f++)
+            collect(f);
+    }
+
+    // Drops everything recorded so far, e.g. after warm-up frames. Call Finish first
+    void Clear()
+    {
+        CpuMs.clear();
+        GpuMs.clear();
+        frame = 0;
+    }
+
+    static double Percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        size_t index = (size_t)std::min((double)values.size() - 1, std::floor(p / 100.0 * values.size()));
+        return values[index];
+    }
+
+    bool WriteCsv(const std::string& filePath) const
+    {
+        std::ofstream file(filePath);
+        if (!file)
+            return false;
+        file << "frame,cpu_ms,gpu_ms\n";
+        for (size_t i = 0; i < CpuMs.size(); i++)
+            file << i << "," << CpuMs[i] << "," << (i < GpuMs.size() ? GpuMs[i] : 0.0) << "\n";
+        return (bool)file;
+    }
+
+private:
+    static const int QUERY_LATENCY = 4;
+    unsigned int queries[QUERY_LATENCY];
+    int frame = 0;
+    std::chrono::high_resolution_clock::time_point cpuStart;
+
+    void collect(int f)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[f % QUERY_LATENCY], GL_QUERY_RESULT, &ns);
+        if ((int)GpuMs.size() <= f)
+            GpuMs.resize(f + 1, 0.0);
+        GpuMs[f] = ns / 1.0e6;
+    }
+};
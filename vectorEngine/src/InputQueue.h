@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+
+// Single producer, single consumer ring buffer. The producer only writes tail and the consumer only head, so neither
+// side locks, and each keeps a stale copy of the other's index to avoid touching its cache line on every call.
+// Push fails when the ring is full rather than overwriting. Capacity must be a power of two
+template<typename T, size_t Capacity>
+class SpscRing
+{
+public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    // Producer side
+    bool Push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == Capacity)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == Capacity)
+                return false;
+        }
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache)
+                return false;
+        }
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // the consumer's and the producer's halves live on separate cache lines
+    alignas(64) std::atomic<size_t> head{ 0 };
+    size_t tailCache = 0;
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    size_t headCache = 0;
+    alignas(64) T items[Capacity];
+};
+
+
+enum Input_Event_Type {
+    CURSOR_EVENT,
+    SCROLL_EVENT,
+    KEY_EVENT,
+    RESIZE_EVENT
+};
+
+// One window system callback, as recorded by the window thread
+struct InputEvent
+{
+    Input_Event_Type Type;
+    // seconds, on the window system's clock
+    double Time;
+    // cursor position, scroll offset, or framebuffer size
+    double X;
+    double Y;
+    int Key;
+    int Action;
+};
+
+const int MAX_INPUT_KEYS = 512;
+const size_t INPUT_QUEUE_CAPACITY = 1024;
+
+// What happened since the previous Poll, with cursor movement and scrolling coalesced
+struct InputFrame
+{
+    // cursor movement, y pointing up
+    float MouseX = 0.0f;
+    float MouseY = 0.0f;
+    float Scroll = 0.0f;
+    // the last framebuffer size, when it changed
+    bool Resized = false;
+    int Width = 0;
+    int Height = 0;
+    int Events = 0;
+    // time of the newest event, for measuring input latency
+    double LastEventTime = 0.0;
+};
+
+// Decouples window callbacks from the simulation. Callbacks Post timestamped events into a lock-free ring, and
+// the simulation step Polls once per frame, which drains the ring, folds the events into key state and a coalesced
+// InputFrame. Post may run on a different thread from Poll and IsKeyDown, but each side must stay on one thread
+class InputQueue
+{
+public:
+    // Window thread. Returns false and counts the event as dropped when the consumer has fallen behind
+    bool Post(const InputEvent& event)
+    {
+        if (ring.Push(event))
+            return true;
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Simulation thread
+    const InputFrame& Poll()
+    {
+        frame = InputFrame();
+        pressed.reset();
+        InputEvent event;
+        while (ring.Pop(event))
+        {
+            apply(event);
+            frame.Events++;
+            frame.LastEventTime = event.Time;
+        }
+        return frame;
+    }
+
+    bool IsKeyDown(int key) const { return key >= 0 && key < MAX_INPUT_KEYS && down[key]; }
+    // pressed at some point since the last Poll, even if already released again
+    bool WasPressed(int key) const { return key >= 0 && key < MAX_INPUT_KEYS && pressed[key]; }
+
+    const InputFrame& Frame() const { return frame; }
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    SpscRing<InputEvent, INPUT_QUEUE_CAPACITY> ring;
+    std::atomic<uint64_t> dropped{ 0 };
+
+    InputFrame frame;
+    std::bitset<MAX_INPUT_KEYS> down;
+    std::bitset<MAX_INPUT_KEYS> pressed;
+    // the cursor position the next movement is measured from
+    bool haveCursor = false;
+    double cursorX = 0.0;
+    double cursorY = 0.0;
+
+    void apply(const InputEvent& event)
+    {
+        switch (event.Type)
+        {
+        case CURSOR_EVENT:
+            if (haveCursor)
+            {
+                frame.MouseX += (float)(event.X - cursorX);
+                frame.MouseY += (float)(cursorY - event.Y);
+            }
+            haveCursor = true;
+            cursorX = event.X;
+            cursorY = event.Y;
+            break;
+        case SCROLL_EVENT:
+            frame.Scroll += (float)event.Y;
+            break;
+        case KEY_EVENT:
+            if (event.Key < 0 || event.Key >= MAX_INPUT_KEYS)
+                break;
+            // repeats keep the key down, release is the only other action
+            down[event.Key] = event.Action != 0;
+            if (event.Action == 1)
+                pressed[event.Key] = true;
+            break;
+        case RESIZE_EVENT:
+            frame.Resized = true;
+            frame.Width = (int)event.X;
+            frame.Height = (int)event.Y;
+            break;
+        }
+    }
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed pool of worker threads for data-parallel loops. ParallelFor splits [0, count) into chunks that the
+// workers and the calling thread pull from a shared counter, and returns once every chunk has run.
+// Only one ParallelFor runs at a time; calling it from inside a job runs the nested loop inline
+class JobSystem
+{
+public:
+    // threadCount is the number of workers besides the calling thread, -1 picks one per remaining hardware thread
+    explicit JobSystem(int threadCount = -1)
+    {
+        if (threadCount < 0)
+            threadCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+        for (int i = 0; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Threads that run jobs, including the caller
+    int ThreadCount() const { return (int)workers.size() + 1; }
+
+    // Calls job(begin, end) for consecutive ranges of at most grainSize items covering [0, count)
+    void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& job)
+    {
+        if (count <= 0)
+            return;
+        grainSize = std::max(grainSize, 1);
+        int chunks = (count + grainSize - 1) / grainSize;
+        if (chunks == 1 || workers.empty() || insideJob())
+        {
+            job(0, count);
+            return;
+        }
+
+        std::unique_lock<std::mutex> submitLock(submitMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            itemCount = count;
+            grain = grainSize;
+            chunkCount = chunks;
+            nextChunk = 0;
+            pendingChunks = chunks;
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        // also wait for workers that woke late and found nothing left, so none is still reading this loop's state
+        done.wait(lock, [this] { return pendingChunks == 0 && busyWorkers == 0; });
+        current = NULL;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool quit = false;
+    unsigned int generation = 0;
+
+    const std::function<void(int, int)>* current = NULL;
+    int itemCount = 0;
+    int grain = 1;
+    int chunkCount = 0;
+    std::atomic<int> nextChunk{ 0 };
+    int pendingChunks = 0;
+    int busyWorkers = 0;
+
+    static bool& insideJob()
+    {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    void runChunks()
+    {
+        bool& inside = insideJob();
+        inside = true;
+        int finished = 0;
+        for (int chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+        {
+            int begin = chunk * grain;
+            (*current)(begin, std::min(begin + grain, itemCount));
+            finished++;
+        }
+        inside = false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingChunks -= finished;
+    }
+
+    void workerLoop()
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || (generation != seen && current != NULL); });
+                if (quit)
+                    return;
+                seen = generation;
+                busyWorkers++;
+            }
+            runChunks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_all();
+        }
+    }
+};
+
+// The engine-wide job system, created on first use
+inline JobSystem& GetJobSystem()
+{
+    static JobSystem jobs;
+    return jobs;
+}
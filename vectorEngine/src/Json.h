@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum Json_Type {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+// One value of a parsed document. Strings and keys point into the source text, escapes are left as they are
+struct JsonValue
+{
+    Json_Type Type = JSON_NULL;
+    // members or elements of an object or array
+    uint32_t Count = 0;
+    // index of the value after this one and all its children, i.e. of the next sibling
+    uint32_t End = 0;
+    double Number = 0.0;
+    const char* String = NULL;
+    uint32_t Length = 0;
+    // member name when the parent is an object
+    const char* Key = NULL;
+    uint32_t KeyLength = 0;
+};
+
+// A JSON document flattened into one array in document order: a container's children follow it directly and
+// every value knows where its subtree ends, so walking siblings is a jump rather than a search. Parsing allocates
+// only that array, and a copy of any number too long for a stack buffer. The source text must outlive the document.
+// Values are addressed by index, the root is 0
+class JsonDocument
+{
+public:
+    bool Parse(const char* text, size_t length)
+    {
+        values.clear();
+        cursor = text;
+        end = text + length;
+        error = NULL;
+        // glTF averages well over 16 characters per value, so this usually avoids regrowing the array
+        values.reserve(length / 16 + 1);
+        skipSpace();
+        if (cursor >= end || (*cursor != '{' && *cursor != '['))
+            return fail("expected an object or array");
+        if (!parseValue(0))
+            return false;
+        skipSpace();
+        if (cursor != end)
+            return fail("trailing characters");
+        return true;
+    }
+
+    // why and where Parse failed
+    const char* Error() const { return error; }
+    size_t ErrorOffset(const char* text) const { return (size_t)(cursor - text); }
+
+    size_t Size() const { return values.size(); }
+    const JsonValue& operator[](uint32_t index) const { return values[index]; }
+
+    // first child of a container, only valid when it has any
+    uint32_t First(uint32_t index) const { return index + 1; }
+    uint32_t Next(uint32_t index) const { return values[index].End; }
+
+    // the member named key of an object, or -1
+    int Find(uint32_t object, const char* key) const
+    {
+        if (object >= values.size() || values[object].Type != JSON_OBJECT)
+            return -1;
+        size_t keyLength = std::strlen(key);
+        for (uint32_t child = First(object), i = 0; i < values[object].Count; child = Next(child), i++)
+        {
+            if (values[child].KeyLength == keyLength && std::memcmp(values[child].Key, key, keyLength) == 0)
+                return (int)child;
+        }
+        return -1;
+    }
+
+    // the children of an array or object, in order
+    void Children(uint32_t container, std::vector<uint32_t>& out) const
+    {
+        out.clear();
+        if (container >= values.size())
+            return;
+        for (uint32_t child = First(container), i = 0; i < values[container].Count; child = Next(child), i++)
+            out.push_back(child);
+    }
+
+    double GetNumber(uint32_t object, const char* key, double fallback) const
+    {
+        int member = Find(object, key);
+        return member >= 0 && values[member].Type == JSON_NUMBER ? values[member].Number : fallback;
+    }
+
+    int GetInt(uint32_t object, const char* key, int fallback) const
+    {
+        return (int)GetNumber(object, key, fallback);
+    }
+
+    bool GetBool(uint32_t object, const char* key, bool fallback) const
+    {
+        int member = Find(object, key);
+        return member >= 0 && values[member].Type == JSON_BOOL ? values[member].Number != 0.0 : fallback;
+    }
+
+    // true when the member is a string equal to text
+    bool StringEquals(int value, const char* text) const
+    {
+        size_t length = std::strlen(text);
+        return value >= 0 && values[value].Type == JSON_STRING && values[value].Length == length && std::memcmp(values[value].String, text, length) == 0;
+    }
+
+    // reads up to count numbers of an array member into out, returns how many
+    int GetNumbers(uint32_t object, const char* key, float* out, int count) const
+    {
+        int member = Find(object, key);
+        if (member < 0 || values[member].Type != JSON_ARRAY)
+            return 0;
+        int read = 0;
+        for (uint32_t child = First(member), i = 0; i < values[member].Count && read < count; child = Next(child), i++)
+        {
+            if (values[child].Type == JSON_NUMBER)
+                out[read++] = (float)values[child].Number;
+        }
+        return read;
+    }
+
+private:
+    std::vector<JsonValue> values;
+    const char* cursor = NULL;
+    const char* end = NULL;
+    const char* error = NULL;
+
+    bool fail(const char* message)
+    {
+        error = message;
+        return false;
+    }
+
+    void skipSpace()
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            cursor++;
+    }
+
+    bool literal(const char* word)
+    {
+        size_t length = std::strlen(word);
+        if ((size_t)(end - cursor) < length || std::memcmp(cursor, word, length) != 0)
+            return fail("unexpected character");
+        cursor += length;
+        return true;
+    }
+
+    // a string's contents, cursor on the opening quote
+    bool parseString(const char*& text, uint32_t& length)
+    {
+        const char* start = ++cursor;
+        while (cursor < end && *cursor != '"')
+        {
+            if (*cursor == '\\')
+                cursor++;
+            cursor++;
+        }
+        if (cursor >= end)
+            return fail("unterminated string");
+        text = start;
+        length = (uint32_t)(cursor - start);
+        cursor++;
+        return true;
+    }
+
+    // A number in the JSON grammar, cursor on its first character. strtod accepts more than JSON does and expects a
+    // terminated string, so the number is scanned here and converted from a terminated copy
+    bool parseNumber(double& number)
+    {
+        const char* start = cursor;
+        if (cursor < end && *cursor == '-')
+            cursor++;
+        if (cursor < end && *cursor == '0')
+            cursor++;
+        else if (!skipDigits())
+            return fail("expected a value");
+        if (cursor < end && *cursor == '.')
+        {
+            cursor++;
+            if (!skipDigits())
+                return fail("expected a digit");
+        }
+        if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+        {
+            cursor++;
+            if (cursor < end && (*cursor == '+' || *cursor == '-'))
+                cursor++;
+            if (!skipDigits())
+                return fail("expected a digit");
+        }
+
+        char text[64];
+        size_t length = cursor - start;
+        if (length < sizeof(text))
+        {
+            std::memcpy(text, start, length);
+            text[length] = '\0';
+            number = std::strtod(text, NULL);
+        }
+        else
+        {
+            number = std::strtod(std::string(start, length).c_str(), NULL);
+        }
+        return true;
+    }
+
+    // one or more digits
+    bool skipDigits()
+    {
+        const char* start = cursor;
+        while (cursor < end && *cursor >= '0' && *cursor <= '9')
+            cursor++;
+        return cursor > start;
+    }
+
+    bool parseValue(int depth)
+    {
+        if (depth > 64)
+            return fail("nested too deeply");
+        if (cursor >= end)
+            return fail("unexpected end");
+        uint32_t index = (uint32_t)values.size();
+        values.push_back(JsonValue());
+        switch (*cursor)
+        {
+        case '{':
+        case '[':
+        {
+            bool object = *cursor == '{';
+            char close = object ? '}' : ']';
+            values[index].Type = object ? JSON_OBJECT : JSON_ARRAY;
+            cursor++;
+            skipSpace();
+            uint32_t count = 0;
+            if (cursor < end && *cursor == close)
+            {
+                cursor++;
+                break;
+            }
+            for (;;)
+            {
+                const char* key = NULL;
+                uint32_t keyLength = 0;
+                if (object)
+                {
+                    if (cursor >= end || *cursor != '"')
+                        return fail("expected a member name");
+                    if (!parseString(key, keyLength))
+                        return false;
+                    skipSpace();
+                    if (cursor >= end || *cursor != ':')
+                        return fail("expected ':'");
+                    cursor++;
+                    skipSpace();
+                }
+                uint32_t child = (uint32_t)values.size();
+                if (!parseValue(depth + 1))
+                    return false;
+                values[child].Key = key;
+                values[child].KeyLength = keyLength;
+                count++;
+                skipSpace();
+                if (cursor < end && *cursor == ',')
+                {
+                    cursor++;
+                    skipSpace();
+                    continue;
+                }
+                if (cursor < end && *cursor == close)
+                {
+                    cursor++;
+                    break;
+                }
+                return fail(object ? "expected ',' or '}'" : "expected ',' or ']'");
+            }
+            values[index].Count = count;
+            break;
+        }
+        case '"':
+            values[index].Type = JSON_STRING;
+            if (!parseString(values[index].String, values[index].Length))
+                return false;
+            break;
+        case 't':
+            values[index].Type = JSON_BOOL;
+            values[index].Number = 1.0;
+            if (!literal("true"))
+                return false;
+            break;
+        case 'f':
+            values[index].Type = JSON_BOOL;
+            if (!literal("false"))
+                return false;
+            break;
+        case 'n':
+            if (!literal("null"))
+                return false;
+            break;
+        default:
+            values[index].Type = JSON_NUMBER;
+            if (!parseNumber(values[index].Number))
+                return false;
+            break;
+        }
+        values[index].End = (uint32_t)values.size();
+        return true;
+    }
+};
@@ -2,56 +2,83 @@
 #include <GLFW\glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <stb/stb_image.h>
 
+#include "AllocationTracker.h"
+#include "Animation.h"
+#include "AssetArchive.h"
+#include "Benchmark.h"
 #include "Camera.h"
+#include "ClusteredLighting.h"
+#include "DebugDraw.h"
+#include "DeferredRenderer.h"
+#include "DepthPrepass.h"
+#include "GLCapture.h"
+#include "GltfLoader.h"
+#include "Headless.h"
+#include "InputQueue.h"
+#include "Memory.h"
+#include "MeshImport.h"
+#include "ParticleSystem.h"
+#include "Physics.h"
+#include "RenderThread.h"
 #include "Shader.h"
+#include "ShadowMaps.h"
+#include "Terrain.h"
+#include "TextRenderer.h"
+#include "TextureStreaming.h"
+#include "VertexFormat.h"
+#include "VoxelWorld.h"
 
 #include <iostream>
+#include <memory>
+#include <thread>
 
 float vertices[] = {
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-     0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-     0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+    -0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f,  0.0f,
+     0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   1.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   1.0f,  1.0f,
+     0.5f,  0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   1.0f,  1.0f,
+    -0.5f,  0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f,  1.0f,
+    -0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f,  0.0f,
+
+    -0.5f, -0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   0.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   1.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   1.0f,  1.0f,
+     0.5f,  0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   1.0f,  1.0f,
+    -0.5f,  0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   0.0f,  1.0f,
+    -0.5f, -0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   0.0f,  0.0f,
+
+    -0.5f,  0.5f,  0.5f,  -1.0f,  0.0f,  0.0f,   1.0f,  0.0f,
+    -0.5f,  0.5f, -0.5f,  -1.0f,  0.0f,  0.0f,   1.0f,  1.0f,
+    -0.5f, -0.5f, -0.5f,  -1.0f,  0.0f,  0.0f,   0.0f,  1.0f,
+    -0.5f, -0.5f, -0.5f,  -1.0f,  0.0f,  0.0f,   0.0f,  1.0f,
+    -0.5f, -0.5f,  0.5f,  -1.0f,  0.0f,  0.0f,   0.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f,  -1.0f,  0.0f,  0.0f,   1.0f,  0.0f,
+
+     0.5f,  0.5f,  0.5f,   1.0f,  0.0f,  0.0f,   1.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,   1.0f,  0.0f,  0.0f,   1.0f,  1.0f,
+     0.5f, -0.5f, -0.5f,   1.0f,  0.0f,  0.0f,   0.0f,  1.0f,
+     0.5f, -0.5f, -0.5f,   1.0f,  0.0f,  0.0f,   0.0f,  1.0f,
+     0.5f, -0.5f,  0.5f,   1.0f,  0.0f,  0.0f,   0.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,   1.0f,  0.0f,  0.0f,   1.0f,  0.0f,
+
+    -0.5f, -0.5f, -0.5f,   0.0f, -1.0f,  0.0f,   0.0f,  1.0f,
+     0.5f, -0.5f, -0.5f,   0.0f, -1.0f,  0.0f,   1.0f,  1.0f,
+     0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   1.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   1.0f,  0.0f,
+    -0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   0.0f,  0.0f,
+    -0.5f, -0.5f, -0.5f,   0.0f, -1.0f,  0.0f,   0.0f,  1.0f,
+
+    -0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   0.0f,  1.0f,
+     0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   1.0f,  1.0f,
+     0.5f,  0.5f,  0.5f,   0.0f,  1.0f,  0.0f,   1.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,   0.0f,  1.0f,  0.0f,   1.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f,   0.0f,  1.0f,  0.0f,   0.0f,  0.0f,
+    -0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   0.0f,  1.0f,
+
 };
 glm::vec3 cubePositions[] = {
     glm::vec3(0.0f,  0.0f,  0.0f),
@@ -69,12 +96,49 @@ glm::vec3 cubePositions[] = {
 // settings
 unsigned int SCR_WIDTH = 800;
 unsigned int SCR_HEIGHT = 600;
+const glm::vec4 CLEAR_COLOR(0.2f, 0.3f, 0.3f, 1.0f);
+const glm::vec3 AMBIENT_LIGHT(0.15f);
+// frames rendered before no-alloc regions are enforced, the first use of every path allocates
+const int ALLOCATION_WARMUP_FRAMES = 3;
+const int CUBE_COUNT = 10;
+
+// Settings of the interactive mode, filled in from the command line
+struct WindowOptions
+{
+    bool DepthPrepass = false;
+    bool Deferred = false;
+    bool Shadows = false;
+    int LightCount = 128;
+    int ParticleCount = 0;
+    int CharacterCount = 0;
+    bool CpuSkinning = false;
+    std::string GltfPath;
+    std::string MeshPath;
+    // the cubes fall onto a floor as rigid bodies instead of spinning in place
+    bool Physics = false;
+    // side in metres of the landscape under the cubes, 0 for none
+    float TerrainSize = 0.0f;
+    // chunk columns along each side of a voxel world under the cubes, 0 for none
+    int VoxelColumns = 0;
+    // frame time, draw calls and memory drawn over the scene
+    bool Overlay = false;
+    // the cubes' boxes and names and the lights as debug lines
+    bool DebugDraw = false;
+    // frame snapshots between simulation and render thread, 2 or 3
+    int SnapshotBuffers = 2;
+    // every GL call from startup until CaptureStart + CaptureFrames goes into this file for --replay
+    std::string CapturePath;
+    int CaptureStart = 0;
+    int CaptureFrames = 10;
+};
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
-float lastX = 0;
-float lastY = 0;
-bool firstMouse = true;
+// pushed out to the horizon when there is terrain
+float farPlane = FAR_PLANE;
+
+// input, the callbacks only record events and processInput applies them once per frame
+InputQueue inputQueue;
 
 // timing
 float deltaTime = 0.0f;
@@ -86,12 +150,128 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
 unsigned int createTexture(const char* filePath, bool alpha);
+std::vector<Light> createSceneLights(int count);
+size_t particleFountainCapacity(int liveCount);
+template<typename Particles>
+std::unique_ptr<Particles> createParticleFountain(int liveCount, const glm::vec3& base, float height);
+template<typename Crowd>
+std::unique_ptr<Crowd> createCrowd(int count, const glm::vec3& center, float spacing, bool cpuSkinning);
+void drawCrowd(AnimatedCrowd& crowd, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+void drawCrowd(CrowdRenderer& crowd, const CrowdPose& pose, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+std::unique_ptr<TerrainRenderer> createTerrain(float size, const glm::vec3& center, bool synchronous);
+void drawTerrain(TerrainRenderer& terrain, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+std::unique_ptr<VoxelWorld> createVoxelWorld(int columns, const glm::vec3& center);
+float voxelViewDistance(int columns);
+void drawVoxels(VoxelWorld& voxels, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, Camera& camera, const glm::mat4& view, const glm::mat4& projection);
+void debugDrawScene(const glm::mat4* models, const std::vector<Light>& lights);
+std::unique_ptr<GltfModel> loadModel(const std::string& path, const glm::vec3& center, float size, glm::mat4& placement);
+void drawModel(GltfModel& model, const glm::mat4& placement, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection);
+std::unique_ptr<QuantizedMesh> importMesh(const std::string& path, const glm::vec3& center, float size, glm::mat4& placement, MeshImportStats* stats);
+void drawMesh(Shader& shader, const QuantizedMesh& mesh, const glm::mat4& placement, const glm::mat4& view, const glm::mat4& projection, const QuantizedMesh& cube);
+void bindForwardLighting(Shader& shader, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos);
+glm::mat4 cubeModel(int i, float time);
+void simulateCubes(glm::mat4* models, float time);
+std::unique_ptr<PhysicsWorld> createCubePhysics();
+void readCubePhysics(const PhysicsWorld& physics, glm::mat4* models);
+std::unique_ptr<PhysicsWorld> createPhysicsPile(const BenchmarkScene& scene);
+void drawCubes(Shader& shader, int vertexCount, const glm::mat4* models);
+void renderCubeShadows(CascadedShadowMaps& shadows, Camera& camera, const QuantizedMesh& cube, const glm::mat4* models, bool moving);
+void renderScene(Shader& shader, const QuantizedMesh& cube, unsigned int texture1, unsigned int texture2, const glm::mat4& view, const glm::mat4& projection, const glm::mat4* models, DepthPrepass* prepass);
+void renderWindow(GLFWwindow* window, const WindowOptions& options, SnapshotQueue& snapshots);
+void drawSnapshots(GLFWwindow* window, const WindowOptions& options, SnapshotQueue& snapshots);
+int packAssets(int argc, char const *argv[]);
+int runHeadless(const HeadlessOptions& options);
+int runBenchmark(const BenchmarkOptions& options);
+int runReplay(const ReplayOptions& options);
 
 
 int main(int argc, char const *argv[])
 {
+    if (argc >= 2 && std::string(argv[1]) == "--pack")
+    {
+        return packAssets(argc, argv);
+    }
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        // shaders and images are read from the archive, anything not packed still comes from disk
+        if (std::string(argv[i]) == "--archive" && !GetAssetArchive().Open(argv[i + 1]))
+        {
+            return -1;
+        }
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        // counts heap allocations and reports any inside a frame once warmed up, --assert-no-alloc aborts on them
+        if (std::string(argv[i]) == "--track-allocations")
+        {
+            EnableAllocationTracking(true);
+        }
+        else if (std::string(argv[i]) == "--assert-no-alloc")
+        {
+            EnableAllocationTracking(true);
+            SetAllocationViolationMode(ALLOCATION_ASSERT);
+        }
+    }
+
+    ReplayOptions replayOptions;
+    if (ParseReplayOptions(argc, argv, replayOptions))
+    {
+        return runReplay(replayOptions);
+    }
+    HeadlessOptions headlessOptions;
+    if (ParseHeadlessOptions(argc, argv, headlessOptions))
+    {
+        return runHeadless(headlessOptions);
+    }
+    BenchmarkOptions benchmarkOptions;
+    if (ParseBenchmarkOptions(argc, argv, benchmarkOptions))
+    {
+        return runBenchmark(benchmarkOptions);
+    }
+    WindowOptions windowOptions;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--depth-prepass")
+            windowOptions.DepthPrepass = true;
+        else if (std::string(argv[i]) == "--deferred")
+            windowOptions.Deferred = true;
+        else if (std::string(argv[i]) == "--shadows")
+            windowOptions.Shadows = true;
+        else if (std::string(argv[i]) == "--lights" && i + 1 < argc)
+            windowOptions.LightCount = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--particles" && i + 1 < argc)
+            windowOptions.ParticleCount = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--characters" && i + 1 < argc)
+            windowOptions.CharacterCount = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--cpu-skinning")
+            windowOptions.CpuSkinning = true;
+        else if (std::string(argv[i]) == "--gltf" && i + 1 < argc)
+            windowOptions.GltfPath = argv[++i];
+        else if (std::string(argv[i]) == "--mesh" && i + 1 < argc)
+            windowOptions.MeshPath = argv[++i];
+        else if (std::string(argv[i]) == "--physics")
+            windowOptions.Physics = true;
+        else if (std::string(argv[i]) == "--terrain" && i + 1 < argc)
+            windowOptions.TerrainSize = std::max(0.0f, (float)std::atof(argv[++i]));
+        else if (std::string(argv[i]) == "--voxels" && i + 1 < argc)
+            windowOptions.VoxelColumns = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--overlay")
+            windowOptions.Overlay = true;
+        else if (std::string(argv[i]) == "--debug-draw")
+            windowOptions.DebugDraw = true;
+        else if (std::string(argv[i]) == "--snapshot-buffers" && i + 1 < argc)
+            windowOptions.SnapshotBuffers = std::min(std::max(std::atoi(argv[++i]), 2), 3);
+        else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+            windowOptions.CapturePath = argv[++i];
+        else if (std::string(argv[i]) == "--capture-start" && i + 1 < argc)
+            windowOptions.CaptureStart = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--capture-frames" && i + 1 < argc)
+            windowOptions.CaptureFrames = std::max(1, std::atoi(argv[++i]));
+    }
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -104,39 +284,147 @@ int main(int argc, char const *argv[])
         glfwTerminate();
         return -1;
     }
-    glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (windowOptions.TerrainSize > 0.0f)
+        farPlane = TERRAIN_VIEW_DISTANCE;
+    if (windowOptions.VoxelColumns > 0)
+        farPlane = std::max(farPlane, voxelViewDistance(windowOptions.VoxelColumns));
+    camera.SetProjection((float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, farPlane);
+
+    // the render thread owns the GL context. This thread runs the window system, input and simulation, and hands
+    // every simulated frame over as a snapshot, so the next simulation step overlaps with drawing the last one
+    SnapshotQueue snapshots(windowOptions.SnapshotBuffers);
+    std::thread renderThread(renderWindow, window, windowOptions, std::ref(snapshots));
+
+    std::unique_ptr<PhysicsWorld> physics;
+    float physicsTime = 0.0f;
+    if (windowOptions.Physics)
+    {
+        physics = createCubePhysics();
+    }
+    std::unique_ptr<ParticleSimulation> particles;
+    if (windowOptions.ParticleCount > 0)
+    {
+        particles = createParticleFountain<ParticleSimulation>(windowOptions.ParticleCount, glm::vec3(0.0f, -2.0f, -5.0f), 4.0f);
+    }
+    std::unique_ptr<CrowdAnimation> crowd;
+    if (windowOptions.CharacterCount > 0)
+    {
+        crowd = createCrowd<CrowdAnimation>(windowOptions.CharacterCount, glm::vec3(0.0f, -3.0f, -8.0f), 1.5f, windowOptions.CpuSkinning);
+    }
+
+    uint64_t frameCount = 0;
+    while (!glfwWindowShouldClose(window))
+    {
+        glfwPollEvents();
+
+        // per-frame time logic
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        // until every snapshot buffer has been filled once, resizing them may allocate
+        NoAllocationScope simulation("simulation", frameCount >= (uint64_t)(ALLOCATION_WARMUP_FRAMES + snapshots.Buffers()));
+
+        // input
+        processInput(window);
+        camera.Update();
+
+        // blocks while the render thread is a full set of buffers behind
+        FrameSnapshot* snapshot = snapshots.BeginWrite();
+        if (snapshot == NULL)
+        {
+            break;
+        }
+        snapshot->Frame = frameCount++;
+        snapshot->Time = currentFrame;
+        camera.GetViewProjectionMatrix();
+        snapshot->View = camera;
+        snapshot->Width = SCR_WIDTH;
+        snapshot->Height = SCR_HEIGHT;
+        snapshot->Models.resize(CUBE_COUNT);
+        if (physics)
+        {
+            // fixed steps whatever the frame rate, after a stall at most four are caught up
+            const float step = 1.0f / 60.0f;
+            physicsTime = std::min(physicsTime + deltaTime, 4.0f * step);
+            for (; physicsTime >= step; physicsTime -= step)
+            {
+                physics->Step(step);
+            }
+            readCubePhysics(*physics, snapshot->Models.data());
+        }
+        else
+        {
+            simulateCubes(snapshot->Models.data(), currentFrame);
+        }
+        if (particles)
+        {
+            particles->Update(deltaTime);
+            particles->CopyInstances(snapshot->Particles);
+        }
+        if (crowd)
+        {
+            crowd->Update(currentFrame);
+            crowd->CopyPose(snapshot->Crowd);
+        }
+        snapshots.Publish();
+    }
+
+    snapshots.Close();
+    renderThread.join();
+    glfwTerminate();
+	return 0;
+}
 
+// Draws published snapshots until the queue closes. Runs on its own thread, which owns the GL context
+void renderWindow(GLFWwindow* window, const WindowOptions& options, SnapshotQueue& snapshots)
+{
+    glfwMakeContextCurrent(window);
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        glfwSetWindowShouldClose(window, true);
+        snapshots.Close();
+        return;
     }
 
-    glEnable(GL_DEPTH_TEST);
-
+    drawSnapshots(window, options, snapshots);
+    // everything drawSnapshots created is deleted by now, while the context is still current
+    GetGLCapture().End();
+    // the window itself is destroyed by the main thread
+    glfwMakeContextCurrent(NULL);
+}
 
-    Shader ourShader("src/vShader.glsl", "src/fShader.glsl");
+// The render thread's loop, with the GL objects it draws with living no longer than this call
+void drawSnapshots(GLFWwindow* window, const WindowOptions& options, SnapshotQueue& snapshots)
+{
+    // the first snapshot says how big the framebuffer is
+    FrameSnapshot* frame = snapshots.Acquire();
+    if (frame == NULL)
+    {
+        return;
+    }
+    if (!options.CapturePath.empty())
+    {
+        GetGLCapture().Begin(options.CapturePath, options.CaptureStart, options.CaptureFrames, frame->Width, frame->Height);
+    }
+    int viewportWidth = frame->Width;
+    int viewportHeight = frame->Height;
+    glViewport(0, 0, viewportWidth, viewportHeight);
 
-    unsigned int VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
+    glEnable(GL_DEPTH_TEST);
 
-    glBindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    Shader ourShader("src/vShader.glsl", "src/fShader.glsl");
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // tex coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // positions become snorm16 relative to the cube bounds, uvs unorm16 and normals octahedral snorm8: 32 -> 16 bytes per vertex
+    QuantizedMesh cube(vertices, 36, SourceLayout(8, 0, 6, 3), VertexFormat(VERTEX_POSITION | VERTEX_TEXCOORD | VERTEX_NORMAL));
 
      //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -147,131 +435,1600 @@ int main(int argc, char const *argv[])
     ourShader.use();
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
+    ourShader.setFloat("roughness", DEFAULT_ROUGHNESS);
+    ourShader.setFloat("metalness", DEFAULT_METALNESS);
+    LightClusters::SetSamplerUnits(ourShader);
+    cube.SetDequantUniforms(ourShader);
 
-
-    while (!glfwWindowShouldClose(window))
+    std::unique_ptr<DepthPrepass> prepass;
+    if (options.DepthPrepass)
     {
-        // per-frame time logic
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        processInput(window);
-
-        // render
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
+        prepass.reset(new DepthPrepass());
+        prepass->DepthShader.use();
+        cube.SetDequantUniforms(prepass->DepthShader);
+    }
 
-        ourShader.use();
+    std::unique_ptr<DeferredRenderer> deferred;
+    if (options.Deferred)
+    {
+        deferred.reset(new DeferredRenderer(frame->Width, frame->Height));
+        deferred->GeometryShader.use();
+        cube.SetDequantUniforms(deferred->GeometryShader);
+    }
 
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("view", view);
+    std::unique_ptr<CascadedShadowMaps> shadows;
+    if (options.Shadows)
+    {
+        shadows.reset(new CascadedShadowMaps());
+        shadows->DepthShader.use();
+        cube.SetDequantUniforms(shadows->DepthShader);
+    }
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    LightClusters clusters;
+    std::vector<Light> lights = createSceneLights(options.LightCount);
+    // the sun alone still needs the clustered shading path
+    bool lit = !lights.empty() || shadows;
 
-        ourShader.setMat4("projection", projection);
+    // the main thread simulates the particles, the snapshots carry their instance data
+    std::unique_ptr<ParticleRenderer> particles;
+    if (options.ParticleCount > 0)
+    {
+        particles.reset(new ParticleRenderer(particleFountainCapacity(options.ParticleCount)));
+    }
+    // the main thread animates the characters, the snapshots carry their palettes or skinned vertices
+    std::unique_ptr<CrowdRenderer> crowd;
+    if (options.CharacterCount > 0)
+    {
+        crowd.reset(new CrowdRenderer(CreateTentacleRig(), options.CharacterCount));
+    }
+    std::unique_ptr<GltfModel> model;
+    glm::mat4 modelPlacement;
+    if (!options.GltfPath.empty())
+    {
+        model = loadModel(options.GltfPath, glm::vec3(0.0f, 0.0f, -5.0f), 3.0f, modelPlacement);
+    }
+    std::unique_ptr<QuantizedMesh> mesh;
+    glm::mat4 meshPlacement;
+    if (!options.MeshPath.empty())
+    {
+        mesh = importMesh(options.MeshPath, glm::vec3(0.0f, 0.0f, -5.0f), 3.0f, meshPlacement, NULL);
+    }
+    std::unique_ptr<TerrainRenderer> terrain;
+    if (options.TerrainSize > 0.0f)
+    {
+        terrain = createTerrain(options.TerrainSize, glm::vec3(0.0f, -6.0f, -7.0f), false);
+    }
+    std::unique_ptr<VoxelWorld> voxels;
+    if (options.VoxelColumns > 0)
+    {
+        voxels = createVoxelWorld(options.VoxelColumns, glm::vec3(0.0f, -6.0f, -7.0f));
+    }
+    std::unique_ptr<PerformanceOverlay> overlay;
+    if (options.Overlay)
+    {
+        overlay.reset(new PerformanceOverlay());
+    }
+    std::unique_ptr<DebugRenderer> debugRenderer;
+    if (options.DebugDraw)
+    {
+        GetDebugDraw().Enable();
+        debugRenderer.reset(new DebugRenderer());
+    }
 
-        glBindVertexArray(VAO);
+    int frameCount = 0;
+    for (; frame != NULL; frame = snapshots.Acquire())
+    {
+        BeginAllocatorFrame();
+        GetRenderStats().BeginFrame();
+        Camera& view = frame->View;
+        const glm::mat4* models = frame->Models.data();
+        if (frame->Width != viewportWidth || frame->Height != viewportHeight)
+        {
+            viewportWidth = frame->Width;
+            viewportHeight = frame->Height;
+            glViewport(0, 0, viewportWidth, viewportHeight);
+        }
 
-        for (int i = 0; i < 10; i++)
+        // render
+        bool enforceNoAllocation = frameCount++ >= ALLOCATION_WARMUP_FRAMES;
+        if (enforceNoAllocation)
+        {
+            BeginNoAllocationRegion("frame");
+        }
+        if (shadows)
+        {
+            renderCubeShadows(*shadows, view, cube, models, options.Physics);
+        }
+        ourShader.use();
+        if (lit)
+        {
+            clusters.Update(lights, view.GetViewMatrix(), view.GetProjectionMatrix(), view.GetNearPlane(), view.GetFarPlane(), frame->Width, frame->Height);
+            clusters.Bind(ourShader, view.Position, AMBIENT_LIGHT);
+            if (shadows)
+                shadows->Bind(ourShader);
+        }
+        if (terrain)
+        {
+            terrain->Update(view);
+        }
+        if (voxels)
+        {
+            voxels->Update();
+        }
+        if (deferred)
         {
-            glm::mat4 model;
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            if (i % 3 == 0)
+            deferred->Resize(frame->Width, frame->Height);
+            deferred->BeginGeometryPass(view.GetViewMatrix(), view.GetProjectionMatrix());
+            renderScene(deferred->GeometryShader, cube, texture1, texture2, view.GetViewMatrix(), view.GetProjectionMatrix(), models, prepass.get());
+            if (crowd)
             {
-                angle = glfwGetTime() * 25.0f;
+                drawCrowd(*crowd, frame->Crowd, true, NULL, NULL, view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
             }
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            if (model)
+            {
+                drawModel(*model, modelPlacement, true, NULL, NULL, view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (mesh)
+            {
+                drawMesh(deferred->GeometryShader, *mesh, meshPlacement, view.GetViewMatrix(), view.GetProjectionMatrix(), cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, true, NULL, NULL, view, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, true, NULL, NULL, view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (shadows)
+            {
+                deferred->LightingShader.use();
+                shadows->Bind(deferred->LightingShader);
+            }
+            deferred->Resolve(lit ? &clusters : NULL, view.GetInverseViewMatrix(), view.GetInverseProjectionMatrix(), view.Position,
+                AMBIENT_LIGHT, CLEAR_COLOR, view.GetNearPlane(), view.GetFarPlane());
+        }
+        else
+        {
+            glClearColor(CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderScene(ourShader, cube, texture1, texture2, view.GetViewMatrix(), view.GetProjectionMatrix(), models, prepass.get());
+            if (crowd)
+            {
+                drawCrowd(*crowd, frame->Crowd, false, lit ? &clusters : NULL, shadows.get(), view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (model)
+            {
+                drawModel(*model, modelPlacement, false, lit ? &clusters : NULL, shadows.get(), view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (mesh)
+            {
+                drawMesh(ourShader, *mesh, meshPlacement, view.GetViewMatrix(), view.GetProjectionMatrix(), cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, false, lit ? &clusters : NULL, shadows.get(), view, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, false, lit ? &clusters : NULL, shadows.get(), view.Position, view.GetViewMatrix(), view.GetProjectionMatrix());
+            }
+        }
+        if (particles)
+        {
+            particles->Draw(frame->Particles, view.GetViewMatrix(), view.GetProjectionMatrix());
+        }
+        if (debugRenderer)
+        {
+            debugDrawScene(models, lights);
+            debugRenderer->Flush(GetDebugDraw(), view.GetViewMatrix(), view.GetProjectionMatrix(), frame->Width, frame->Height);
+        }
+        if (overlay)
+        {
+            overlay->Draw(GetRenderStats(), frame->Width, frame->Height);
+        }
+        if (enforceNoAllocation)
+        {
+            EndNoAllocationRegion();
         }
 
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // check and call events, and swap the buffers
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        GetGLCapture().EndFrame();
+        GetFrameArena().Reset();
     }
+}
 
-    // deallocate resources
+// Every third cube spins, the others keep their initial angle
+glm::mat4 cubeModel(int i, float time)
+{
+    glm::mat4 model;
+    model = glm::translate(model, cubePositions[i]);
+    float angle = 20.0f * i;
+    if (i % 3 == 0)
+    {
+        angle = time * 25.0f;
+    }
+    return glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+}
 
-    glfwTerminate();
-	return 0;
+// The cube transforms at the given time, CUBE_COUNT of them
+void simulateCubes(glm::mat4* models, float time)
+{
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        models[i] = cubeModel(i, time);
+    }
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+// The cubes as boxes falling onto an invisible floor under the scene, the spinning ones tumbling. Body i is cube i
+std::unique_ptr<PhysicsWorld> createCubePhysics()
 {
-    SCR_WIDTH = width;
-    SCR_HEIGHT = height;
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    std::unique_ptr<PhysicsWorld> physics(new PhysicsWorld());
+    int box = physics->AddBoxShape(glm::vec3(0.5f));
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        int body = physics->AddBody(box, cubePositions[i], glm::quat_cast(glm::mat3(cubeModel(i, 0.0f))));
+        if (i % 3 == 0)
+        {
+            physics->AngularVelocities[body] = glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f)) * 3.0f;
+        }
+    }
+    int floor = physics->AddBoxShape(glm::vec3(20.0f, 0.5f, 20.0f));
+    physics->AddBody(floor, glm::vec3(0.0f, -4.5f, -7.0f), glm::quat(), 0.0f);
+    physics->Reserve(CUBE_COUNT * 8);
+    return physics;
 }
 
-void processInput(GLFWwindow* window)
+// The cube transforms from the last physics step
+void readCubePhysics(const PhysicsWorld& physics, glm::mat4* models)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    for (int i = 0; i < CUBE_COUNT; i++)
     {
-        glfwSetWindowShouldClose(window, true);
+        models[i] = physics.GetTransform(i);
     }
+}
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) camera.ProcessKeyboard(RIGHT, deltaTime);
+// The benchmark objects as boxes dropped onto a static floor under the scene, which is wide enough that the ones
+// tumbling off a pile stay on it. Body i is object i, the floor comes last
+std::unique_ptr<PhysicsWorld> createPhysicsPile(const BenchmarkScene& scene)
+{
+    std::unique_ptr<PhysicsWorld> physics(new PhysicsWorld());
+    int box = physics->AddBoxShape(glm::vec3(0.5f));
+    for (size_t i = 0; i < scene.Size(); i++)
+    {
+        physics->AddBody(box, scene.Positions[i], glm::angleAxis(glm::radians(scene.Angles[i]), scene.Axes[i]));
+    }
+    const float extent = scene.Radius / 1.75f;
+    int floor = physics->AddBoxShape(glm::vec3(extent * 2.0f, 0.5f, extent * 2.0f));
+    physics->AddBody(floor, scene.Center - glm::vec3(0.0f, extent + 1.5f, 0.0f), glm::quat(), 0.0f);
+    // resting boxes touch a handful of neighbours, a tight pile up to a dozen
+    physics->Reserve(scene.Size() * 8);
+    return physics;
 }
 
-void mouse_callback(GLFWwindow * window, double xpos, double ypos)
+// Draws the cubes with the shader's view/projection already set, using whichever VAO is bound
+void drawCubes(Shader& shader, int vertexCount, const glm::mat4* models)
+{
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        shader.setMat4("model", models[i]);
+
+        glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+        GetRenderStats().CountDraw(vertexCount);
+    }
+}
+
+// Draws the cubes into the shadow cascades, only the spinning ones are redrawn into the cached cascades every frame
+// unless all of them are moving
+void renderCubeShadows(CascadedShadowMaps& shadows, Camera& camera, const QuantizedMesh& cube, const glm::mat4* models, bool moving)
+{
+    ShadowCaster* casters = GetFrameArena().New<ShadowCaster>(CUBE_COUNT);
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        // a unit cube's bounding sphere
+        casters[i] = { glm::vec3(models[i][3]), 0.87f, !moving && i % 3 != 0 };
+    }
+    shadows.Render(camera, casters, CUBE_COUNT, [&](Shader& shader, const std::vector<int>& indices)
+    {
+        glBindVertexArray(cube.PositionVAO);
+        for (int i : indices)
+        {
+            shader.setMat4("model", models[i]);
+            glDrawArrays(GL_TRIANGLES, 0, cube.VertexCount);
+            GetRenderStats().CountDraw(cube.VertexCount);
+        }
+    });
+}
+
+// Draws the scene into the bound, already cleared framebuffer. With a pre-pass the depth buffer is laid down first
+// from the position-only stream and the shading pass only runs for visible fragments
+void renderScene(Shader& shader, const QuantizedMesh& cube, unsigned int texture1, unsigned int texture2, const glm::mat4& view, const glm::mat4& projection, const glm::mat4* models, DepthPrepass* prepass)
 {
-    if (firstMouse)
+    if (prepass != NULL)
     {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
+        prepass->BeginDepthPass(view, projection);
+        glBindVertexArray(cube.PositionVAO);
+        drawCubes(prepass->DepthShader, cube.VertexCount, models);
+        prepass->BeginShadingPass();
     }
 
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos;
-    lastX = xpos;
-    lastY = ypos;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture2);
+
+    shader.use();
+    shader.setMat4("view", view);
+    shader.setMat4("projection", projection);
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    glBindVertexArray(cube.VAO);
+    drawCubes(shader, cube.VertexCount, models);
+
+    if (prepass != NULL)
+    {
+        prepass->End();
+    }
 }
 
-void scroll_callback(GLFWwindow * window, double xoffset, double yoffset)
+// --pack <archive> [--compress] <files...> writes the files into an asset archive under the paths as given, which
+// should be relative to the working directory the engine runs from, e.g. src/vShader.glsl
+int packAssets(int argc, char const *argv[])
 {
-    camera.ProcessMouseScroll(yoffset);
+    if (argc < 3)
+    {
+        std::cerr << "Usage: --pack <archive> [--compress] <files...>" << std::endl;
+        return -1;
+    }
+    bool compress = false;
+    std::vector<std::string> files;
+    for (int i = 3; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--compress")
+            compress = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (!WriteAssetArchive(argv[2], files, compress))
+    {
+        return -1;
+    }
+    std::cout << "Packed " << files.size() << " files into \"" << argv[2] << "\"" << std::endl;
+    return 0;
 }
 
-unsigned int createTexture(const char* filePath, bool alpha)
+// Renders the fixed camera path into an FBO, checks selected frames against golden images and records timings.
+// Returns non-zero if any frame differs from its golden image
+int runHeadless(const HeadlessOptions& options)
 {
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // GL_LINEAR_MIPMAP_LINEAR
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load and generate the texture
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(filePath, &width, &height, &nrChannels, 0);
-    if (data)
+    if (options.UpdateGolden && !CreateDirectories(options.GoldenDir))
     {
-        unsigned int pixelFormat = alpha ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, pixelFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        std::cerr << "Failed to create golden image directory \"" << options.GoldenDir << "\"" << std::endl;
+        return -1;
     }
-    else
+    OffscreenContext context;
+    if (!context.Create(options.Width, options.Height))
     {
-        std::cerr << "Failed to load texture with filepath \"" << filePath << "\"" << std::endl;
+        return -1;
+    }
+    if (!options.CapturePath.empty() && !GetGLCapture().Begin(options.CapturePath, options.CaptureStart, options.CaptureFrames, options.Width, options.Height))
+    {
+        return -1;
+    }
+
+    RenderTarget target;
+    if (!target.Create(options.Width, options.Height))
+    {
+        return -1;
+    }
+
+    glEnable(GL_DEPTH_TEST);
+
+    Shader ourShader("src/vShader.glsl", "src/fShader.glsl");
+    QuantizedMesh cube(vertices, 36, SourceLayout(8, 0, 6, 3), VertexFormat(VERTEX_POSITION | VERTEX_TEXCOORD | VERTEX_NORMAL));
+
+    stbi_set_flip_vertically_on_load(true);
+    unsigned int texture1 = createTexture("res/container.jpg", false);
+    unsigned int texture2 = createTexture("res/awesomeface.png", true);
+
+    ourShader.use();
+    ourShader.setInt("texture1", 0);
+    ourShader.setInt("texture2", 1);
+    ourShader.setFloat("roughness", DEFAULT_ROUGHNESS);
+    ourShader.setFloat("metalness", DEFAULT_METALNESS);
+    LightClusters::SetSamplerUnits(ourShader);
+    cube.SetDequantUniforms(ourShader);
+
+    std::unique_ptr<DepthPrepass> prepass;
+    if (options.DepthPrepass)
+    {
+        prepass.reset(new DepthPrepass());
+        prepass->DepthShader.use();
+        cube.SetDequantUniforms(prepass->DepthShader);
+    }
+    std::unique_ptr<OverdrawMeter> overdraw;
+    if (options.Overdraw)
+    {
+        overdraw.reset(new OverdrawMeter());
+        overdraw->CountShader.use();
+        cube.SetDequantUniforms(overdraw->CountShader);
+    }
+    std::unique_ptr<DeferredRenderer> deferred;
+    if (options.Deferred)
+    {
+        deferred.reset(new DeferredRenderer(options.Width, options.Height));
+        deferred->GeometryShader.use();
+        cube.SetDequantUniforms(deferred->GeometryShader);
+    }
+    std::unique_ptr<CascadedShadowMaps> shadows;
+    if (options.Shadows)
+    {
+        shadows.reset(new CascadedShadowMaps());
+        shadows->DepthShader.use();
+        cube.SetDequantUniforms(shadows->DepthShader);
+    }
+    LightClusters clusters;
+    std::vector<Light> lights = createSceneLights(options.LightCount);
+    bool lit = !lights.empty() || shadows;
+    std::unique_ptr<ParticleSystem> particles;
+    if (options.ParticleCount > 0)
+    {
+        particles = createParticleFountain<ParticleSystem>(options.ParticleCount, glm::vec3(0.0f, -2.0f, -5.0f), 4.0f);
+    }
+    std::unique_ptr<AnimatedCrowd> crowd;
+    if (options.CharacterCount > 0)
+    {
+        crowd = createCrowd<AnimatedCrowd>(options.CharacterCount, glm::vec3(0.0f, -3.0f, -8.0f), 1.5f, options.CpuSkinning);
+    }
+    std::unique_ptr<GltfModel> model;
+    glm::mat4 modelPlacement;
+    if (!options.GltfPath.empty())
+    {
+        model = loadModel(options.GltfPath, glm::vec3(0.0f, 0.0f, -5.0f), 3.0f, modelPlacement);
+        if (!model)
+        {
+            return -1;
+        }
+    }
+    std::unique_ptr<QuantizedMesh> mesh;
+    glm::mat4 meshPlacement;
+    if (!options.MeshPath.empty())
+    {
+        mesh = importMesh(options.MeshPath, glm::vec3(0.0f, 0.0f, -5.0f), 3.0f, meshPlacement, NULL);
+        if (!mesh)
+        {
+            return -1;
+        }
+    }
+    std::unique_ptr<PhysicsWorld> physics;
+    if (options.Physics)
+    {
+        physics = createCubePhysics();
+    }
+    // generated as the camera needs it, so every image is complete and the same from run to run
+    std::unique_ptr<TerrainRenderer> terrain;
+    if (options.TerrainSize > 0.0f)
+    {
+        terrain = createTerrain(options.TerrainSize, glm::vec3(0.0f, -6.0f, -7.0f), true);
+    }
+    std::unique_ptr<VoxelWorld> voxels;
+    if (options.VoxelColumns > 0)
+    {
+        voxels = createVoxelWorld(options.VoxelColumns, glm::vec3(0.0f, -6.0f, -7.0f));
+    }
+    std::unique_ptr<PerformanceOverlay> overlay;
+    if (options.Overlay)
+    {
+        overlay.reset(new PerformanceOverlay());
+    }
+    std::unique_ptr<DebugRenderer> debugRenderer;
+    if (options.DebugDraw)
+    {
+        GetDebugDraw().Enable();
+        debugRenderer.reset(new DebugRenderer());
+    }
+
+    float farPlane = terrain ? TERRAIN_VIEW_DISTANCE : FAR_PLANE;
+    if (voxels)
+        farPlane = std::max(farPlane, voxelViewDistance(options.VoxelColumns));
+
+    const float aspect = (float)options.Width / (float)options.Height;
+    const float frameTime = 1.0f / 60.0f;
+    glm::mat4 models[CUBE_COUNT];
+    int failures = 0;
+    std::vector<unsigned char> pixels, golden;
+    FrameTimings timings;
+    AllocationCounts steadyStart;
+
+    for (int frame = 0; frame < options.Frames; frame++)
+    {
+        Camera pose = CameraPathPose(frame, options.Frames);
+        pose.SetProjection(aspect, NEAR_PLANE, farPlane);
+        glm::mat4 view = pose.GetViewMatrix();
+        glm::mat4 projection = pose.GetProjectionMatrix();
+
+        BeginAllocatorFrame();
+        GetRenderStats().BeginFrame();
+        timings.BeginFrame();
+        bool enforceNoAllocation = frame >= ALLOCATION_WARMUP_FRAMES;
+        if (frame == ALLOCATION_WARMUP_FRAMES)
+        {
+            steadyStart = GetAllocationCounts();
+        }
+        if (enforceNoAllocation)
+        {
+            BeginNoAllocationRegion("frame");
+        }
+        if (physics)
+        {
+            physics->Step(frameTime);
+            readCubePhysics(*physics, models);
+        }
+        else
+        {
+            simulateCubes(models, frame * frameTime);
+        }
+        if (crowd)
+        {
+            crowd->Update(frame * frameTime);
+        }
+        if (terrain)
+        {
+            terrain->Update(pose);
+        }
+        if (voxels)
+        {
+            voxels->Update();
+        }
+        if (shadows)
+        {
+            renderCubeShadows(*shadows, pose, cube, models, options.Physics);
+        }
+        if (lit)
+        {
+            clusters.Update(lights, view, projection, pose.GetNearPlane(), pose.GetFarPlane(), options.Width, options.Height);
+            ourShader.use();
+            clusters.Bind(ourShader, pose.Position, AMBIENT_LIGHT);
+            if (shadows)
+                shadows->Bind(ourShader);
+        }
+        target.Bind();
+        if (deferred)
+        {
+            deferred->BeginGeometryPass(view, projection);
+            renderScene(deferred->GeometryShader, cube, texture1, texture2, view, projection, models, prepass.get());
+            if (crowd)
+            {
+                drawCrowd(*crowd, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (model)
+            {
+                drawModel(*model, modelPlacement, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (mesh)
+            {
+                drawMesh(deferred->GeometryShader, *mesh, meshPlacement, view, projection, cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, true, NULL, NULL, pose, view, projection);
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (shadows)
+            {
+                deferred->LightingShader.use();
+                shadows->Bind(deferred->LightingShader);
+            }
+            deferred->Resolve(lit ? &clusters : NULL, pose.GetInverseViewMatrix(), pose.GetInverseProjectionMatrix(), pose.Position,
+                AMBIENT_LIGHT, CLEAR_COLOR, pose.GetNearPlane(), pose.GetFarPlane());
+        }
+        else
+        {
+            glClearColor(CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderScene(ourShader, cube, texture1, texture2, view, projection, models, prepass.get());
+            if (crowd)
+            {
+                drawCrowd(*crowd, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+            if (model)
+            {
+                drawModel(*model, modelPlacement, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+            if (mesh)
+            {
+                drawMesh(ourShader, *mesh, meshPlacement, view, projection, cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, false, lit ? &clusters : NULL, shadows.get(), pose, view, projection);
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+        }
+        if (particles)
+        {
+            particles->Update(frameTime);
+            particles->Draw(view, projection);
+        }
+        if (debugRenderer)
+        {
+            debugDrawScene(models, lights);
+            debugRenderer->Flush(GetDebugDraw(), view, projection, options.Width, options.Height);
+        }
+        if (overlay)
+        {
+            overlay->Draw(GetRenderStats(), options.Width, options.Height);
+        }
+        if (enforceNoAllocation)
+        {
+            EndNoAllocationRegion();
+        }
+        timings.EndFrame();
+        GetGLCapture().EndFrame();
+        GetFrameArena().Reset();
+
+        if (frame % options.GoldenInterval != 0)
+        {
+            continue;
+        }
+
+        if (overdraw)
+        {
+            overdraw->Begin(options.Width, options.Height);
+            renderScene(overdraw->CountShader, cube, texture1, texture2, view, projection, models, prepass.get());
+            OverdrawResult result = overdraw->End();
+            std::cout << "frame " << frame << ": overdraw " << result.Average << " average, " << result.Max << " max, " << result.Coverage * 100.0f << "% coverage" << std::endl;
+        }
+
+        // readback stalls the pipeline, so it happens outside the timed region
+        target.ReadPixels(pixels);
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%04d.ppm", frame);
+        std::string goldenPath = options.GoldenDir + "/" + name;
+        int goldenWidth, goldenHeight;
+        if (options.UpdateGolden)
+        {
+            if (!WritePPM(goldenPath, options.Width, options.Height, pixels))
+            {
+                std::cerr << "Failed to write golden image \"" << goldenPath << "\"" << std::endl;
+                failures++;
+            }
+        }
+        else if (!std::ifstream(goldenPath))
+        {
+            // a run that compares nothing would pass whatever it drew
+            if (options.AllowMissingGolden)
+            {
+                std::cout << name << ": NO BASELINE, --update-golden records \"" << goldenPath << "\"" << std::endl;
+            }
+            else
+            {
+                std::cerr << name << ": no golden image \"" << goldenPath << "\", record it with --update-golden or pass --allow-missing-golden" << std::endl;
+                failures++;
+            }
+        }
+        else if (!ReadPPM(goldenPath, goldenWidth, goldenHeight, golden) || goldenWidth != options.Width || goldenHeight != options.Height)
+        {
+            std::cerr << "Unreadable or mismatched golden image \"" << goldenPath << "\"" << std::endl;
+            failures++;
+        }
+        else
+        {
+            ImageDiff diff = CompareImages(pixels, golden, options.DeltaEThreshold);
+            bool pass = diff.FailFraction <= options.MaxFailFraction;
+            std::cout << name << ": " << (pass ? "PASS" : "FAIL") << " mean dE " << diff.MeanDeltaE << ", max dE " << diff.MaxDeltaE
+                << ", " << diff.FailFraction * 100.0f << "% of pixels over threshold" << std::endl;
+            if (!pass)
+            {
+                // keep the offending frame next to the golden one for inspection
+                WritePPM(options.GoldenDir + "/failed_" + name, options.Width, options.Height, pixels);
+                failures++;
+            }
+        }
+    }
+    timings.Finish();
+
+    std::cout << "frames " << options.Frames
+        << ", cpu ms p50 " << FrameTimings::Percentile(timings.CpuMs, 50.0) << " p95 " << FrameTimings::Percentile(timings.CpuMs, 95.0)
+        << ", gpu ms p50 " << FrameTimings::Percentile(timings.GpuMs, 50.0) << " p95 " << FrameTimings::Percentile(timings.GpuMs, 95.0) << std::endl;
+    if (IsAllocationTrackingEnabled() && options.Frames > ALLOCATION_WARMUP_FRAMES)
+    {
+        // includes golden image comparison and readback, which happen outside the no-alloc region
+        AllocationCounts steady = GetAllocationCounts() - steadyStart;
+        double frames = options.Frames - ALLOCATION_WARMUP_FRAMES;
+        std::cout << "heap per frame: new " << steady.NewAllocations / frames << " (" << steady.NewBytes / frames << " bytes), malloc "
+            << steady.MallocAllocations / frames << " (" << steady.MallocBytes / frames << " bytes), " << steady.Violations << " no-alloc violations" << std::endl;
+    }
+    if (!options.TimingsPath.empty() && !timings.WriteCsv(options.TimingsPath))
+    {
+        std::cerr << "Failed to write timings to \"" << options.TimingsPath << "\"" << std::endl;
+    }
+
+    target.Destroy();
+    GetGLCapture().End();
+    return failures == 0 ? 0 : 1;
+}
+
+// Replays a GL capture on an offscreen context, with a render target of the captured size standing in for the
+// default framebuffer, and reports how long the captured frames and every GL function in them took
+int runReplay(const ReplayOptions& options)
+{
+    GLReplayer replayer;
+    if (!replayer.Load(options.CapturePath))
+    {
+        return -1;
+    }
+    OffscreenContext context;
+    if (!context.Create(replayer.Width, replayer.Height))
+    {
+        return -1;
+    }
+    RenderTarget target;
+    if (!target.Create(replayer.Width, replayer.Height))
+    {
+        return -1;
+    }
+    replayer.DefaultFramebuffer = target.FBO;
+    replayer.CallTimings = options.CallTimings;
+    if (!replayer.Run())
+    {
+        return 1;
+    }
+
+    // stdout is the JSON when there is no --out
+    std::cerr << "replayed " << replayer.SubmitMs.size() << " frames, " << replayer.Calls << " calls after " << replayer.SetupCalls << " setup calls"
+        << ", submit ms p50 " << FrameTimings::Percentile(replayer.SubmitMs, 50.0) << " p95 " << FrameTimings::Percentile(replayer.SubmitMs, 95.0)
+        << ", finish ms p50 " << FrameTimings::Percentile(replayer.FinishMs, 50.0) << " p95 " << FrameTimings::Percentile(replayer.FinishMs, 95.0)
+        << ", " << replayer.Errors << " GL errors" << std::endl;
+    if (options.OutputPath.empty())
+    {
+        WriteReplayJson(std::cout, options, replayer);
+    }
+    else
+    {
+        std::ofstream out(options.OutputPath);
+        WriteReplayJson(out, options, replayer);
+        if (!out)
+        {
+            std::cerr << "Failed to write replay results to \"" << options.OutputPath << "\"" << std::endl;
+            return -1;
+        }
+    }
+    target.Destroy();
+    return 0;
+}
+
+// Renders a procedurally generated scene along the deterministic camera path and writes frame-time percentiles,
+// submission counts and memory use as JSON. Every rendering optimization is measured against these workloads
+int runBenchmark(const BenchmarkOptions& options)
+{
+    OffscreenContext context;
+    if (!context.Create(options.Width, options.Height))
+    {
+        return -1;
+    }
+
+    RenderTarget target;
+    if (!target.Create(options.Width, options.Height))
+    {
+        return -1;
+    }
+
+    glEnable(GL_DEPTH_TEST);
+
+    Shader ourShader("src/vShader.glsl", "src/fShader.glsl");
+    QuantizedMesh cube(vertices, 36, SourceLayout(8, 0, 6, 3), VertexFormat(VERTEX_POSITION | VERTEX_TEXCOORD | VERTEX_NORMAL));
+    BenchmarkScene scene = GenerateBenchmarkScene(options);
+
+    std::vector<unsigned int> materials(options.MaterialCount);
+    std::unique_ptr<TextureStreamer> streamer;
+    if (options.TextureBudgetMB > 0)
+    {
+        streamer.reset(new TextureStreamer((uint64_t)options.TextureBudgetMB << 20));
+        for (int m = 0; m < options.MaterialCount; m++)
+        {
+            int size = options.TextureSize;
+            int handle = streamer->Add([m, size](std::vector<unsigned char>& rgba, int& width, int& height)
+            {
+                std::vector<unsigned char> rgb = GenerateMaterialTexture(m, size);
+                rgba.resize((size_t)size * size * 4);
+                for (size_t p = 0; p < (size_t)size * size; p++)
+                {
+                    rgba[p * 4 + 0] = rgb[p * 3 + 0];
+                    rgba[p * 4 + 1] = rgb[p * 3 + 1];
+                    rgba[p * 4 + 2] = rgb[p * 3 + 2];
+                    rgba[p * 4 + 3] = 255;
+                }
+                width = height = size;
+                return true;
+            });
+            // handles are assigned in order, so the material index doubles as the handle
+            materials[m] = streamer->GetTexture(handle);
+        }
+    }
+    for (int m = 0; m < options.MaterialCount && !streamer; m++)
+    {
+        std::vector<unsigned char> pixels = GenerateMaterialTexture(m, options.TextureSize);
+        glGenTextures(1, &materials[m]);
+        glBindTexture(GL_TEXTURE_2D, materials[m]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, options.TextureSize, options.TextureSize, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GetRenderStats().TextureBytes += (uint64_t)options.TextureSize * options.TextureSize * 4 * 4 / 3;
+    }
+    stbi_set_flip_vertically_on_load(true);
+    unsigned int overlay = createTexture("res/awesomeface.png", true);
+
+    ourShader.use();
+    ourShader.setInt("texture1", 0);
+    ourShader.setInt("texture2", 1);
+    ourShader.setFloat("roughness", DEFAULT_ROUGHNESS);
+    ourShader.setFloat("metalness", DEFAULT_METALNESS);
+    LightClusters::SetSamplerUnits(ourShader);
+    cube.SetDequantUniforms(ourShader);
+
+    std::unique_ptr<DepthPrepass> prepass;
+    if (options.DepthPrepass)
+    {
+        prepass.reset(new DepthPrepass());
+        prepass->DepthShader.use();
+        cube.SetDequantUniforms(prepass->DepthShader);
+    }
+    std::unique_ptr<OverdrawMeter> overdraw;
+    OverdrawResult overdrawResult;
+    if (options.Overdraw)
+    {
+        overdraw.reset(new OverdrawMeter());
+        overdraw->CountShader.use();
+        cube.SetDequantUniforms(overdraw->CountShader);
+    }
+    std::unique_ptr<DeferredRenderer> deferred;
+    if (options.Deferred)
+    {
+        deferred.reset(new DeferredRenderer(options.Width, options.Height));
+        deferred->GeometryShader.use();
+        cube.SetDequantUniforms(deferred->GeometryShader);
+    }
+    std::unique_ptr<CascadedShadowMaps> shadows;
+    if (options.Shadows)
+    {
+        shadows.reset(new CascadedShadowMaps());
+        shadows->DepthShader.use();
+        cube.SetDequantUniforms(shadows->DepthShader);
+        shadows->MaxDistance = scene.Radius * 3.0f;
+        shadows->CasterDistance = scene.Radius * 2.0f;
+    }
+    LightClusters clusters;
+    std::vector<Light> lights = GenerateBenchmarkLights(options, scene);
+    bool lit = !lights.empty() || shadows;
+    std::unique_ptr<ParticleSystem> particles;
+    if (options.ParticleCount > 0)
+    {
+        particles = createParticleFountain<ParticleSystem>(options.ParticleCount, scene.Center - glm::vec3(0.0f, scene.Radius * 0.5f, 0.0f), scene.Radius * 0.8f);
+    }
+    std::unique_ptr<AnimatedCrowd> crowd;
+    if (options.CharacterCount > 0)
+    {
+        crowd = createCrowd<AnimatedCrowd>(options.CharacterCount, scene.Center - glm::vec3(0.0f, scene.Radius * 0.6f, 0.0f), 1.5f, options.CpuSkinning);
+    }
+    std::unique_ptr<GltfModel> model;
+    glm::mat4 modelPlacement;
+    if (!options.GltfPath.empty())
+    {
+        model = loadModel(options.GltfPath, scene.Center, scene.Radius, modelPlacement);
+        if (!model)
+        {
+            return -1;
+        }
+    }
+    std::unique_ptr<QuantizedMesh> mesh;
+    MeshImportStats meshStats;
+    glm::mat4 meshPlacement;
+    if (!options.MeshPath.empty())
+    {
+        mesh = importMesh(options.MeshPath, scene.Center, scene.Radius, meshPlacement, &meshStats);
+        if (!mesh)
+        {
+            return -1;
+        }
+    }
+    std::unique_ptr<PhysicsWorld> physics;
+    if (options.Physics)
+    {
+        physics = createPhysicsPile(scene);
+    }
+    std::unique_ptr<TerrainRenderer> terrain;
+    if (options.TerrainSize > 0.0f)
+    {
+        terrain = createTerrain(options.TerrainSize, scene.Center - glm::vec3(0.0f, scene.Radius, 0.0f), false);
+    }
+    std::unique_ptr<VoxelWorld> voxels;
+    if (options.VoxelColumns > 0)
+    {
+        voxels = createVoxelWorld(options.VoxelColumns, scene.Center - glm::vec3(0.0f, scene.Radius, 0.0f));
+    }
+    std::unique_ptr<PerformanceOverlay> hud;
+    if (options.Overlay)
+    {
+        hud.reset(new PerformanceOverlay());
+    }
+    std::unique_ptr<DebugRenderer> debugRenderer;
+    if (options.DebugDraw)
+    {
+        GetDebugDraw().Enable();
+        debugRenderer.reset(new DebugRenderer());
+    }
+    float farPlane = scene.Radius * 3.0f;
+    if (terrain)
+        farPlane = std::max(farPlane, TERRAIN_VIEW_DISTANCE);
+    if (voxels)
+        farPlane = std::max(farPlane, voxelViewDistance(options.VoxelColumns));
+
+    const float aspect = (float)options.Width / (float)options.Height;
+    const float frameTime = 1.0f / 60.0f;
+    FrameTimings timings;
+    std::vector<RenderStats> frameStats;
+    frameStats.reserve(options.Frames);
+    PhaseTimings phases;
+    phases.FrameCapacity = options.WarmupFrames + options.Frames;
+    std::vector<AllocatorStats> allocatorTotals;
+    HeapReport heap;
+    std::vector<glm::mat4> models(scene.Size());
+
+    for (int frame = -options.WarmupFrames; frame < options.Frames; frame++)
+    {
+        if (frame == 0)
+        {
+            timings.Finish();
+            timings.Clear();
+            frameStats.clear();
+            phases.Clear();
+            allocatorTotals.clear();
+            heap.Begin();
+        }
+        Camera pose = CameraPathPose(frame, options.Frames, scene.Center, scene.Radius);
+        float time = frame * frameTime;
+
+        GetRenderStats().BeginFrame();
+        BeginAllocatorFrame();
+        timings.BeginFrame();
+        bool enforceNoAllocation = frame + options.WarmupFrames >= ALLOCATION_WARMUP_FRAMES;
+        if (voxels)
+        {
+            // digs a pit along a circle around the scene and fills the last one back in, which keeps a few chunks
+            // remeshing every frame. Edits can grow a chunk's palette, which allocates, so they come before the
+            // no-allocation region; meshing and uploading are inside it
+            AllocationScope allocationScope("voxel_edit");
+            std::chrono::high_resolution_clock::time_point editStart = std::chrono::high_resolution_clock::now();
+            float angle = (frame / 2) * 0.15f;
+            glm::vec3 pit = scene.Center + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * scene.Radius * 0.8f;
+            pit.y = voxels->SurfaceHeight(pit.x, pit.z);
+            voxels->FillSphere(pit, 4.0f, frame % 2 == 0 ? VOXEL_AIR : (uint16_t)VOXEL_DIRT);
+            phases.Add("voxel_edit", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - editStart).count());
+        }
+        if (enforceNoAllocation)
+        {
+            BeginNoAllocationRegion("frame");
+        }
+
+        if (physics)
+        {
+            // the bodies take the place of the spinning objects, everything placed by position follows them
+            AllocationScope allocationScope("physics");
+            std::chrono::high_resolution_clock::time_point physicsStart = std::chrono::high_resolution_clock::now();
+            physics->Step(frameTime);
+            physics->WriteTransforms(0, scene.Size(), scene.Transforms, 0);
+            std::copy(physics->Positions.begin(), physics->Positions.begin() + scene.Size(), scene.Positions.begin());
+            phases.Add("physics", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - physicsStart).count());
+        }
+
+        PushAllocationScope("transforms");
+        std::chrono::high_resolution_clock::time_point transformStart = std::chrono::high_resolution_clock::now();
+        if (options.GlmTransforms && !physics)
+        {
+            for (size_t i = 0; i < scene.Size(); i++)
+            {
+                glm::mat4 model;
+                model = glm::translate(model, scene.Positions[i]);
+                model = glm::rotate(model, glm::radians(scene.Angles[i] + scene.AngularSpeeds[i] * time), scene.Axes[i]);
+                models[i] = model;
+            }
+        }
+        else
+        {
+            if (!physics)
+            {
+                scene.UpdateRotations(time);
+            }
+            ComposeTransforms(scene.Transforms, 0, scene.Size(), models.data());
+        }
+        phases.Add("transforms", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - transformStart).count());
+        PopAllocationScope();
+
+        pose.SetProjection(aspect, NEAR_PLANE, farPlane);
+        const glm::mat4& view = pose.GetViewMatrix();
+        const glm::mat4& projection = pose.GetProjectionMatrix();
+
+        if (streamer)
+        {
+            // each material needs the mip of its largest visible object
+            AllocationScope allocationScope("texture_streaming");
+            std::chrono::high_resolution_clock::time_point streamStart = std::chrono::high_resolution_clock::now();
+            const Frustum& frustum = pose.GetFrustum();
+            for (size_t i = 0; i < scene.Size(); i++)
+            {
+                if (frustum.IntersectsSphere(scene.Positions[i], 0.87f))
+                {
+                    streamer->RequestSize(scene.Materials[i], TextureStreamer::ProjectedSize(view, projection, options.Height, scene.Positions[i], 0.87f));
+                }
+            }
+            streamer->Update();
+            phases.Add("texture_streaming", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - streamStart).count());
+        }
+        if (lit)
+        {
+            AllocationScope allocationScope("light_assignment");
+            clusters.Update(lights, view, projection, pose.GetNearPlane(), pose.GetFarPlane(), options.Width, options.Height);
+            phases.Add("light_assignment", clusters.AssignMs);
+        }
+        if (particles)
+        {
+            AllocationScope allocationScope("particles");
+            std::chrono::high_resolution_clock::time_point particleStart = std::chrono::high_resolution_clock::now();
+            particles->Update(frameTime);
+            phases.Add("particles", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - particleStart).count());
+        }
+        if (crowd)
+        {
+            AllocationScope allocationScope("animation");
+            crowd->Update(time);
+            phases.Add("animation", crowd->AnimateMs);
+            if (options.CpuSkinning)
+                phases.Add("skinning", crowd->SkinMs);
+        }
+        if (terrain)
+        {
+            AllocationScope allocationScope("terrain");
+            terrain->Update(pose);
+            phases.Add("terrain", terrain->Stats.SelectMs);
+        }
+        if (voxels)
+        {
+            AllocationScope allocationScope("voxel_meshing");
+            voxels->Update();
+            phases.Add("voxel_meshing", voxels->Stats.MeshMs);
+            phases.Add("voxel_upload", voxels->Stats.UploadMs);
+        }
+
+        // draws every object with shader, binding material textures only when the material changes
+        auto drawObjects = [&](Shader& shader, bool bindMaterials)
+        {
+            int boundMaterial = -1;
+            for (size_t i = 0; i < scene.Size(); i++)
+            {
+                if (bindMaterials && scene.Materials[i] != boundMaterial)
+                {
+                    boundMaterial = scene.Materials[i];
+                    glBindTexture(GL_TEXTURE_2D, materials[boundMaterial]);
+                }
+                shader.setMat4("model", models[i]);
+
+                glDrawArrays(GL_TRIANGLES, 0, cube.VertexCount);
+                GetRenderStats().CountDraw(cube.VertexCount);
+            }
+        };
+        auto renderFrame = [&](Shader& shader)
+        {
+            if (prepass)
+            {
+                prepass->BeginDepthPass(view, projection);
+                glBindVertexArray(cube.PositionVAO);
+                drawObjects(prepass->DepthShader, false);
+                prepass->BeginShadingPass();
+            }
+            shader.use();
+            shader.setMat4("view", view);
+            shader.setMat4("projection", projection);
+            if (lit && &shader == &ourShader)
+            {
+                clusters.Bind(shader, pose.Position, AMBIENT_LIGHT);
+                if (shadows)
+                    shadows->Bind(shader);
+            }
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, overlay);
+            glActiveTexture(GL_TEXTURE0);
+            glBindVertexArray(cube.VAO);
+            drawObjects(shader, true);
+            if (prepass)
+            {
+                prepass->End();
+            }
+        };
+
+        if (shadows)
+        {
+            AllocationScope allocationScope("shadows");
+            std::chrono::high_resolution_clock::time_point shadowStart = std::chrono::high_resolution_clock::now();
+            // objects that don't spin never invalidate the cached cascades, falling ones always do
+            ShadowCaster* casters = GetFrameArena().New<ShadowCaster>(scene.Size());
+            for (size_t i = 0; i < scene.Size(); i++)
+            {
+                casters[i] = { scene.Positions[i], 0.87f, !options.Physics && scene.AngularSpeeds[i] == 0.0f };
+            }
+            shadows->Render(pose, casters, scene.Size(), [&](Shader& shader, const std::vector<int>& indices)
+            {
+                glBindVertexArray(cube.PositionVAO);
+                for (int i : indices)
+                {
+                    shader.setMat4("model", models[i]);
+                    glDrawArrays(GL_TRIANGLES, 0, cube.VertexCount);
+                    GetRenderStats().CountDraw(cube.VertexCount);
+                }
+            });
+            phases.Add("shadows", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - shadowStart).count());
+        }
+
+        PushAllocationScope("draw");
+        target.Bind();
+        if (deferred)
+        {
+            deferred->BeginGeometryPass(view, projection);
+            renderFrame(deferred->GeometryShader);
+            if (crowd)
+            {
+                drawCrowd(*crowd, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (model)
+            {
+                drawModel(*model, modelPlacement, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (mesh)
+            {
+                drawMesh(deferred->GeometryShader, *mesh, meshPlacement, view, projection, cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, true, NULL, NULL, pose, view, projection);
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, true, NULL, NULL, pose.Position, view, projection);
+            }
+            if (shadows)
+            {
+                deferred->LightingShader.use();
+                shadows->Bind(deferred->LightingShader);
+            }
+            deferred->Resolve(lit ? &clusters : NULL, pose.GetInverseViewMatrix(), pose.GetInverseProjectionMatrix(), pose.Position,
+                AMBIENT_LIGHT, CLEAR_COLOR, pose.GetNearPlane(), pose.GetFarPlane());
+        }
+        else
+        {
+            glClearColor(CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderFrame(ourShader);
+            if (crowd)
+            {
+                drawCrowd(*crowd, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+            if (model)
+            {
+                drawModel(*model, modelPlacement, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+            if (mesh)
+            {
+                drawMesh(ourShader, *mesh, meshPlacement, view, projection, cube);
+            }
+            if (voxels)
+            {
+                drawVoxels(*voxels, false, lit ? &clusters : NULL, shadows.get(), pose, view, projection);
+            }
+            if (terrain)
+            {
+                drawTerrain(*terrain, false, lit ? &clusters : NULL, shadows.get(), pose.Position, view, projection);
+            }
+        }
+        if (particles)
+        {
+            particles->Draw(view, projection);
+        }
+        PopAllocationScope();
+        if (debugRenderer)
+        {
+            // every object's box and every light from the job system, the way bounds or BVH nodes would be drawn
+            // from the passes that compute them
+            AllocationScope allocationScope("debug_draw");
+            std::chrono::high_resolution_clock::time_point debugStart = std::chrono::high_resolution_clock::now();
+            GetJobSystem().ParallelFor((int)scene.Size(), 256, [&](int begin, int end)
+            {
+                for (int i = begin; i < end; i++)
+                    GetDebugDraw().Box(models[i], glm::vec4(0.2f, 1.0f, 0.3f, 1.0f));
+            });
+            for (const Light& light : lights)
+                GetDebugDraw().Sphere(light.Position, 0.15f, glm::vec4(light.Color, 1.0f), true);
+            std::chrono::high_resolution_clock::time_point debugFlush = std::chrono::high_resolution_clock::now();
+            debugRenderer->Flush(GetDebugDraw(), view, projection, options.Width, options.Height);
+            phases.Add("debug_draw", std::chrono::duration<double, std::milli>(debugFlush - debugStart).count());
+            phases.Add("debug_flush", debugRenderer->FlushMs);
+        }
+        if (hud)
+        {
+            AllocationScope allocationScope("overlay");
+            hud->Draw(GetRenderStats(), options.Width, options.Height);
+            phases.Add("overlay", hud->CostMs);
+            phases.Add("overlay_layout", hud->LayoutMs);
+            phases.Add("overlay_submit", hud->Text.SubmitMs);
+        }
+        if (enforceNoAllocation)
+        {
+            EndNoAllocationRegion();
+        }
+        timings.EndFrame();
+        frameStats.push_back(GetRenderStats());
+        AccumulateAllocatorStats(allocatorTotals);
+        GetFrameArena().Reset();
+
+        // measured once, on the first recorded frame, outside the timed region
+        if (overdraw && frame == 0)
+        {
+            overdraw->Begin(options.Width, options.Height);
+            renderFrame(overdraw->CountShader);
+            overdrawResult = overdraw->End();
+        }
+    }
+    timings.Finish();
+
+    heap.End();
+    const HeapReport* heapReport = IsAllocationTrackingEnabled() ? &heap : NULL;
+
+    if (options.OutputPath.empty())
+    {
+        WriteBenchmarkJson(std::cout, options, timings, phases, frameStats, allocatorTotals, heapReport, overdraw ? &overdrawResult : NULL, model ? &model->Stats : NULL, mesh ? &meshStats : NULL, physics ? &physics->Stats : NULL, terrain ? &terrain->Stats : NULL, voxels ? &voxels->Stats : NULL, PeakProcessMemory());
+    }
+    else
+    {
+        std::ofstream out(options.OutputPath);
+        WriteBenchmarkJson(out, options, timings, phases, frameStats, allocatorTotals, heapReport, overdraw ? &overdrawResult : NULL, model ? &model->Stats : NULL, mesh ? &meshStats : NULL, physics ? &physics->Stats : NULL, terrain ? &terrain->Stats : NULL, voxels ? &voxels->Stats : NULL, PeakProcessMemory());
+        if (!out)
+        {
+            std::cerr << "Failed to write benchmark results to \"" << options.OutputPath << "\"" << std::endl;
+            return -1;
+        }
+    }
+
+    if (!streamer)
+    {
+        glDeleteTextures((GLsizei)materials.size(), materials.data());
+    }
+    glDeleteTextures(1, &overlay);
+    target.Destroy();
+    return 0;
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    inputQueue.Post({ RESIZE_EVENT, glfwGetTime(), (double)width, (double)height, 0, 0 });
+}
+
+// Applies the input events of the last frame to the simulation. The render thread picks up a resize from the snapshot
+void processInput(GLFWwindow* window)
+{
+    const InputFrame& input = inputQueue.Poll();
+
+    if (input.Resized)
+    {
+        SCR_WIDTH = input.Width;
+        SCR_HEIGHT = input.Height;
+        if (input.Height > 0)
+        {
+            camera.SetProjection((float)input.Width / (float)input.Height, NEAR_PLANE, farPlane);
+        }
+    }
+
+    if (inputQueue.WasPressed(GLFW_KEY_ESCAPE))
+    {
+        glfwSetWindowShouldClose(window, true);
+    }
+
+    // a tap shorter than a frame still moves for one frame
+    auto held = [](int key) { return inputQueue.IsKeyDown(key) || inputQueue.WasPressed(key); };
+    if (held(GLFW_KEY_W)) camera.ProcessKeyboard(FORWARD, deltaTime);
+    if (held(GLFW_KEY_S)) camera.ProcessKeyboard(BACKWARD, deltaTime);
+    if (held(GLFW_KEY_A)) camera.ProcessKeyboard(LEFT, deltaTime);
+    if (held(GLFW_KEY_D)) camera.ProcessKeyboard(RIGHT, deltaTime);
+
+    if (input.MouseX != 0.0f || input.MouseY != 0.0f)
+    {
+        camera.ProcessMouseMovement(input.MouseX, input.MouseY);
+    }
+    if (input.Scroll != 0.0f)
+    {
+        camera.ProcessMouseScroll(input.Scroll);
+    }
+}
+
+void mouse_callback(GLFWwindow * window, double xpos, double ypos)
+{
+    inputQueue.Post({ CURSOR_EVENT, glfwGetTime(), xpos, ypos, 0, 0 });
+}
+
+void scroll_callback(GLFWwindow * window, double xoffset, double yoffset)
+{
+    inputQueue.Post({ SCROLL_EVENT, glfwGetTime(), xoffset, yoffset, 0, 0 });
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    inputQueue.Post({ KEY_EVENT, glfwGetTime(), 0.0, 0.0, key, action });
+}
+
+unsigned int createTexture(const char* filePath, bool alpha)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // set the texture wrapping/filtering options (on the currently bound texture object)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // GL_LINEAR_MIPMAP_LINEAR
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // load and generate the texture
+    int width, height, nrChannels;
+    unsigned char *data = LoadAssetImage(filePath, &width, &height, &nrChannels, 0);
+    if (data)
+    {
+        unsigned int pixelFormat = alpha ? GL_RGBA : GL_RGB;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, pixelFormat, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GetRenderStats().TextureBytes += (uint64_t)width * height * 4 * 4 / 3;
+    }
+    else
+    {
+        std::cerr << "Failed to load texture with filepath \"" << filePath << "\"" << std::endl;
+    }
+    stbi_image_free(data);
+    return texture;
+}
+
+// Deterministic lights spread through the volume of the demo cubes: mostly small point lights, every fourth one a spot
+// aimed at the centre cube
+std::vector<Light> createSceneLights(int count)
+{
+    std::vector<Light> lights;
+    lights.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        // golden angle spiral, evenly covers the box without any randomness
+        float t = (i + 0.5f) / count;
+        float angle = i * 2.39996323f;
+        glm::vec3 position(std::cos(angle) * 5.0f * std::sqrt(t), -4.0f + 10.0f * std::fmod(i * 0.618034f, 1.0f), 2.0f - 18.0f * t);
+        glm::vec3 color = glm::clamp(glm::abs(glm::fract(glm::vec3(i * 0.1031f) + glm::vec3(0.0f, 0.333f, 0.667f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+        if (i % 4 == 3)
+            lights.push_back(Light::Spot(position, cubePositions[0] - position, 8.0f, 15.0f, 25.0f, color, 6.0f));
+        else
+            lights.push_back(Light::Point(position, 3.0f, color, 3.0f));
+    }
+    return lights;
+}
+
+// capacity covers the fluctuation of the emitted lifetimes
+size_t particleFountainCapacity(int liveCount)
+{
+    return liveCount + liveCount / 4 + PARTICLE_CHUNK;
+}
+
+// A fountain rising from base to about height, emitting so that liveCount particles are alive once it is running.
+// Particles is ParticleSystem, or ParticleSimulation when another thread draws them
+template<typename Particles>
+std::unique_ptr<Particles> createParticleFountain(int liveCount, const glm::vec3& base, float height)
+{
+    ParticleEmitter emitter;
+    emitter.Position = base;
+    emitter.Spread = 0.35f;
+    emitter.LifeMin = 1.0f;
+    emitter.LifeMax = 2.0f;
+    emitter.Rate = liveCount / (0.5f * (emitter.LifeMin + emitter.LifeMax));
+
+    std::unique_ptr<Particles> particles(new Particles(particleFountainCapacity(liveCount)));
+    float speed = std::sqrt(2.0f * -particles->Gravity.y * height);
+    emitter.SpeedMin = speed * 0.8f;
+    emitter.SpeedMax = speed;
+    particles->Emitters.push_back(emitter);
+    return particles;
+}
+
+// count characters in a square grid around center, each playing the sway and curl clips at its own phase and blend rate.
+// Crowd is AnimatedCrowd, or CrowdAnimation when another thread draws them with a CrowdRenderer of CreateTentacleRig()
+template<typename Crowd>
+std::unique_ptr<Crowd> createCrowd(int count, const glm::vec3& center, float spacing, bool cpuSkinning)
+{
+    int side = (int)std::ceil(std::sqrt((float)count));
+    std::vector<CharacterInstance> instances(count);
+    for (int i = 0; i < count; i++)
+    {
+        CharacterInstance& instance = instances[i];
+        glm::vec3 position = center + glm::vec3((i % side - (side - 1) * 0.5f) * spacing, 0.0f, (i / side - (side - 1) * 0.5f) * spacing);
+        instance.World = glm::rotate(glm::translate(glm::mat4(1.0f), position), i * 2.4f, glm::vec3(0.0f, 1.0f, 0.0f));
+        instance.BaseClip = 0;
+        instance.BlendClip = 1;
+        instance.Phase = i * 0.37f;
+        instance.Speed = 0.8f + 0.05f * (i % 9);
+        instance.BlendSpeed = 0.2f + 0.03f * (i % 7);
+    }
+    std::unique_ptr<Crowd> crowd(new Crowd(CreateTentacleRig(), instances));
+    crowd->CpuSkinning = cpuSkinning;
+    return crowd;
+}
+
+// Draws the characters after the scene, which leaves the material textures bound. Forward shading binds the lights
+// and the sun's shadows when given, into the G-buffer they are lit with everything else
+void drawCrowd(AnimatedCrowd& crowd, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+    Shader& shader = deferred ? crowd.Renderer.GeometryShader : crowd.Renderer.ForwardShader;
+    bindForwardLighting(shader, clusters, shadows, viewPos);
+    crowd.Draw(shader, view, projection);
+}
+
+// Draws a crowd animated on another thread from its copied pose
+void drawCrowd(CrowdRenderer& crowd, const CrowdPose& pose, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+    Shader& shader = deferred ? crowd.GeometryShader : crowd.ForwardShader;
+    bindForwardLighting(shader, clusters, shadows, viewPos);
+    crowd.Draw(shader, pose, view, projection);
+}
+
+// A landscape of about size metres whose surface passes through center, textured with the wall
+std::unique_ptr<TerrainRenderer> createTerrain(float size, const glm::vec3& center, bool synchronous)
+{
+    std::unique_ptr<TerrainRenderer> terrain(new TerrainRenderer(size, center));
+    terrain->GroundTexture = createTexture("res/wall.jpg", false);
+    terrain->Synchronous = synchronous;
+    const TerrainStats& stats = terrain->Stats;
+    std::cout << "terrain: " << stats.Levels << " levels, " << TERRAIN_GRID * TERRAIN_LEAF_SPACING * (float)(1 << (stats.Levels - 1))
+        << " m across" << std::endl;
+    return terrain;
+}
+
+// Draws the terrain like drawCrowd draws the characters, after everything that relies on the material textures
+void drawTerrain(TerrainRenderer& terrain, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+    Shader& shader = deferred ? terrain.GeometryShader : terrain.ForwardShader;
+    bindForwardLighting(shader, clusters, shadows, viewPos);
+    terrain.Draw(shader, view, projection, viewPos);
+}
+
+// A voxel world of columns * columns chunk columns, centred on center with its ground there, textured with the wall
+std::unique_ptr<VoxelWorld> createVoxelWorld(int columns, const glm::vec3& center)
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    std::unique_ptr<VoxelWorld> voxels(new VoxelWorld(columns, columns, center));
+    voxels->Texture = createTexture("res/wall.jpg", false);
+    const VoxelStats& stats = voxels->Stats;
+    std::cout << "voxels: " << stats.Chunks << " chunks, " << stats.SolidVoxels << " solid voxels in " << stats.StorageBytes / (1024.0 * 1024.0)
+        << " MiB (" << stats.DenseBytes / (1024.0 * 1024.0) << " MiB dense), " << stats.Quads << " quads, generated and meshed in "
+        << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms" << std::endl;
+    return voxels;
+}
+
+// far enough to see across the voxel world from its middle
+float voxelViewDistance(int columns)
+{
+    return columns * VOXEL_CHUNK * 0.75f;
+}
+
+// Draws the chunks in the camera's frustum like drawCrowd draws the characters
+void drawVoxels(VoxelWorld& voxels, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, Camera& camera, const glm::mat4& view, const glm::mat4& projection)
+{
+    Shader& shader = deferred ? voxels.GeometryShader : voxels.ForwardShader;
+    bindForwardLighting(shader, clusters, shadows, camera.Position);
+    voxels.Draw(shader, camera.GetFrustum(), view, projection);
+}
+
+// Every cube's box with its name above it, and a small marker over the scene at every light
+void debugDrawScene(const glm::mat4* models, const std::vector<Light>& lights)
+{
+    DebugDraw& draw = GetDebugDraw();
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        char name[16];
+        std::snprintf(name, sizeof(name), "cube %d", i);
+        draw.Box(models[i], glm::vec4(0.2f, 1.0f, 0.3f, 1.0f));
+        draw.Text(glm::vec3(models[i][3]) + glm::vec3(0.0f, 0.9f, 0.0f), name, glm::vec4(0.6f, 1.0f, 0.6f, 1.0f));
+    }
+    for (const Light& light : lights)
+    {
+        draw.Sphere(light.Position, 0.15f, glm::vec4(light.Color, 1.0f), true);
+    }
+}
+
+// Loads a .glb file and returns the transform that scales its largest side to size and centers it on center.
+// Prints how long parsing and uploading took
+std::unique_ptr<GltfModel> loadModel(const std::string& path, const glm::vec3& center, float size, glm::mat4& placement)
+{
+    std::unique_ptr<GltfModel> model(new GltfModel());
+    if (!model->Load(path))
+    {
+        return NULL;
+    }
+    const GltfLoadStats& stats = model->Stats;
+    std::cout << "gltf: " << stats.FileBytes / (1024.0 * 1024.0) << " MiB, parse " << stats.ParseMs << " ms, upload " << stats.UploadMs
+        << " ms (" << stats.UploadedBytes / (1024.0 * 1024.0) << " MiB, " << stats.BufferViews << " views in " << stats.Buffers << " buffers, "
+        << stats.VertexArrays << " vertex arrays), textures " << stats.TextureMs << " ms" << std::endl;
+    glm::vec3 extent = model->BoundsMax - model->BoundsMin;
+    float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    float scale = largest > 0.0f ? size / largest : 1.0f;
+    placement = glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), glm::vec3(scale)) *
+        glm::translate(glm::mat4(1.0f), -(model->BoundsMin + model->BoundsMax) * 0.5f);
+    return model;
+}
+
+// Draws the model like drawCrowd draws the characters
+void drawModel(GltfModel& model, const glm::mat4& placement, bool deferred, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos, const glm::mat4& view, const glm::mat4& projection)
+{
+    Shader& shader = deferred ? model.GeometryShader : model.ForwardShader;
+    bindForwardLighting(shader, clusters, shadows, viewPos);
+    model.Draw(shader, placement, view, projection);
+}
+
+// Imports an .obj or .ply mesh and returns the transform that scales its largest side to size and centers it on
+// center. Prints the import times and the process's peak memory, which bounds what the import needed
+std::unique_ptr<QuantizedMesh> importMesh(const std::string& path, const glm::vec3& center, float size, glm::mat4& placement, MeshImportStats* stats)
+{
+    std::unique_ptr<QuantizedMesh> mesh(new QuantizedMesh());
+    MeshImporter importer;
+    if (!importer.Import(path, *mesh))
+    {
+        return NULL;
+    }
+    const MeshImportStats& imported = importer.Stats;
+    std::cout << "mesh: " << imported.FileBytes / (1024.0 * 1024.0) << " MiB, " << imported.Vertices << " vertices, " << imported.Triangles
+        << " triangles" << (imported.Indexed ? "" : " (unshared vertices)") << ", scan " << imported.ScanMs << " ms, parse " << imported.ParseMs
+        << " ms, upload " << imported.UploadMs << " ms, " << imported.Chunks << " chunks on " << imported.Threads << " threads, peak memory "
+        << PeakProcessMemory() / (1024.0 * 1024.0) << " MiB" << std::endl;
+    if (imported.BadIndices > 0)
+    {
+        std::cout << "mesh: " << imported.BadIndices << " face corners reference missing vertices, vertex 0 is used instead" << std::endl;
+    }
+    if (stats != NULL)
+    {
+        *stats = imported;
+    }
+    float largest = std::max(mesh->PositionScale.x, std::max(mesh->PositionScale.y, mesh->PositionScale.z)) * 2.0f;
+    placement = glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), glm::vec3(size / largest)) *
+        glm::translate(glm::mat4(1.0f), -mesh->PositionOffset);
+    return mesh;
+}
+
+// Draws an imported mesh with the shader the cubes were drawn with, whose textures it borrows, and puts the
+// cube's dequantization back
+void drawMesh(Shader& shader, const QuantizedMesh& mesh, const glm::mat4& placement, const glm::mat4& view, const glm::mat4& projection, const QuantizedMesh& cube)
+{
+    shader.use();
+    shader.setMat4("view", view);
+    shader.setMat4("projection", projection);
+    shader.setMat4("model", placement);
+    mesh.SetDequantUniforms(shader);
+    mesh.Draw();
+    GetRenderStats().CountDraw(mesh.IndexCount > 0 ? mesh.IndexCount : mesh.VertexCount);
+    cube.SetDequantUniforms(shader);
+}
+
+// Uses shader and binds the lights and the sun's shadows when given
+void bindForwardLighting(Shader& shader, const LightClusters* clusters, const CascadedShadowMaps* shadows, const glm::vec3& viewPos)
+{
+    shader.use();
+    if (clusters)
+    {
+        clusters->Bind(shader, viewPos, AMBIENT_LIGHT);
+        if (shadows)
+            shadows->Bind(shader);
     }
-    stbi_image_free(data);
-    return texture;
 }
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+// Counters of one engine allocator. The Frame* counters are cleared by BeginAllocatorFrame, like RenderStats
+struct AllocatorStats
+{
+    const char* Name;
+    // currently allocated, and the most that ever was
+    uint64_t Bytes = 0;
+    uint64_t PeakBytes = 0;
+    uint64_t FrameAllocations = 0;
+    uint64_t FrameBytes = 0;
+    // allocations that didn't fit and went to the general heap
+    uint64_t FrameOverflows = 0;
+
+    explicit AllocatorStats(const char* name) : Name(name) {}
+
+    void CountAllocation(uint64_t bytes)
+    {
+        Bytes += bytes;
+        PeakBytes = std::max(PeakBytes, Bytes);
+        FrameAllocations++;
+        FrameBytes += bytes;
+    }
+
+    void CountFree(uint64_t bytes)
+    {
+        Bytes -= bytes;
+    }
+};
+
+// Every live engine allocator, for reporting
+inline std::vector<AllocatorStats*>& GetAllocatorStats()
+{
+    static std::vector<AllocatorStats*> allocators;
+    return allocators;
+}
+
+inline void BeginAllocatorFrame()
+{
+    for (AllocatorStats* stats : GetAllocatorStats())
+    {
+        stats->FrameAllocations = 0;
+        stats->FrameBytes = 0;
+        stats->FrameOverflows = 0;
+    }
+}
+
+inline void RegisterAllocator(AllocatorStats* stats)
+{
+    GetAllocatorStats().push_back(stats);
+}
+
+inline void UnregisterAllocator(AllocatorStats* stats)
+{
+    std::vector<AllocatorStats*>& allocators = GetAllocatorStats();
+    allocators.erase(std::remove(allocators.begin(), allocators.end(), stats), allocators.end());
+}
+
+
+// Linear allocator for data that lives until the end of the frame. Allocation bumps an offset and Reset releases
+// everything at once, no destructors run. A frame that doesn't fit spills to the heap, and Reset then grows the block
+// to that frame's total so later frames fit again
+class FrameArena
+{
+public:
+    AllocatorStats Stats;
+
+    explicit FrameArena(size_t capacity, const char* name = "frame_arena") : Stats(name), capacity(capacity)
+    {
+        block = (char*)std::malloc(capacity);
+        RegisterAllocator(&Stats);
+    }
+
+    ~FrameArena()
+    {
+        Reset();
+        std::free(block);
+        UnregisterAllocator(&Stats);
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        Stats.CountAllocation(size);
+        if (start + size <= capacity)
+        {
+            offset = start + size;
+            return block + start;
+        }
+        Stats.FrameOverflows++;
+        spilledBytes += size + alignment;
+        void* memory = std::malloc(size + alignment);
+        spilled.push_back(memory);
+        return (void*)(((uintptr_t)memory + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    // count default-initialized Ts, which must not need destructing
+    template<typename T>
+    T* New(size_t count = 1)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+        T* items = (T*)Allocate(sizeof(T) * count, alignof(T));
+        for (size_t i = 0; i < count; i++)
+            new (items + i) T;
+        return items;
+    }
+
+    // Releases everything allocated since the last Reset, call at the end of the frame
+    void Reset()
+    {
+        Stats.CountFree(Stats.Bytes);
+        if (!spilled.empty())
+        {
+            for (void* memory : spilled)
+                std::free(memory);
+            spilled.clear();
+            capacity = (offset + spilledBytes) * 3 / 2;
+            std::free(block);
+            block = (char*)std::malloc(capacity);
+            spilledBytes = 0;
+        }
+        offset = 0;
+    }
+
+    size_t Capacity() const { return capacity; }
+    size_t Used() const { return offset; }
+
+private:
+    char* block;
+    size_t capacity;
+    size_t offset = 0;
+    std::vector<void*> spilled;
+    size_t spilledBytes = 0;
+};
+
+// The engine-wide frame arena, reset by the main loops at the end of every frame
+inline FrameArena& GetFrameArena()
+{
+    static FrameArena arena(1 << 20);
+    return arena;
+}
+
+
+// Fixed-size blocks carved out of pages, for small objects created and destroyed at runtime. Free blocks form an
+// intrusive list, so allocating and freeing are a couple of pointer moves and never touch the heap once warm
+class PoolAllocator
+{
+public:
+    AllocatorStats Stats;
+
+    PoolAllocator(size_t blockSize, size_t blocksPerPage = 256, const char* name = "pool")
+        : Stats(name), blockSize(std::max((blockSize + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1), sizeof(FreeBlock))),
+          blocksPerPage(std::max<size_t>(blocksPerPage, 1))
+    {
+        RegisterAllocator(&Stats);
+    }
+
+    ~PoolAllocator()
+    {
+        for (char* page : pages)
+            std::free(page);
+        UnregisterAllocator(&Stats);
+    }
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    void* Allocate()
+    {
+        if (freeList == NULL)
+            addPage();
+        FreeBlock* block = freeList;
+        freeList = block->Next;
+        Stats.CountAllocation(blockSize);
+        return block;
+    }
+
+    void Free(void* memory)
+    {
+        if (memory == NULL)
+            return;
+        FreeBlock* block = (FreeBlock*)memory;
+        block->Next = freeList;
+        freeList = block;
+        Stats.CountFree(blockSize);
+    }
+
+    size_t BlockSize() const { return blockSize; }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* Next;
+    };
+
+    size_t blockSize;
+    size_t blocksPerPage;
+    FreeBlock* freeList = NULL;
+    std::vector<char*> pages;
+
+    void addPage()
+    {
+        Stats.FrameOverflows++;
+        char* page = (char*)std::malloc(blockSize * blocksPerPage);
+        pages.push_back(page);
+        for (size_t i = blocksPerPage; i-- > 0;)
+        {
+            FreeBlock* block = (FreeBlock*)(page + i * blockSize);
+            block->Next = freeList;
+            freeList = block;
+        }
+    }
+};
+
+
+// STL allocator adapter for node based containers: single elements that fit the pool's blocks come from the pool, anything else from the
+// heap. The pool's block size should be the container's node size
+template<typename T>
+struct PoolStlAllocator
+{
+    typedef T value_type;
+    PoolAllocator* Pool;
+
+    PoolStlAllocator(PoolAllocator& pool) : Pool(&pool) {}
+    template<typename U>
+    PoolStlAllocator(const PoolStlAllocator<U>& other) : Pool(other.Pool) {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1 && sizeof(T) <= Pool->BlockSize())
+            return (T*)Pool->Allocate();
+        Pool->Stats.FrameOverflows++;
+        return (T*)::operator new(sizeof(T) * n);
+    }
+
+    void deallocate(T* memory, size_t n)
+    {
+        if (n == 1 && sizeof(T) <= Pool->BlockSize())
+            Pool->Free(memory);
+        else
+            ::operator delete(memory);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const PoolStlAllocator<T>& a, const PoolStlAllocator<U>& b) { return a.Pool == b.Pool; }
+template<typename T, typename U>
+bool operator!=(const PoolStlAllocator<T>& a, const PoolStlAllocator<U>& b) { return a.Pool != b.Pool; }
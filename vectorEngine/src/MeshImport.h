@@ -0,0 +1,1178 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "AssetArchive.h"
+#include "JobSystem.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// text is cut into chunks of about this size, each ending at a line break
+const size_t IMPORT_CHUNK_BYTES = 4 * 1024 * 1024;
+// binary PLY records per job
+const int IMPORT_RECORD_GRAIN = 256 * 1024;
+
+
+// Locale independent decimal parsing for mesh text formats. Both skip leading blanks, stop at the first character
+// that can't continue the number and fail without consuming anything when there is no number
+inline bool ParseImportInt(const char*& p, const char* end, int64_t& value)
+{
+    const char* c = p;
+    while (c < end && (*c == ' ' || *c == '\t'))
+        c++;
+    bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+        c++;
+    if (c >= end || (unsigned)(*c - '0') > 9)
+        return false;
+    int64_t result = 0;
+    while (c < end && (unsigned)(*c - '0') <= 9)
+        result = result * 10 + (*c++ - '0');
+    value = negative ? -result : result;
+    p = c;
+    return true;
+}
+
+// Accumulates up to 19 significant digits exactly and scales once, which is within an ulp of strtod for every
+// value a float can hold
+inline bool ParseImportFloat(const char*& p, const char* end, float& value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* c = p;
+    while (c < end && (*c == ' ' || *c == '\t'))
+        c++;
+    bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+        c++;
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; c < end && (unsigned)(*c - '0') <= 9; c++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*c - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (c < end && *c == '.')
+    {
+        for (c++; c < end && (unsigned)(*c - '0') <= 9; c++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return false;
+    if (c < end && (*c == 'e' || *c == 'E'))
+    {
+        const char* e = c + 1;
+        int64_t power;
+        if (ParseImportInt(e, end, power) && e[-1] != ' ' && e[-1] != '\t')
+        {
+            exponent += (int)std::max<int64_t>(std::min<int64_t>(power, 400), -400);
+            c = e;
+        }
+    }
+    double result = (double)mantissa;
+    if (exponent < 0)
+        result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+    value = (float)(negative ? -result : result);
+    p = c;
+    return true;
+}
+
+
+struct MeshImportStats
+{
+    uint64_t FileBytes = 0;
+    int64_t Vertices = 0;
+    int64_t Triangles = 0;
+    int Chunks = 0;
+    int Threads = 0;
+    // one vertex per file vertex with an index buffer, otherwise three unshared vertices per triangle
+    bool Indexed = true;
+    // face corners that referenced a missing vertex, drawn with vertex 0 instead
+    int64_t BadIndices = 0;
+    double ScanMs = 0.0;
+    double ParseMs = 0.0;
+    double UploadMs = 0.0;
+};
+
+// Imports Wavefront OBJ and PLY (ASCII and binary) meshes into a QuantizedMesh. The file is memory mapped and never
+// copied: text is split into line-aligned chunks and binary PLY into record ranges that the job system processes in
+// parallel, first to count elements and find the quantization bounds, then to parse again and write packed vertices
+// and indices straight into the mapped GL buffers. Nothing proportional to the file is held besides the output
+// itself, except for OBJ files whose faces index positions, texture coordinates and normals separately: their
+// vertices are unshared, three per triangle, gathered from compact packed copies of the attributes.
+// Polygons are fan triangulated. Only the first texture coordinate set and no materials or groups are read
+class MeshImporter
+{
+public:
+    MeshImportStats Stats;
+
+    // Prints the reason and returns false on failure. mesh is only allocated once the input is known to be good,
+    // but failing to map its buffers leaves it allocated and unfilled, so discard it on failure
+    bool Import(const std::string& path, QuantizedMesh& mesh)
+    {
+        Stats = MeshImportStats();
+        Stats.Threads = GetJobSystem().ThreadCount();
+        error = "";
+        MappedFile file;
+        AssetData asset;
+        if (!GetAssetArchive().Find(path, asset))
+        {
+            if (!file.Open(path))
+            {
+                std::cout << "ERROR::IMPORT:: Failed to map \"" << path << "\"" << std::endl;
+                return false;
+            }
+            asset.Data = file.Data();
+            asset.Size = (size_t)file.Size();
+        }
+        Stats.FileBytes = asset.Size;
+        data = (const char*)asset.Data;
+        size = asset.Size;
+
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+        bool imported = extension == "obj" ? importObj(mesh) : extension == "ply" ? importPly(mesh) : fail("unknown file type, expected .obj or .ply");
+        if (!imported)
+            std::cout << "ERROR::IMPORT:: Failed to import \"" << path << "\": " << error << std::endl;
+        data = NULL;
+        return imported;
+    }
+
+private:
+    enum Chunk_Kind { CHUNK_OBJ, CHUNK_PLY_VERTICES, CHUNK_PLY_FACES };
+
+    // A line-aligned piece of text with what the scan found in it. The First* members are the totals of all chunks
+    // before it, i.e. where its elements go in the output
+    struct TextChunk
+    {
+        const char* Begin;
+        const char* End;
+        Chunk_Kind Kind;
+        int64_t Positions, TexCoords, Normals, Triangles;
+        int64_t FirstPosition, FirstTexCoord, FirstNormal, FirstTriangle;
+        glm::vec3 PositionMin, PositionMax;
+        glm::vec2 TexCoordMin, TexCoordMax;
+        // a face corner whose texture coordinate or normal index differs from its position index
+        bool Split;
+        int64_t BadIndices;
+    };
+
+    // Where packed output goes, the mapped GL buffers or the compact attribute copies of split OBJ files
+    struct Output
+    {
+        unsigned char* Vertices = NULL;
+        int16_t* Positions = NULL;
+        uint32_t* Indices = NULL;
+        int64_t VertexCount = 0;
+        // split OBJ attributes: 4 x snorm16, 2 x unorm16 and 2 x snorm8 each
+        std::vector<int16_t> CompactPositions;
+        std::vector<uint16_t> CompactTexCoords;
+        std::vector<int8_t> CompactNormals;
+    };
+
+    // PLY property types
+    enum Ply_Type { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+    struct PlyProperty
+    {
+        Ply_Type Type = PLY_INVALID;
+        // for list properties, Type is the item type
+        Ply_Type CountType = PLY_INVALID;
+        bool List = false;
+        std::string Name;
+    };
+
+    struct PlyElement
+    {
+        std::string Name;
+        int64_t Count = 0;
+        std::vector<PlyProperty> Properties;
+    };
+
+    const char* data = NULL;
+    size_t size = 0;
+    const char* error = "";
+    std::vector<TextChunk> chunks;
+    Output output;
+    VertexFormat format;
+    glm::vec3 positionOffset, positionScale;
+    glm::vec4 texCoordTransform;
+    // attribute slots of the PLY vertex properties: 0-2 position, 3-5 normal, 6-7 texture coordinates
+    int plySlots[8];
+    bool plyBigEndian = false;
+    std::vector<PlyProperty> plyVertex;
+
+    bool fail(const char* message)
+    {
+        error = message;
+        return false;
+    }
+
+    static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    static const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    static const char* lineEnd(const char* p, const char* end)
+    {
+        const char* found = (const char*)std::memchr(p, '\n', end - p);
+        return found != NULL ? found : end;
+    }
+
+    // Cuts [begin, end) into chunks of about IMPORT_CHUNK_BYTES that end after a line break
+    void splitLines(const char* begin, const char* end, Chunk_Kind kind)
+    {
+        while (begin < end)
+        {
+            const char* split = begin + std::min((size_t)(end - begin), IMPORT_CHUNK_BYTES);
+            split = split < end ? lineEnd(split, end) + 1 : end;
+            TextChunk chunk = {};
+            chunk.Begin = begin;
+            chunk.End = std::min(split, end);
+            chunk.Kind = kind;
+            chunks.push_back(chunk);
+            begin = chunk.End;
+        }
+    }
+
+    // Runs pass over every chunk in parallel and turns the counts into output offsets
+    template<typename Pass>
+    void forEachChunk(Pass pass)
+    {
+        GetJobSystem().ParallelFor((int)chunks.size(), 1, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                pass(chunks[i]);
+        });
+    }
+
+    void prefixSums()
+    {
+        int64_t positions = 0, texCoords = 0, normals = 0, triangles = 0;
+        for (TextChunk& chunk : chunks)
+        {
+            chunk.FirstPosition = positions;
+            chunk.FirstTexCoord = texCoords;
+            chunk.FirstNormal = normals;
+            chunk.FirstTriangle = triangles;
+            positions += chunk.Positions;
+            texCoords += chunk.TexCoords;
+            normals += chunk.Normals;
+            triangles += chunk.Triangles;
+        }
+    }
+
+    void resetBounds(TextChunk& chunk)
+    {
+        chunk.PositionMin = glm::vec3(FLT_MAX);
+        chunk.PositionMax = glm::vec3(-FLT_MAX);
+        chunk.TexCoordMin = glm::vec2(FLT_MAX);
+        chunk.TexCoordMax = glm::vec2(-FLT_MAX);
+    }
+
+    // Dequantization parameters from the merged bounds, the same as QuantizedMesh::Quantize computes
+    void setBounds(glm::vec3 positionMin, glm::vec3 positionMax, glm::vec2 texCoordMin, glm::vec2 texCoordMax)
+    {
+        if (positionMin.x > positionMax.x)
+            positionMin = positionMax = glm::vec3(0.0f);
+        positionOffset = (positionMin + positionMax) * 0.5f;
+        positionScale = glm::max((positionMax - positionMin) * 0.5f, glm::vec3(1e-6f));
+        if (texCoordMin.x > texCoordMax.x)
+            texCoordMin = texCoordMax = glm::vec2(0.0f);
+        texCoordTransform = glm::vec4(glm::max(texCoordMax - texCoordMin, glm::vec2(1e-6f)), texCoordMin);
+    }
+
+    void mergeBounds()
+    {
+        glm::vec3 positionMin(FLT_MAX), positionMax(-FLT_MAX);
+        glm::vec2 texCoordMin(FLT_MAX), texCoordMax(-FLT_MAX);
+        for (const TextChunk& chunk : chunks)
+        {
+            positionMin = glm::min(positionMin, chunk.PositionMin);
+            positionMax = glm::max(positionMax, chunk.PositionMax);
+            texCoordMin = glm::min(texCoordMin, chunk.TexCoordMin);
+            texCoordMax = glm::max(texCoordMax, chunk.TexCoordMax);
+        }
+        setBounds(positionMin, positionMax, texCoordMin, texCoordMax);
+    }
+
+    void packPosition(glm::vec3 p, int16_t* out) const
+    {
+        p = (p - positionOffset) / positionScale;
+        out[0] = PackSnorm16(p.x);
+        out[1] = PackSnorm16(p.y);
+        out[2] = PackSnorm16(p.z);
+        out[3] = 32767;
+    }
+
+    void packTexCoord(glm::vec2 uv, uint16_t* out) const
+    {
+        uv = (uv - glm::vec2(texCoordTransform.z, texCoordTransform.w)) / glm::vec2(texCoordTransform.x, texCoordTransform.y);
+        out[0] = PackUnorm16(uv.x);
+        out[1] = PackUnorm16(uv.y);
+    }
+
+    static void packNormal(glm::vec3 n, int8_t* out)
+    {
+        float length = glm::length(n);
+        glm::vec2 e = OctEncode(length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f));
+        out[0] = PackSnorm8(e.x);
+        out[1] = PackSnorm8(e.y);
+    }
+
+    // Writes one attribute of vertex index into the mapped vertex and position streams
+    void writePosition(int64_t index, glm::vec3 p)
+    {
+        int16_t* packed = output.Positions + index * 4;
+        packPosition(p, packed);
+        std::memcpy(output.Vertices + index * format.Stride() + format.PositionOffset(), packed, 4 * sizeof(int16_t));
+    }
+
+    void writeTexCoord(int64_t index, glm::vec2 uv)
+    {
+        packTexCoord(uv, (uint16_t*)(output.Vertices + index * format.Stride() + format.TexCoordOffset()));
+    }
+
+    void writeNormal(int64_t index, glm::vec3 n)
+    {
+        packNormal(n, (int8_t*)(output.Vertices + index * format.Stride() + format.NormalOffset()));
+    }
+
+    // Sizes mesh for the output and maps its buffers for the workers to fill
+    bool mapOutput(QuantizedMesh& mesh, int64_t vertexCount, int64_t indexCount)
+    {
+        if (vertexCount > INT32_MAX || indexCount > INT32_MAX)
+            return fail("more than 2^31 vertices or indices");
+        mesh.Allocate((int)vertexCount, (int)indexCount, format);
+        mesh.PositionOffset = positionOffset;
+        mesh.PositionScale = positionScale;
+        mesh.TexCoordTransform = format.Has(VERTEX_TEXCOORD) ? texCoordTransform : glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        output.VertexCount = vertexCount;
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+        output.Vertices = vertexCount > 0 ? (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(vertexCount * format.Stride()), access) : NULL;
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.PositionVBO);
+        output.Positions = vertexCount > 0 ? (int16_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(vertexCount * 4 * sizeof(int16_t)), access) : NULL;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (indexCount > 0)
+        {
+            // the element binding is VAO state, map it through the copy target instead
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.EBO);
+            output.Indices = (uint32_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)(indexCount * sizeof(uint32_t)), access);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        if ((vertexCount > 0 && (output.Vertices == NULL || output.Positions == NULL)) || (indexCount > 0 && output.Indices == NULL))
+        {
+            unmapOutput(mesh);
+            return fail("could not map the mesh buffers");
+        }
+        // vertices are written attribute by attribute, padding and missing attributes have to be defined
+        if (vertexCount > 0)
+        {
+            GetJobSystem().ParallelFor((int)((vertexCount + IMPORT_RECORD_GRAIN - 1) / IMPORT_RECORD_GRAIN), 1, [&](int begin, int end)
+            {
+                int64_t first = (int64_t)begin * IMPORT_RECORD_GRAIN, last = std::min((int64_t)end * IMPORT_RECORD_GRAIN, vertexCount);
+                std::memset(output.Vertices + first * format.Stride(), 0, (size_t)((last - first) * format.Stride()));
+            });
+        }
+        return true;
+    }
+
+    void unmapOutput(QuantizedMesh& mesh)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        if (output.Vertices != NULL)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        if (output.Positions != NULL)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.PositionVBO);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (output.Indices != NULL)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.EBO);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        output = Output();
+        Stats.UploadMs = elapsedMs(start);
+    }
+
+    // An OBJ face corner: v, v/vt, v//vn or v/vt/vn. Indices are as written, 1-based or negative, 0 when absent
+    static bool parseCorner(const char*& p, const char* end, int64_t* corner)
+    {
+        corner[1] = corner[2] = 0;
+        if (!ParseImportInt(p, end, corner[0]))
+            return false;
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+                ParseImportInt(p, end, corner[1]);
+            if (p < end && *p == '/')
+            {
+                p++;
+                ParseImportInt(p, end, corner[2]);
+            }
+        }
+        return true;
+    }
+
+    // 0-based index of a corner index given the number of elements before the line, -1 when out of range
+    static int64_t resolve(int64_t index, int64_t before, int64_t total)
+    {
+        int64_t resolved = index > 0 ? index - 1 : before + index;
+        return resolved >= 0 && resolved < total ? resolved : -1;
+    }
+
+    // Counts the elements of an OBJ chunk and grows its bounds
+    void scanObj(TextChunk& chunk)
+    {
+        resetBounds(chunk);
+        for (const char* line = chunk.Begin; line < chunk.End;)
+        {
+            const char* end = lineEnd(line, chunk.End);
+            const char* p = skipBlanks(line, end);
+            if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                glm::vec3 v(0.0f);
+                p += 2;
+                for (int i = 0; i < 3; i++)
+                    ParseImportFloat(p, end, v[i]);
+                chunk.PositionMin = glm::min(chunk.PositionMin, v);
+                chunk.PositionMax = glm::max(chunk.PositionMax, v);
+                chunk.Positions++;
+            }
+            else if (end - p >= 3 && p[0] == 'v' && p[1] == 't')
+            {
+                glm::vec2 uv(0.0f);
+                p += 2;
+                for (int i = 0; i < 2; i++)
+                    ParseImportFloat(p, end, uv[i]);
+                chunk.TexCoordMin = glm::min(chunk.TexCoordMin, uv);
+                chunk.TexCoordMax = glm::max(chunk.TexCoordMax, uv);
+                chunk.TexCoords++;
+            }
+            else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n')
+            {
+                chunk.Normals++;
+            }
+            else if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                p++;
+                int corners = 0;
+                int64_t corner[3];
+                while (parseCorner(p, end, corner))
+                {
+                    // relative indices only match when the counts do, which the scan can't know yet
+                    chunk.Split |= (corner[1] != 0 && corner[1] != corner[0]) || (corner[2] != 0 && corner[2] != corner[0]) || corner[0] < 0;
+                    corners++;
+                }
+                chunk.Triangles += std::max(corners - 2, 0);
+            }
+            line = end + 1;
+        }
+    }
+
+    // Second pass over an OBJ chunk: attributes go to the vertex of the same index, or to the compact copies for
+    // split files, and indexed faces straight to the index buffer
+    void parseObj(TextChunk& chunk, bool indexed, bool texCoords, bool normals)
+    {
+        int64_t positions = chunk.FirstPosition, uvs = chunk.FirstTexCoord, normalIndex = chunk.FirstNormal;
+        uint32_t* indices = output.Indices != NULL ? output.Indices + chunk.FirstTriangle * 3 : NULL;
+        for (const char* line = chunk.Begin; line < chunk.End;)
+        {
+            const char* end = lineEnd(line, chunk.End);
+            const char* p = skipBlanks(line, end);
+            if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                glm::vec3 v(0.0f);
+                p += 2;
+                for (int i = 0; i < 3; i++)
+                    ParseImportFloat(p, end, v[i]);
+                if (indexed)
+                    writePosition(positions, v);
+                else
+                    packPosition(v, &output.CompactPositions[positions * 4]);
+                positions++;
+            }
+            else if (end - p >= 3 && p[0] == 'v' && p[1] == 't')
+            {
+                glm::vec2 uv(0.0f);
+                p += 2;
+                for (int i = 0; i < 2; i++)
+                    ParseImportFloat(p, end, uv[i]);
+                if (texCoords && indexed)
+                    writeTexCoord(uvs, uv);
+                else if (texCoords)
+                    packTexCoord(uv, &output.CompactTexCoords[uvs * 2]);
+                uvs++;
+            }
+            else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n')
+            {
+                glm::vec3 n(0.0f);
+                p += 2;
+                for (int i = 0; i < 3; i++)
+                    ParseImportFloat(p, end, n[i]);
+                if (normals && indexed)
+                    writeNormal(normalIndex, n);
+                else if (normals)
+                    packNormal(n, &output.CompactNormals[normalIndex * 2]);
+                normalIndex++;
+            }
+            else if (indexed && end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                p++;
+                int corners = 0;
+                int64_t corner[3];
+                uint32_t first = 0, previous = 0;
+                while (parseCorner(p, end, corner))
+                {
+                    int64_t index = resolve(corner[0], positions, output.VertexCount);
+                    if (index < 0)
+                    {
+                        chunk.BadIndices++;
+                        index = 0;
+                    }
+                    if (corners == 0)
+                        first = (uint32_t)index;
+                    else if (corners >= 2)
+                    {
+                        indices[0] = first;
+                        indices[1] = previous;
+                        indices[2] = (uint32_t)index;
+                        indices += 3;
+                    }
+                    previous = (uint32_t)index;
+                    corners++;
+                }
+            }
+            line = end + 1;
+        }
+    }
+
+    // Third pass for split OBJ files: every face corner becomes its own vertex, gathered from the compact copies
+    void expandObj(TextChunk& chunk, int64_t totalPositions, int64_t totalTexCoords, int64_t totalNormals, bool texCoords, bool normals)
+    {
+        int64_t positions = chunk.FirstPosition, uvs = chunk.FirstTexCoord, normalIndex = chunk.FirstNormal;
+        int64_t vertex = chunk.FirstTriangle * 3;
+        const int stride = format.Stride();
+        for (const char* line = chunk.Begin; line < chunk.End;)
+        {
+            const char* end = lineEnd(line, chunk.End);
+            const char* p = skipBlanks(line, end);
+            if (end - p >= 2 && p[0] == 'v')
+            {
+                positions += p[1] == ' ' || p[1] == '\t';
+                uvs += p[1] == 't';
+                normalIndex += p[1] == 'n';
+            }
+            else if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                p++;
+                int corners = 0;
+                int64_t corner[3], resolved[3][3];
+                while (parseCorner(p, end, corner))
+                {
+                    int64_t* r = resolved[std::min(corners, 2)];
+                    r[0] = resolve(corner[0], positions, totalPositions);
+                    r[1] = corner[1] != 0 ? resolve(corner[1], uvs, totalTexCoords) : -1;
+                    r[2] = corner[2] != 0 ? resolve(corner[2], normalIndex, totalNormals) : -1;
+                    if (r[0] < 0)
+                    {
+                        chunk.BadIndices++;
+                        r[0] = 0;
+                    }
+                    if (corners >= 2)
+                    {
+                        // fan: first, previous, current
+                        for (int k = 0; k < 3; k++, vertex++)
+                        {
+                            const int64_t* source = resolved[k];
+                            unsigned char* out = output.Vertices + vertex * stride;
+                            std::memcpy(out + format.PositionOffset(), &output.CompactPositions[source[0] * 4], 4 * sizeof(int16_t));
+                            std::memcpy(output.Positions + vertex * 4, &output.CompactPositions[source[0] * 4], 4 * sizeof(int16_t));
+                            if (texCoords && source[1] >= 0)
+                                std::memcpy(out + format.TexCoordOffset(), &output.CompactTexCoords[source[1] * 2], 2 * sizeof(uint16_t));
+                            if (normals && source[2] >= 0)
+                                std::memcpy(out + format.NormalOffset(), &output.CompactNormals[source[2] * 2], 2);
+                        }
+                        std::memcpy(resolved[1], resolved[2], sizeof(resolved[2]));
+                    }
+                    corners++;
+                }
+            }
+            line = end + 1;
+        }
+    }
+
+    bool importObj(QuantizedMesh& mesh)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        chunks.clear();
+        splitLines(data, data + size, CHUNK_OBJ);
+        Stats.Chunks = (int)chunks.size();
+        forEachChunk([this](TextChunk& chunk) { scanObj(chunk); });
+        prefixSums();
+        mergeBounds();
+        TextChunk last = chunks.empty() ? TextChunk() : chunks.back();
+        int64_t positions = last.FirstPosition + last.Positions, texCoords = last.FirstTexCoord + last.TexCoords;
+        int64_t normals = last.FirstNormal + last.Normals, triangles = last.FirstTriangle + last.Triangles;
+        bool split = false;
+        for (const TextChunk& chunk : chunks)
+            split |= chunk.Split;
+        Stats.ScanMs = elapsedMs(start);
+        if (triangles == 0)
+            return fail("no faces");
+
+        start = std::chrono::high_resolution_clock::now();
+        // shared vertices need one texture coordinate and normal per position
+        bool indexed = !split;
+        bool hasTexCoords = indexed ? texCoords == positions : texCoords > 0;
+        bool hasNormals = indexed ? normals == positions : normals > 0;
+        format = VertexFormat(VERTEX_POSITION | (hasTexCoords ? VERTEX_TEXCOORD : 0) | (hasNormals ? VERTEX_NORMAL : 0));
+        Stats.Indexed = indexed;
+        Stats.Triangles = triangles;
+        Stats.Vertices = indexed ? positions : triangles * 3;
+        if (!indexed)
+        {
+            // attributes are parsed into the packed copies before the output exists, faces are expanded from them
+            // once it is mapped
+            output.CompactPositions.resize((size_t)positions * 4);
+            output.CompactTexCoords.resize(hasTexCoords ? (size_t)texCoords * 2 : 0);
+            output.CompactNormals.resize(hasNormals ? (size_t)normals * 2 : 0);
+            forEachChunk([&](TextChunk& chunk) { parseObj(chunk, false, hasTexCoords, hasNormals); });
+        }
+        if (!mapOutput(mesh, Stats.Vertices, indexed ? triangles * 3 : 0))
+            return false;
+        if (indexed)
+            forEachChunk([&](TextChunk& chunk) { parseObj(chunk, true, hasTexCoords, hasNormals); });
+        else
+            forEachChunk([&](TextChunk& chunk) { expandObj(chunk, positions, texCoords, normals, hasTexCoords, hasNormals); });
+        for (const TextChunk& chunk : chunks)
+            Stats.BadIndices += chunk.BadIndices;
+        Stats.ParseMs = elapsedMs(start);
+        unmapOutput(mesh);
+        chunks.clear();
+        return true;
+    }
+
+    static Ply_Type plyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8") return PLY_INT8;
+        if (name == "uchar" || name == "uint8") return PLY_UINT8;
+        if (name == "short" || name == "int16") return PLY_INT16;
+        if (name == "ushort" || name == "uint16") return PLY_UINT16;
+        if (name == "int" || name == "int32") return PLY_INT32;
+        if (name == "uint" || name == "uint32") return PLY_UINT32;
+        if (name == "float" || name == "float32") return PLY_FLOAT32;
+        if (name == "double" || name == "float64") return PLY_FLOAT64;
+        return PLY_INVALID;
+    }
+
+    static int plySize(Ply_Type type)
+    {
+        static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+        return sizes[type];
+    }
+
+    double readPly(const char* p, Ply_Type type) const
+    {
+        unsigned char bytes[8];
+        int n = plySize(type);
+        std::memcpy(bytes, p, n);
+        if (plyBigEndian)
+            std::reverse(bytes, bytes + n);
+        switch (type)
+        {
+        case PLY_INT8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PLY_UINT8: return bytes[0];
+        case PLY_INT16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLY_UINT16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLY_INT32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_UINT32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT32: { float v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT64: { double v; std::memcpy(&v, bytes, 8); return v; }
+        default: return 0.0;
+        }
+    }
+
+    // The attributes of a vertex from its property values, in plySlots order
+    void plyAttributes(const float* values, glm::vec3& position, glm::vec3& normal, glm::vec2& texCoord) const
+    {
+        float slots[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+        for (int s = 0; s < 8; s++)
+        {
+            if (plySlots[s] >= 0)
+                slots[s] = values[plySlots[s]];
+        }
+        position = glm::vec3(slots[0], slots[1], slots[2]);
+        normal = glm::vec3(slots[3], slots[4], slots[5]);
+        texCoord = glm::vec2(slots[6], slots[7]);
+    }
+
+    // Property values of binary vertex i
+    void binaryVertex(const char* vertices, int stride, int64_t i, float* values) const
+    {
+        const char* p = vertices + i * stride;
+        for (size_t k = 0; k < plyVertex.size(); k++)
+        {
+            values[k] = (float)readPly(p, plyVertex[k].Type);
+            p += plySize(plyVertex[k].Type);
+        }
+    }
+
+    // ASCII PLY chunks: vertex lines grow the bounds, face lines count triangles
+    void scanPly(TextChunk& chunk)
+    {
+        resetBounds(chunk);
+        std::vector<float> values(plyVertex.size());
+        for (const char* line = chunk.Begin; line < chunk.End;)
+        {
+            const char* end = lineEnd(line, chunk.End);
+            const char* p = skipBlanks(line, end);
+            if (p < end && *p != '\r')
+            {
+                if (chunk.Kind == CHUNK_PLY_VERTICES)
+                {
+                    for (float& value : values)
+                        ParseImportFloat(p, end, value);
+                    glm::vec3 position, normal;
+                    glm::vec2 texCoord;
+                    plyAttributes(values.data(), position, normal, texCoord);
+                    chunk.PositionMin = glm::min(chunk.PositionMin, position);
+                    chunk.PositionMax = glm::max(chunk.PositionMax, position);
+                    chunk.TexCoordMin = glm::min(chunk.TexCoordMin, texCoord);
+                    chunk.TexCoordMax = glm::max(chunk.TexCoordMax, texCoord);
+                    chunk.Positions++;
+                }
+                else
+                {
+                    int64_t corners = 0;
+                    ParseImportInt(p, end, corners);
+                    chunk.Triangles += std::max<int64_t>(corners - 2, 0);
+                }
+            }
+            line = end + 1;
+        }
+    }
+
+    void parsePly(TextChunk& chunk)
+    {
+        std::vector<float> values(plyVertex.size());
+        int64_t vertex = chunk.FirstPosition;
+        uint32_t* indices = output.Indices + chunk.FirstTriangle * 3;
+        for (const char* line = chunk.Begin; line < chunk.End;)
+        {
+            const char* end = lineEnd(line, chunk.End);
+            const char* p = skipBlanks(line, end);
+            if (p < end && *p != '\r')
+            {
+                if (chunk.Kind == CHUNK_PLY_VERTICES)
+                {
+                    for (float& value : values)
+                        ParseImportFloat(p, end, value);
+                    writeVertex(vertex++, values.data());
+                }
+                else
+                {
+                    int64_t corners = 0, index = 0;
+                    ParseImportInt(p, end, corners);
+                    uint32_t first = 0, previous = 0;
+                    for (int64_t k = 0; k < corners; k++)
+                    {
+                        if (!ParseImportInt(p, end, index) || index < 0 || index >= output.VertexCount)
+                        {
+                            chunk.BadIndices++;
+                            index = 0;
+                        }
+                        if (k == 0)
+                            first = (uint32_t)index;
+                        else if (k >= 2)
+                        {
+                            indices[0] = first;
+                            indices[1] = previous;
+                            indices[2] = (uint32_t)index;
+                            indices += 3;
+                        }
+                        previous = (uint32_t)index;
+                    }
+                }
+            }
+            line = end + 1;
+        }
+    }
+
+    void writeVertex(int64_t index, const float* values)
+    {
+        glm::vec3 position, normal;
+        glm::vec2 texCoord;
+        plyAttributes(values, position, normal, texCoord);
+        writePosition(index, position);
+        if (format.Has(VERTEX_TEXCOORD))
+            writeTexCoord(index, texCoord);
+        if (format.Has(VERTEX_NORMAL))
+            writeNormal(index, normal);
+    }
+
+    bool importPly(QuantizedMesh& mesh)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        // header: one keyword line after another up to end_header
+        const char* end = data + size;
+        const char* p = data;
+        std::vector<PlyElement> elements;
+        bool ascii = false, formatSeen = false;
+        for (int lineNumber = 0;; lineNumber++)
+        {
+            if (p >= end)
+                return fail("truncated header");
+            const char* eol = lineEnd(p, end);
+            std::string line(p, eol > p && eol[-1] == '\r' ? eol - 1 : eol);
+            p = eol + 1;
+            std::vector<std::string> words;
+            for (size_t i = 0; i < line.size();)
+            {
+                size_t j = line.find_first_of(" \t", i);
+                if (j == std::string::npos)
+                    j = line.size();
+                if (j > i)
+                    words.push_back(line.substr(i, j - i));
+                i = j + 1;
+            }
+            if (lineNumber == 0)
+            {
+                if (line != "ply")
+                    return fail("not a PLY file");
+                continue;
+            }
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+            if (words[0] == "end_header")
+                break;
+            if (words[0] == "format" && words.size() >= 2)
+            {
+                ascii = words[1] == "ascii";
+                plyBigEndian = words[1] == "binary_big_endian";
+                formatSeen = ascii || plyBigEndian || words[1] == "binary_little_endian";
+            }
+            else if (words[0] == "element" && words.size() >= 3)
+            {
+                PlyElement element;
+                element.Name = words[1];
+                element.Count = std::atoll(words[2].c_str());
+                elements.push_back(element);
+            }
+            else if (words[0] == "property" && !elements.empty())
+            {
+                PlyProperty property;
+                property.List = words.size() >= 5 && words[1] == "list";
+                if (property.List)
+                {
+                    property.CountType = plyType(words[2]);
+                    property.Type = plyType(words[3]);
+                    property.Name = words[4];
+                }
+                else if (words.size() >= 3)
+                {
+                    property.Type = plyType(words[1]);
+                    property.Name = words[2];
+                }
+                if (property.Type == PLY_INVALID || (property.List && property.CountType == PLY_INVALID))
+                    return fail("unknown property type");
+                elements.back().Properties.push_back(property);
+            }
+        }
+        if (!formatSeen)
+            return fail("missing or unknown format");
+
+        // vertex and face elements, anything before them must have a fixed size to be skipped
+        const PlyElement* vertices = NULL;
+        const PlyElement* faces = NULL;
+        for (const PlyElement& element : elements)
+        {
+            if (element.Name == "vertex")
+                vertices = &element;
+            else if (element.Name == "face")
+                faces = &element;
+            else if (vertices == NULL || faces == NULL)
+                return fail("elements other than vertex and face are not supported before them");
+        }
+        if (vertices == NULL || faces == NULL || elements[0].Name != "vertex")
+            return fail("expected vertex then face elements");
+        plyVertex = vertices->Properties;
+        static const char* slotNames[8][3] = {
+            { "x", "x", "x" }, { "y", "y", "y" }, { "z", "z", "z" },
+            { "nx", "nx", "nx" }, { "ny", "ny", "ny" }, { "nz", "nz", "nz" },
+            { "u", "s", "texture_u" }, { "v", "t", "texture_v" }
+        };
+        for (int s = 0; s < 8; s++)
+        {
+            plySlots[s] = -1;
+            for (size_t k = 0; k < plyVertex.size(); k++)
+            {
+                if (plyVertex[k].List)
+                    return fail("list properties on vertices are not supported");
+                for (int n = 0; n < 3; n++)
+                {
+                    if (plyVertex[k].Name == slotNames[s][n])
+                        plySlots[s] = (int)k;
+                }
+            }
+        }
+        if (plySlots[0] < 0 || plySlots[1] < 0 || plySlots[2] < 0)
+            return fail("vertices without x, y and z");
+        int faceList = -1;
+        for (size_t k = 0; k < faces->Properties.size(); k++)
+        {
+            if (faces->Properties[k].List && (faces->Properties[k].Name == "vertex_indices" || faces->Properties[k].Name == "vertex_index"))
+                faceList = (int)k;
+        }
+        if (faceList != 0 || (!ascii && faces->Properties.size() != 1))
+            return fail("faces must have exactly one property, the vertex index list");
+        bool hasNormals = plySlots[3] >= 0 && plySlots[4] >= 0 && plySlots[5] >= 0;
+        bool hasTexCoords = plySlots[6] >= 0 && plySlots[7] >= 0;
+        format = VertexFormat(VERTEX_POSITION | (hasTexCoords ? VERTEX_TEXCOORD : 0) | (hasNormals ? VERTEX_NORMAL : 0));
+        Stats.Vertices = vertices->Count;
+        if (ascii)
+            return importPlyText(mesh, p, start);
+        return importPlyBinary(mesh, p, *faces, faces == &elements.back(), start);
+    }
+
+    bool importPlyText(QuantizedMesh& mesh, const char* body, std::chrono::high_resolution_clock::time_point start)
+    {
+        // the face lines start after as many lines as there are vertices, found by counting line breaks in parallel
+        const char* end = data + size;
+        chunks.clear();
+        splitLines(body, end, CHUNK_PLY_VERTICES);
+        forEachChunk([this](TextChunk& chunk)
+        {
+            for (const char* p = chunk.Begin; (p = (const char*)std::memchr(p, '\n', chunk.End - p)) != NULL; p++)
+                chunk.Positions++;
+        });
+        const char* faceStart = end;
+        int64_t lines = 0;
+        for (const TextChunk& chunk : chunks)
+        {
+            if (lines + chunk.Positions >= Stats.Vertices)
+            {
+                faceStart = chunk.Begin;
+                for (; lines < Stats.Vertices; lines++)
+                    faceStart = lineEnd(faceStart, chunk.End) + 1;
+                break;
+            }
+            lines += chunk.Positions;
+        }
+        chunks.clear();
+        splitLines(body, faceStart, CHUNK_PLY_VERTICES);
+        splitLines(faceStart, end, CHUNK_PLY_FACES);
+        Stats.Chunks = (int)chunks.size();
+        if (chunks.empty())
+            return fail("no vertex or face data");
+        forEachChunk([this](TextChunk& chunk) { scanPly(chunk); });
+        prefixSums();
+        mergeBounds();
+        const TextChunk& last = chunks.back();
+        Stats.Triangles = last.FirstTriangle + last.Triangles;
+        if (last.FirstPosition + last.Positions != Stats.Vertices)
+            return fail("vertex count doesn't match the header");
+        Stats.ScanMs = elapsedMs(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        if (!mapOutput(mesh, Stats.Vertices, Stats.Triangles * 3))
+            return false;
+        forEachChunk([this](TextChunk& chunk) { parsePly(chunk); });
+        for (const TextChunk& chunk : chunks)
+            Stats.BadIndices += chunk.BadIndices;
+        Stats.ParseMs = elapsedMs(start);
+        unmapOutput(mesh);
+        chunks.clear();
+        return true;
+    }
+
+    bool importPlyBinary(QuantizedMesh& mesh, const char* body, const PlyElement& faces, bool facesLast, std::chrono::high_resolution_clock::time_point start)
+    {
+        int stride = 0;
+        for (const PlyProperty& property : plyVertex)
+            stride += plySize(property.Type);
+        const char* end = data + size;
+        const char* vertices = body;
+        const char* faceData = vertices + Stats.Vertices * stride;
+        if (faceData > end)
+            return fail("truncated vertex data");
+        int64_t faceCount = faces.Count;
+        const PlyProperty& list = faces.Properties[0];
+        int countSize = plySize(list.CountType), indexSize = plySize(list.Type);
+        // scans are triangle meshes, whose face records all have the same size and can be split anywhere. Faces are
+        // all triangles when they exactly fill the rest of the file, odd records that don't are counted as bad
+        int triangleRecord = countSize + 3 * indexSize;
+        bool triangles = facesLast && (uint64_t)(end - faceData) == (uint64_t)faceCount * triangleRecord;
+
+        // bounds per record range, merged after
+        int vertexJobs = (int)((Stats.Vertices + IMPORT_RECORD_GRAIN - 1) / IMPORT_RECORD_GRAIN);
+        int faceJobs = (int)((faceCount + IMPORT_RECORD_GRAIN - 1) / IMPORT_RECORD_GRAIN);
+        Stats.Chunks = vertexJobs + faceJobs;
+        std::vector<TextChunk> ranges(vertexJobs, TextChunk());
+        GetJobSystem().ParallelFor(vertexJobs, 1, [&](int begin, int jobEnd)
+        {
+            std::vector<float> values(plyVertex.size());
+            for (int job = begin; job < jobEnd; job++)
+            {
+                TextChunk& range = ranges[job];
+                resetBounds(range);
+                int64_t last = std::min((int64_t)(job + 1) * IMPORT_RECORD_GRAIN, Stats.Vertices);
+                for (int64_t i = (int64_t)job * IMPORT_RECORD_GRAIN; i < last; i++)
+                {
+                    binaryVertex(vertices, stride, i, values.data());
+                    glm::vec3 position, normal;
+                    glm::vec2 texCoord;
+                    plyAttributes(values.data(), position, normal, texCoord);
+                    range.PositionMin = glm::min(range.PositionMin, position);
+                    range.PositionMax = glm::max(range.PositionMax, position);
+                    range.TexCoordMin = glm::min(range.TexCoordMin, texCoord);
+                    range.TexCoordMax = glm::max(range.TexCoordMax, texCoord);
+                }
+            }
+        });
+        chunks.swap(ranges);
+        mergeBounds();
+        chunks.clear();
+
+        // polygon faces: one serial walk for the triangle count of each range of faces and where the range starts
+        std::vector<const char*> faceStarts(faceJobs + 1, faceData);
+        std::vector<int64_t> firstTriangles(faceJobs + 1, 0);
+        if (triangles)
+        {
+            for (int job = 0; job <= faceJobs; job++)
+            {
+                int64_t first = std::min((int64_t)job * IMPORT_RECORD_GRAIN, faceCount);
+                faceStarts[job] = faceData + first * triangleRecord;
+                firstTriangles[job] = first;
+            }
+        }
+        else
+        {
+            const char* p = faceData;
+            int64_t triangleCount = 0;
+            for (int64_t face = 0; face <= faceCount; face++)
+            {
+                if (face % IMPORT_RECORD_GRAIN == 0 || face == faceCount)
+                {
+                    int job = (int)((face + IMPORT_RECORD_GRAIN - 1) / IMPORT_RECORD_GRAIN);
+                    faceStarts[job] = p;
+                    firstTriangles[job] = triangleCount;
+                }
+                if (face == faceCount)
+                    break;
+                if (p + countSize > end)
+                    return fail("truncated face data");
+                int64_t corners = (int64_t)readPly(p, list.CountType);
+                p += countSize + corners * indexSize;
+                if (p > end || corners < 0)
+                    return fail("truncated face data");
+                triangleCount += std::max<int64_t>(corners - 2, 0);
+            }
+        }
+        Stats.Triangles = firstTriangles[faceJobs];
+        Stats.ScanMs = elapsedMs(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        if (!mapOutput(mesh, Stats.Vertices, Stats.Triangles * 3))
+            return false;
+        GetJobSystem().ParallelFor(vertexJobs, 1, [&](int begin, int jobEnd)
+        {
+            std::vector<float> values(plyVertex.size());
+            int64_t last = std::min((int64_t)jobEnd * IMPORT_RECORD_GRAIN, Stats.Vertices);
+            for (int64_t i = (int64_t)begin * IMPORT_RECORD_GRAIN; i < last; i++)
+            {
+                binaryVertex(vertices, stride, i, values.data());
+                writeVertex(i, values.data());
+            }
+        });
+        std::vector<int64_t> badIndices(faceJobs, 0);
+        GetJobSystem().ParallelFor(faceJobs, 1, [&](int begin, int jobEnd)
+        {
+            for (int job = begin; job < jobEnd; job++)
+            {
+                const char* p = faceStarts[job];
+                uint32_t* indices = output.Indices + firstTriangles[job] * 3;
+                int64_t faceEnd = std::min((int64_t)(job + 1) * IMPORT_RECORD_GRAIN, faceCount);
+                for (int64_t face = (int64_t)job * IMPORT_RECORD_GRAIN; face < faceEnd; face++)
+                {
+                    int64_t corners = (int64_t)readPly(p, list.CountType);
+                    p += countSize;
+                    // a triangle-sized record that isn't a triangle can't be trusted to be where the others expect
+                    if (triangles && corners != 3)
+                    {
+                        badIndices[job] += 3;
+                        corners = 3;
+                    }
+                    uint32_t first = 0, previous = 0;
+                    for (int64_t k = 0; k < corners; k++, p += indexSize)
+                    {
+                        int64_t index = (int64_t)readPly(p, list.Type);
+                        if (index < 0 || index >= Stats.Vertices)
+                        {
+                            badIndices[job]++;
+                            index = 0;
+                        }
+                        if (k == 0)
+                            first = (uint32_t)index;
+                        else if (k >= 2)
+                        {
+                            indices[0] = first;
+                            indices[1] = previous;
+                            indices[2] = (uint32_t)index;
+                            indices += 3;
+                        }
+                        previous = (uint32_t)index;
+                    }
+                }
+            }
+        });
+        for (int64_t bad : badIndices)
+            Stats.BadIndices += bad;
+        Stats.ParseMs = elapsedMs(start);
+        unmapOutput(mesh);
+        return true;
+    }
+};
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+#include <immintrin.h>
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <emmintrin.h>
+#endif
+
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// Particles are simulated and compacted in chunks of this many, one job each
+const size_t PARTICLE_CHUNK = 16384;
+
+// A point that spawns particles into a cone around Direction
+struct ParticleEmitter
+{
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Direction = glm::vec3(0.0f, 1.0f, 0.0f);
+    // half angle of the cone, radians
+    float Spread = 0.4f;
+    float SpeedMin = 2.0f;
+    float SpeedMax = 4.0f;
+    // seconds
+    float LifeMin = 1.0f;
+    float LifeMax = 2.0f;
+    // particles per second
+    float Rate = 1000.0f;
+    // RGBA, alpha scales the additive contribution
+    glm::vec4 Color = glm::vec4(1.0f, 0.55f, 0.2f, 0.25f);
+    // fraction of a particle owed to the next update
+    float Pending = 0.0f;
+};
+
+// Particle state as structure-of-arrays. Age is normalized, 0 at birth and 1 at death, so aging is one multiply-add
+// by AgeRate = 1 / lifetime and the death test is a single compare
+struct ParticleSoA
+{
+    std::vector<float> PX, PY, PZ;
+    std::vector<float> VX, VY, VZ;
+    std::vector<float> Age, AgeRate;
+    // RGBA8
+    std::vector<uint32_t> Color;
+
+    void Resize(size_t count)
+    {
+        PX.resize(count); PY.resize(count); PZ.resize(count);
+        VX.resize(count); VY.resize(count); VZ.resize(count);
+        Age.resize(count); AgeRate.resize(count);
+        Color.resize(count);
+    }
+
+    // Moves particle from to index to, both arrays are the same
+    void Copy(size_t to, size_t from)
+    {
+        PX[to] = PX[from]; PY[to] = PY[from]; PZ[to] = PZ[from];
+        VX[to] = VX[from]; VY[to] = VY[from]; VZ[to] = VZ[from];
+        Age[to] = Age[from]; AgeRate[to] = AgeRate[from];
+        Color[to] = Color[from];
+    }
+
+    // Moves count particles starting at from down to to, the ranges may overlap
+    void Move(size_t to, size_t from, size_t count)
+    {
+        std::vector<float>* streams[] = { &PX, &PY, &PZ, &VX, &VY, &VZ, &Age, &AgeRate };
+        for (std::vector<float>* stream : streams)
+            std::memmove(stream->data() + to, stream->data() + from, count * sizeof(float));
+        std::memmove(Color.data() + to, Color.data() + from, count * sizeof(uint32_t));
+    }
+};
+
+
+// Reference path: gravity, explicit Euler and aging for particles [begin, end)
+inline void IntegrateParticlesScalar(ParticleSoA& p, size_t begin, size_t end, const glm::vec3& gravity, float dt)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        p.VX[i] += gravity.x * dt; p.VY[i] += gravity.y * dt; p.VZ[i] += gravity.z * dt;
+        p.PX[i] += p.VX[i] * dt; p.PY[i] += p.VY[i] * dt; p.PZ[i] += p.VZ[i] * dt;
+        p.Age[i] += p.AgeRate[i] * dt;
+    }
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+inline void IntegrateParticlesSSE(ParticleSoA& p, size_t begin, size_t end, const glm::vec3& gravity, float dt)
+{
+    const __m128 step = _mm_set1_ps(dt);
+    const __m128 dv[3] = { _mm_set1_ps(gravity.x * dt), _mm_set1_ps(gravity.y * dt), _mm_set1_ps(gravity.z * dt) };
+    float* position[3] = { p.PX.data(), p.PY.data(), p.PZ.data() };
+    float* velocity[3] = { p.VX.data(), p.VY.data(), p.VZ.data() };
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128 v = _mm_add_ps(_mm_loadu_ps(velocity[axis] + i), dv[axis]);
+            _mm_storeu_ps(velocity[axis] + i, v);
+            _mm_storeu_ps(position[axis] + i, _mm_add_ps(_mm_loadu_ps(position[axis] + i), _mm_mul_ps(v, step)));
+        }
+        _mm_storeu_ps(&p.Age[i], _mm_add_ps(_mm_loadu_ps(&p.Age[i]), _mm_mul_ps(_mm_loadu_ps(&p.AgeRate[i]), step)));
+    }
+    IntegrateParticlesScalar(p, i, end, gravity, dt);
+}
+#endif
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+inline void IntegrateParticlesAVX(ParticleSoA& p, size_t begin, size_t end, const glm::vec3& gravity, float dt)
+{
+    const __m256 step = _mm256_set1_ps(dt);
+    const __m256 dv[3] = { _mm256_set1_ps(gravity.x * dt), _mm256_set1_ps(gravity.y * dt), _mm256_set1_ps(gravity.z * dt) };
+    float* position[3] = { p.PX.data(), p.PY.data(), p.PZ.data() };
+    float* velocity[3] = { p.VX.data(), p.VY.data(), p.VZ.data() };
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m256 v = _mm256_add_ps(_mm256_loadu_ps(velocity[axis] + i), dv[axis]);
+            _mm256_storeu_ps(velocity[axis] + i, v);
+            _mm256_storeu_ps(position[axis] + i, _mm256_add_ps(_mm256_loadu_ps(position[axis] + i), _mm256_mul_ps(v, step)));
+        }
+        _mm256_storeu_ps(&p.Age[i], _mm256_add_ps(_mm256_loadu_ps(&p.Age[i]), _mm256_mul_ps(_mm256_loadu_ps(&p.AgeRate[i]), step)));
+    }
+    IntegrateParticlesSSE(p, i, end, gravity, dt);
+}
+#endif
+
+// Advances particles [begin, end) using the widest instruction set the build targets
+inline void IntegrateParticles(ParticleSoA& p, size_t begin, size_t end, const glm::vec3& gravity, float dt)
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    IntegrateParticlesAVX(p, begin, end, gravity, dt);
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    IntegrateParticlesSSE(p, begin, end, gravity, dt);
+#else
+    IntegrateParticlesScalar(p, begin, end, gravity, dt);
+#endif
+}
+
+// Packs the live particles of [begin, end) to the front of the range and returns how many there are. Every particle
+// is copied and the write index advances by the compare result, so there is no branch to mispredict
+inline size_t CompactParticles(ParticleSoA& p, size_t begin, size_t end)
+{
+    size_t write = begin;
+    for (size_t i = begin; i < end; i++)
+    {
+        p.Copy(write, i);
+        write += p.Age[i] < 1.0f;
+    }
+    return write - begin;
+}
+
+
+// Per-instance data of the live particles, copied out of a simulation for a renderer on another thread. Streams are
+// x, y, z and age, the same order as the instance buffer
+struct ParticleInstances
+{
+    std::vector<float> Streams[4];
+    // RGBA8
+    std::vector<uint32_t> Color;
+    size_t Count = 0;
+};
+
+// CPU side of the particles, no GL. Update emits, integrates, ages and compacts in parallel chunks on the job system
+class ParticleSimulation
+{
+public:
+    std::vector<ParticleEmitter> Emitters;
+    glm::vec3 Gravity = glm::vec3(0.0f, -3.0f, 0.0f);
+
+    explicit ParticleSimulation(size_t capacity) : capacity(capacity)
+    {
+        particles.Resize(capacity);
+        chunkCounts.resize(capacity / PARTICLE_CHUNK + 2);
+    }
+
+    ParticleSimulation(const ParticleSimulation&) = delete;
+    ParticleSimulation& operator=(const ParticleSimulation&) = delete;
+
+    size_t Size() const { return count; }
+    size_t Capacity() const { return capacity; }
+
+    // Advances every particle by dt seconds, drops the dead ones and emits new ones
+    void Update(float dt)
+    {
+        stepTime = dt;
+        JobSystem& jobs = GetJobSystem();
+
+        // integrate, age and compact each chunk in place
+        int chunks = (int)((count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK);
+        jobs.ParallelFor(chunks, 1, [this](int begin, int end)
+        {
+            for (int chunk = begin; chunk < end; chunk++)
+            {
+                size_t first = chunk * PARTICLE_CHUNK;
+                size_t last = std::min(first + PARTICLE_CHUNK, count);
+                IntegrateParticles(particles, first, last, Gravity, stepTime);
+                chunkCounts[chunk] = CompactParticles(particles, first, last);
+            }
+        });
+        // close the gaps between the chunks
+        size_t live = chunks > 0 ? chunkCounts[0] : 0;
+        for (int chunk = 1; chunk < chunks; chunk++)
+        {
+            particles.Move(live, chunk * PARTICLE_CHUNK, chunkCounts[chunk]);
+            live += chunkCounts[chunk];
+        }
+        count = live;
+
+        for (ParticleEmitter& emitter : Emitters)
+        {
+            emitter.Pending += emitter.Rate * dt;
+            size_t spawn = std::min((size_t)emitter.Pending, capacity - count);
+            emitter.Pending -= (float)(size_t)emitter.Pending;
+            emit(emitter, spawn);
+        }
+    }
+
+    // Copies what the renderer needs of the live particles. out is sized for the capacity the first time, so reusing
+    // it never allocates again
+    void CopyInstances(ParticleInstances& out) const
+    {
+        const float* streams[] = { particles.PX.data(), particles.PY.data(), particles.PZ.data(), particles.Age.data() };
+        for (int stream = 0; stream < 4; stream++)
+        {
+            out.Streams[stream].resize(capacity);
+            std::memcpy(out.Streams[stream].data(), streams[stream], count * sizeof(float));
+        }
+        out.Color.resize(capacity);
+        std::memcpy(out.Color.data(), particles.Color.data(), count * sizeof(uint32_t));
+        out.Count = count;
+    }
+
+protected:
+    ParticleSoA particles;
+    size_t capacity;
+    size_t count = 0;
+
+private:
+    // survivors of each chunk in the last update
+    std::vector<size_t> chunkCounts;
+    // the state of the running Update, read by the jobs so their lambdas only capture this
+    float stepTime = 0.0f;
+    const ParticleEmitter* emitting = NULL;
+    size_t emitStart = 0;
+    size_t emitCount = 0;
+    uint32_t emitSeed = 0;
+
+    // xorshift32, one generator per emission chunk so the result doesn't depend on the thread count
+    static uint32_t nextRandom(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // [0, 1)
+    static float randomFloat(uint32_t& state)
+    {
+        return (nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static uint32_t packColor(const glm::vec4& color)
+    {
+        glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+    }
+
+    // Appends spawn particles from emitter, spread over the job system in chunks
+    void emit(const ParticleEmitter& emitter, size_t spawn)
+    {
+        if (spawn == 0)
+            return;
+        emitting = &emitter;
+        emitStart = count;
+        emitCount = spawn;
+        emitSeed++;
+        int chunks = (int)((spawn + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK);
+        GetJobSystem().ParallelFor(chunks, 1, [this](int begin, int end)
+        {
+            for (int chunk = begin; chunk < end; chunk++)
+                emitChunk(chunk);
+        });
+        count += spawn;
+        emitting = NULL;
+    }
+
+    void emitChunk(int chunk)
+    {
+        const ParticleEmitter& emitter = *emitting;
+        // orthonormal basis around the cone axis
+        glm::vec3 axis = glm::normalize(emitter.Direction);
+        glm::vec3 tangent = glm::normalize(glm::cross(axis, std::abs(axis.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+        glm::vec3 bitangent = glm::cross(axis, tangent);
+        float cosSpread = std::cos(emitter.Spread);
+        uint32_t color = packColor(emitter.Color);
+
+        uint32_t random = (emitSeed * 0x9E3779B9u) ^ ((uint32_t)chunk * 0x85EBCA6Bu) ^ 0x27D4EB2Du;
+        if (random == 0)
+            random = 1;
+        size_t first = emitStart + chunk * PARTICLE_CHUNK;
+        size_t last = emitStart + std::min((chunk + 1) * PARTICLE_CHUNK, emitCount);
+        for (size_t i = first; i < last; i++)
+        {
+            // uniform direction inside the cone
+            float cosTheta = 1.0f - randomFloat(random) * (1.0f - cosSpread);
+            float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+            float phi = randomFloat(random) * glm::two_pi<float>();
+            glm::vec3 direction = axis * cosTheta + (tangent * std::cos(phi) + bitangent * std::sin(phi)) * sinTheta;
+            glm::vec3 velocity = direction * (emitter.SpeedMin + (emitter.SpeedMax - emitter.SpeedMin) * randomFloat(random));
+            float life = emitter.LifeMin + (emitter.LifeMax - emitter.LifeMin) * randomFloat(random);
+
+            particles.PX[i] = emitter.Position.x; particles.PY[i] = emitter.Position.y; particles.PZ[i] = emitter.Position.z;
+            particles.VX[i] = velocity.x; particles.VY[i] = velocity.y; particles.VZ[i] = velocity.z;
+            particles.Age[i] = 0.0f;
+            particles.AgeRate[i] = 1.0f / std::max(life, 1e-3f);
+            particles.Color[i] = color;
+        }
+    }
+};
+
+
+// Draws particles as camera-facing quads. Position, age and colour stream straight from their arrays into one instance
+// buffer and vParticle.glsl expands every particle to a quad with a single instanced draw
+class ParticleRenderer
+{
+public:
+    Shader ParticleShader;
+    // world space half size of a particle at birth and at death
+    glm::vec2 SizeOverLife = glm::vec2(0.015f, 0.04f);
+
+    explicit ParticleRenderer(size_t capacity) : ParticleShader("src/vParticle.glsl", "src/fParticle.glsl"), capacity(capacity)
+    {
+        // one buffer, one section per stream, so every stream uploads straight from its array
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * BYTES_PER_PARTICLE, NULL, GL_STREAM_DRAW);
+        for (int stream = 0; stream < 4; stream++)
+        {
+            glVertexAttribPointer(stream, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(stream * capacity * sizeof(float)));
+            glEnableVertexAttribArray(stream);
+            glVertexAttribDivisor(stream, 1);
+        }
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint32_t), (void*)(4 * capacity * sizeof(float)));
+        glEnableVertexAttribArray(4);
+        glVertexAttribDivisor(4, 1);
+        glBindVertexArray(0);
+        GetRenderStats().BufferBytes += capacity * BYTES_PER_PARTICLE;
+    }
+
+    ~ParticleRenderer()
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+        glDeleteVertexArrays(1, &vao);
+        GetRenderStats().BufferBytes -= capacity * BYTES_PER_PARTICLE;
+    }
+
+    ParticleRenderer(const ParticleRenderer&) = delete;
+    ParticleRenderer& operator=(const ParticleRenderer&) = delete;
+
+    // Draws count particles additively over the scene, depth tested against it but not writing depth. streams are
+    // x, y, z and age
+    void Draw(const float* const streams[4], const uint32_t* color, size_t count, const glm::mat4& view, const glm::mat4& projection)
+    {
+        count = std::min(count, capacity);
+        if (count == 0)
+            return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // orphan the storage, the previous frame's draw may still be reading it
+        glBufferData(GL_ARRAY_BUFFER, capacity * BYTES_PER_PARTICLE, NULL, GL_STREAM_DRAW);
+        for (int stream = 0; stream < 4; stream++)
+            glBufferSubData(GL_ARRAY_BUFFER, stream * capacity * sizeof(float), count * sizeof(float), streams[stream]);
+        glBufferSubData(GL_ARRAY_BUFFER, 4 * capacity * sizeof(float), count * sizeof(uint32_t), color);
+
+        ParticleShader.use();
+        ParticleShader.setMat4("view", view);
+        ParticleShader.setMat4("projection", projection);
+        ParticleShader.setVec2("sizeOverLife", SizeOverLife);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+        GetRenderStats().CountDraw(6, count);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
+
+    void Draw(const ParticleInstances& instances, const glm::mat4& view, const glm::mat4& projection)
+    {
+        const float* streams[] = { instances.Streams[0].data(), instances.Streams[1].data(), instances.Streams[2].data(), instances.Streams[3].data() };
+        Draw(streams, instances.Color.data(), instances.Count, view, projection);
+    }
+
+private:
+    // x, y, z, age and RGBA8
+    static const size_t BYTES_PER_PARTICLE = 5 * sizeof(float);
+
+    size_t capacity;
+    unsigned int vao = 0;
+    unsigned int instanceBuffer = 0;
+};
+
+// A simulation drawn on the same thread
+class ParticleSystem : public ParticleSimulation
+{
+public:
+    ParticleRenderer Renderer;
+
+    explicit ParticleSystem(size_t capacity) : ParticleSimulation(capacity), Renderer(capacity) {}
+
+    void Draw(const glm::mat4& view, const glm::mat4& projection)
+    {
+        const float* streams[] = { particles.PX.data(), particles.PY.data(), particles.PZ.data(), particles.Age.data() };
+        Renderer.Draw(streams, particles.Color.data(), count, view, projection);
+    }
+};
@@ -0,0 +1,1210 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "JobSystem.h"
+#include "TransformBatch.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// points kept per contact manifold
+const int PHYSICS_MANIFOLD_POINTS = 4;
+// hulls are built by brute force, which is fine for the handful of points a collision hull has
+const int PHYSICS_MAX_HULL_POINTS = 64;
+// clipping works on fixed buffers, faces with more vertices are rejected when building the hull
+const int PHYSICS_MAX_FACE_VERTICES = 32;
+// penetration left to the position correction, keeps resting contacts from flickering
+const float PHYSICS_SLOP = 0.005f;
+// fraction of the remaining penetration removed per step
+const float PHYSICS_BAUMGARTE = 0.2f;
+// points up to this far apart are contacts already, the solver lets them close but not pass the gap. Resting
+// bodies keep all their points that way instead of rocking between touching and not
+const float PHYSICS_SPECULATIVE_DISTANCE = 0.02f;
+// body bounds are grown by this much so pairs that are about to touch reach the narrowphase
+const float PHYSICS_BOUNDS_MARGIN = PHYSICS_SPECULATIVE_DISTANCE;
+// bodies slower than this, in units and radians per second, for PHYSICS_SLEEP_TIME put their island to sleep
+const float PHYSICS_SLEEP_LINEAR = 0.05f;
+const float PHYSICS_SLEEP_ANGULAR = 0.05f;
+const float PHYSICS_SLEEP_TIME = 0.5f;
+// approaching faster than this bounces, slower contacts are treated as resting
+const float PHYSICS_RESTITUTION_THRESHOLD = 1.0f;
+// items per job of the parallel passes
+const int PHYSICS_BODY_GRAIN = 1024;
+const int PHYSICS_PAIR_GRAIN = 256;
+const int PHYSICS_ISLAND_GRAIN = 4;
+
+enum Shape_Type {
+    SHAPE_SPHERE,
+    SHAPE_HULL
+};
+
+
+// A convex polyhedron around its centre of mass. Faces list their vertices counter-clockwise seen from outside,
+// every edge knows the two faces it joins, which is what the separating axis test needs to skip edge pairs that
+// can't touch
+struct ConvexHull
+{
+    struct Edge
+    {
+        int V0, V1;
+        int Face0, Face1;
+    };
+
+    std::vector<glm::vec3> Vertices;
+    // outward normal and distance from the centre of mass
+    std::vector<glm::vec4> Planes;
+    // vertices of face f are FaceVertices[FaceStarts[f]] up to FaceVertices[FaceStarts[f + 1]]
+    std::vector<int> FaceStarts;
+    std::vector<int> FaceVertices;
+    std::vector<Edge> Edges;
+    float Volume = 0.0f;
+    // inertia tensor about the centre of mass at unit density, with the products of inertia
+    glm::mat3 Inertia = glm::mat3(0.0f);
+    glm::vec3 BoundsMin = glm::vec3(0.0f), BoundsMax = glm::vec3(0.0f);
+
+    int FaceCount() const { return (int)Planes.size(); }
+
+    int Support(const glm::vec3& direction) const
+    {
+        int best = 0;
+        float bestDot = -FLT_MAX;
+        for (int i = 0; i < (int)Vertices.size(); i++)
+        {
+            float d = glm::dot(Vertices[i], direction);
+            if (d > bestDot)
+            {
+                bestDot = d;
+                best = i;
+            }
+        }
+        return best;
+    }
+};
+
+// Builds the hull of points and moves it to its centre of mass, which is returned in centroid. Points inside the
+// hull are dropped. Returns false when the points don't span a volume or there are too many of them
+inline bool BuildConvexHull(const std::vector<glm::vec3>& input, ConvexHull& hull, glm::vec3& centroid)
+{
+    hull = ConvexHull();
+    if (input.size() < 4 || input.size() > (size_t)PHYSICS_MAX_HULL_POINTS)
+        return false;
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (const glm::vec3& p : input)
+    {
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    const float epsilon = 1e-4f * std::max(glm::length(high - low), 1e-3f);
+
+    // every plane through three points with all points behind it bounds the hull, points on it make up the face
+    std::vector<int> used(input.size(), 0);
+    std::vector<std::vector<int>> faces;
+    const int n = (int)input.size();
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i + 1; j < n; j++)
+        {
+            for (int k = j + 1; k < n; k++)
+            {
+                glm::vec3 normal = glm::cross(input[j] - input[i], input[k] - input[i]);
+                float length = glm::length(normal);
+                if (length < epsilon * epsilon)
+                    continue;
+                normal /= length;
+                float offset = glm::dot(normal, input[i]);
+                int front = 0, back = 0;
+                for (const glm::vec3& p : input)
+                {
+                    float d = glm::dot(normal, p) - offset;
+                    front += d > epsilon;
+                    back += d < -epsilon;
+                }
+                if (front > 0 && back > 0)
+                    continue;
+                if (front > 0)
+                {
+                    normal = -normal;
+                    offset = -offset;
+                }
+                bool known = false;
+                for (const glm::vec4& plane : hull.Planes)
+                    known |= glm::dot(glm::vec3(plane), normal) > 1.0f - 1e-5f && std::abs(plane.w - offset) < epsilon;
+                if (known)
+                    continue;
+
+                // order the face's points counter-clockwise around their average, seen from outside
+                std::vector<int> face;
+                glm::vec3 center(0.0f);
+                for (int p = 0; p < n; p++)
+                {
+                    bool duplicate = false;
+                    for (int q : face)
+                        duplicate |= glm::length(input[q] - input[p]) < epsilon;
+                    if (!duplicate && std::abs(glm::dot(normal, input[p]) - offset) <= epsilon)
+                    {
+                        face.push_back(p);
+                        center += input[p];
+                    }
+                }
+                if (face.size() > (size_t)PHYSICS_MAX_FACE_VERTICES)
+                    return false;
+                center /= (float)face.size();
+                glm::vec3 u = glm::normalize(input[face[0]] - center), v = glm::cross(normal, u);
+                std::sort(face.begin(), face.end(), [&](int a, int b)
+                {
+                    glm::vec3 da = input[a] - center, db = input[b] - center;
+                    return std::atan2(glm::dot(da, v), glm::dot(da, u)) < std::atan2(glm::dot(db, v), glm::dot(db, u));
+                });
+                for (int p : face)
+                    used[p] = 1;
+                hull.Planes.push_back(glm::vec4(normal, offset));
+                faces.push_back(face);
+            }
+        }
+    }
+    if (hull.Planes.size() < 4)
+        return false;
+
+    // compact the vertices, the ones inside aren't referenced by any face
+    std::vector<int> remap(n, -1);
+    for (int p = 0; p < n; p++)
+    {
+        if (used[p])
+        {
+            remap[p] = (int)hull.Vertices.size();
+            hull.Vertices.push_back(input[p]);
+        }
+    }
+    for (const std::vector<int>& face : faces)
+    {
+        hull.FaceStarts.push_back((int)hull.FaceVertices.size());
+        for (int p : face)
+            hull.FaceVertices.push_back(remap[p]);
+    }
+    hull.FaceStarts.push_back((int)hull.FaceVertices.size());
+
+    // volume, centroid and covariance from tetrahedra fanned out of a point inside
+    glm::vec3 reference(0.0f);
+    for (const glm::vec3& p : hull.Vertices)
+        reference += p;
+    reference /= (float)hull.Vertices.size();
+    float volume = 0.0f;
+    glm::vec3 weighted(0.0f);
+    glm::mat3 covariance(0.0f);
+    const glm::mat3 canonical(2.0f, 1.0f, 1.0f, 1.0f, 2.0f, 1.0f, 1.0f, 1.0f, 2.0f);
+    for (int f = 0; f < hull.FaceCount(); f++)
+    {
+        const glm::vec3 a = hull.Vertices[hull.FaceVertices[hull.FaceStarts[f]]] - reference;
+        for (int i = hull.FaceStarts[f] + 1; i + 1 < hull.FaceStarts[f + 1]; i++)
+        {
+            glm::vec3 b = hull.Vertices[hull.FaceVertices[i]] - reference, c = hull.Vertices[hull.FaceVertices[i + 1]] - reference;
+            glm::mat3 tetrahedron(a, b, c);
+            float determinant = glm::determinant(tetrahedron);
+            volume += determinant / 6.0f;
+            weighted += determinant / 6.0f * (a + b + c) * 0.25f;
+            covariance += determinant / 120.0f * tetrahedron * canonical * glm::transpose(tetrahedron);
+        }
+    }
+    if (volume <= 0.0f)
+        return false;
+    glm::vec3 center = weighted / volume;
+    covariance -= volume * glm::outerProduct(center, center);
+    centroid = reference + center;
+    float trace = covariance[0][0] + covariance[1][1] + covariance[2][2];
+    hull.Volume = volume;
+    hull.Inertia = glm::mat3(trace) - covariance;
+
+    hull.BoundsMin = glm::vec3(FLT_MAX);
+    hull.BoundsMax = glm::vec3(-FLT_MAX);
+    for (glm::vec3& p : hull.Vertices)
+    {
+        p -= centroid;
+        hull.BoundsMin = glm::min(hull.BoundsMin, p);
+        hull.BoundsMax = glm::max(hull.BoundsMax, p);
+    }
+    for (glm::vec4& plane : hull.Planes)
+        plane.w -= glm::dot(glm::vec3(plane), centroid);
+
+    // each edge once, with the face on either side
+    for (int f = 0; f < hull.FaceCount(); f++)
+    {
+        int begin = hull.FaceStarts[f], end = hull.FaceStarts[f + 1];
+        for (int i = begin; i < end; i++)
+        {
+            int v0 = hull.FaceVertices[i], v1 = hull.FaceVertices[i + 1 < end ? i + 1 : begin];
+            bool shared = false;
+            for (ConvexHull::Edge& edge : hull.Edges)
+            {
+                if (edge.V0 == v1 && edge.V1 == v0)
+                {
+                    edge.Face1 = f;
+                    shared = true;
+                }
+            }
+            if (!shared)
+                hull.Edges.push_back({ v0, v1, f, -1 });
+        }
+    }
+    hull.Edges.erase(std::remove_if(hull.Edges.begin(), hull.Edges.end(), [](const ConvexHull::Edge& edge) { return edge.Face1 < 0; }), hull.Edges.end());
+    return true;
+}
+
+
+struct PhysicsStats
+{
+    int Bodies = 0;
+    int AwakeBodies = 0;
+    int Pairs = 0;
+    int Contacts = 0;
+    int Islands = 0;
+    int LargestIsland = 0;
+    double BroadphaseMs = 0.0;
+    double NarrowphaseMs = 0.0;
+    double SolveMs = 0.0;
+};
+
+// Rigid bodies with sphere and convex hull shapes, boxes being hulls. A step sweeps and prunes the bodies' bounds
+// along x, builds contact manifolds for the overlapping pairs, groups touching bodies into islands and solves each
+// island with sequential impulses, warm started from the impulses of the previous step. Bounds, pairs and islands
+// are processed in parallel on the job system; an island is the unit of parallel solving, so one tall stack
+// runs on one thread. Islands that come to rest sleep and cost nothing until something touches them.
+// All buffers are kept between steps, a step only allocates while they grow
+class PhysicsWorld
+{
+public:
+    glm::vec3 Gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+    // piles settle with 10, a single tower of ten boxes needs about 20 to come to rest instead of swaying
+    int VelocityIterations = 10;
+    float Friction = 0.6f;
+    float Restitution = 0.0f;
+    float LinearDamping = 0.01f;
+    float AngularDamping = 0.05f;
+    PhysicsStats Stats;
+
+    // Shapes are shared by any number of bodies, these return the shape index or -1
+    int AddSphereShape(float radius)
+    {
+        Shape shape;
+        shape.Type = SHAPE_SPHERE;
+        shape.Radius = radius;
+        shape.Volume = 4.0f / 3.0f * glm::pi<float>() * radius * radius * radius;
+        shape.Inertia = glm::mat3(0.4f * shape.Volume * radius * radius);
+        shape.BoundsMax = glm::vec3(radius);
+        shapes.push_back(shape);
+        return (int)shapes.size() - 1;
+    }
+
+    int AddBoxShape(const glm::vec3& halfExtents)
+    {
+        std::vector<glm::vec3> corners;
+        for (int i = 0; i < 8; i++)
+            corners.push_back(glm::vec3(i & 1 ? halfExtents.x : -halfExtents.x, i & 2 ? halfExtents.y : -halfExtents.y, i & 4 ? halfExtents.z : -halfExtents.z));
+        return AddHullShape(corners);
+    }
+
+    // The hull's centre of mass becomes the body origin, so it should be around the origin of the points
+    int AddHullShape(const std::vector<glm::vec3>& points)
+    {
+        Shape shape;
+        shape.Type = SHAPE_HULL;
+        ConvexHull hull;
+        glm::vec3 centroid;
+        if (!BuildConvexHull(points, hull, centroid))
+            return -1;
+        shape.Hull = (int)hulls.size();
+        shape.Volume = hull.Volume;
+        shape.Inertia = hull.Inertia;
+        glm::vec3 extent = glm::max(glm::abs(hull.BoundsMin), glm::abs(hull.BoundsMax));
+        shape.BoundsMax = extent;
+        hulls.push_back(hull);
+        shapes.push_back(shape);
+        return (int)shapes.size() - 1;
+    }
+
+    // Density 0 makes the body static. Returns the body index
+    int AddBody(int shape, const glm::vec3& position, const glm::quat& orientation, float density = 1.0f)
+    {
+        const Shape& s = shapes[shape];
+        Positions.push_back(position);
+        Orientations.push_back(glm::normalize(orientation));
+        LinearVelocities.push_back(glm::vec3(0.0f));
+        AngularVelocities.push_back(glm::vec3(0.0f));
+        float mass = density * s.Volume;
+        inverseMasses.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+        inverseInertias.push_back(mass > 0.0f ? glm::inverse(density * s.Inertia) : glm::mat3(0.0f));
+        worldInverseInertias.push_back(glm::mat3(0.0f));
+        bodyShapes.push_back(shape);
+        sleepTimers.push_back(0.0f);
+        awake.push_back(mass > 0.0f ? 1 : 0);
+        for (std::vector<float>* bound : { &MinX, &MaxX, &MinY, &MaxY, &MinZ, &MaxZ })
+            bound->push_back(0.0f);
+        int body = (int)Positions.size() - 1;
+        sweep.push_back({ 0.0f, body });
+        sweepSorted = false;
+        return body;
+    }
+
+    size_t BodyCount() const { return Positions.size(); }
+    bool IsStatic(int body) const { return inverseMasses[body] == 0.0f; }
+    bool IsAwake(int body) const { return awake[body] != 0; }
+
+    void Wake(int body)
+    {
+        if (!IsStatic(body))
+        {
+            awake[body] = 1;
+            sleepTimers[body] = 0.0f;
+        }
+    }
+
+    // Sizes the step buffers for up to pairCount overlapping pairs, so a scene settling into piles after its first
+    // frames doesn't allocate. Call after adding the bodies
+    void Reserve(size_t pairCount)
+    {
+        int jobs = ((int)BodyCount() + PHYSICS_BODY_GRAIN - 1) / PHYSICS_BODY_GRAIN;
+        jobPairs.resize(std::max((int)jobPairs.size(), jobs));
+        for (std::vector<Pair>& found : jobPairs)
+            found.reserve(pairCount);
+        pairs.reserve(pairCount);
+        manifolds.reserve(pairCount);
+        previousManifolds.reserve(pairCount);
+        islandManifolds.reserve(pairCount);
+        islandStarts.reserve(BodyCount() + 1);
+        manifoldStarts.reserve(BodyCount() + 1);
+        islandCursor.reserve(BodyCount() + 1);
+        islandBodies.reserve(BodyCount());
+    }
+
+    // Body state, SoA so the passes only touch what they need. Set velocities through these, then Wake the body
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::quat> Orientations;
+    std::vector<glm::vec3> LinearVelocities;
+    std::vector<glm::vec3> AngularVelocities;
+    // world bounds of every body from the last step
+    std::vector<float> MinX, MaxX, MinY, MaxY, MinZ, MaxZ;
+
+    // Writes bodies [first, first + count) to out starting at outFirst, for ComposeTransforms
+    void WriteTransforms(size_t first, size_t count, TransformSoA& out, size_t outFirst) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out.SetPosition(outFirst + i, Positions[first + i]);
+            out.SetRotation(outFirst + i, Orientations[first + i]);
+        }
+    }
+
+    glm::mat4 GetTransform(int body) const
+    {
+        glm::mat4 transform = glm::mat4_cast(Orientations[body]);
+        transform[3] = glm::vec4(Positions[body], 1.0f);
+        return transform;
+    }
+
+    void Step(float dt)
+    {
+        stepDt = dt;
+        Stats.Bodies = (int)BodyCount();
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        GetJobSystem().ParallelFor((int)BodyCount(), PHYSICS_BODY_GRAIN, [this](int begin, int end) { updateBodies(begin, end); });
+        sortSweep();
+        findPairs();
+        Stats.BroadphaseMs = elapsedMs(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        std::swap(manifolds, previousManifolds);
+        manifolds.resize(pairs.size());
+        GetJobSystem().ParallelFor((int)pairs.size(), PHYSICS_PAIR_GRAIN, [this](int begin, int end) { collidePairs(begin, end); });
+        Stats.NarrowphaseMs = elapsedMs(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        buildIslands();
+        GetJobSystem().ParallelFor((int)islandStarts.size() - 1, PHYSICS_ISLAND_GRAIN, [this](int begin, int end)
+        {
+            for (int island = begin; island < end; island++)
+                solveIsland(island);
+        });
+        Stats.SolveMs = elapsedMs(start);
+    }
+
+private:
+    struct Shape
+    {
+        Shape_Type Type = SHAPE_SPHERE;
+        float Radius = 0.0f;
+        int Hull = -1;
+        float Volume = 0.0f;
+        glm::mat3 Inertia = glm::mat3(0.0f);
+        // half size of a box around the origin that contains the shape in any orientation of its axes
+        glm::vec3 BoundsMax = glm::vec3(0.0f);
+    };
+
+    struct SweepEntry
+    {
+        float MinX;
+        int Body;
+    };
+
+    struct Pair
+    {
+        int A, B;
+    };
+
+    struct ContactPoint
+    {
+        glm::vec3 Position;
+        // position relative to body A in its local frame, matches points between steps for warm starting
+        glm::vec3 LocalA;
+        // negative while the bodies are still apart
+        float Depth;
+        float NormalImpulse;
+        float TangentImpulse[2];
+        // solver state
+        glm::vec3 RA, RB;
+        float NormalMass;
+        float TangentMass[2];
+        float Bias;
+    };
+
+    // Contact points of one pair, the normal points from A to B
+    struct Manifold
+    {
+        int A, B;
+        int Count;
+        glm::vec3 Normal;
+        glm::vec3 Tangents[2];
+        ContactPoint Points[PHYSICS_MANIFOLD_POINTS];
+    };
+
+    std::vector<Shape> shapes;
+    std::vector<ConvexHull> hulls;
+    std::vector<float> inverseMasses;
+    // in the body frame, not diagonal for hulls whose principal axes aren't the body axes
+    std::vector<glm::mat3> inverseInertias;
+    std::vector<glm::mat3> worldInverseInertias;
+    std::vector<int> bodyShapes;
+    std::vector<float> sleepTimers;
+    std::vector<uint8_t> awake;
+
+    std::vector<SweepEntry> sweep;
+    bool sweepSorted = false;
+    // pairs found by each job of the sweep, concatenated in job order so the result doesn't depend on timing
+    std::vector<std::vector<Pair>> jobPairs;
+    std::vector<Pair> pairs;
+    std::vector<Manifold> manifolds, previousManifolds;
+
+    // islands: bodies and manifolds of island i are islandBodies[islandStarts[i]..] and islandManifolds[manifoldStarts[i]..]
+    std::vector<int> islandParents;
+    std::vector<int> islandOf;
+    std::vector<int> islandStarts, islandBodies;
+    std::vector<int> manifoldStarts, islandManifolds;
+    std::vector<int> islandCursor;
+    float stepDt = 0.0f;
+
+    static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // World inertia and bounds of bodies [begin, end)
+    void updateBodies(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            glm::mat3 rotation = glm::mat3_cast(Orientations[i]);
+            worldInverseInertias[i] = rotation * inverseInertias[i] * glm::transpose(rotation);
+            const Shape& shape = shapes[bodyShapes[i]];
+            glm::vec3 extent = shape.BoundsMax;
+            if (shape.Type == SHAPE_HULL)
+            {
+                // the box around the rotated box around the hull
+                glm::mat3 absolute(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+                extent = absolute * extent;
+            }
+            extent += PHYSICS_BOUNDS_MARGIN;
+            const glm::vec3& p = Positions[i];
+            MinX[i] = p.x - extent.x; MaxX[i] = p.x + extent.x;
+            MinY[i] = p.y - extent.y; MaxY[i] = p.y + extent.y;
+            MinZ[i] = p.z - extent.z; MaxZ[i] = p.z + extent.z;
+        }
+    }
+
+    // Bodies barely move between steps, so insertion sort on last step's order is close to linear. A scene that
+    // reshuffles falls back to a full sort
+    void sortSweep()
+    {
+        for (SweepEntry& entry : sweep)
+            entry.MinX = MinX[entry.Body];
+        size_t moves = 0, limit = sweep.size() * 8;
+        for (size_t i = 1; i < sweep.size() && sweepSorted && moves <= limit; i++)
+        {
+            SweepEntry entry = sweep[i];
+            size_t j = i;
+            for (; j > 0 && sweep[j - 1].MinX > entry.MinX; j--)
+                sweep[j] = sweep[j - 1];
+            sweep[j] = entry;
+            moves += i - j;
+        }
+        if (!sweepSorted || moves > limit)
+            std::sort(sweep.begin(), sweep.end(), [](const SweepEntry& a, const SweepEntry& b) { return a.MinX < b.MinX; });
+        sweepSorted = true;
+    }
+
+    void findPairs()
+    {
+        int jobs = ((int)sweep.size() + PHYSICS_BODY_GRAIN - 1) / PHYSICS_BODY_GRAIN;
+        if ((int)jobPairs.size() < jobs)
+            jobPairs.resize(jobs);
+        // ParallelFor runs the whole range as one job when it can't spread it, then only the first slot is written
+        for (int job = 0; job < jobs; job++)
+            jobPairs[job].clear();
+        GetJobSystem().ParallelFor((int)sweep.size(), PHYSICS_BODY_GRAIN, [this](int begin, int end)
+        {
+            std::vector<Pair>& found = jobPairs[begin / PHYSICS_BODY_GRAIN];
+            for (int i = begin; i < end; i++)
+            {
+                int a = sweep[i].Body;
+                float maxX = MaxX[a];
+                for (int j = i + 1; j < (int)sweep.size() && sweep[j].MinX <= maxX; j++)
+                {
+                    int b = sweep[j].Body;
+                    // resting and static bodies don't need contacts among themselves
+                    if (!awake[a] && !awake[b])
+                        continue;
+                    if (MinY[a] > MaxY[b] || MinY[b] > MaxY[a] || MinZ[a] > MaxZ[b] || MinZ[b] > MaxZ[a])
+                        continue;
+                    found.push_back({ std::min(a, b), std::max(a, b) });
+                }
+            }
+        });
+        pairs.clear();
+        for (int job = 0; job < jobs; job++)
+            pairs.insert(pairs.end(), jobPairs[job].begin(), jobPairs[job].end());
+        // sorted so the previous step's manifold of a pair can be found by binary search
+        std::sort(pairs.begin(), pairs.end(), [](const Pair& x, const Pair& y) { return x.A != y.A ? x.A < y.A : x.B < y.B; });
+        Stats.Pairs = (int)pairs.size();
+    }
+
+    // Contact manifolds of pairs [begin, end), with the impulses of matching points of the previous step
+    void collidePairs(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Manifold& manifold = manifolds[i];
+            manifold.A = pairs[i].A;
+            manifold.B = pairs[i].B;
+            manifold.Count = 0;
+            collide(manifold);
+            if (manifold.Count == 0)
+                continue;
+            const glm::vec3& n = manifold.Normal;
+            manifold.Tangents[0] = std::abs(n.x) >= 0.57735f ? glm::normalize(glm::vec3(n.y, -n.x, 0.0f)) : glm::normalize(glm::vec3(0.0f, n.z, -n.y));
+            manifold.Tangents[1] = glm::cross(n, manifold.Tangents[0]);
+            glm::quat inverseA = glm::conjugate(Orientations[manifold.A]);
+            for (int p = 0; p < manifold.Count; p++)
+            {
+                ContactPoint& point = manifold.Points[p];
+                point.LocalA = inverseA * (point.Position - Positions[manifold.A]);
+                point.NormalImpulse = point.TangentImpulse[0] = point.TangentImpulse[1] = 0.0f;
+            }
+
+            const Manifold* old = findPrevious(manifold.A, manifold.B);
+            if (old == NULL || glm::dot(old->Normal, manifold.Normal) < 0.95f)
+                continue;
+            for (int p = 0; p < manifold.Count; p++)
+            {
+                ContactPoint& point = manifold.Points[p];
+                for (int q = 0; q < old->Count; q++)
+                {
+                    const ContactPoint& match = old->Points[q];
+                    glm::vec3 offset = match.LocalA - point.LocalA;
+                    if (glm::dot(offset, offset) < 0.05f * 0.05f)
+                    {
+                        point.NormalImpulse = match.NormalImpulse;
+                        point.TangentImpulse[0] = match.TangentImpulse[0];
+                        point.TangentImpulse[1] = match.TangentImpulse[1];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    const Manifold* findPrevious(int a, int b) const
+    {
+        size_t low = 0, high = previousManifolds.size();
+        while (low < high)
+        {
+            size_t mid = (low + high) / 2;
+            const Manifold& m = previousManifolds[mid];
+            if (m.A < a || (m.A == a && m.B < b))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return low < previousManifolds.size() && previousManifolds[low].A == a && previousManifolds[low].B == b ? &previousManifolds[low] : NULL;
+    }
+
+    void collide(Manifold& manifold) const
+    {
+        const Shape& a = shapes[bodyShapes[manifold.A]];
+        const Shape& b = shapes[bodyShapes[manifold.B]];
+        if (a.Type == SHAPE_SPHERE && b.Type == SHAPE_SPHERE)
+        {
+            collideSpheres(manifold, a.Radius, b.Radius);
+        }
+        else if (a.Type == SHAPE_HULL && b.Type == SHAPE_HULL)
+        {
+            collideHulls(manifold, hulls[a.Hull], hulls[b.Hull]);
+        }
+        else
+        {
+            bool sphereFirst = a.Type == SHAPE_SPHERE;
+            collideSphereHull(manifold, sphereFirst ? manifold.A : manifold.B, sphereFirst ? a.Radius : b.Radius,
+                sphereFirst ? manifold.B : manifold.A, hulls[sphereFirst ? b.Hull : a.Hull]);
+            if (!sphereFirst)
+                manifold.Normal = -manifold.Normal;
+        }
+    }
+
+    void addPoint(Manifold& manifold, const glm::vec3& position, float depth) const
+    {
+        ContactPoint& point = manifold.Points[manifold.Count++];
+        point.Position = position;
+        point.Depth = depth;
+    }
+
+    void collideSpheres(Manifold& manifold, float radiusA, float radiusB) const
+    {
+        glm::vec3 d = Positions[manifold.B] - Positions[manifold.A];
+        float distance = glm::length(d);
+        if (distance > radiusA + radiusB + PHYSICS_SPECULATIVE_DISTANCE)
+            return;
+        manifold.Normal = distance > 1e-6f ? d / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+        float depth = radiusA + radiusB - distance;
+        addPoint(manifold, Positions[manifold.A] + manifold.Normal * (radiusA - depth * 0.5f), depth);
+    }
+
+    static glm::vec3 closestOnSegment(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b)
+    {
+        glm::vec3 ab = b - a;
+        float t = glm::dot(p - a, ab) / std::max(glm::dot(ab, ab), 1e-12f);
+        return a + ab * glm::clamp(t, 0.0f, 1.0f);
+    }
+
+    // Normal from the sphere to the hull. The closest point of a hull to a point outside lies on one of the faces
+    // facing it, inside it's the shallowest face
+    void collideSphereHull(Manifold& manifold, int sphere, float radius, int body, const ConvexHull& hull) const
+    {
+        glm::quat inverse = glm::conjugate(Orientations[body]);
+        glm::vec3 center = inverse * (Positions[sphere] - Positions[body]);
+        int shallowest = 0;
+        float maxSeparation = -FLT_MAX;
+        for (int f = 0; f < hull.FaceCount(); f++)
+        {
+            float s = glm::dot(glm::vec3(hull.Planes[f]), center) - hull.Planes[f].w;
+            if (s > maxSeparation)
+            {
+                maxSeparation = s;
+                shallowest = f;
+            }
+        }
+        if (maxSeparation > radius + PHYSICS_SPECULATIVE_DISTANCE)
+            return;
+        glm::vec3 closest, normal;
+        float distance;
+        if (maxSeparation <= 0.0f)
+        {
+            normal = glm::vec3(hull.Planes[shallowest]);
+            closest = center - normal * maxSeparation;
+            // negative inside, which deepens the contact
+            distance = maxSeparation;
+        }
+        else
+        {
+            distance = FLT_MAX;
+            for (int f = 0; f < hull.FaceCount(); f++)
+            {
+                glm::vec3 n(hull.Planes[f]);
+                float s = glm::dot(n, center) - hull.Planes[f].w;
+                if (s <= 0.0f)
+                    continue;
+                glm::vec3 projected = center - n * s;
+                bool inside = true;
+                int begin = hull.FaceStarts[f], end = hull.FaceStarts[f + 1];
+                for (int i = begin; i < end; i++)
+                {
+                    const glm::vec3& v0 = hull.Vertices[hull.FaceVertices[i]];
+                    const glm::vec3& v1 = hull.Vertices[hull.FaceVertices[i + 1 < end ? i + 1 : begin]];
+                    if (glm::dot(glm::cross(v1 - v0, n), projected - v0) > 0.0f)
+                    {
+                        inside = false;
+                        glm::vec3 candidate = closestOnSegment(center, v0, v1);
+                        float d = glm::length(center - candidate);
+                        if (d < distance)
+                        {
+                            distance = d;
+                            closest = candidate;
+                        }
+                    }
+                }
+                if (inside && s < distance)
+                {
+                    distance = s;
+                    closest = projected;
+                }
+            }
+            if (distance > radius + PHYSICS_SPECULATIVE_DISTANCE)
+                return;
+            normal = distance > 1e-6f ? (center - closest) / distance : glm::vec3(hull.Planes[shallowest]);
+        }
+        glm::mat3 rotation = glm::mat3_cast(Orientations[body]);
+        manifold.Normal = -(rotation * normal);
+        addPoint(manifold, Positions[body] + rotation * closest, radius - distance);
+    }
+
+    // Gauss map test: edges a (faces with normals na0, na1) and b (normals nb0, nb1, negated for the Minkowski
+    // difference) can only touch when their arcs cross
+    static bool isMinkowskiFace(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+    {
+        glm::vec3 bxa = glm::cross(b, a), dxc = glm::cross(d, c);
+        float cba = glm::dot(c, bxa), dba = glm::dot(d, bxa), adc = glm::dot(a, dxc), bdc = glm::dot(b, dxc);
+        return cba * dba < 0.0f && adc * bdc < 0.0f && cba * bdc > 0.0f;
+    }
+
+    // Separating axis test over the faces of both hulls and the edge pairs that form Minkowski faces, then the
+    // incident face clipped against the reference face, or the closest points of the two edges. Works in A's frame
+    void collideHulls(Manifold& manifold, const ConvexHull& hullA, const ConvexHull& hullB) const
+    {
+        glm::mat3 rotationA = glm::mat3_cast(Orientations[manifold.A]);
+        glm::mat3 rotationB = glm::mat3_cast(Orientations[manifold.B]);
+        // B to A and A to B
+        glm::mat3 rotation = glm::transpose(rotationA) * rotationB;
+        glm::vec3 translation = glm::transpose(rotationA) * (Positions[manifold.B] - Positions[manifold.A]);
+        glm::mat3 inverseRotation = glm::transpose(rotation);
+        glm::vec3 inverseTranslation = -(inverseRotation * translation);
+
+        int faceA = -1, faceB = -1, edgeA = -1, edgeB = -1;
+        float separationA = -FLT_MAX, separationB = -FLT_MAX, separationEdge = -FLT_MAX;
+        for (int f = 0; f < hullA.FaceCount(); f++)
+        {
+            glm::vec3 n(hullA.Planes[f]);
+            glm::vec3 v = rotation * hullB.Vertices[hullB.Support(inverseRotation * -n)] + translation;
+            float s = glm::dot(n, v) - hullA.Planes[f].w;
+            if (s > separationA)
+            {
+                separationA = s;
+                faceA = f;
+            }
+            if (s > PHYSICS_SPECULATIVE_DISTANCE)
+                return;
+        }
+        for (int f = 0; f < hullB.FaceCount(); f++)
+        {
+            glm::vec3 n(hullB.Planes[f]);
+            glm::vec3 v = inverseRotation * hullA.Vertices[hullA.Support(rotation * -n)] + inverseTranslation;
+            float s = glm::dot(n, v) - hullB.Planes[f].w;
+            if (s > separationB)
+            {
+                separationB = s;
+                faceB = f;
+            }
+            if (s > PHYSICS_SPECULATIVE_DISTANCE)
+                return;
+        }
+        for (int i = 0; i < (int)hullA.Edges.size(); i++)
+        {
+            const ConvexHull::Edge& ea = hullA.Edges[i];
+            glm::vec3 pa = hullA.Vertices[ea.V0], da = hullA.Vertices[ea.V1] - pa;
+            glm::vec3 a(hullA.Planes[ea.Face0]), b(hullA.Planes[ea.Face1]);
+            for (int j = 0; j < (int)hullB.Edges.size(); j++)
+            {
+                const ConvexHull::Edge& eb = hullB.Edges[j];
+                glm::vec3 c = -(rotation * glm::vec3(hullB.Planes[eb.Face0])), d = -(rotation * glm::vec3(hullB.Planes[eb.Face1]));
+                if (!isMinkowskiFace(a, b, c, d))
+                    continue;
+                glm::vec3 pb = rotation * hullB.Vertices[eb.V0] + translation, db = rotation * (hullB.Vertices[eb.V1] - hullB.Vertices[eb.V0]);
+                glm::vec3 axis = glm::cross(da, db);
+                float length = glm::length(axis);
+                // parallel edges are covered by the face axes
+                if (length < 1e-4f * glm::length(da) * glm::length(db))
+                    continue;
+                axis /= length;
+                if (glm::dot(axis, pa) < 0.0f)
+                    axis = -axis;
+                float s = glm::dot(axis, pb - pa);
+                if (s > separationEdge)
+                {
+                    separationEdge = s;
+                    edgeA = i;
+                    edgeB = j;
+                }
+                if (s > PHYSICS_SPECULATIVE_DISTANCE)
+                    return;
+            }
+        }
+
+        // faces are preferred unless an edge pair is clearly deeper in the separation order, which keeps stacks
+        // from switching between edge and face contacts
+        const float tolerance = 0.1f * PHYSICS_SLOP;
+        if (edgeA >= 0 && separationEdge > std::max(separationA, separationB) + tolerance)
+        {
+            const ConvexHull::Edge& ea = hullA.Edges[edgeA];
+            const ConvexHull::Edge& eb = hullB.Edges[edgeB];
+            glm::vec3 p0 = hullA.Vertices[ea.V0], p1 = hullA.Vertices[ea.V1];
+            glm::vec3 q0 = rotation * hullB.Vertices[eb.V0] + translation, q1 = rotation * hullB.Vertices[eb.V1] + translation;
+            // closest points of the two lines, the edges overlap there when they form a Minkowski face
+            glm::vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+            float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r), c = glm::dot(d1, r), b = glm::dot(d1, d2);
+            float denominator = a * e - b * b;
+            float s = denominator > 1e-12f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+            float t = glm::clamp((b * s + f) / std::max(e, 1e-12f), 0.0f, 1.0f);
+            glm::vec3 onA = p0 + d1 * s, onB = q0 + d2 * t;
+            glm::vec3 axis = glm::normalize(glm::cross(d1, d2));
+            if (glm::dot(axis, p0) < 0.0f)
+                axis = -axis;
+            manifold.Normal = rotationA * axis;
+            addPoint(manifold, Positions[manifold.A] + rotationA * ((onA + onB) * 0.5f), -separationEdge);
+            return;
+        }
+
+        bool flip = separationB > separationA + tolerance;
+        const ConvexHull& reference = flip ? hullB : hullA;
+        const ConvexHull& incident = flip ? hullA : hullB;
+        int referenceFace = flip ? faceB : faceA;
+        // incident hull into the reference hull's frame
+        const glm::mat3& toReference = flip ? inverseRotation : rotation;
+        const glm::vec3& toReferenceOffset = flip ? inverseTranslation : translation;
+        glm::vec3 normal(reference.Planes[referenceFace]);
+        float offset = reference.Planes[referenceFace].w;
+
+        // the incident face is the one most against the reference normal
+        int incidentFace = 0;
+        float minDot = FLT_MAX;
+        for (int f = 0; f < incident.FaceCount(); f++)
+        {
+            float d = glm::dot(toReference * glm::vec3(incident.Planes[f]), normal);
+            if (d < minDot)
+            {
+                minDot = d;
+                incidentFace = f;
+            }
+        }
+        glm::vec3 buffers[2][PHYSICS_MAX_FACE_VERTICES * 2];
+        int count = 0;
+        for (int i = incident.FaceStarts[incidentFace]; i < incident.FaceStarts[incidentFace + 1]; i++)
+            buffers[0][count++] = toReference * incident.Vertices[incident.FaceVertices[i]] + toReferenceOffset;
+
+        // clip by the planes through the reference face's edges
+        int input = 0;
+        int begin = reference.FaceStarts[referenceFace], end = reference.FaceStarts[referenceFace + 1];
+        for (int i = begin; i < end && count > 0; i++)
+        {
+            const glm::vec3& v0 = reference.Vertices[reference.FaceVertices[i]];
+            const glm::vec3& v1 = reference.Vertices[reference.FaceVertices[i + 1 < end ? i + 1 : begin]];
+            glm::vec3 side = glm::cross(v1 - v0, normal);
+            float sideOffset = glm::dot(side, v0);
+            const glm::vec3* in = buffers[input];
+            glm::vec3* out = buffers[1 - input];
+            int clipped = 0;
+            for (int k = 0; k < count && clipped < PHYSICS_MAX_FACE_VERTICES * 2 - 1; k++)
+            {
+                const glm::vec3& p = in[k];
+                const glm::vec3& q = in[(k + 1) % count];
+                float dp = glm::dot(side, p) - sideOffset, dq = glm::dot(side, q) - sideOffset;
+                if (dp <= 0.0f)
+                    out[clipped++] = p;
+                if ((dp < 0.0f) != (dq < 0.0f) && dp != dq)
+                    out[clipped++] = p + (q - p) * (dp / (dp - dq));
+            }
+            count = clipped;
+            input = 1 - input;
+        }
+
+        // points below the reference face, at most four: the deepest, the one furthest from it, then the ones that
+        // add the most area
+        glm::vec3 candidates[PHYSICS_MAX_FACE_VERTICES * 2];
+        float depths[PHYSICS_MAX_FACE_VERTICES * 2];
+        int kept = 0;
+        for (int k = 0; k < count; k++)
+        {
+            float s = glm::dot(normal, buffers[input][k]) - offset;
+            if (s <= PHYSICS_SPECULATIVE_DISTANCE)
+            {
+                candidates[kept] = buffers[input][k] - normal * (s * 0.5f);
+                depths[kept++] = -s;
+            }
+        }
+        if (kept == 0)
+            return;
+        int chosen[PHYSICS_MANIFOLD_POINTS];
+        int chosenCount = 0;
+        if (kept <= PHYSICS_MANIFOLD_POINTS)
+        {
+            for (int k = 0; k < kept; k++)
+                chosen[chosenCount++] = k;
+        }
+        else
+        {
+            int first = 0;
+            for (int k = 1; k < kept; k++)
+                first = depths[k] > depths[first] ? k : first;
+            int second = first == 0 ? 1 : 0;
+            for (int k = 0; k < kept; k++)
+                second = glm::length(candidates[k] - candidates[first]) > glm::length(candidates[second] - candidates[first]) ? k : second;
+            // signed areas on either side of the first two points
+            int third = -1, fourth = -1;
+            float most = 0.0f, least = 0.0f;
+            for (int k = 0; k < kept; k++)
+            {
+                float area = glm::dot(glm::cross(candidates[first] - candidates[k], candidates[second] - candidates[k]), normal);
+                if (area > most) { most = area; third = k; }
+                if (area < least) { least = area; fourth = k; }
+            }
+            chosen[chosenCount++] = first;
+            chosen[chosenCount++] = second;
+            if (third >= 0)
+                chosen[chosenCount++] = third;
+            if (fourth >= 0)
+                chosen[chosenCount++] = fourth;
+        }
+
+        glm::mat3 referenceRotation = flip ? rotationB : rotationA;
+        const glm::vec3& referencePosition = Positions[flip ? manifold.B : manifold.A];
+        manifold.Normal = referenceRotation * (flip ? -normal : normal);
+        for (int k = 0; k < chosenCount; k++)
+            addPoint(manifold, referencePosition + referenceRotation * candidates[chosen[k]], depths[chosen[k]]);
+    }
+
+    int findIsland(int body)
+    {
+        while (islandParents[body] != body)
+        {
+            islandParents[body] = islandParents[islandParents[body]];
+            body = islandParents[body];
+        }
+        return body;
+    }
+
+    // Wakes bodies touched by awake ones, then unites touching dynamic bodies and sorts bodies and manifolds
+    // by island. Static bodies belong to no island, so a floor doesn't join everything on it
+    void buildIslands()
+    {
+        const int bodyCount = (int)BodyCount();
+        islandParents.resize(bodyCount);
+        islandOf.resize(bodyCount);
+        for (int i = 0; i < bodyCount; i++)
+            islandParents[i] = i;
+        int contacts = 0;
+        for (const Manifold& manifold : manifolds)
+        {
+            if (manifold.Count == 0)
+                continue;
+            contacts += manifold.Count;
+            if (IsStatic(manifold.A) || IsStatic(manifold.B))
+                continue;
+            if (awake[manifold.A] != awake[manifold.B])
+            {
+                Wake(manifold.A);
+                Wake(manifold.B);
+            }
+            int a = findIsland(manifold.A), b = findIsland(manifold.B);
+            if (a != b)
+                islandParents[std::max(a, b)] = std::min(a, b);
+        }
+        Stats.Contacts = contacts;
+
+        // number the islands of awake bodies in body order, then bucket bodies and manifolds by island
+        islandStarts.clear();
+        int awakeCount = 0;
+        for (int i = 0; i < bodyCount; i++)
+        {
+            islandOf[i] = -1;
+            if (!awake[i])
+                continue;
+            awakeCount++;
+            int root = findIsland(i);
+            if (root == i)
+            {
+                islandOf[i] = (int)islandStarts.size();
+                islandStarts.push_back(0);
+            }
+        }
+        const int islandCount = (int)islandStarts.size();
+        islandStarts.push_back(0);
+        manifoldStarts.assign(islandCount + 1, 0);
+        for (int i = 0; i < bodyCount; i++)
+        {
+            if (awake[i])
+            {
+                // roots come first in body order, so they are numbered already
+                islandOf[i] = islandOf[findIsland(i)];
+                islandStarts[islandOf[i] + 1]++;
+            }
+        }
+        for (const Manifold& manifold : manifolds)
+        {
+            int island = manifoldIsland(manifold);
+            if (island >= 0)
+                manifoldStarts[island + 1]++;
+        }
+        for (int island = 0; island < islandCount; island++)
+        {
+            islandStarts[island + 1] += islandStarts[island];
+            manifoldStarts[island + 1] += manifoldStarts[island];
+        }
+        islandBodies.resize(awakeCount);
+        islandManifolds.resize(manifoldStarts[islandCount]);
+        islandCursor.assign(islandStarts.begin(), islandStarts.end() - 1);
+        for (int i = 0; i < bodyCount; i++)
+        {
+            if (awake[i])
+                islandBodies[islandCursor[islandOf[i]]++] = i;
+        }
+        islandCursor.assign(manifoldStarts.begin(), manifoldStarts.end() - 1);
+        for (int m = 0; m < (int)manifolds.size(); m++)
+        {
+            int island = manifoldIsland(manifolds[m]);
+            if (island >= 0)
+                islandManifolds[islandCursor[island]++] = m;
+        }
+
+        Stats.Islands = islandCount;
+        Stats.AwakeBodies = awakeCount;
+        Stats.LargestIsland = 0;
+        for (int island = 0; island < islandCount; island++)
+            Stats.LargestIsland = std::max(Stats.LargestIsland, islandStarts[island + 1] - islandStarts[island]);
+    }
+
+    int manifoldIsland(const Manifold& manifold) const
+    {
+        if (manifold.Count == 0)
+            return -1;
+        return !IsStatic(manifold.A) ? islandOf[manifold.A] : islandOf[manifold.B];
+    }
+
+    void applyImpulse(int a, int b, const glm::vec3& rA, const glm::vec3& rB, const glm::vec3& impulse)
+    {
+        // static bodies are shared between islands solved in parallel and must not be written
+        if (inverseMasses[a] > 0.0f)
+        {
+            LinearVelocities[a] -= impulse * inverseMasses[a];
+            AngularVelocities[a] -= worldInverseInertias[a] * glm::cross(rA, impulse);
+        }
+        if (inverseMasses[b] > 0.0f)
+        {
+            LinearVelocities[b] += impulse * inverseMasses[b];
+            AngularVelocities[b] += worldInverseInertias[b] * glm::cross(rB, impulse);
+        }
+    }
+
+    glm::vec3 relativeVelocity(int a, int b, const glm::vec3& rA, const glm::vec3& rB) const
+    {
+        return LinearVelocities[b] + glm::cross(AngularVelocities[b], rB) - LinearVelocities[a] - glm::cross(AngularVelocities[a], rA);
+    }
+
+    float effectiveMass(int a, int b, const glm::vec3& rA, const glm::vec3& rB, const glm::vec3& direction) const
+    {
+        glm::vec3 ra = glm::cross(rA, direction), rb = glm::cross(rB, direction);
+        float k = inverseMasses[a] + inverseMasses[b] + glm::dot(ra, worldInverseInertias[a] * ra) + glm::dot(rb, worldInverseInertias[b] * rb);
+        return k > 0.0f ? 1.0f / k : 0.0f;
+    }
+
+    // Integrates, solves and sleeps one island. Only its own bodies and manifolds are written
+    void solveIsland(int island)
+    {
+        const float dt = stepDt;
+        const int* bodies = islandBodies.data() + islandStarts[island];
+        const int bodyCount = islandStarts[island + 1] - islandStarts[island];
+        const int* contacts = islandManifolds.data() + manifoldStarts[island];
+        const int manifoldCount = manifoldStarts[island + 1] - manifoldStarts[island];
+
+        for (int i = 0; i < bodyCount; i++)
+        {
+            int body = bodies[i];
+            LinearVelocities[body] = (LinearVelocities[body] + Gravity * dt) * (1.0f / (1.0f + dt * LinearDamping));
+            AngularVelocities[body] *= 1.0f / (1.0f + dt * AngularDamping);
+        }
+
+        for (int m = 0; m < manifoldCount; m++)
+        {
+            Manifold& manifold = manifolds[contacts[m]];
+            for (int p = 0; p < manifold.Count; p++)
+            {
+                ContactPoint& point = manifold.Points[p];
+                point.RA = point.Position - Positions[manifold.A];
+                point.RB = point.Position - Positions[manifold.B];
+                point.NormalMass = effectiveMass(manifold.A, manifold.B, point.RA, point.RB, manifold.Normal);
+                point.TangentMass[0] = effectiveMass(manifold.A, manifold.B, point.RA, point.RB, manifold.Tangents[0]);
+                point.TangentMass[1] = effectiveMass(manifold.A, manifold.B, point.RA, point.RB, manifold.Tangents[1]);
+                // a gap may close within the step, penetration is pushed out gradually
+                point.Bias = point.Depth < 0.0f ? point.Depth / dt : PHYSICS_BAUMGARTE / dt * std::max(0.0f, point.Depth - PHYSICS_SLOP);
+                float approach = glm::dot(relativeVelocity(manifold.A, manifold.B, point.RA, point.RB), manifold.Normal);
+                if (approach < -PHYSICS_RESTITUTION_THRESHOLD)
+                    point.Bias = std::max(point.Bias, -Restitution * approach);
+                applyImpulse(manifold.A, manifold.B, point.RA, point.RB, manifold.Normal * point.NormalImpulse +
+                    manifold.Tangents[0] * point.TangentImpulse[0] + manifold.Tangents[1] * point.TangentImpulse[1]);
+            }
+        }
+
+        for (int iteration = 0; iteration < VelocityIterations; iteration++)
+        {
+            for (int m = 0; m < manifoldCount; m++)
+            {
+                Manifold& manifold = manifolds[contacts[m]];
+                for (int p = 0; p < manifold.Count; p++)
+                {
+                    ContactPoint& point = manifold.Points[p];
+                    // friction first, bounded by the normal impulse of the last iteration
+                    for (int t = 0; t < 2; t++)
+                    {
+                        const glm::vec3& tangent = manifold.Tangents[t];
+                        float lambda = -glm::dot(relativeVelocity(manifold.A, manifold.B, point.RA, point.RB), tangent) * point.TangentMass[t];
+                        float limit = Friction * point.NormalImpulse;
+                        float accumulated = glm::clamp(point.TangentImpulse[t] + lambda, -limit, limit);
+                        lambda = accumulated - point.TangentImpulse[t];
+                        point.TangentImpulse[t] = accumulated;
+                        applyImpulse(manifold.A, manifold.B, point.RA, point.RB, tangent * lambda);
+                    }
+                    float approach = glm::dot(relativeVelocity(manifold.A, manifold.B, point.RA, point.RB), manifold.Normal);
+                    float lambda = (point.Bias - approach) * point.NormalMass;
+                    float accumulated = std::max(point.NormalImpulse + lambda, 0.0f);
+                    lambda = accumulated - point.NormalImpulse;
+                    point.NormalImpulse = accumulated;
+                    applyImpulse(manifold.A, manifold.B, point.RA, point.RB, manifold.Normal * lambda);
+                }
+            }
+        }
+
+        float minSleep = FLT_MAX;
+        for (int i = 0; i < bodyCount; i++)
+        {
+            int body = bodies[i];
+            Positions[body] += LinearVelocities[body] * dt;
+            const glm::vec3& w = AngularVelocities[body];
+            glm::quat& q = Orientations[body];
+            q = glm::normalize(q + glm::quat(0.0f, w.x, w.y, w.z) * q * (0.5f * dt));
+            bool resting = glm::dot(LinearVelocities[body], LinearVelocities[body]) < PHYSICS_SLEEP_LINEAR * PHYSICS_SLEEP_LINEAR
+                && glm::dot(w, w) < PHYSICS_SLEEP_ANGULAR * PHYSICS_SLEEP_ANGULAR;
+            sleepTimers[body] = resting ? sleepTimers[body] + dt : 0.0f;
+            minSleep = std::min(minSleep, sleepTimers[body]);
+        }
+        if (minSleep >= PHYSICS_SLEEP_TIME)
+        {
+            for (int i = 0; i < bodyCount; i++)
+            {
+                int body = bodies[i];
+                awake[body] = 0;
+                LinearVelocities[body] = glm::vec3(0.0f);
+                AngularVelocities[body] = glm::vec3(0.0f);
+            }
+        }
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+
+// Counters for the work submitted to GL. Per-frame counters are cleared by BeginFrame, the byte counts track
+// what is currently allocated on the GPU by engine code
+struct RenderStats
+{
+    uint64_t DrawCalls = 0;
+    uint64_t Triangles = 0;
+    uint64_t UniformUploads = 0;
+    // the part of DrawCalls spent on shadow maps
+    uint64_t ShadowDrawCalls = 0;
+    uint64_t TextureUploadBytes = 0;
+    uint64_t BufferBytes = 0;
+    uint64_t TextureBytes = 0;
+
+    void BeginFrame()
+    {
+        DrawCalls = 0;
+        Triangles = 0;
+        UniformUploads = 0;
+        ShadowDrawCalls = 0;
+        TextureUploadBytes = 0;
+    }
+
+    void CountDraw(uint64_t vertexCount, uint64_t instanceCount = 1)
+    {
+        DrawCalls++;
+        Triangles += vertexCount / 3 * instanceCount;
+    }
+};
+
+inline RenderStats& GetRenderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+// Peak resident set size of the process in bytes
+inline uint64_t PeakProcessMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (uint64_t)usage.ru_maxrss * 1024;
+    return 0;
+#endif
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Animation.h"
+#include "Camera.h"
+#include "ParticleSystem.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+// Everything the render thread needs to draw one frame, produced by the simulation thread. Once published the
+// simulation never touches it again until the render thread has moved on to a newer one
+struct FrameSnapshot
+{
+    uint64_t Frame = 0;
+    // seconds, drives animation on the render side
+    float Time = 0.0f;
+    // the camera with its matrices already refreshed, so reading them doesn't recompute anything
+    Camera View;
+    int Width = 0;
+    int Height = 0;
+    // world transforms of the visible objects. The storage is reused by later frames
+    std::vector<glm::mat4> Models;
+    // live particles of the fountain, if there is one
+    ParticleInstances Particles;
+    // pose of the animated characters, if there are any
+    CrowdPose Crowd;
+};
+
+// Hands snapshots from one producer thread to one consumer thread through a fixed set of buffers. The consumer owns
+// the snapshot it last acquired, the producer fills a free one, and published snapshots are consumed oldest first.
+// With two buffers the producer runs at most one frame ahead, with three it can get two ahead and absorb a
+// slow frame on either side. The producer blocks when every buffer is taken, which paces it to the consumer
+class SnapshotQueue
+{
+public:
+    explicit SnapshotQueue(int buffers = 2) : slots(std::max(buffers, 2)), states(slots.size(), SLOT_FREE), order(slots.size(), 0) {}
+
+    SnapshotQueue(const SnapshotQueue&) = delete;
+    SnapshotQueue& operator=(const SnapshotQueue&) = delete;
+
+    // Producer: a buffer to fill, holding whatever an older frame left in it. NULL once the queue is closed
+    FrameSnapshot* BeginWrite()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return closed || find(SLOT_FREE) >= 0; });
+        if (closed)
+            return NULL;
+        writing = find(SLOT_FREE);
+        states[writing] = SLOT_WRITING;
+        return &slots[writing];
+    }
+
+    // Producer: hands the buffer from BeginWrite to the consumer
+    void Publish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            states[writing] = SLOT_READY;
+            order[writing] = ++published;
+            writing = -1;
+        }
+        changed.notify_all();
+    }
+
+    // Consumer: releases the previous snapshot and waits for the next one. NULL once the queue is closed
+    FrameSnapshot* Acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (reading >= 0)
+        {
+            states[reading] = SLOT_FREE;
+            reading = -1;
+            changed.notify_all();
+        }
+        changed.wait(lock, [this] { return closed || find(SLOT_READY) >= 0; });
+        if (closed)
+            return NULL;
+        for (int i = 0; i < (int)slots.size(); i++)
+        {
+            if (states[i] == SLOT_READY && (reading < 0 || order[i] < order[reading]))
+                reading = i;
+        }
+        states[reading] = SLOT_READING;
+        return &slots[reading];
+    }
+
+    // Wakes both sides for shutdown, either thread may call it
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+    int Buffers() const { return (int)slots.size(); }
+
+private:
+    enum Slot_State { SLOT_FREE, SLOT_WRITING, SLOT_READY, SLOT_READING };
+
+    std::vector<FrameSnapshot> slots;
+    std::vector<Slot_State> states;
+    // publish sequence number of each ready slot
+    std::vector<uint64_t> order;
+    uint64_t published = 0;
+    int writing = -1;
+    int reading = -1;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    int find(Slot_State state) const
+    {
+        for (int i = 0; i < (int)slots.size(); i++)
+        {
+            if (states[i] == state)
+                return i;
+        }
+        return -1;
+    }
+};
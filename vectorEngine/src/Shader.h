@@ -1,10 +1,16 @@
 #pragma once
 
 #include <glad\glad.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <vector>
+
+#include "AssetArchive.h"
+#include "RenderStats.h"
 
 
 class Shader
@@ -18,36 +24,47 @@ public:
     // use/activate the shader
     void use();
     // utility uniform functions
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
-    void setVec2(const std::string &name, const glm::vec2 &value) const;
-    void setVec2(const std::string &name, float x, float y) const;
-    void setVec3(const std::string &name, const glm::vec3 &value) const;
-    void setVec3(const std::string &name, float x, float y, float z) const;
-    void setVec4(const std::string &name, const glm::vec4 &value) const;
-    void setVec4(const std::string &name, float x, float y, float z, float w) const;
-    void setMat2(const std::string &name, const glm::mat2 &mat) const;
-    void setMat3(const std::string &name, const glm::mat3 &mat) const;
-    void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setFloat(const char* name, float value) const;
+    void setVec2(const char* name, const glm::vec2 &value) const;
+    void setVec2(const char* name, float x, float y) const;
+    void setVec3(const char* name, const glm::vec3 &value) const;
+    void setVec3(const char* name, float x, float y, float z) const;
+    void setVec4(const char* name, const glm::vec4 &value) const;
+    void setVec4(const char* name, float x, float y, float z, float w) const;
+    void setMat2(const char* name, const glm::mat2 &mat) const;
+    void setMat3(const char* name, const glm::mat3 &mat) const;
+    void setMat4(const char* name, const glm::mat4 &mat) const;
+    void setMat4(const char* name, const glm::mat4* mats, int count) const;
 private:
-    std::string readShaderFile(const char* filepath);
-    unsigned int compileShader(int shaderType, const char* shaderCode, std::string debugName);
-    void checkCompileErrors(GLuint shader, std::string type);
+    // Source of one stage as the string list glShaderSource takes. Pieces point into the asset archive, or into
+    // Files for shaders read from disk, so includes are spliced in without copying
+    struct ShaderSource
+    {
+        std::vector<const GLchar*> Pieces;
+        std::vector<GLint> Lengths;
+        std::deque<std::string> Files;
+    };
+
+    int uniformLocation(const char* name) const;
+    void readShaderFile(const char* filePath, ShaderSource& source);
+    void expandIncludes(const char* code, size_t size, const std::string& filePath, ShaderSource& source);
+    unsigned int compileShader(int shaderType, const ShaderSource& source, const char* debugName);
+    void checkCompileErrors(GLuint shader, const char* type);
 };
 
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
-    // 1. retrieve the vertex/fragment source code from filepath
-    std::string vShaderStr = readShaderFile(vertexPath).c_str();
-    const char* vShaderCode = vShaderStr.c_str();
-    std::string fShaderStr = readShaderFile(fragmentPath).c_str();
-    const char* fShaderCode = fShaderStr.c_str();
+    // 1. retrieve the vertex/fragment source code from the asset archive or filepath
+    ShaderSource vShaderSource, fShaderSource;
+    readShaderFile(vertexPath, vShaderSource);
+    readShaderFile(fragmentPath, fShaderSource);
 
     // 2. compile shaders
-    unsigned int vertex = compileShader(GL_VERTEX_SHADER, vShaderCode, "VERTEX");
-    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, fShaderCode, "FRAGMENT");
+    unsigned int vertex = compileShader(GL_VERTEX_SHADER, vShaderSource, "VERTEX");
+    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, fShaderSource, "FRAGMENT");
 
     // shader Program
     ID = glCreateProgram();
@@ -67,103 +84,157 @@ void Shader::use()
     glUseProgram(ID);
 }
 
-void Shader::setBool(const std::string &name, bool value) const
+void Shader::setBool(const char* name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(uniformLocation(name), (int)value);
 }
 
-void Shader::setInt(const std::string &name, int value) const
+void Shader::setInt(const char* name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(uniformLocation(name), value);
 }
 
-void Shader::setFloat(const std::string &name, float value) const
+void Shader::setFloat(const char* name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(uniformLocation(name), value);
 }
 
-void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
+void Shader::setVec2(const char* name, const glm::vec2 &value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(uniformLocation(name), 1, &value[0]);
 }
-void Shader::setVec2(const std::string &name, float x, float y) const
+void Shader::setVec2(const char* name, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(uniformLocation(name), x, y);
 }
 
-void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
+void Shader::setVec3(const char* name, const glm::vec3 &value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(uniformLocation(name), 1, &value[0]);
 }
-void Shader::setVec3(const std::string &name, float x, float y, float z) const
+void Shader::setVec3(const char* name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(uniformLocation(name), x, y, z);
 }
 
-void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
+void Shader::setVec4(const char* name, const glm::vec4 &value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(uniformLocation(name), 1, &value[0]);
 }
-void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const
+void Shader::setVec4(const char* name, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(uniformLocation(name), x, y, z, w);
 }
 
-void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
+void Shader::setMat2(const char* name, const glm::mat2 &mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
-void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
+void Shader::setMat3(const char* name, const glm::mat3 &mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
-void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
+void Shader::setMat4(const char* name, const glm::mat4 &mat) const
+{
+    glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+}
+// a uniform array, name is the array without an index
+void Shader::setMat4(const char* name, const glm::mat4* mats, int count) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(uniformLocation(name), count, GL_FALSE, &mats[0][0][0]);
 }
 
+int Shader::uniformLocation(const char* name) const
+{
+    GetRenderStats().UniformUploads++;
+    return glGetUniformLocation(ID, name);
+}
 
-std::string Shader::readShaderFile(const char * filePath)
+
+void Shader::readShaderFile(const char* filePath, ShaderSource& source)
 {
-    std::string shaderCode;
+    AssetData asset;
+    if (GetAssetArchive().Find(filePath, asset))
+    {
+        expandIncludes((const char*)asset.Data, asset.Size, filePath, source);
+        return;
+    }
+
     std::ifstream shaderFile;
     // ensure ifstream object can throw exceptions:
     shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try
     {
-        // open file
-        shaderFile.open(filePath);
-        std::stringstream vShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << shaderFile.rdbuf();
-        // close file handlers
+        // read the whole file straight into the string that the pieces will point at
+        shaderFile.open(filePath, std::ios::binary | std::ios::ate);
+        source.Files.emplace_back();
+        std::string& shaderCode = source.Files.back();
+        shaderCode.resize((size_t)shaderFile.tellg());
+        shaderFile.seekg(0);
+        shaderFile.read(&shaderCode[0], shaderCode.size());
         shaderFile.close();
-        // convert stream into string
-        shaderCode = vShaderStream.str();
+        expandIncludes(shaderCode.data(), shaderCode.size(), filePath, source);
     }
     catch (std::ifstream::failure e)
     {
         std::cout << "ERROR::SHADER::FILE \"" << filePath << "\" NOT_SUCCESFULLY_READ" << std::endl;
     }
-    return shaderCode;
 }
 
-unsigned int Shader::compileShader(int shaderType, const char* shaderCode, std::string debugName)
+// Splices lines of the form #include "file" into the piece list as the contents of that file, relative to the
+// including file. GLSL 3.30 has no include mechanism and code shared between passes would otherwise be duplicated
+void Shader::expandIncludes(const char* code, size_t size, const std::string& filePath, ShaderSource& source)
+{
+    std::string directory = filePath.substr(0, filePath.find_last_of("/\\") + 1);
+    auto addPiece = [&source](const char* begin, const char* end)
+    {
+        if (end > begin)
+        {
+            source.Pieces.push_back(begin);
+            source.Lengths.push_back((GLint)(end - begin));
+        }
+    };
+
+    const char* end = code + size;
+    const char* pieceStart = code;
+    for (const char* line = code; line < end;)
+    {
+        const char* lineEnd = std::find(line, end, '\n');
+        const char* start = line;
+        while (start < lineEnd && (*start == ' ' || *start == '\t'))
+            start++;
+        const char* open = lineEnd - start > 8 && std::strncmp(start, "#include", 8) == 0 ? std::find(start + 8, lineEnd, '"') : lineEnd;
+        const char* close = open < lineEnd ? std::find(open + 1, lineEnd, '"') : lineEnd;
+        if (close < lineEnd)
+        {
+            addPiece(pieceStart, line);
+            readShaderFile((directory + std::string(open + 1, close)).c_str(), source);
+            // the included file may not end its last line
+            static const char newline[] = "\n";
+            addPiece(newline, newline + 1);
+            pieceStart = lineEnd < end ? lineEnd + 1 : end;
+        }
+        line = lineEnd < end ? lineEnd + 1 : end;
+    }
+    addPiece(pieceStart, end);
+}
+
+unsigned int Shader::compileShader(int shaderType, const ShaderSource& source, const char* debugName)
 {
     unsigned int shader = glCreateShader(shaderType);
-    glShaderSource(shader, 1, &shaderCode, NULL);
+    glShaderSource(shader, (GLsizei)source.Pieces.size(), source.Pieces.data(), source.Lengths.data());
     glCompileShader(shader);
     checkCompileErrors(shader, debugName);
     return shader;
 }
 
-void Shader::checkCompileErrors(GLuint shader, std::string type)
+void Shader::checkCompileErrors(GLuint shader, const char* type)
 {
     GLint success;
     GLchar infoLog[1024];
-    if (type != "PROGRAM")
+    if (std::strcmp(type, "PROGRAM") != 0)
     {
         glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
         if (!success)
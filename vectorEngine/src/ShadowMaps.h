@@ -0,0 +1,337 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Camera.h"
+#include "ClusteredLighting.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// Matches SHADOW_CASCADES in clusteredLighting.glsl
+const int SHADOW_CASCADES = 4;
+
+
+// Bounding sphere of an object that casts shadows. Static casters are assumed not to move until InvalidateStatic
+struct ShadowCaster
+{
+    glm::vec3 Center;
+    float Radius;
+    bool Static;
+};
+
+struct ShadowCascade
+{
+    glm::mat4 View;
+    glm::mat4 Projection;
+    // view depth at which the cascade ends
+    float SplitFar;
+    // world space size of one shadow map texel
+    float TexelSize;
+    // light space centre of the fitted box, cached cascades are only re-rendered when it moves
+    glm::vec3 Center;
+    float Radius;
+};
+
+
+// Cascaded shadow maps for one directional light. Cascades are fitted to slices of the camera frustum with a bounding
+// sphere, so their size doesn't change as the camera turns, and snapped to whole texels so edges don't shimmer.
+// The first SHADOW_CASCADES - CachedCascades cascades are redrawn every frame. The others keep their static casters in
+// a cache layer that is only redrawn when the light, the static content or the (coarsely snapped) fit changes;
+// each frame the cache is copied to the live layer and only dynamic casters are drawn on top
+class CascadedShadowMaps
+{
+public:
+    Shader DepthShader;
+    ShadowCascade Cascades[SHADOW_CASCADES];
+    // shadows end at min(camera far plane, MaxDistance)
+    float MaxDistance = 100.0f;
+    // how far behind a cascade casters are still included, along the light direction
+    float CasterDistance = 50.0f;
+    // blend between uniform (0) and logarithmic (1) split distances
+    float SplitLambda = 0.8f;
+    int CachedCascades = 2;
+    // per Render call
+    int CascadesRendered = 0;
+    int CacheRefreshes = 0;
+
+    CascadedShadowMaps(int mapSize = 1024) : DepthShader("src/vShader.glsl", "src/fDepth.glsl"), size(mapSize)
+    {
+        shadowTexture = createDepthArray(SHADOW_CASCADES);
+        cacheTexture = createDepthArray(SHADOW_CASCADES);
+        glGenFramebuffers(SHADOW_CASCADES, liveFramebuffers);
+        glGenFramebuffers(SHADOW_CASCADES, cacheFramebuffers);
+        for (int c = 0; c < SHADOW_CASCADES; c++)
+        {
+            attachLayer(liveFramebuffers[c], shadowTexture, c);
+            attachLayer(cacheFramebuffers[c], cacheTexture, c);
+            cacheValid[c] = false;
+            liveMatchesCache[c] = false;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GetRenderStats().TextureBytes += textureBytes();
+        SetLight(glm::vec3(-0.4f, -1.0f, -0.3f), glm::vec3(1.0f));
+    }
+
+    ~CascadedShadowMaps()
+    {
+        glDeleteFramebuffers(SHADOW_CASCADES, liveFramebuffers);
+        glDeleteFramebuffers(SHADOW_CASCADES, cacheFramebuffers);
+        glDeleteTextures(1, &shadowTexture);
+        glDeleteTextures(1, &cacheTexture);
+        GetRenderStats().TextureBytes -= textureBytes();
+    }
+
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    // direction the light travels in, world space
+    void SetLight(const glm::vec3& direction, const glm::vec3& color)
+    {
+        glm::vec3 d = glm::normalize(direction);
+        if (d != lightDirection)
+        {
+            lightDirection = d;
+            // any up vector not parallel to the light gives a fixed light space orientation
+            glm::vec3 up = std::abs(d.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            lightRotation = glm::lookAt(glm::vec3(0.0f), d, up);
+            InvalidateStatic();
+        }
+        lightColor = color;
+    }
+
+    // Call when static casters were added, removed or moved
+    void InvalidateStatic()
+    {
+        for (int c = 0; c < SHADOW_CASCADES; c++)
+            cacheValid[c] = false;
+    }
+
+    // Fits the cascades to camera and draws the casters that touch them. draw must draw the listed casters with the
+    // given shader, which is already in use with view and projection set; only the model matrix is left to the caller
+    void Render(Camera& camera, const ShadowCaster* casters, size_t casterCount, const std::function<void(Shader&, const std::vector<int>&)>& draw)
+    {
+        CascadesRendered = 0;
+        CacheRefreshes = 0;
+        fitCascades(camera);
+
+        GLint previousFramebuffer, previousViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glViewport(0, 0, size, size);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        // slope scaled bias against acne, the shader adds a normal offset on top
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        DepthShader.use();
+
+        for (int c = 0; c < SHADOW_CASCADES; c++)
+        {
+            const ShadowCascade& cascade = Cascades[c];
+            bool cached = c >= SHADOW_CASCADES - CachedCascades;
+            if (!cached)
+            {
+                cull(cascade, casters, casterCount, false, true, visible);
+                renderLayer(liveFramebuffers[c], cascade, visible, draw);
+                CascadesRendered++;
+                continue;
+            }
+
+            if (!cacheValid[c])
+            {
+                cull(cascade, casters, casterCount, true, false, visible);
+                renderLayer(cacheFramebuffers[c], cascade, visible, draw);
+                cacheValid[c] = true;
+                liveMatchesCache[c] = false;
+                CacheRefreshes++;
+            }
+            cull(cascade, casters, casterCount, false, true, visible);
+            if (visible.empty() && liveMatchesCache[c])
+                continue;
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, cacheFramebuffers[c]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, liveFramebuffers[c]);
+            glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            liveMatchesCache[c] = visible.empty();
+            if (!visible.empty())
+                renderLayer(liveFramebuffers[c], cascade, visible, draw, false);
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    }
+
+    // Binds the shadow maps and sets the sun uniforms of clusteredLighting.glsl on a shader that is in use
+    void Bind(const Shader& shader) const
+    {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        // maps [-1, 1] clip space to [0, 1] texture space
+        const glm::mat4 bias(0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f);
+        glm::mat4 matrices[SHADOW_CASCADES];
+        glm::vec4 splits, texelSizes;
+        for (int c = 0; c < SHADOW_CASCADES; c++)
+        {
+            matrices[c] = bias * Cascades[c].Projection * Cascades[c].View;
+            splits[c] = Cascades[c].SplitFar;
+            texelSizes[c] = Cascades[c].TexelSize;
+        }
+        shader.setMat4("shadowMatrices", matrices, SHADOW_CASCADES);
+        shader.setBool("sunEnabled", true);
+        shader.setVec3("sunDirection", -lightDirection);
+        shader.setVec3("sunColor", lightColor);
+        shader.setVec4("cascadeSplits", splits);
+        shader.setVec4("cascadeTexelSize", texelSizes);
+        shader.setFloat("shadowMapSize", (float)size);
+    }
+
+private:
+    int size;
+    unsigned int shadowTexture = 0;
+    unsigned int cacheTexture = 0;
+    unsigned int liveFramebuffers[SHADOW_CASCADES];
+    unsigned int cacheFramebuffers[SHADOW_CASCADES];
+    bool cacheValid[SHADOW_CASCADES];
+    bool liveMatchesCache[SHADOW_CASCADES];
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    glm::vec3 lightColor = glm::vec3(1.0f);
+    glm::mat4 lightRotation;
+    std::vector<int> visible;
+
+    unsigned int createDepthArray(int layers)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        // hardware depth compare, linear filtering gives 2x2 PCF per tap
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    void attachLayer(unsigned int framebuffer, unsigned int texture, int layer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Shadow map layer " << layer << " is not complete" << std::endl;
+    }
+
+    uint64_t textureBytes() const
+    {
+        return (uint64_t)size * size * 4 * SHADOW_CASCADES * 2;
+    }
+
+    void fitCascades(Camera& camera)
+    {
+        const float zNear = camera.GetNearPlane();
+        const float zFar = std::min(camera.GetFarPlane(), MaxDistance);
+        const float tanHalfFov = std::tan(glm::radians(camera.Zoom) * 0.5f);
+        const float aspect = camera.GetAspectRatio();
+        const glm::mat4& inverseView = camera.GetInverseViewMatrix();
+
+        float sliceNear = zNear;
+        for (int c = 0; c < SHADOW_CASCADES; c++)
+        {
+            // practical split scheme
+            float t = (c + 1) / (float)SHADOW_CASCADES;
+            float logSplit = zNear * std::pow(zFar / zNear, t);
+            float uniformSplit = zNear + (zFar - zNear) * t;
+            float sliceFar = glm::mix(uniformSplit, logSplit, SplitLambda);
+
+            // bounding sphere of the slice, on the view axis so it only depends on the slice and the field of view
+            float k = std::sqrt(1.0f + aspect * aspect) * tanHalfFov;
+            float k2 = k * k;
+            float centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + k2), sliceFar);
+            glm::vec3 farCorner(k * sliceFar, 0.0f, sliceFar - centerDepth);
+            float radius = glm::length(farCorner);
+            // quantized so rounding never changes the texel size between frames
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            glm::vec3 center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+
+            ShadowCascade& cascade = Cascades[c];
+            bool cached = c >= SHADOW_CASCADES - CachedCascades;
+            glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+            if (cached)
+            {
+                // a coarse grid keeps the fit, and with it the cached map, unchanged while the camera moves within
+                // a cell. The sphere grows by the largest snapping offset so the slice is always covered
+                float step = radius * 0.25f;
+                glm::vec3 snapped = glm::floor(lightCenter / step + 0.5f) * step;
+                radius += step * 0.87f;
+                if (snapped != cascade.Center || radius != cascade.Radius)
+                    cacheValid[c] = false;
+                lightCenter = snapped;
+            }
+            else
+            {
+                float texel = 2.0f * radius / size;
+                lightCenter.x = std::floor(lightCenter.x / texel + 0.5f) * texel;
+                lightCenter.y = std::floor(lightCenter.y / texel + 0.5f) * texel;
+            }
+
+            cascade.Center = lightCenter;
+            cascade.Radius = radius;
+            cascade.SplitFar = sliceFar;
+            cascade.TexelSize = 2.0f * radius / size;
+            cascade.View = lightRotation;
+            // light space looks down -z, casters up to CasterDistance in front of the sphere are kept
+            cascade.Projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+                -(lightCenter.z + radius + CasterDistance), -(lightCenter.z - radius));
+            sliceNear = sliceFar;
+        }
+    }
+
+    // Indices of the casters whose bounding sphere overlaps the cascade box in light space
+    void cull(const ShadowCascade& cascade, const ShadowCaster* casters, size_t casterCount, bool includeStatic, bool includeDynamic, std::vector<int>& out) const
+    {
+        out.clear();
+        const glm::vec3& c = cascade.Center;
+        const float r = cascade.Radius;
+        for (size_t i = 0; i < casterCount; i++)
+        {
+            const ShadowCaster& caster = casters[i];
+            if (caster.Static ? !includeStatic : !includeDynamic)
+                continue;
+            glm::vec3 p = glm::vec3(lightRotation * glm::vec4(caster.Center, 1.0f));
+            float cr = caster.Radius;
+            if (p.x + cr < c.x - r || p.x - cr > c.x + r || p.y + cr < c.y - r || p.y - cr > c.y + r)
+                continue;
+            if (p.z - cr > c.z + r + CasterDistance || p.z + cr < c.z - r)
+                continue;
+            out.push_back((int)i);
+        }
+    }
+
+    void renderLayer(unsigned int framebuffer, const ShadowCascade& cascade, const std::vector<int>& casters,
+        const std::function<void(Shader&, const std::vector<int>&)>& draw, bool clear = true)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (clear)
+            glClear(GL_DEPTH_BUFFER_BIT);
+        DepthShader.setMat4("view", cascade.View);
+        DepthShader.setMat4("projection", cascade.Projection);
+        uint64_t drawCalls = GetRenderStats().DrawCalls;
+        draw(DepthShader, casters);
+        GetRenderStats().ShadowDrawCalls += GetRenderStats().DrawCalls - drawCalls;
+    }
+};
@@ -0,0 +1,632 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "ClusteredLighting.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Quads along a node's side. Every node is drawn as four instances of one shared grid of half as many quads, so a
+// node whose children cover part of it draws just the quarters they leave
+const int TERRAIN_GRID = 32;
+// height samples along a tile's side: the node's vertices and a border of one for the normals
+const int TERRAIN_TILE_SAMPLES = TERRAIN_GRID + 3;
+// metres between the vertices of the finest level
+const float TERRAIN_LEAF_SPACING = 0.5f;
+// A level is drawn out to this many of its node sizes from the camera, further away its parent takes over. There must
+// be room for a whole node to morph between two ranges, so at least 2 * sqrt(2)
+const float TERRAIN_RANGE_SCALE = 3.0f;
+// how far from the previous level's range to its own a level's vertices start morphing into the parent's
+const float TERRAIN_MORPH_START = 0.66f;
+const int TERRAIN_MAX_LEVELS = 16;
+// resident height tiles live in one R16 atlas, about 840 of them
+const int TERRAIN_ATLAS_SIZE = 1024;
+const int TERRAIN_ATLAS_COLUMNS = TERRAIN_ATLAS_SIZE / TERRAIN_TILE_SAMPLES;
+const int TERRAIN_MAX_INSTANCES = 4096;
+// tiles being generated or waiting for upload at once
+const int TERRAIN_MAX_LOADS = 64;
+const int TERRAIN_HEIGHT_UNIT = 9;
+// far plane with terrain, about where the coarsest levels are the horizon
+const float TERRAIN_VIEW_DISTANCE = 4000.0f;
+// the procedural landscape: hills of this wavelength and height, with 12 octaves of detail down to about a metre
+const double TERRAIN_FEATURE_SIZE = 2000.0;
+const float TERRAIN_AMPLITUDE = 60.0f;
+const int TERRAIN_OCTAVES = 12;
+
+// Value noise in [-1, 1], smoothly interpolated between random values on the integer lattice
+inline float TerrainValueNoise(double x, double z)
+{
+    double fx = std::floor(x), fz = std::floor(z);
+    int64_t ix = (int64_t)fx, iz = (int64_t)fz;
+    auto lattice = [](int64_t x, int64_t z)
+    {
+        uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)z * 0xd8163841u;
+        h = (h ^ (h >> 15)) * 0x2c1b3c6du;
+        h = (h ^ (h >> 12)) * 0x297a2d39u;
+        h ^= h >> 15;
+        return h * (2.0f / 4294967295.0f) - 1.0f;
+    };
+    float tx = (float)(x - fx), tz = (float)(z - fz);
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    tz = tz * tz * (3.0f - 2.0f * tz);
+    float a = lattice(ix, iz), b = lattice(ix + 1, iz), c = lattice(ix, iz + 1), d = lattice(ix + 1, iz + 1);
+    return glm::mix(glm::mix(a, b, tx), glm::mix(c, d, tx), tz);
+}
+
+// Height of the procedural landscape at world x, z, relative to its mean. Every level samples the same function,
+// so neighbouring nodes agree wherever their vertices coincide
+inline float TerrainHeight(double x, double z)
+{
+    double frequency = 1.0 / TERRAIN_FEATURE_SIZE;
+    float amplitude = TERRAIN_AMPLITUDE;
+    float height = 0.0f;
+    for (int octave = 0; octave < TERRAIN_OCTAVES; octave++)
+    {
+        // offset every octave so their lattices don't line up at the origin
+        height += amplitude * TerrainValueNoise(x * frequency + octave * 17.31, z * frequency - octave * 9.17);
+        amplitude *= 0.45f;
+        frequency *= 2.03;
+    }
+    return height;
+}
+
+// What the last Update selected and streamed
+struct TerrainStats
+{
+    int Levels = 0;
+    // quarter nodes drawn, all in one instanced draw
+    int Instances = 0;
+    uint64_t Triangles = 0;
+    int ResidentTiles = 0;
+    int PendingTiles = 0;
+    uint64_t GeneratedTiles = 0;
+    double SelectMs = 0.0;
+};
+
+// Continuous distance-dependent LOD terrain (CDLOD). A quadtree over the terrain picks, from the camera distance,
+// the coarsest level whose vertex spacing is good enough for each area, and every selected node is drawn from one
+// shared grid mesh whose vertex shader reads the height from the node's tile and morphs the vertices into the
+// parent level's grid as they approach the level's range, so levels meet without cracks or popping. Each node has
+// its own tile of heights at its level's spacing, generated on a loader thread and kept in an atlas with least
+// recently used eviction. A node whose tile isn't resident yet is drawn by its parent. What is drawn depends only on
+// the view distance, so draw calls and vertices stay the same however large the terrain is
+class TerrainRenderer
+{
+public:
+    // with fShader.glsl for forward shading, and with fGBuffer.glsl for the deferred geometry pass
+    Shader ForwardShader;
+    Shader GeometryShader;
+    // bound to both material units, tiled every TextureScale metres
+    unsigned int GroundTexture = 0;
+    float TextureScale = 4.0f;
+    // tiles uploaded per Update, finished ones beyond that wait for the next frame
+    int UploadsPerFrame = 16;
+    // generates missing tiles in Update on the calling thread, so every frame is complete. For reproducible images
+    bool Synchronous = false;
+    TerrainStats Stats;
+
+    // A square terrain of about size metres centred on center, whose surface passes through it
+    TerrainRenderer(float size, const glm::vec3& center)
+        : ForwardShader("src/vTerrain.glsl", "src/fShader.glsl"), GeometryShader("src/vTerrain.glsl", "src/fGBuffer.glsl")
+    {
+        // whole levels: the root is the leaf node size times a power of two
+        float leafSize = TERRAIN_GRID * TERRAIN_LEAF_SPACING;
+        levels = 1;
+        while (levels < TERRAIN_MAX_LEVELS && leafSize * (float)(1 << (levels - 1)) < size)
+            levels++;
+        Stats.Levels = levels;
+        float rootSize = nodeSize(levels - 1);
+        origin = glm::dvec2(center.x - rootSize * 0.5, center.z - rootSize * 0.5);
+        baseHeight = center.y - TerrainHeight(center.x, center.z);
+        float reach = 0.0f, amplitude = TERRAIN_AMPLITUDE;
+        for (int octave = 0; octave < TERRAIN_OCTAVES; octave++, amplitude *= 0.45f)
+            reach += amplitude;
+        minHeight = baseHeight - reach;
+        maxHeight = baseHeight + reach;
+
+        // the root covers everything and is always in range. Morphing starts part of the way from the previous range
+        glm::vec2 morph[TERRAIN_MAX_LEVELS];
+        for (int level = 0; level < levels; level++)
+        {
+            ranges[level] = level == levels - 1 ? FLT_MAX : TERRAIN_RANGE_SCALE * nodeSize(level);
+            float previous = level == 0 ? 0.0f : ranges[level - 1];
+            float start = level == levels - 1 ? FLT_MAX : glm::mix(previous, ranges[level], TERRAIN_MORPH_START);
+            morph[level] = glm::vec2(start, level == levels - 1 ? 0.0f : 1.0f / (ranges[level] - start));
+        }
+
+        Shader* shaders[] = { &ForwardShader, &GeometryShader };
+        for (Shader* shader : shaders)
+        {
+            shader->use();
+            shader->setInt("texture1", 0);
+            shader->setInt("texture2", 1);
+            shader->setFloat("roughness", 0.9f);
+            shader->setFloat("metalness", 0.0f);
+            shader->setInt("heightAtlas", TERRAIN_HEIGHT_UNIT);
+            shader->setFloat("atlasTexel", 1.0f / TERRAIN_ATLAS_SIZE);
+            shader->setVec2("heightRange", glm::vec2(minHeight, maxHeight - minHeight));
+            shader->setFloat("textureScale", 1.0f / TextureScale);
+            glUniform2fv(glGetUniformLocation(shader->ID, "morphRanges"), levels, &morph[0].x);
+        }
+        ForwardShader.use();
+        LightClusters::SetSamplerUnits(ForwardShader);
+
+        createMesh();
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, TERRAIN_ATLAS_SIZE, TERRAIN_ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_SHORT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GetRenderStats().TextureBytes += (uint64_t)TERRAIN_ATLAS_SIZE * TERRAIN_ATLAS_SIZE * 2;
+
+        slots.resize(TERRAIN_ATLAS_COLUMNS * TERRAIN_ATLAS_COLUMNS);
+        int tableSize = 1;
+        while (tableSize < (int)slots.size() * 2)
+            tableSize *= 2;
+        table.assign(tableSize, -1);
+        loads.resize(TERRAIN_MAX_LOADS);
+        for (TileLoad& load : loads)
+            load.Samples.resize(TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES);
+        missing.reserve(TERRAIN_MAX_LOADS);
+        instances.reserve(TERRAIN_MAX_INSTANCES);
+
+        // the root is the fallback for everything else
+        TileLoad& root = loads[0];
+        root.Key = tileKey(levels - 1, 0, 0);
+        generateTile(root);
+        uploadTile(root, frame);
+        loader = std::thread(&TerrainRenderer::loaderLoop, this);
+    }
+
+    ~TerrainRenderer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        loader.join();
+        unsigned int buffers[] = { gridBuffer, indexBuffer, instanceBuffer };
+        glDeleteBuffers(3, buffers);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteTextures(1, &atlas);
+        GetRenderStats().TextureBytes -= (uint64_t)TERRAIN_ATLAS_SIZE * TERRAIN_ATLAS_SIZE * 2;
+        GetRenderStats().BufferBytes -= gridBytes + TERRAIN_MAX_INSTANCES * sizeof(TerrainInstance);
+    }
+
+    TerrainRenderer(const TerrainRenderer&) = delete;
+    TerrainRenderer& operator=(const TerrainRenderer&) = delete;
+
+    // Uploads finished tiles, selects the nodes to draw from the camera and queues tiles for the ones that are
+    // missing. Call once per frame before Draw
+    void Update(Camera& camera)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        frame++;
+        uploadFinished();
+        select(camera);
+        // synchronously every pass makes the next level down resident, until nothing is missing
+        for (int pass = 0; Synchronous && !missing.empty() && pass < levels; pass++)
+        {
+            for (uint64_t key : missing)
+            {
+                TileLoad& load = loads[0];
+                load.Key = key;
+                generateTile(load);
+                uploadTile(load, frame);
+            }
+            select(camera);
+        }
+        // the synchronous passes use the first load as scratch, so nothing may go to the loader
+        if (!Synchronous)
+            requestMissing();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, TERRAIN_MAX_INSTANCES * sizeof(TerrainInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(TerrainInstance), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        Stats.Instances = (int)instances.size();
+        Stats.Triangles = (uint64_t)instances.size() * indexCount / 3;
+        Stats.ResidentTiles = 0;
+        for (const TileSlot& slot : slots)
+            Stats.ResidentTiles += slot.Used ? 1 : 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats.PendingTiles = 0;
+        for (const TileLoad& load : loads)
+            Stats.PendingTiles += load.State != LOAD_FREE ? 1 : 0;
+        Stats.SelectMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Draws the selected nodes with shader, ForwardShader or GeometryShader, which the caller has bound with its
+    // lighting uniforms set. Leaves the ground texture bound to units 0 and 1
+    void Draw(Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos)
+    {
+        if (instances.empty())
+            return;
+        shader.use();
+        shader.setMat4("view", view);
+        shader.setMat4("projection", projection);
+        shader.setVec3("cameraPos", viewPos);
+        glActiveTexture(GL_TEXTURE0 + TERRAIN_HEIGHT_UNIT);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, GroundTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, GroundTexture);
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, NULL, (GLsizei)instances.size());
+        GetRenderStats().CountDraw(indexCount, instances.size());
+        glBindVertexArray(0);
+    }
+
+    // height of the terrain surface at world x, z
+    float HeightAt(float x, float z) const
+    {
+        return baseHeight + TerrainHeight(x, z);
+    }
+
+private:
+    // per quarter node: its node's origin, vertex spacing and level, and the tile's texel origin in the atlas with
+    // the quarter's offset in grid steps
+    struct TerrainInstance
+    {
+        glm::vec4 Node;
+        glm::vec4 Tile;
+    };
+
+    struct TileSlot
+    {
+        uint64_t Key = 0;
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        uint64_t LastUsed = 0;
+        bool Used = false;
+    };
+
+    enum Load_State {
+        LOAD_FREE,
+        LOAD_QUEUED,
+        LOAD_GENERATING,
+        LOAD_DONE
+    };
+
+    // A tile on its way to the atlas. The loader thread only touches loads it took out of LOAD_QUEUED
+    struct TileLoad
+    {
+        uint64_t Key = 0;
+        Load_State State = LOAD_FREE;
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        std::vector<uint16_t> Samples;
+    };
+
+    int levels = 1;
+    glm::dvec2 origin;
+    float baseHeight = 0.0f;
+    float minHeight = 0.0f, maxHeight = 0.0f;
+    float ranges[TERRAIN_MAX_LEVELS];
+    uint64_t frame = 0;
+
+    unsigned int vao = 0, gridBuffer = 0, indexBuffer = 0, instanceBuffer = 0, atlas = 0;
+    GLsizei indexCount = 0;
+    size_t gridBytes = 0;
+    std::vector<TerrainInstance> instances;
+
+    // atlas slots, and an open addressing table from tile key to slot
+    std::vector<TileSlot> slots;
+    std::vector<int> table;
+    std::vector<uint64_t> missing;
+
+    std::vector<TileLoad> loads;
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+
+    float nodeSize(int level) const { return TERRAIN_GRID * TERRAIN_LEAF_SPACING * (float)(1 << level); }
+
+    static uint64_t tileKey(int level, int x, int z) { return (uint64_t)level << 56 | (uint64_t)z << 28 | (uint64_t)x; }
+    static int keyLevel(uint64_t key) { return (int)(key >> 56); }
+    static int keyX(uint64_t key) { return (int)(key & 0xFFFFFFF); }
+    static int keyZ(uint64_t key) { return (int)((key >> 28) & 0xFFFFFFF); }
+
+    // The quarter grid: (TERRAIN_GRID / 2 + 1)^2 vertices as byte coordinates, and the instance buffer
+    void createMesh()
+    {
+        const int side = TERRAIN_GRID / 2;
+        std::vector<uint8_t> grid;
+        for (int z = 0; z <= side; z++)
+        {
+            for (int x = 0; x <= side; x++)
+            {
+                grid.push_back((uint8_t)x);
+                grid.push_back((uint8_t)z);
+            }
+        }
+        std::vector<uint16_t> indices;
+        for (int z = 0; z < side; z++)
+        {
+            for (int x = 0; x < side; x++)
+            {
+                uint16_t i = (uint16_t)(z * (side + 1) + x);
+                uint16_t quad[] = { i, (uint16_t)(i + side + 1), (uint16_t)(i + 1), (uint16_t)(i + 1), (uint16_t)(i + side + 1), (uint16_t)(i + side + 2) };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        indexCount = (GLsizei)indices.size();
+        gridBytes = grid.size() + indices.size() * sizeof(uint16_t);
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &gridBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, gridBuffer);
+        glBufferData(GL_ARRAY_BUFFER, grid.size(), grid.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_BYTE, 2, (void*)0);
+        glEnableVertexAttribArray(0);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, TERRAIN_MAX_INSTANCES * sizeof(TerrainInstance), NULL, GL_STREAM_DRAW);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void*)offsetof(TerrainInstance, Node));
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void*)offsetof(TerrainInstance, Tile));
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        GetRenderStats().BufferBytes += gridBytes + TERRAIN_MAX_INSTANCES * sizeof(TerrainInstance);
+    }
+
+    int findSlot(uint64_t key) const
+    {
+        size_t mask = table.size() - 1;
+        for (size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull >> 40) & mask; table[i] >= 0; i = (i + 1) & mask)
+        {
+            if (slots[table[i]].Key == key)
+                return table[i];
+        }
+        return -1;
+    }
+
+    void insertSlot(uint64_t key, int slot)
+    {
+        size_t mask = table.size() - 1;
+        size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull >> 40) & mask;
+        while (table[i] >= 0)
+            i = (i + 1) & mask;
+        table[i] = slot;
+    }
+
+    // removes a key with backward shift, so lookups never need tombstones
+    void eraseSlot(uint64_t key)
+    {
+        size_t mask = table.size() - 1;
+        size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull >> 40) & mask;
+        while (slots[table[i]].Key != key)
+            i = (i + 1) & mask;
+        for (size_t j = (i + 1) & mask; table[j] >= 0; j = (j + 1) & mask)
+        {
+            size_t home = (size_t)(slots[table[j]].Key * 0x9E3779B97F4A7C15ull >> 40) & mask;
+            // move j into the hole at i unless its home lies cyclically in (i, j]
+            bool between = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+            if (!between)
+            {
+                table[i] = table[j];
+                i = j;
+            }
+        }
+        table[i] = -1;
+    }
+
+    // Heights of a node's vertices and their border, quantized over the terrain's height range
+    void generateTile(TileLoad& load) const
+    {
+        int level = keyLevel(load.Key);
+        double spacing = nodeSize(level) / TERRAIN_GRID;
+        double x0 = origin.x + keyX(load.Key) * (double)nodeSize(level) - spacing;
+        double z0 = origin.y + keyZ(load.Key) * (double)nodeSize(level) - spacing;
+        float low = FLT_MAX, high = -FLT_MAX;
+        float scale = 65535.0f / (maxHeight - minHeight);
+        for (int j = 0; j < TERRAIN_TILE_SAMPLES; j++)
+        {
+            for (int i = 0; i < TERRAIN_TILE_SAMPLES; i++)
+            {
+                float height = baseHeight + TerrainHeight(x0 + i * spacing, z0 + j * spacing);
+                // the border only shades the edge, it isn't part of the node's bounds
+                if (i > 0 && j > 0 && i < TERRAIN_TILE_SAMPLES - 1 && j < TERRAIN_TILE_SAMPLES - 1)
+                {
+                    low = std::min(low, height);
+                    high = std::max(high, height);
+                }
+                load.Samples[j * TERRAIN_TILE_SAMPLES + i] = (uint16_t)glm::clamp((height - minHeight) * scale + 0.5f, 0.0f, 65535.0f);
+            }
+        }
+        load.MinHeight = low;
+        load.MaxHeight = high;
+    }
+
+    // Puts a generated tile into a free slot, or the least recently used one not used since keepFrom. The root tile,
+    // the fallback for everything else, is never replaced
+    void uploadTile(const TileLoad& load, uint64_t keepFrom)
+    {
+        if (findSlot(load.Key) >= 0)
+            return;
+        uint64_t root = tileKey(levels - 1, 0, 0);
+        int best = -1;
+        for (int i = 0; i < (int)slots.size(); i++)
+        {
+            if (!slots[i].Used)
+            {
+                best = i;
+                break;
+            }
+            if (slots[i].Key != root && slots[i].LastUsed < keepFrom && (best < 0 || slots[i].LastUsed < slots[best].LastUsed))
+                best = i;
+        }
+        if (best < 0)
+            return;
+        TileSlot& slot = slots[best];
+        if (slot.Used)
+            eraseSlot(slot.Key);
+        slot.Key = load.Key;
+        slot.MinHeight = load.MinHeight;
+        slot.MaxHeight = load.MaxHeight;
+        slot.LastUsed = frame;
+        slot.Used = true;
+        insertSlot(load.Key, best);
+
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (best % TERRAIN_ATLAS_COLUMNS) * TERRAIN_TILE_SAMPLES, (best / TERRAIN_ATLAS_COLUMNS) * TERRAIN_TILE_SAMPLES,
+            TERRAIN_TILE_SAMPLES, TERRAIN_TILE_SAMPLES, GL_RED, GL_UNSIGNED_SHORT, load.Samples.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GetRenderStats().TextureUploadBytes += load.Samples.size() * sizeof(uint16_t);
+        Stats.GeneratedTiles++;
+    }
+
+    void uploadFinished()
+    {
+        int uploaded = 0;
+        for (TileLoad& load : loads)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (load.State != LOAD_DONE)
+                    continue;
+            }
+            if (uploaded++ >= UploadsPerFrame)
+                return;
+            // this frame has not selected its nodes yet, the last frame's are the best guess at what it needs
+            uploadTile(load, frame - 1);
+            std::lock_guard<std::mutex> lock(mutex);
+            load.State = LOAD_FREE;
+        }
+    }
+
+    // Queues this frame's missing tiles on free loads, unless they are already on their way
+    void requestMissing()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (uint64_t key : missing)
+            {
+                int free = -1;
+                bool queued = false;
+                for (int i = 0; i < (int)loads.size() && !queued; i++)
+                {
+                    queued = loads[i].State != LOAD_FREE && loads[i].Key == key;
+                    if (loads[i].State == LOAD_FREE && free < 0)
+                        free = i;
+                }
+                if (queued || free < 0)
+                    continue;
+                loads[free].Key = key;
+                loads[free].State = LOAD_QUEUED;
+            }
+        }
+        wake.notify_one();
+    }
+
+    void loaderLoop()
+    {
+        for (;;)
+        {
+            TileLoad* load = NULL;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, &load]
+                {
+                    for (TileLoad& candidate : loads)
+                    {
+                        if (candidate.State == LOAD_QUEUED)
+                        {
+                            load = &candidate;
+                            break;
+                        }
+                    }
+                    return quit || load != NULL;
+                });
+                if (quit)
+                    return;
+                load->State = LOAD_GENERATING;
+            }
+            generateTile(*load);
+            std::lock_guard<std::mutex> lock(mutex);
+            load->State = LOAD_DONE;
+        }
+    }
+
+    static bool sphereIntersectsBox(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        if (radius == FLT_MAX)
+            return true;
+        glm::vec3 d = center - glm::clamp(center, boxMin, boxMax);
+        return glm::dot(d, d) <= radius * radius;
+    }
+
+    void select(Camera& camera)
+    {
+        instances.clear();
+        missing.clear();
+        selectNode(camera, levels - 1, 0, 0);
+    }
+
+    // Selects the node or the parts of it its children don't take. Returns false if the node is out of its level's
+    // range or its tile is missing, in which case its parent covers its area
+    bool selectNode(Camera& camera, int level, int x, int z)
+    {
+        uint64_t key = tileKey(level, x, z);
+        int slot = findSlot(key);
+        float size = nodeSize(level);
+        glm::vec3 boxMin((float)(origin.x + x * (double)size), slot >= 0 ? slots[slot].MinHeight : minHeight, (float)(origin.y + z * (double)size));
+        glm::vec3 boxMax(boxMin.x + size, slot >= 0 ? slots[slot].MaxHeight : maxHeight, boxMin.z + size);
+        if (!sphereIntersectsBox(camera.Position, ranges[level], boxMin, boxMax))
+            return false;
+        if (slot < 0)
+        {
+            if (missing.size() < missing.capacity())
+                missing.push_back(key);
+            return false;
+        }
+        slots[slot].LastUsed = frame;
+        if (!camera.GetFrustum().IntersectsBox(boxMin, boxMax))
+            return true;
+
+        bool covered[4] = { false, false, false, false };
+        if (level > 0 && sphereIntersectsBox(camera.Position, ranges[level - 1], boxMin, boxMax))
+        {
+            for (int child = 0; child < 4; child++)
+                covered[child] = selectNode(camera, level - 1, x * 2 + (child & 1), z * 2 + (child >> 1));
+        }
+        for (int quarter = 0; quarter < 4; quarter++)
+        {
+            if (covered[quarter] || instances.size() == TERRAIN_MAX_INSTANCES)
+                continue;
+            TerrainInstance instance;
+            instance.Node = glm::vec4(boxMin.x, boxMin.z, size / TERRAIN_GRID, (float)level);
+            instance.Tile = glm::vec4((float)((slot % TERRAIN_ATLAS_COLUMNS) * TERRAIN_TILE_SAMPLES), (float)((slot / TERRAIN_ATLAS_COLUMNS) * TERRAIN_TILE_SAMPLES),
+                (float)((quarter & 1) * TERRAIN_GRID / 2), (float)((quarter >> 1) * TERRAIN_GRID / 2));
+            instances.push_back(instance);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+// characters laid out per frame, the vertex buffer is sized for them once
+const int TEXT_MAX_CHARACTERS = 4096;
+// Every glyph has a cell of the atlas. Glyphs are drawn with strokes on a grid 4 units wide and 6 tall from the
+// baseline, and the cell covers that with room for descenders and the distance falloff
+const int GLYPH_CELL_WIDTH = 32;
+const int GLYPH_CELL_HEIGHT = 48;
+const int GLYPH_ATLAS_COLUMNS = 16;
+const float GLYPH_UNIT_PIXELS = 5.0f;
+const glm::vec2 GLYPH_CELL_ORIGIN(-1.2f, -1.6f);
+const float GLYPH_CAP_HEIGHT = 6.0f;
+const float GLYPH_ADVANCE = 6.0f;
+const float GLYPH_LINE_HEIGHT = 10.0f;
+// half the width of a stroke, and the distance in units from the stroke's edge at which the field reaches 0 or 1
+const float GLYPH_STROKE = 0.45f;
+const float GLYPH_SPREAD = 1.5f;
+
+// Strokes of the built-in font: polylines of x,y points separated by ';'. Lower case letters use the upper case
+// glyphs, anything else missing is drawn as '?'
+struct GlyphStrokes
+{
+    char Character;
+    const char* Strokes;
+};
+
+const GlyphStrokes GLYPH_STROKES[] = {
+    { ' ', "" },
+    { '0', "1,0 0,1 0,5 1,6 3,6 4,5 4,1 3,0 1,0" },
+    { '1', "1,5 2,6 2,0;1,0 3,0" },
+    { '2', "0,5 1,6 3,6 4,5 4,4 0,0 4,0" },
+    { '3', "0,5 1,6 3,6 4,5 4,4 3,3 4,2 4,1 3,0 1,0 0,1;1,3 3,3" },
+    { '4', "3,0 3,6 0,2 4,2" },
+    { '5', "4,6 0,6 0,3 3,3 4,2 4,1 3,0 0,0" },
+    { '6', "4,5 3,6 1,6 0,5 0,1 1,0 3,0 4,1 4,2 3,3 0,3" },
+    { '7', "0,6 4,6 1,0" },
+    { '8', "1,3 0,4 0,5 1,6 3,6 4,5 4,4 3,3 1,3 0,2 0,1 1,0 3,0 4,1 4,2 3,3" },
+    { '9', "4,3 1,3 0,4 0,5 1,6 3,6 4,5 4,1 3,0 1,0" },
+    { 'A', "0,0 0,4 2,6 4,4 4,0;0,3 4,3" },
+    { 'B', "0,0 0,6 3,6 4,5 4,4 3,3 0,3;3,3 4,2 4,1 3,0 0,0" },
+    { 'C', "4,5 3,6 1,6 0,5 0,1 1,0 3,0 4,1" },
+    { 'D', "0,0 0,6 2,6 4,4 4,2 2,0 0,0" },
+    { 'E', "4,6 0,6 0,0 4,0;0,3 3,3" },
+    { 'F', "4,6 0,6 0,0;0,3 3,3" },
+    { 'G', "4,5 3,6 1,6 0,5 0,1 1,0 3,0 4,1 4,3 2,3" },
+    { 'H', "0,0 0,6;4,0 4,6;0,3 4,3" },
+    { 'I', "1,6 3,6;2,6 2,0;1,0 3,0" },
+    { 'J', "4,6 4,1 3,0 1,0 0,1" },
+    { 'K', "0,0 0,6;4,6 0,2;1,3 4,0" },
+    { 'L', "0,6 0,0 4,0" },
+    { 'M', "0,0 0,6 2,3 4,6 4,0" },
+    { 'N', "0,0 0,6 4,0 4,6" },
+    { 'O', "1,0 0,1 0,5 1,6 3,6 4,5 4,1 3,0 1,0" },
+    { 'P', "0,0 0,6 3,6 4,5 4,4 3,3 0,3" },
+    { 'Q', "1,0 0,1 0,5 1,6 3,6 4,5 4,1 3,0 1,0;2,2 4,0" },
+    { 'R', "0,0 0,6 3,6 4,5 4,4 3,3 0,3;2,3 4,0" },
+    { 'S', "4,5 3,6 1,6 0,5 0,4 1,3 3,3 4,2 4,1 3,0 1,0 0,1" },
+    { 'T', "0,6 4,6;2,6 2,0" },
+    { 'U', "0,6 0,1 1,0 3,0 4,1 4,6" },
+    { 'V', "0,6 2,0 4,6" },
+    { 'W', "0,6 1,0 2,3 3,0 4,6" },
+    { 'X', "0,0 4,6;0,6 4,0" },
+    { 'Y', "0,6 2,3 4,6;2,3 2,0" },
+    { 'Z', "0,6 4,6 0,0 4,0" },
+    { '.', "2,0 2,0.3" },
+    { ',', "2,0.5 1,-1" },
+    { ':', "2,1 2,1.3;2,4 2,4.3" },
+    { '/', "0,0 4,6" },
+    { '%', "0,0 4,6;0,5 1,5 1,6 0,6 0,5;3,0 4,0 4,1 3,1 3,0" },
+    { '-', "1,3 3,3" },
+    { '+', "1,3 3,3;2,2 2,4" },
+    { '=', "1,2 3,2;1,4 3,4" },
+    { '(', "3,6 2,5 2,1 3,0" },
+    { ')', "1,6 2,5 2,1 1,0" },
+    { '_', "0,-1 4,-1" },
+    { '?', "0,5 1,6 3,6 4,5 4,4 2,3 2,2;2,0 2,0.3" },
+};
+const int GLYPH_COUNT = sizeof(GLYPH_STROKES) / sizeof(GLYPH_STROKES[0]);
+
+
+// Screen space text from a signed distance field atlas of the built-in stroke font, which stays sharp at any size.
+// The atlas is rasterized once on the job system. Add lays strings out into one vertex buffer and Draw submits all
+// of them with a single call
+class TextRenderer
+{
+public:
+    Shader TextShader;
+    // how long building the atlas took
+    double RasterizeMs = 0.0;
+    // the last Draw or Redraw: upload, state changes and the draw call
+    double SubmitMs = 0.0;
+
+    TextRenderer()
+        : TextShader("src/vText.glsl", "src/fText.glsl")
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        std::fill(glyphIndex, glyphIndex + 128, -1);
+        std::vector<std::vector<glm::vec4>> segments(GLYPH_COUNT);
+        for (int glyph = 0; glyph < GLYPH_COUNT; glyph++)
+        {
+            glyphIndex[(unsigned char)GLYPH_STROKES[glyph].Character] = glyph;
+            segments[glyph] = parseStrokes(GLYPH_STROKES[glyph].Strokes);
+        }
+        for (char c = 'a'; c <= 'z'; c++)
+            glyphIndex[(int)c] = glyphIndex[c - 'a' + 'A'];
+        int unknown = glyphIndex['?'];
+        for (int& index : glyphIndex)
+            index = index < 0 ? unknown : index;
+
+        int rows = (GLYPH_COUNT + GLYPH_ATLAS_COLUMNS - 1) / GLYPH_ATLAS_COLUMNS;
+        atlasSize = glm::ivec2(GLYPH_ATLAS_COLUMNS * GLYPH_CELL_WIDTH, rows * GLYPH_CELL_HEIGHT);
+        std::vector<uint8_t> pixels(atlasSize.x * atlasSize.y, 0);
+        GetJobSystem().ParallelFor(GLYPH_COUNT, 4, [this, &segments, &pixels](int begin, int end)
+        {
+            for (int glyph = begin; glyph < end; glyph++)
+                rasterize(segments[glyph], pixels.data() + cellOrigin(glyph).y * atlasSize.x + cellOrigin(glyph).x);
+        });
+        RasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasSize.x, atlasSize.y, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GetRenderStats().TextureBytes += pixels.size();
+
+        // quads are 0 1 2, 0 2 3 of their four vertices
+        std::vector<uint16_t> indices(TEXT_MAX_CHARACTERS * 6);
+        for (int quad = 0; quad < TEXT_MAX_CHARACTERS; quad++)
+        {
+            uint16_t pattern[] = { 0, 1, 2, 0, 2, 3 };
+            for (int i = 0; i < 6; i++)
+                indices[quad * 6 + i] = (uint16_t)(quad * 4 + pattern[i]);
+        }
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, TEXT_MAX_CHARACTERS * 4 * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, Position));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, TexCoord));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)offsetof(TextVertex, Color));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        GetRenderStats().BufferBytes += TEXT_MAX_CHARACTERS * 4 * sizeof(TextVertex) + indices.size() * sizeof(uint16_t);
+
+        vertices.reserve(TEXT_MAX_CHARACTERS * 4);
+        TextShader.use();
+        TextShader.setInt("glyphAtlas", 0);
+    }
+
+    ~TextRenderer()
+    {
+        unsigned int buffers[] = { vertexBuffer, indexBuffer };
+        glDeleteBuffers(2, buffers);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteTextures(1, &atlas);
+        GetRenderStats().TextureBytes -= (uint64_t)atlasSize.x * atlasSize.y;
+        GetRenderStats().BufferBytes -= TEXT_MAX_CHARACTERS * 4 * sizeof(TextVertex) + TEXT_MAX_CHARACTERS * 6 * sizeof(uint16_t);
+    }
+
+    TextRenderer(const TextRenderer&) = delete;
+    TextRenderer& operator=(const TextRenderer&) = delete;
+
+    // Lays out text with the top left of its first line at x, y in pixels from the top left of the screen, with
+    // capitals pixelHeight tall. '\n' starts a new line. Characters beyond TEXT_MAX_CHARACTERS a frame are dropped
+    void Add(const char* text, float x, float y, float pixelHeight, const glm::vec4& color)
+    {
+        float scale = pixelHeight / GLYPH_CAP_HEIGHT;
+        glm::vec2 pen(x, y + pixelHeight);
+        glm::vec2 size = glm::vec2(GLYPH_CELL_WIDTH, GLYPH_CELL_HEIGHT) / GLYPH_UNIT_PIXELS * scale;
+        glm::vec2 texel = 1.0f / glm::vec2(atlasSize);
+        uint32_t packed = packColor(color);
+        for (const char* c = text; *c != '\0'; c++)
+        {
+            if (*c == '\n')
+            {
+                pen = glm::vec2(x, pen.y + GLYPH_LINE_HEIGHT * scale);
+                continue;
+            }
+            int glyph = glyphIndex[(unsigned char)*c & 127];
+            if (*c != ' ' && vertices.size() < vertices.capacity())
+            {
+                // y grows down the screen and up the atlas
+                glm::vec2 low(pen.x + GLYPH_CELL_ORIGIN.x * scale, pen.y - GLYPH_CELL_ORIGIN.y * scale);
+                glm::vec2 uvLow = glm::vec2(cellOrigin(glyph)) * texel;
+                glm::vec2 uvHigh = uvLow + glm::vec2(GLYPH_CELL_WIDTH, GLYPH_CELL_HEIGHT) * texel;
+                vertices.push_back({ low, uvLow, packed });
+                vertices.push_back({ glm::vec2(low.x + size.x, low.y), glm::vec2(uvHigh.x, uvLow.y), packed });
+                vertices.push_back({ glm::vec2(low.x + size.x, low.y - size.y), uvHigh, packed });
+                vertices.push_back({ glm::vec2(low.x, low.y - size.y), glm::vec2(uvLow.x, uvHigh.y), packed });
+            }
+            pen.x += GLYPH_ADVANCE * scale;
+        }
+    }
+
+    // Draws everything added since the last Draw over the current framebuffer of width by height pixels
+    void Draw(int width, int height)
+    {
+        uploadedQuads = vertices.size() / 4;
+        SubmitMs = 0.0;
+        if (vertices.empty())
+            return;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        // respecified at the size of this frame's text, a HUD is a few kilobytes where orphaning the whole buffer
+        // would make the driver allocate and clear all of it
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TextVertex), vertices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        vertices.clear();
+        double uploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        Redraw(width, height);
+        SubmitMs += uploadMs;
+    }
+
+    // Draws the text of the last Draw again, without laying it out or uploading it
+    void Redraw(int width, int height)
+    {
+        SubmitMs = 0.0;
+        if (uploadedQuads == 0)
+            return;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        TextShader.use();
+        TextShader.setVec2("screenSize", glm::vec2((float)width, (float)height));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBindVertexArray(vao);
+        GLsizei indexCount = (GLsizei)(uploadedQuads * 6);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, NULL);
+        GetRenderStats().CountDraw(indexCount);
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        SubmitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+private:
+    struct TextVertex
+    {
+        glm::vec2 Position;
+        glm::vec2 TexCoord;
+        uint32_t Color;
+    };
+
+    int glyphIndex[128];
+    glm::ivec2 atlasSize;
+    unsigned int atlas = 0, vao = 0, vertexBuffer = 0, indexBuffer = 0;
+    std::vector<TextVertex> vertices;
+    // in the vertex buffer since the last Draw
+    size_t uploadedQuads = 0;
+
+    glm::ivec2 cellOrigin(int glyph) const
+    {
+        return glm::ivec2(glyph % GLYPH_ATLAS_COLUMNS * GLYPH_CELL_WIDTH, glyph / GLYPH_ATLAS_COLUMNS * GLYPH_CELL_HEIGHT);
+    }
+
+    static uint32_t packColor(const glm::vec4& color)
+    {
+        glm::uvec4 c = glm::uvec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+        return c.r | c.g << 8 | c.b << 16 | c.a << 24;
+    }
+
+    // Turns "x,y x,y;x,y ..." into the segments between consecutive points of every polyline
+    static std::vector<glm::vec4> parseStrokes(const char* strokes)
+    {
+        std::vector<glm::vec4> segments;
+        const char* c = strokes;
+        bool first = true;
+        glm::vec2 previous;
+        while (*c != '\0')
+        {
+            if (*c == ';')
+            {
+                first = true;
+                c++;
+                continue;
+            }
+            char* end;
+            glm::vec2 point;
+            point.x = std::strtof(c, &end);
+            point.y = std::strtof(end + 1, &end);
+            if (!first)
+                segments.push_back(glm::vec4(previous, point));
+            previous = point;
+            first = false;
+            c = *end == ' ' ? end + 1 : end;
+        }
+        return segments;
+    }
+
+    // Writes the glyph's signed distance field into its cell, 0.5 on the stroke's edge and rising inwards
+    void rasterize(const std::vector<glm::vec4>& segments, uint8_t* cell) const
+    {
+        for (int y = 0; y < GLYPH_CELL_HEIGHT; y++)
+        {
+            for (int x = 0; x < GLYPH_CELL_WIDTH; x++)
+            {
+                glm::vec2 p = GLYPH_CELL_ORIGIN + (glm::vec2((float)x, (float)y) + 0.5f) / GLYPH_UNIT_PIXELS;
+                float distance = GLYPH_SPREAD + GLYPH_STROKE;
+                for (const glm::vec4& segment : segments)
+                {
+                    glm::vec2 a(segment.x, segment.y), ab = glm::vec2(segment.z, segment.w) - a;
+                    float t = glm::dot(ab, ab) > 0.0f ? glm::clamp(glm::dot(p - a, ab) / glm::dot(ab, ab), 0.0f, 1.0f) : 0.0f;
+                    distance = std::min(distance, glm::length(p - a - ab * t));
+                }
+                float value = 0.5f - 0.5f * (distance - GLYPH_STROKE) / GLYPH_SPREAD;
+                cell[y * atlasSize.x + x] = (uint8_t)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+};
+
+// Frame time, draw calls, triangles and memory in the top left corner. The text is formatted and laid out every
+// OVERLAY_REFRESH_FRAMES frames, which still reads as live, and the frames between redraw what was uploaded. It times
+// itself, the cost of an earlier overlay is on screen too
+const int OVERLAY_REFRESH_FRAMES = 8;
+
+class PerformanceOverlay
+{
+public:
+    TextRenderer Text;
+    // the last Draw, from formatting to submitting, and the formatting and layout part of it, 0 when the text was
+    // reused. Software GL does vertex work in the draw call, which then dominates
+    double CostMs = 0.0;
+    double LayoutMs = 0.0;
+
+    // Shows stats, the counters of the frame so far, over the current framebuffer of width by height pixels
+    void Draw(const RenderStats& stats, int width, int height)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        // smoothed over about half a second at 60 fps, so the numbers can be read
+        if (frames > 0)
+        {
+            double frameMs = std::chrono::duration<double, std::milli>(start - lastFrame).count();
+            frameMsAverage = frames == 1 ? frameMs : frameMsAverage + (frameMs - frameMsAverage) * 0.06;
+        }
+        lastFrame = start;
+
+        LayoutMs = 0.0;
+        if (frames++ % OVERLAY_REFRESH_FRAMES == 0)
+        {
+            char line[256];
+            std::snprintf(line, sizeof(line), "frame %.2f ms  %.0f fps\ndraws %llu  triangles %.1fk\ngpu memory %.1f MiB  peak rss %.1f MiB\noverlay %.3f ms",
+                frameMsAverage, frameMsAverage > 0.0 ? 1000.0 / frameMsAverage : 0.0, (unsigned long long)stats.DrawCalls, stats.Triangles / 1000.0,
+                (stats.BufferBytes + stats.TextureBytes) / (1024.0 * 1024.0), PeakProcessMemory() / (1024.0 * 1024.0), CostMs);
+            Text.Add(line, 10.0f, 10.0f, 12.0f, glm::vec4(1.0f, 0.95f, 0.6f, 1.0f));
+            LayoutMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            Text.Draw(width, height);
+        }
+        else
+        {
+            Text.Redraw(width, height);
+        }
+        CostMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+private:
+    int frames = 0;
+    double frameMsAverage = 0.0;
+    std::chrono::high_resolution_clock::time_point lastFrame;
+};
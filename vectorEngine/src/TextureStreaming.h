@@ -0,0 +1,400 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "AssetArchive.h"
+#include "Memory.h"
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Produces the full resolution RGBA8 image of a streamed texture. Runs on the loader thread, so it must not touch GL
+typedef std::function<bool(std::vector<unsigned char>& rgba, int& width, int& height)> TextureSource;
+
+// Decodes an image from the asset archive or disk with stb_image, honouring stbi_set_flip_vertically_on_load
+inline TextureSource TextureFileSource(const std::string& filePath)
+{
+    return [filePath](std::vector<unsigned char>& rgba, int& width, int& height)
+    {
+        int channels;
+        unsigned char* data = LoadAssetImage(filePath.c_str(), &width, &height, &channels, 4);
+        if (data == NULL)
+        {
+            std::cerr << "Failed to load texture with filepath \"" << filePath << "\"" << std::endl;
+            return false;
+        }
+        rgba.assign(data, data + (size_t)width * height * 4);
+        stbi_image_free(data);
+        return true;
+    };
+}
+
+
+// Keeps textures resident only down to the mip level their on-screen size needs, inside a fixed memory budget.
+// Each frame the renderer reports the projected size of whatever uses a texture with RequestSize, and Update picks
+// a finest resident level per texture: the requested one, coarsened least recently used first while the total is
+// over BudgetBytes. Coarser levels are dropped at once, finer ones are decoded and downsampled on a loader thread and
+// uploaded a few megabytes per frame, so a texture sharpens over a few frames instead of stalling one.
+// GL 3.3 has no immutable storage, so a texture object keeps every level defined and dropped levels are redefined
+// as 0x0 images below GL_TEXTURE_BASE_LEVEL; levels of TAIL_SIZE and smaller are always resident
+class TextureStreamer
+{
+public:
+    static const int TAIL_SIZE = 64;
+
+    uint64_t BudgetBytes;
+    // uploads stop for the frame once this much was uploaded, at least one load is always uploaded
+    uint64_t UploadBytesPerFrame = 4 << 20;
+    // added to every requested level, positive values trade sharpness for memory
+    float LodBias = 0.0f;
+    // from the last Update
+    uint64_t ResidentBytes = 0;
+    uint64_t UploadedBytes = 0;
+    int PendingLoads = 0;
+    int Evictions = 0;
+
+    explicit TextureStreamer(uint64_t budgetBytes) : BudgetBytes(budgetBytes)
+    {
+        loader = std::thread(&TextureStreamer::loaderLoop, this);
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        loader.join();
+        for (StreamedTexture& texture : textures)
+        {
+            glDeleteTextures(1, &texture.Id);
+            GetRenderStats().TextureBytes -= residentBytes(texture, texture.ResidentLevel);
+        }
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Decodes the texture once to learn its size and uploads the always resident tail. Returns the handle for
+    // GetTexture and RequestSize, or -1 if the source failed
+    int Add(const TextureSource& source)
+    {
+        std::vector<unsigned char> rgba;
+        int width, height;
+        if (!source(rgba, width, height))
+            return -1;
+
+        StreamedTexture texture;
+        texture.Source = source;
+        texture.Width = width;
+        texture.Height = height;
+        texture.LevelCount = 1;
+        while (std::max(width, height) >> texture.LevelCount > 0)
+            texture.LevelCount++;
+        texture.TailLevel = 0;
+        while (std::max(levelWidth(texture, texture.TailLevel), levelHeight(texture, texture.TailLevel)) > TAIL_SIZE)
+            texture.TailLevel++;
+
+        glGenTextures(1, &texture.Id);
+        glBindTexture(GL_TEXTURE_2D, texture.Id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.LevelCount - 1);
+        for (int level = 0; level < texture.TailLevel; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        std::vector<std::vector<unsigned char>> levels = buildLevels(rgba, width, height, texture.TailLevel, texture.LevelCount);
+        texture.ResidentLevel = texture.LevelCount;
+        textures.push_back(texture);
+        uploadLevels(textures.back(), texture.TailLevel, levels);
+        return (int)textures.size() - 1;
+    }
+
+    unsigned int GetTexture(int handle) const { return textures[handle].Id; }
+    int GetResidentLevel(int handle) const { return textures[handle].ResidentLevel; }
+    int GetLevelCount(int handle) const { return textures[handle].LevelCount; }
+
+    // Notes that the texture covers about pixels texels across on screen this frame. Call for every visible user
+    // of the texture before Update, the largest size wins
+    void RequestSize(int handle, float pixels)
+    {
+        StreamedTexture& texture = textures[handle];
+        texture.RequestedPixels = std::max(texture.RequestedPixels, pixels);
+    }
+
+    // Diameter in pixels of a sphere's projection, for RequestSize
+    static float ProjectedSize(const glm::mat4& view, const glm::mat4& projection, int viewportHeight, const glm::vec3& center, float radius)
+    {
+        float depth = -(view * glm::vec4(center, 1.0f)).z;
+        if (depth <= radius)
+            return (float)viewportHeight;
+        return radius * projection[1][1] * viewportHeight / depth;
+    }
+
+    // Picks the resident level of every texture, drops unneeded levels, queues loads for missing ones and uploads
+    // finished loads. Call once per frame after the RequestSize calls and before drawing with the textures
+    void Update()
+    {
+        frame++;
+        UploadedBytes = 0;
+        Evictions = 0;
+
+        // wanted levels; unused textures keep what they have until the budget needs it
+        uint64_t total = 0;
+        order.resize(textures.size());
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture& texture = textures[i];
+            if (texture.RequestedPixels > 0.0f)
+            {
+                float texels = (float)std::max(texture.Width, texture.Height);
+                int level = (int)std::floor(std::log2(texels / std::max(texture.RequestedPixels, 1.0f)) + LodBias);
+                texture.TargetLevel = glm::clamp(level, 0, texture.TailLevel);
+                texture.LastUsed = frame;
+            }
+            else
+            {
+                texture.TargetLevel = std::min(texture.ResidentLevel, texture.TailLevel);
+            }
+            total += residentBytes(texture, texture.TargetLevel);
+            order[i] = (int)i;
+        }
+
+        // over budget: coarsen least recently used first, among this frame's textures the smallest on screen first
+        if (total > BudgetBytes)
+        {
+            std::sort(order.begin(), order.end(), [this](int a, int b)
+            {
+                if (textures[a].LastUsed != textures[b].LastUsed)
+                    return textures[a].LastUsed < textures[b].LastUsed;
+                return textures[a].RequestedPixels < textures[b].RequestedPixels;
+            });
+            for (size_t i = 0; i < order.size() && total > BudgetBytes; i++)
+            {
+                StreamedTexture& texture = textures[order[i]];
+                while (texture.TargetLevel < texture.TailLevel && total > BudgetBytes)
+                {
+                    total -= levelBytes(texture, texture.TargetLevel);
+                    texture.TargetLevel++;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture& texture = textures[i];
+            texture.RequestedPixels = 0.0f;
+            if (texture.TargetLevel > texture.ResidentLevel)
+            {
+                evictLevels(texture, texture.TargetLevel);
+                Evictions++;
+            }
+            else if (texture.TargetLevel < texture.ResidentLevel && !texture.Loading && !texture.Failed)
+            {
+                texture.Loading = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back({ (int)i, texture.TargetLevel, texture.ResidentLevel, texture.Source, {} });
+            }
+        }
+        wake.notify_one();
+
+        uploadFinished();
+
+        ResidentBytes = 0;
+        PendingLoads = 0;
+        for (const StreamedTexture& texture : textures)
+        {
+            ResidentBytes += residentBytes(texture, texture.ResidentLevel);
+            PendingLoads += texture.Loading ? 1 : 0;
+        }
+        GetRenderStats().TextureUploadBytes += UploadedBytes;
+    }
+
+private:
+    struct StreamedTexture
+    {
+        unsigned int Id = 0;
+        TextureSource Source;
+        int Width = 0;
+        int Height = 0;
+        int LevelCount = 0;
+        // finest level that is always resident
+        int TailLevel = 0;
+        // finest level currently resident, GL_TEXTURE_BASE_LEVEL
+        int ResidentLevel = 0;
+        int TargetLevel = 0;
+        float RequestedPixels = 0.0f;
+        uint64_t LastUsed = 0;
+        bool Loading = false;
+        // the source failed on the loader thread, the texture stays at what is resident
+        bool Failed = false;
+    };
+
+    // levels [FirstLevel, EndLevel) of one texture
+    struct LoadRequest
+    {
+        int Handle;
+        int FirstLevel;
+        int EndLevel;
+        TextureSource Source;
+        std::vector<std::vector<unsigned char>> Levels;
+    };
+
+    std::vector<StreamedTexture> textures;
+    std::vector<int> order;
+    uint64_t frame = 0;
+
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+    // Requests are list nodes from a pool, spliced from queue to queue. Only the main thread creates and destroys
+    // nodes, the loader just moves them, so the pool needs no lock of its own
+    typedef std::list<LoadRequest, PoolStlAllocator<LoadRequest>> LoadQueue;
+    PoolAllocator requestPool { sizeof(LoadRequest) + 2 * sizeof(void*), 64, "stream_requests" };
+    LoadQueue requests { PoolStlAllocator<LoadRequest>(requestPool) };
+    LoadQueue finished { PoolStlAllocator<LoadRequest>(requestPool) };
+    // the request the loader is working on, and the one being uploaded
+    LoadQueue loading { PoolStlAllocator<LoadRequest>(requestPool) };
+    LoadQueue uploading { PoolStlAllocator<LoadRequest>(requestPool) };
+
+    static int levelWidth(const StreamedTexture& texture, int level) { return std::max(1, texture.Width >> level); }
+    static int levelHeight(const StreamedTexture& texture, int level) { return std::max(1, texture.Height >> level); }
+
+    static uint64_t levelBytes(const StreamedTexture& texture, int level)
+    {
+        return (uint64_t)levelWidth(texture, level) * levelHeight(texture, level) * 4;
+    }
+
+    static uint64_t residentBytes(const StreamedTexture& texture, int firstLevel)
+    {
+        uint64_t bytes = 0;
+        for (int level = firstLevel; level < texture.LevelCount; level++)
+            bytes += levelBytes(texture, level);
+        return bytes;
+    }
+
+    // Box filters rgba down the mip chain and returns levels [firstLevel, endLevel)
+    static std::vector<std::vector<unsigned char>> buildLevels(std::vector<unsigned char>& rgba, int width, int height, int firstLevel, int endLevel)
+    {
+        std::vector<std::vector<unsigned char>> levels;
+        std::vector<unsigned char> current;
+        current.swap(rgba);
+        for (int level = 0; level < endLevel; level++)
+        {
+            if (level >= firstLevel)
+                levels.push_back(current);
+            if (level + 1 == endLevel)
+                break;
+            int w = std::max(1, width >> 1), h = std::max(1, height >> 1);
+            std::vector<unsigned char> next((size_t)w * h * 4);
+            for (int y = 0; y < h; y++)
+            {
+                // odd sizes fold the last row or column into the previous texel
+                int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+                for (int x = 0; x < w; x++)
+                {
+                    int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int sum = current[((size_t)y0 * width + x0) * 4 + c] + current[((size_t)y0 * width + x1) * 4 + c]
+                            + current[((size_t)y1 * width + x0) * 4 + c] + current[((size_t)y1 * width + x1) * 4 + c];
+                        next[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            current.swap(next);
+            width = w;
+            height = h;
+        }
+        return levels;
+    }
+
+    // Uploads levels starting at firstLevel, which must end where the resident levels begin
+    void uploadLevels(StreamedTexture& texture, int firstLevel, const std::vector<std::vector<unsigned char>>& levels)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture.Id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            int level = firstLevel + (int)i;
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levelWidth(texture, level), levelHeight(texture, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[i].data());
+            UploadedBytes += levelBytes(texture, level);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GetRenderStats().TextureBytes += residentBytes(texture, firstLevel) - residentBytes(texture, texture.ResidentLevel);
+        texture.ResidentLevel = firstLevel;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+    }
+
+    void evictLevels(StreamedTexture& texture, int firstLevel)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture.Id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+        for (int level = texture.ResidentLevel; level < firstLevel; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GetRenderStats().TextureBytes -= residentBytes(texture, texture.ResidentLevel) - residentBytes(texture, firstLevel);
+        texture.ResidentLevel = firstLevel;
+    }
+
+    void uploadFinished()
+    {
+        for (;;)
+        {
+            uploading.clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (finished.empty() || (UploadedBytes > 0 && UploadedBytes >= UploadBytesPerFrame))
+                    return;
+                uploading.splice(uploading.begin(), finished, finished.begin());
+            }
+            LoadRequest& load = uploading.front();
+            StreamedTexture& texture = textures[load.Handle];
+            texture.Loading = false;
+            texture.Failed = load.Levels.empty();
+            // levels were evicted while loading, the load no longer joins up with what's resident
+            if (load.Levels.empty() || load.EndLevel != texture.ResidentLevel)
+                continue;
+            // the budget may have shrunk the target since the load was queued
+            int skip = std::max(0, std::min(texture.TargetLevel, load.EndLevel) - load.FirstLevel);
+            load.Levels.erase(load.Levels.begin(), load.Levels.begin() + skip);
+            if (!load.Levels.empty())
+                uploadLevels(texture, load.FirstLevel + skip, load.Levels);
+        }
+    }
+
+    void loaderLoop()
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !requests.empty(); });
+                if (quit)
+                    return;
+                loading.splice(loading.begin(), requests, requests.begin());
+            }
+            LoadRequest& load = loading.front();
+            std::vector<unsigned char> rgba;
+            int width, height;
+            if (load.Source(rgba, width, height))
+                load.Levels = buildLevels(rgba, width, height, load.FirstLevel, load.EndLevel);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.splice(finished.end(), loading);
+            }
+        }
+    }
+};
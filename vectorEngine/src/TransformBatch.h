@@ -0,0 +1,216 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#include <glm/simd/matrix.h>
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+
+// Positions, rotations and scales of many objects stored as structure-of-arrays, so the batch kernels can load
+// the same component of 4 (SSE) or 8 (AVX) objects with a single instruction. Rotations are unit quaternions
+struct TransformSoA
+{
+    std::vector<float> PX, PY, PZ;
+    std::vector<float> QX, QY, QZ, QW;
+    std::vector<float> SX, SY, SZ;
+
+    size_t Size() const { return PX.size(); }
+
+    void Resize(size_t count)
+    {
+        PX.resize(count, 0.0f); PY.resize(count, 0.0f); PZ.resize(count, 0.0f);
+        QX.resize(count, 0.0f); QY.resize(count, 0.0f); QZ.resize(count, 0.0f); QW.resize(count, 1.0f);
+        SX.resize(count, 1.0f); SY.resize(count, 1.0f); SZ.resize(count, 1.0f);
+    }
+
+    void SetPosition(size_t i, const glm::vec3& p)
+    {
+        PX[i] = p.x; PY[i] = p.y; PZ[i] = p.z;
+    }
+
+    void SetRotation(size_t i, const glm::quat& q)
+    {
+        QX[i] = q.x; QY[i] = q.y; QZ[i] = q.z; QW[i] = q.w;
+    }
+
+    // Same rotation as glm::rotate(angle, axis), axis must be normalized
+    void SetAxisAngle(size_t i, const glm::vec3& axis, float radians)
+    {
+        float s = std::sin(radians * 0.5f);
+        QX[i] = axis.x * s; QY[i] = axis.y * s; QZ[i] = axis.z * s; QW[i] = std::cos(radians * 0.5f);
+    }
+
+    void SetScale(size_t i, const glm::vec3& s)
+    {
+        SX[i] = s.x; SY[i] = s.y; SZ[i] = s.z;
+    }
+};
+
+
+// Reference path, one object at a time. Produces translate(p) * mat4_cast(q) * scale(s)
+inline void ComposeTransformsScalar(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        float x = in.QX[i], y = in.QY[i], z = in.QZ[i], w = in.QW[i];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+        glm::mat4& m = out[i];
+        m[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * in.SX[i];
+        m[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * in.SY[i];
+        m[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * in.SZ[i];
+        m[3] = glm::vec4(in.PX[i], in.PY[i], in.PZ[i], 1.0f);
+    }
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+// Writes the four column-major matrices whose rows are spread across SoA lanes. Each column is a 4x4 transpose
+// of (row0, row1, row2, row3) lanes
+inline void storeTransposed4(__m128 r0[4], __m128 r1[4], __m128 r2[4], __m128 r3[4], float* out)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        __m128 a = r0[c], b = r1[c], d = r2[c], e = r3[c];
+        _MM_TRANSPOSE4_PS(a, b, d, e);
+        // after the transpose a..e hold column c of objects 0..3
+        _mm_storeu_ps(out + 0 * 16 + c * 4, a);
+        _mm_storeu_ps(out + 1 * 16 + c * 4, b);
+        _mm_storeu_ps(out + 2 * 16 + c * 4, d);
+        _mm_storeu_ps(out + 3 * 16 + c * 4, e);
+    }
+}
+
+// Four objects per iteration: the quaternion to matrix expansion runs on full SSE lanes and the only shuffles are
+// the final transposes
+inline void ComposeTransformsSSE(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&in.QX[i]), y = _mm_loadu_ps(&in.QY[i]), z = _mm_loadu_ps(&in.QZ[i]), w = _mm_loadu_ps(&in.QW[i]);
+        __m128 sx = _mm_loadu_ps(&in.SX[i]), sy = _mm_loadu_ps(&in.SY[i]), sz = _mm_loadu_ps(&in.SZ[i]);
+
+        __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+        // rows of the 4x4 matrix, component c of each row is column c
+        __m128 row0[4] = {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+            _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+            _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+            _mm_loadu_ps(&in.PX[i]) };
+        __m128 row1[4] = {
+            _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+            _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+            _mm_loadu_ps(&in.PY[i]) };
+        __m128 row2[4] = {
+            _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+            _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+            _mm_loadu_ps(&in.PZ[i]) };
+        __m128 row3[4] = { zero, zero, zero, one };
+
+        storeTransposed4(row0, row1, row2, row3, &out[i][0][0]);
+    }
+    ComposeTransformsScalar(in, i, end, out);
+}
+#endif
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+// Eight objects per iteration, the two halves are transposed with the SSE path
+inline void ComposeTransformsAVX(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one4 = _mm_set1_ps(1.0f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&in.QX[i]), y = _mm256_loadu_ps(&in.QY[i]), z = _mm256_loadu_ps(&in.QZ[i]), w = _mm256_loadu_ps(&in.QW[i]);
+        __m256 sx = _mm256_loadu_ps(&in.SX[i]), sy = _mm256_loadu_ps(&in.SY[i]), sz = _mm256_loadu_ps(&in.SZ[i]);
+
+        __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+        __m256 rows[3][4] = {
+            { _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx), _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+              _mm256_mul_ps(_mm256_add_ps(xz, wy), sz), _mm256_loadu_ps(&in.PX[i]) },
+            { _mm256_mul_ps(_mm256_add_ps(xy, wz), sx), _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+              _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz), _mm256_loadu_ps(&in.PY[i]) },
+            { _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx), _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+              _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz), _mm256_loadu_ps(&in.PZ[i]) } };
+
+        __m128 lo[3][4], hi[3][4];
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                lo[r][c] = _mm256_castps256_ps128(rows[r][c]);
+                hi[r][c] = _mm256_extractf128_ps(rows[r][c], 1);
+            }
+        }
+        __m128 row3[4] = { zero, zero, zero, one4 };
+        storeTransposed4(lo[0], lo[1], lo[2], row3, &out[i][0][0]);
+        storeTransposed4(hi[0], hi[1], hi[2], row3, &out[i + 4][0][0]);
+    }
+    ComposeTransformsSSE(in, i, end, out);
+}
+#endif
+
+// Builds translate * rotate * scale model matrices for objects [begin, end) using the widest instruction set the
+// build targets
+inline void ComposeTransforms(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    ComposeTransformsAVX(in, begin, end, out);
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    ComposeTransformsSSE(in, begin, end, out);
+#else
+    ComposeTransformsScalar(in, begin, end, out);
+#endif
+}
+
+inline void ComposeTransforms(const TransformSoA& in, std::vector<glm::mat4>& out)
+{
+    out.resize(in.Size());
+    ComposeTransforms(in, 0, in.Size(), out.data());
+}
+
+// out[i] = parent * local[i], e.g. to append a shared parent or bake the view-projection into instance matrices.
+// glm::mat4 is only 4-byte aligned, so the columns go through unaligned loads into glm_mat4_mul
+inline void MultiplyTransforms(const glm::mat4& parent, const glm::mat4* local, size_t count, glm::mat4* out)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    glm_vec4 p[4] = { _mm_loadu_ps(&parent[0][0]), _mm_loadu_ps(&parent[1][0]), _mm_loadu_ps(&parent[2][0]), _mm_loadu_ps(&parent[3][0]) };
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* l = &local[i][0][0];
+        glm_vec4 m[4] = { _mm_loadu_ps(l), _mm_loadu_ps(l + 4), _mm_loadu_ps(l + 8), _mm_loadu_ps(l + 12) };
+        glm_vec4 r[4];
+        glm_mat4_mul(p, m, r);
+        float* o = &out[i][0][0];
+        _mm_storeu_ps(o, r[0]);
+        _mm_storeu_ps(o + 4, r[1]);
+        _mm_storeu_ps(o + 8, r[2]);
+        _mm_storeu_ps(o + 12, r[3]);
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+        out[i] = parent * local[i];
+#endif
+}
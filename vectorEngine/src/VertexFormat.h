@@ -0,0 +1,372 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Attributes that can be present in a quantized vertex. Attribute locations match vShader.glsl
+enum Vertex_Attribute {
+    VERTEX_POSITION = 1 << 0,
+    VERTEX_TEXCOORD = 1 << 1,
+    VERTEX_NORMAL   = 1 << 2,
+    VERTEX_TANGENT  = 1 << 3
+};
+
+enum TexCoord_Encoding {
+    TEXCOORD_UNORM16,   // 2x unorm16 relative to the mesh UV bounds
+    TEXCOORD_HALF       // 2x half float, for meshes whose UVs can't be bounded sensibly
+};
+
+enum Normal_Encoding {
+    NORMAL_OCT_SNORM8,  // octahedral, 2 bytes
+    NORMAL_OCT_SNORM16  // octahedral, 4 bytes
+};
+
+const unsigned int POSITION_LOCATION = 0;
+const unsigned int TEXCOORD_LOCATION = 2;
+const unsigned int NORMAL_LOCATION = 3;
+const unsigned int TANGENT_LOCATION = 4;
+
+
+// Describes the packed layout of a vertex. Positions are always stored as 4x snorm16 (xyz relative to the
+// mesh bounding box, w holds the tangent handedness)
+struct VertexFormat
+{
+    unsigned int Attributes;
+    TexCoord_Encoding TexCoordEncoding;
+    Normal_Encoding NormalEncoding;
+
+    VertexFormat(unsigned int attributes = VERTEX_POSITION | VERTEX_TEXCOORD, TexCoord_Encoding texCoordEncoding = TEXCOORD_UNORM16, Normal_Encoding normalEncoding = NORMAL_OCT_SNORM8)
+        : Attributes(attributes), TexCoordEncoding(texCoordEncoding), NormalEncoding(normalEncoding)
+    {
+    }
+
+    bool Has(Vertex_Attribute attribute) const { return (Attributes & attribute) != 0; }
+
+    int PositionOffset() const { return 0; }
+    int TexCoordOffset() const { return PositionOffset() + 4 * sizeof(int16_t); }
+    int NormalOffset() const { return TexCoordOffset() + (Has(VERTEX_TEXCOORD) ? 2 * sizeof(uint16_t) : 0); }
+    int TangentOffset() const { return NormalOffset() + (Has(VERTEX_NORMAL) ? octSize() : 0); }
+    // padded so every vertex starts 4-byte aligned
+    int Stride() const { return (TangentOffset() + (Has(VERTEX_TANGENT) ? octSize() : 0) + 3) & ~3; }
+
+private:
+    int octSize() const { return NormalEncoding == NORMAL_OCT_SNORM8 ? 2 : 4; }
+};
+
+// Describes where each attribute lives in an interleaved float source array. Offsets and stride are in
+// floats, -1 means the attribute isn't present. Tangents are read as vec4 (xyz + handedness in w)
+struct SourceLayout
+{
+    int Stride;
+    int Position;
+    int TexCoord;
+    int Normal;
+    int Tangent;
+
+    SourceLayout(int stride, int position = 0, int texCoord = -1, int normal = -1, int tangent = -1)
+        : Stride(stride), Position(position), TexCoord(texCoord), Normal(normal), Tangent(tangent)
+    {
+    }
+};
+
+
+// Quantization helpers, shared with anything else that writes packed vertex data
+inline int16_t PackSnorm16(float v)
+{
+    return (int16_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline uint16_t PackUnorm16(float v)
+{
+    return (uint16_t)std::lround(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
+inline int8_t PackSnorm8(float v)
+{
+    return (int8_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 127.0f);
+}
+
+// Maps a unit vector onto the [-1, 1] square by projecting it onto an octahedron and folding the lower half over
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+    n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    glm::vec2 p(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+
+// A static mesh stored in a quantized vertex format. The dequantization parameters are per mesh and have to be
+// uploaded with SetDequantUniforms before drawing
+class QuantizedMesh
+{
+public:
+    unsigned int VAO;
+    unsigned int VBO;
+    // position-only stream (8 bytes per vertex) for depth-only passes
+    unsigned int PositionVAO;
+    unsigned int PositionVBO;
+    // 32-bit triangle indices shared by both vertex arrays, 0 and no indices for non-indexed meshes
+    unsigned int EBO;
+    int VertexCount;
+    int IndexCount;
+    VertexFormat Format;
+    // position = packed * PositionScale + PositionOffset
+    glm::vec3 PositionScale;
+    glm::vec3 PositionOffset;
+    // uv = packed * TexCoordTransform.xy + TexCoordTransform.zw
+    glm::vec4 TexCoordTransform;
+
+    QuantizedMesh() : VAO(0), VBO(0), PositionVAO(0), PositionVBO(0), EBO(0), VertexCount(0), IndexCount(0), PositionScale(1.0f), PositionOffset(0.0f), TexCoordTransform(1.0f, 1.0f, 0.0f, 0.0f)
+    {
+    }
+
+    // Quantizes vertexCount interleaved float vertices described by source and uploads them
+    QuantizedMesh(const float* vertices, int vertexCount, SourceLayout source, VertexFormat format = VertexFormat())
+        : QuantizedMesh()
+    {
+        Format = format;
+        VertexCount = vertexCount;
+
+        std::vector<unsigned char> packed;
+        Quantize(vertices, vertexCount, source, packed);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        GetRenderStats().BufferBytes += packed.size();
+        SetupAttributes();
+
+        std::vector<int16_t> positions((size_t)vertexCount * 4);
+        for (int i = 0; i < vertexCount; i++)
+            memcpy(&positions[(size_t)i * 4], packed.data() + (size_t)i * Format.Stride() + Format.PositionOffset(), 4 * sizeof(int16_t));
+        glGenVertexArrays(1, &PositionVAO);
+        glGenBuffers(1, &PositionVBO);
+        glBindVertexArray(PositionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, PositionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(int16_t), positions.data(), GL_STATIC_DRAW);
+        GetRenderStats().BufferBytes += positions.size() * sizeof(int16_t);
+        glVertexAttribPointer(POSITION_LOCATION, 4, GL_SHORT, GL_TRUE, 4 * sizeof(int16_t), (void*)0);
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glBindVertexArray(0);
+    }
+
+    // Creates uninitialized buffers for vertexCount vertices in format and indexCount indices, for a producer that
+    // packs vertices itself, e.g. into the mapped buffers. The dequantization parameters are left to it as well
+    void Allocate(int vertexCount, int indexCount, VertexFormat format)
+    {
+        Format = format;
+        VertexCount = vertexCount;
+        IndexCount = indexCount;
+        size_t vertexBytes = (size_t)Format.Stride() * vertexCount;
+        size_t positionBytes = (size_t)vertexCount * 4 * sizeof(int16_t);
+        size_t indexBytes = (size_t)indexCount * sizeof(uint32_t);
+
+        if (indexCount > 0)
+        {
+            glGenBuffers(1, &EBO);
+        }
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+        SetupAttributes();
+        if (indexCount > 0)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+        }
+
+        glGenVertexArrays(1, &PositionVAO);
+        glGenBuffers(1, &PositionVBO);
+        glBindVertexArray(PositionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, PositionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positionBytes, NULL, GL_STATIC_DRAW);
+        glVertexAttribPointer(POSITION_LOCATION, 4, GL_SHORT, GL_TRUE, 4 * sizeof(int16_t), (void*)0);
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        if (indexCount > 0)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        }
+        glBindVertexArray(0);
+        GetRenderStats().BufferBytes += vertexBytes + positionBytes + indexBytes;
+    }
+
+    // Fills out with the packed vertex data and computes the dequantization parameters, without touching GL
+    void Quantize(const float* vertices, int vertexCount, SourceLayout source, std::vector<unsigned char>& out)
+    {
+        const int stride = Format.Stride();
+        out.assign((size_t)stride * vertexCount, 0);
+
+        // position bounds, stored as centre + half extent so snorm16 covers the box exactly
+        glm::vec3 posMin(FLT_MAX), posMax(-FLT_MAX);
+        glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+        for (int i = 0; i < vertexCount; i++)
+        {
+            const float* v = vertices + i * source.Stride;
+            glm::vec3 p(v[source.Position], v[source.Position + 1], v[source.Position + 2]);
+            posMin = glm::min(posMin, p);
+            posMax = glm::max(posMax, p);
+            if (source.TexCoord >= 0)
+            {
+                glm::vec2 uv(v[source.TexCoord], v[source.TexCoord + 1]);
+                uvMin = glm::min(uvMin, uv);
+                uvMax = glm::max(uvMax, uv);
+            }
+        }
+        if (vertexCount == 0)
+        {
+            posMin = posMax = glm::vec3(0.0f);
+            uvMin = uvMax = glm::vec2(0.0f);
+        }
+        PositionOffset = (posMin + posMax) * 0.5f;
+        PositionScale = glm::max((posMax - posMin) * 0.5f, glm::vec3(1e-6f));
+        if (Format.TexCoordEncoding == TEXCOORD_UNORM16 && source.TexCoord >= 0)
+        {
+            glm::vec2 uvRange = glm::max(uvMax - uvMin, glm::vec2(1e-6f));
+            TexCoordTransform = glm::vec4(uvRange, uvMin);
+        }
+        else
+        {
+            TexCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        }
+
+        for (int i = 0; i < vertexCount; i++)
+        {
+            const float* v = vertices + i * source.Stride;
+            unsigned char* dst = out.data() + (size_t)i * stride;
+
+            glm::vec3 p = (glm::vec3(v[source.Position], v[source.Position + 1], v[source.Position + 2]) - PositionOffset) / PositionScale;
+            int16_t* pos = (int16_t*)(dst + Format.PositionOffset());
+            pos[0] = PackSnorm16(p.x);
+            pos[1] = PackSnorm16(p.y);
+            pos[2] = PackSnorm16(p.z);
+            pos[3] = 32767;
+
+            if (Format.Has(VERTEX_TEXCOORD))
+            {
+                glm::vec2 uv = source.TexCoord >= 0 ? glm::vec2(v[source.TexCoord], v[source.TexCoord + 1]) : glm::vec2(0.0f);
+                uint16_t* t = (uint16_t*)(dst + Format.TexCoordOffset());
+                if (Format.TexCoordEncoding == TEXCOORD_UNORM16)
+                {
+                    uv = (uv - glm::vec2(TexCoordTransform.z, TexCoordTransform.w)) / glm::vec2(TexCoordTransform.x, TexCoordTransform.y);
+                    t[0] = PackUnorm16(uv.x);
+                    t[1] = PackUnorm16(uv.y);
+                }
+                else
+                {
+                    t[0] = glm::packHalf1x16(uv.x);
+                    t[1] = glm::packHalf1x16(uv.y);
+                }
+            }
+
+            if (Format.Has(VERTEX_NORMAL))
+            {
+                glm::vec3 n = source.Normal >= 0 ? glm::vec3(v[source.Normal], v[source.Normal + 1], v[source.Normal + 2]) : glm::vec3(0.0f, 0.0f, 1.0f);
+                packOct(OctEncode(n), dst + Format.NormalOffset());
+            }
+
+            if (Format.Has(VERTEX_TANGENT))
+            {
+                glm::vec3 t = source.Tangent >= 0 ? glm::vec3(v[source.Tangent], v[source.Tangent + 1], v[source.Tangent + 2]) : glm::vec3(1.0f, 0.0f, 0.0f);
+                packOct(OctEncode(t), dst + Format.TangentOffset());
+                // bitangent handedness rides along in the otherwise unused position w
+                if (source.Tangent >= 0 && v[source.Tangent + 3] < 0.0f)
+                    pos[3] = -32767;
+            }
+        }
+    }
+
+    // Uploads the per-mesh dequantization parameters, the shader must already be in use
+    void SetDequantUniforms(const Shader& shader) const
+    {
+        shader.setVec3("posScale", PositionScale);
+        shader.setVec3("posOffset", PositionOffset);
+        shader.setVec4("texCoordTransform", TexCoordTransform);
+    }
+
+    void Draw() const
+    {
+        glBindVertexArray(VAO);
+        if (IndexCount > 0)
+            glDrawElements(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, NULL);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, VertexCount);
+    }
+
+    size_t SizeBytes() const
+    {
+        return (size_t)Format.Stride() * VertexCount + (size_t)IndexCount * sizeof(uint32_t);
+    }
+
+private:
+    void SetupAttributes()
+    {
+        const int stride = Format.Stride();
+        // all attributes are normalized so the conversion to float happens in the vertex fetch hardware. Pre-4.2
+        // drivers may map snorm as (2c + 1) / (2^b - 1), the resulting half-step bias is far below a texel/pixel
+        glVertexAttribPointer(POSITION_LOCATION, 4, GL_SHORT, GL_TRUE, stride, (void*)(intptr_t)Format.PositionOffset());
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        if (Format.Has(VERTEX_TEXCOORD))
+        {
+            if (Format.TexCoordEncoding == TEXCOORD_UNORM16)
+                glVertexAttribPointer(TEXCOORD_LOCATION, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(intptr_t)Format.TexCoordOffset());
+            else
+                glVertexAttribPointer(TEXCOORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(intptr_t)Format.TexCoordOffset());
+            glEnableVertexAttribArray(TEXCOORD_LOCATION);
+        }
+        GLenum octType = Format.NormalEncoding == NORMAL_OCT_SNORM8 ? GL_BYTE : GL_SHORT;
+        if (Format.Has(VERTEX_NORMAL))
+        {
+            glVertexAttribPointer(NORMAL_LOCATION, 2, octType, GL_TRUE, stride, (void*)(intptr_t)Format.NormalOffset());
+            glEnableVertexAttribArray(NORMAL_LOCATION);
+        }
+        if (Format.Has(VERTEX_TANGENT))
+        {
+            glVertexAttribPointer(TANGENT_LOCATION, 2, octType, GL_TRUE, stride, (void*)(intptr_t)Format.TangentOffset());
+            glEnableVertexAttribArray(TANGENT_LOCATION);
+        }
+    }
+
+    void packOct(glm::vec2 e, unsigned char* dst) const
+    {
+        if (Format.NormalEncoding == NORMAL_OCT_SNORM8)
+        {
+            int8_t* o = (int8_t*)dst;
+            o[0] = PackSnorm8(e.x);
+            o[1] = PackSnorm8(e.y);
+        }
+        else
+        {
+            int16_t* o = (int16_t*)dst;
+            o[0] = PackSnorm16(e.x);
+            o[1] = PackSnorm16(e.y);
+        }
+    }
+};
@@ -0,0 +1,566 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "ClusteredLighting.h"
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Shader.h"
+#include "Terrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// Voxels along a chunk's side
+const int VOXEL_CHUNK = 32;
+const int VOXEL_CHUNK_VOLUME = VOXEL_CHUNK * VOXEL_CHUNK * VOXEL_CHUNK;
+// a chunk and a shell of its neighbours' voxels, which decide which of its boundary faces show
+const int VOXEL_PADDED = VOXEL_CHUNK + 2;
+// chunks stacked in every column of the world
+const int VOXEL_COLUMN_CHUNKS = 4;
+// The worst case is a checkerboard, every other voxel solid with all six faces showing
+const int VOXEL_MAX_QUADS = VOXEL_CHUNK_VOLUME / 2 * 6;
+// chunks meshed per Update, each with its own scratch. The rest stay dirty for the next one
+const int VOXEL_MESH_BATCH = 8;
+const uint16_t VOXEL_AIR = 0;
+
+enum Voxel_Material {
+    VOXEL_GRASS = 1,
+    VOXEL_DIRT,
+    VOXEL_STONE
+};
+
+
+// A chunk's voxels as indices into a palette of the materials it contains, packed into as few bits as the palette
+// needs. A chunk of one material takes no bits at all, the typical surface chunk 2 bits per voxel. Materials that
+// no voxel uses any more stay in the palette until Assign
+class VoxelChunk
+{
+public:
+    uint16_t Get(int index) const
+    {
+        if (bits == 0)
+            return palette[0];
+        int perWord = 64 / bits;
+        return palette[(words[index / perWord] >> (index % perWord * bits)) & ((1ull << bits) - 1)];
+    }
+
+    void Set(int index, uint16_t material)
+    {
+        int entry = findEntry(material);
+        if (entry < 0)
+        {
+            entry = (int)palette.size();
+            palette.push_back(material);
+            if ((int)palette.size() > 1 << bits)
+                repack(bits == 0 ? 1 : bits * 2);
+        }
+        if (bits == 0)
+            return;
+        int perWord = 64 / bits;
+        uint64_t& word = words[index / perWord];
+        int shift = index % perWord * bits;
+        word = (word & ~(((1ull << bits) - 1) << shift)) | (uint64_t)entry << shift;
+    }
+
+    // Replaces every voxel with the VOXEL_CHUNK_VOLUME materials in x, then y, then z order
+    void Assign(const uint16_t* materials)
+    {
+        palette.clear();
+        palette.push_back(materials[0]);
+        for (int i = 1; i < VOXEL_CHUNK_VOLUME; i++)
+        {
+            if (materials[i] != materials[i - 1] && findEntry(materials[i]) < 0)
+                palette.push_back(materials[i]);
+        }
+        int needed = 0;
+        while ((int)palette.size() > 1 << needed)
+            needed = needed == 0 ? 1 : needed * 2;
+        bits = needed;
+        words.assign(bits == 0 ? 0 : VOXEL_CHUNK_VOLUME / (64 / bits), 0);
+        for (int i = 0; bits > 0 && i < VOXEL_CHUNK_VOLUME; i++)
+            Set(i, materials[i]);
+    }
+
+    bool Uniform() const { return bits == 0; }
+    size_t Bytes() const { return words.size() * sizeof(uint64_t) + palette.size() * sizeof(uint16_t); }
+
+private:
+    std::vector<uint16_t> palette = std::vector<uint16_t>(1, VOXEL_AIR);
+    std::vector<uint64_t> words;
+    // 0, 1, 2, 4, 8 or 16, so no index straddles two words
+    int bits = 0;
+
+    int findEntry(uint16_t material) const
+    {
+        for (size_t i = 0; i < palette.size(); i++)
+        {
+            if (palette[i] == material)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    void repack(int newBits)
+    {
+        std::vector<uint64_t> packed(VOXEL_CHUNK_VOLUME / (64 / newBits), 0);
+        int perWord = 64 / newBits;
+        for (int i = 0; i < VOXEL_CHUNK_VOLUME; i++)
+        {
+            uint64_t entry = bits == 0 ? 0 : (words[i / (64 / bits)] >> (i % (64 / bits) * bits)) & ((1ull << bits) - 1);
+            packed[i / perWord] |= entry << (i % perWord * newBits);
+        }
+        words.swap(packed);
+        bits = newBits;
+    }
+};
+
+// What the world holds and what the last Update and Draw did
+struct VoxelStats
+{
+    int Chunks = 0;
+    uint64_t SolidVoxels = 0;
+    // palette storage against two bytes per voxel
+    uint64_t StorageBytes = 0;
+    uint64_t DenseBytes = 0;
+    uint64_t Quads = 0;
+    int ChunksMeshed = 0;
+    int DirtyChunks = 0;
+    double MeshMs = 0.0;
+    double UploadMs = 0.0;
+    int Draws = 0;
+};
+
+// A world of chunks of unit voxels. Every chunk is meshed on the job system into greedily merged quads of the faces
+// between solid voxels and air, and drawn with one call. Edits mark the chunks they touch dirty, including the
+// neighbours that share a changed boundary voxel, and Update remeshes a bounded batch of them per frame. Quads are a
+// single packed uint per vertex, drawn with one index buffer of the quad pattern shared by all chunks
+class VoxelWorld
+{
+public:
+    // with fShader.glsl for forward shading, and with fGBuffer.glsl for the deferred geometry pass
+    Shader ForwardShader;
+    Shader GeometryShader;
+    // bound to both material units, every voxel face shows all of it
+    unsigned int Texture = 0;
+    VoxelStats Stats;
+
+    // chunksX * VOXEL_COLUMN_CHUNKS * chunksZ chunks of hills centred on center, whose ground is at center's height
+    // there. Generated and meshed completely
+    VoxelWorld(int chunksX, int chunksZ, const glm::vec3& center)
+        : ForwardShader("src/vVoxel.glsl", "src/fShader.glsl"), GeometryShader("src/vVoxel.glsl", "src/fGBuffer.glsl"),
+          sizeX(chunksX), sizeZ(chunksZ)
+    {
+        glm::ivec2 middle(sizeX * VOXEL_CHUNK / 2, sizeZ * VOXEL_CHUNK / 2);
+        // the top of the middle column's grass voxel
+        origin = glm::vec3(center.x - middle.x, center.y - columnHeight(middle.x, middle.y) - 1.0f, center.z - middle.y);
+        Shader* shaders[] = { &ForwardShader, &GeometryShader };
+        for (Shader* shader : shaders)
+        {
+            shader->use();
+            shader->setInt("texture1", 0);
+            shader->setInt("texture2", 1);
+            shader->setFloat("roughness", 0.8f);
+            shader->setFloat("metalness", 0.0f);
+        }
+        ForwardShader.use();
+        LightClusters::SetSamplerUnits(ForwardShader);
+
+        int count = sizeX * VOXEL_COLUMN_CHUNKS * sizeZ;
+        chunks.resize(count);
+        Stats.Chunks = count;
+        Stats.DenseBytes = (uint64_t)count * VOXEL_CHUNK_VOLUME * sizeof(uint16_t);
+        dirty.reserve(count);
+        scratch.resize(VOXEL_MESH_BATCH);
+        for (MeshScratch& s : scratch)
+        {
+            s.Padded.resize(VOXEL_PADDED * VOXEL_PADDED * VOXEL_PADDED);
+            s.Vertices.resize(VOXEL_MAX_QUADS * 4);
+        }
+        generate();
+
+        // quads are 0 1 2, 0 2 3 of their four vertices
+        std::vector<uint32_t> indices(VOXEL_MAX_QUADS * 6);
+        for (uint32_t quad = 0; quad < (uint32_t)VOXEL_MAX_QUADS; quad++)
+        {
+            uint32_t pattern[] = { 0, 1, 2, 0, 2, 3 };
+            for (int i = 0; i < 6; i++)
+                indices[quad * 6 + i] = quad * 4 + pattern[i];
+        }
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        GetRenderStats().BufferBytes += indices.size() * sizeof(uint32_t);
+
+        for (int i = 0; i < count; i++)
+        {
+            markDirty(i);
+        }
+        while (!dirty.empty())
+        {
+            Update();
+        }
+    }
+
+    ~VoxelWorld()
+    {
+        for (Chunk& chunk : chunks)
+        {
+            glDeleteBuffers(1, &chunk.VertexBuffer);
+            glDeleteVertexArrays(1, &chunk.Vao);
+            GetRenderStats().BufferBytes -= chunk.BufferBytes;
+        }
+        glDeleteBuffers(1, &indexBuffer);
+        GetRenderStats().BufferBytes -= (uint64_t)VOXEL_MAX_QUADS * 6 * sizeof(uint32_t);
+    }
+
+    VoxelWorld(const VoxelWorld&) = delete;
+    VoxelWorld& operator=(const VoxelWorld&) = delete;
+
+    // material of the voxel at world voxel coordinates, air outside the world
+    uint16_t GetVoxel(int x, int y, int z) const
+    {
+        if (x < 0 || y < 0 || z < 0 || x >= sizeX * VOXEL_CHUNK || y >= VOXEL_COLUMN_CHUNKS * VOXEL_CHUNK || z >= sizeZ * VOXEL_CHUNK)
+            return VOXEL_AIR;
+        return chunks[chunkIndex(x / VOXEL_CHUNK, y / VOXEL_CHUNK, z / VOXEL_CHUNK)].Voxels.Get(voxelIndex(x % VOXEL_CHUNK, y % VOXEL_CHUNK, z % VOXEL_CHUNK));
+    }
+
+    // Changes one voxel and marks the chunks whose mesh it shows in dirty. Growing a chunk's palette allocates
+    void SetVoxel(int x, int y, int z, uint16_t material)
+    {
+        if (x < 0 || y < 0 || z < 0 || x >= sizeX * VOXEL_CHUNK || y >= VOXEL_COLUMN_CHUNKS * VOXEL_CHUNK || z >= sizeZ * VOXEL_CHUNK)
+            return;
+        glm::ivec3 chunk(x / VOXEL_CHUNK, y / VOXEL_CHUNK, z / VOXEL_CHUNK);
+        glm::ivec3 local(x % VOXEL_CHUNK, y % VOXEL_CHUNK, z % VOXEL_CHUNK);
+        VoxelChunk& voxels = chunks[chunkIndex(chunk.x, chunk.y, chunk.z)].Voxels;
+        int index = voxelIndex(local.x, local.y, local.z);
+        uint16_t previous = voxels.Get(index);
+        if (previous == material)
+            return;
+        voxels.Set(index, material);
+        if (previous == VOXEL_AIR)
+            Stats.SolidVoxels++;
+        else if (material == VOXEL_AIR)
+            Stats.SolidVoxels--;
+        markDirty(chunkIndex(chunk.x, chunk.y, chunk.z));
+        for (int axis = 0; axis < 3; axis++)
+        {
+            glm::ivec3 neighbour = chunk;
+            if (local[axis] == 0)
+                neighbour[axis]--;
+            else if (local[axis] == VOXEL_CHUNK - 1)
+                neighbour[axis]++;
+            if (neighbour != chunk && inside(neighbour))
+                markDirty(chunkIndex(neighbour.x, neighbour.y, neighbour.z));
+        }
+    }
+
+    // Sets every voxel whose centre is within radius of center, in world units
+    void FillSphere(const glm::vec3& center, float radius, uint16_t material)
+    {
+        glm::vec3 local = center - origin;
+        glm::ivec3 low = glm::ivec3(glm::floor(local - radius)), high = glm::ivec3(glm::ceil(local + radius));
+        for (int z = low.z; z <= high.z; z++)
+        {
+            for (int y = low.y; y <= high.y; y++)
+            {
+                for (int x = low.x; x <= high.x; x++)
+                {
+                    glm::vec3 d = glm::vec3(x, y, z) + 0.5f - local;
+                    if (glm::dot(d, d) <= radius * radius)
+                        SetVoxel(x, y, z, material);
+                }
+            }
+        }
+    }
+
+    // top of the generated ground at world x, z
+    float SurfaceHeight(float x, float z) const
+    {
+        return origin.y + columnHeight((int)std::floor(x - origin.x), (int)std::floor(z - origin.z)) + 1.0f;
+    }
+
+    // Remeshes up to VOXEL_MESH_BATCH dirty chunks on the job system and uploads them, the latest edits first
+    void Update()
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        batchSize = std::min((int)dirty.size(), VOXEL_MESH_BATCH);
+        for (int i = 0; i < batchSize; i++)
+        {
+            scratch[i].Chunk = dirty.back();
+            chunks[dirty.back()].Dirty = false;
+            dirty.pop_back();
+        }
+        GetJobSystem().ParallelFor(batchSize, 1, [this](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                meshChunk(scratch[i]);
+        });
+        std::chrono::high_resolution_clock::time_point meshed = std::chrono::high_resolution_clock::now();
+
+        for (int i = 0; i < batchSize; i++)
+        {
+            const MeshScratch& s = scratch[i];
+            Chunk& chunk = chunks[s.Chunk];
+            if (chunk.Vao == 0 && s.Quads > 0)
+            {
+                glGenVertexArrays(1, &chunk.Vao);
+                glGenBuffers(1, &chunk.VertexBuffer);
+                glBindVertexArray(chunk.Vao);
+                glBindBuffer(GL_ARRAY_BUFFER, chunk.VertexBuffer);
+                glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+                glEnableVertexAttribArray(0);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+                glBindVertexArray(0);
+            }
+            Stats.Quads += (uint64_t)s.Quads - chunk.Quads;
+            chunk.Quads = s.Quads;
+            if (chunk.Vao == 0)
+                continue;
+            // a chunk that lost every face keeps its buffer for the next edit
+            size_t bytes = (size_t)s.Quads * 4 * sizeof(uint32_t);
+            glBindBuffer(GL_ARRAY_BUFFER, chunk.VertexBuffer);
+            if (bytes > chunk.BufferBytes)
+            {
+                GetRenderStats().BufferBytes += bytes - chunk.BufferBytes;
+                chunk.BufferBytes = bytes;
+                glBufferData(GL_ARRAY_BUFFER, bytes, s.Vertices.data(), GL_DYNAMIC_DRAW);
+            }
+            else if (bytes > 0)
+            {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, s.Vertices.data());
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        Stats.ChunksMeshed = batchSize;
+        Stats.DirtyChunks = (int)dirty.size();
+        Stats.MeshMs = std::chrono::duration<double, std::milli>(meshed - start).count();
+        Stats.UploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - meshed).count();
+        Stats.StorageBytes = 0;
+        for (const Chunk& chunk : chunks)
+            Stats.StorageBytes += chunk.Voxels.Bytes();
+    }
+
+    // Draws the chunks in the frustum with shader, ForwardShader or GeometryShader, which the caller has bound with
+    // its lighting uniforms set. Leaves the texture bound to units 0 and 1
+    void Draw(Shader& shader, const Frustum& frustum, const glm::mat4& view, const glm::mat4& projection)
+    {
+        shader.use();
+        shader.setMat4("view", view);
+        shader.setMat4("projection", projection);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        Stats.Draws = 0;
+        for (int i = 0; i < (int)chunks.size(); i++)
+        {
+            const Chunk& chunk = chunks[i];
+            if (chunk.Quads == 0)
+                continue;
+            glm::vec3 boxMin = origin + glm::vec3(chunkCoords(i) * VOXEL_CHUNK);
+            if (!frustum.IntersectsBox(boxMin, boxMin + glm::vec3((float)VOXEL_CHUNK)))
+                continue;
+            shader.setVec3("chunkOrigin", boxMin);
+            glBindVertexArray(chunk.Vao);
+            glDrawElements(GL_TRIANGLES, chunk.Quads * 6, GL_UNSIGNED_INT, NULL);
+            GetRenderStats().CountDraw(chunk.Quads * 6);
+            Stats.Draws++;
+        }
+        glBindVertexArray(0);
+    }
+
+private:
+    struct Chunk
+    {
+        VoxelChunk Voxels;
+        unsigned int Vao = 0;
+        unsigned int VertexBuffer = 0;
+        size_t BufferBytes = 0;
+        int Quads = 0;
+        bool Dirty = false;
+    };
+
+    // what one job of a mesh batch works in, allocated once for the worst case
+    struct MeshScratch
+    {
+        int Chunk = 0;
+        std::vector<uint16_t> Padded;
+        uint16_t Mask[VOXEL_CHUNK * VOXEL_CHUNK];
+        std::vector<uint32_t> Vertices;
+        int Quads = 0;
+    };
+
+    int sizeX, sizeZ;
+    glm::vec3 origin;
+    std::vector<Chunk> chunks;
+    std::vector<int> dirty;
+    std::vector<MeshScratch> scratch;
+    int batchSize = 0;
+    unsigned int indexBuffer = 0;
+
+    int chunkIndex(int x, int y, int z) const { return (z * VOXEL_COLUMN_CHUNKS + y) * sizeX + x; }
+    glm::ivec3 chunkCoords(int index) const { return glm::ivec3(index % sizeX, index / sizeX % VOXEL_COLUMN_CHUNKS, index / (sizeX * VOXEL_COLUMN_CHUNKS)); }
+    static int voxelIndex(int x, int y, int z) { return (z * VOXEL_CHUNK + y) * VOXEL_CHUNK + x; }
+    bool inside(const glm::ivec3& chunk) const
+    {
+        return chunk.x >= 0 && chunk.y >= 0 && chunk.z >= 0 && chunk.x < sizeX && chunk.y < VOXEL_COLUMN_CHUNKS && chunk.z < sizeZ;
+    }
+
+    void markDirty(int chunk)
+    {
+        if (!chunks[chunk].Dirty)
+        {
+            chunks[chunk].Dirty = true;
+            dirty.push_back(chunk);
+        }
+    }
+
+    // rolling hills about half way up the world, in voxels above its floor
+    int columnHeight(int x, int z) const
+    {
+        float hills = TerrainValueNoise(x / 48.0, z / 48.0) * 14.0f + TerrainValueNoise(x / 13.0 + 5.1, z / 13.0 - 2.7) * 4.0f;
+        return (int)(VOXEL_COLUMN_CHUNKS * VOXEL_CHUNK * 0.5f + hills);
+    }
+
+    // Fills the chunks column by column on the job system: grass on top, a few voxels of dirt, stone below
+    void generate()
+    {
+        std::vector<uint64_t> solid(sizeX * sizeZ, 0);
+        GetJobSystem().ParallelFor(sizeX * sizeZ, 1, [this, &solid](int begin, int end)
+        {
+            std::vector<uint16_t> materials(VOXEL_CHUNK_VOLUME);
+            std::vector<int> heights(VOXEL_CHUNK * VOXEL_CHUNK);
+            for (int column = begin; column < end; column++)
+            {
+                int cx = column % sizeX, cz = column / sizeX;
+                for (int z = 0; z < VOXEL_CHUNK; z++)
+                {
+                    for (int x = 0; x < VOXEL_CHUNK; x++)
+                        heights[z * VOXEL_CHUNK + x] = columnHeight(cx * VOXEL_CHUNK + x, cz * VOXEL_CHUNK + z);
+                }
+                for (int cy = 0; cy < VOXEL_COLUMN_CHUNKS; cy++)
+                {
+                    for (int z = 0; z < VOXEL_CHUNK; z++)
+                    {
+                        for (int y = 0; y < VOXEL_CHUNK; y++)
+                        {
+                            for (int x = 0; x < VOXEL_CHUNK; x++)
+                            {
+                                int height = heights[z * VOXEL_CHUNK + x], wy = cy * VOXEL_CHUNK + y;
+                                uint16_t material = wy > height ? VOXEL_AIR : wy == height ? (uint16_t)VOXEL_GRASS : wy > height - 4 ? (uint16_t)VOXEL_DIRT : (uint16_t)VOXEL_STONE;
+                                materials[voxelIndex(x, y, z)] = material;
+                                solid[column] += material != VOXEL_AIR;
+                            }
+                        }
+                    }
+                    chunks[chunkIndex(cx, cy, cz)].Voxels.Assign(materials.data());
+                }
+            }
+        });
+        for (uint64_t count : solid)
+            Stats.SolidVoxels += count;
+    }
+
+    // One vertex of a quad: its corner in the chunk, 0 to VOXEL_CHUNK, the face direction and the material
+    static uint32_t packVertex(const glm::ivec3& corner, int face, uint16_t material)
+    {
+        return (uint32_t)corner.x | (uint32_t)corner.y << 6 | (uint32_t)corner.z << 12 | (uint32_t)face << 18 | (uint32_t)material << 21;
+    }
+
+    // Greedy meshing: for every face direction and slice, a mask of the visible faces' materials is covered with
+    // rectangles as wide and then as tall as the same material allows
+    void meshChunk(MeshScratch& s) const
+    {
+        glm::ivec3 base = chunkCoords(s.Chunk) * VOXEL_CHUNK - 1;
+        uint16_t* padded = s.Padded.data();
+        const VoxelChunk& voxels = chunks[s.Chunk].Voxels;
+        for (int z = 0; z < VOXEL_PADDED; z++)
+        {
+            for (int y = 0; y < VOXEL_PADDED; y++)
+            {
+                for (int x = 0; x < VOXEL_PADDED; x++)
+                {
+                    bool shell = x == 0 || y == 0 || z == 0 || x == VOXEL_PADDED - 1 || y == VOXEL_PADDED - 1 || z == VOXEL_PADDED - 1;
+                    padded[(z * VOXEL_PADDED + y) * VOXEL_PADDED + x] = shell ? GetVoxel(base.x + x, base.y + y, base.z + z) : voxels.Get(voxelIndex(x - 1, y - 1, z - 1));
+                }
+            }
+        }
+
+        const int strides[3] = { 1, VOXEL_PADDED, VOXEL_PADDED * VOXEL_PADDED };
+        uint32_t* vertices = s.Vertices.data();
+        int quads = 0;
+        for (int face = 0; face < 6; face++)
+        {
+            // faces 0 to 5 are +x, -x, +y, -y, +z, -z. The quads span u and v, whose cross product is the axis
+            int axis = face / 2, u = (axis + 1) % 3, v = (axis + 2) % 3;
+            bool positive = face % 2 == 0;
+            int step = positive ? strides[axis] : -strides[axis];
+            for (int slice = 0; slice < VOXEL_CHUNK; slice++)
+            {
+                for (int j = 0; j < VOXEL_CHUNK; j++)
+                {
+                    for (int i = 0; i < VOXEL_CHUNK; i++)
+                    {
+                        int cell = (slice + 1) * strides[axis] + (i + 1) * strides[u] + (j + 1) * strides[v];
+                        uint16_t material = padded[cell];
+                        s.Mask[j * VOXEL_CHUNK + i] = material != VOXEL_AIR && padded[cell + step] == VOXEL_AIR ? material : VOXEL_AIR;
+                    }
+                }
+                for (int j = 0; j < VOXEL_CHUNK; j++)
+                {
+                    for (int i = 0; i < VOXEL_CHUNK; )
+                    {
+                        uint16_t material = s.Mask[j * VOXEL_CHUNK + i];
+                        if (material == VOXEL_AIR)
+                        {
+                            i++;
+                            continue;
+                        }
+                        int width = 1;
+                        while (i + width < VOXEL_CHUNK && s.Mask[j * VOXEL_CHUNK + i + width] == material)
+                            width++;
+                        int height = 1;
+                        for (; j + height < VOXEL_CHUNK; height++)
+                        {
+                            const uint16_t* row = s.Mask + (j + height) * VOXEL_CHUNK + i;
+                            int k = 0;
+                            while (k < width && row[k] == material)
+                                k++;
+                            if (k < width)
+                                break;
+                        }
+                        for (int h = 0; h < height; h++)
+                            std::memset(s.Mask + (j + h) * VOXEL_CHUNK + i, 0, width * sizeof(uint16_t));
+
+                        glm::ivec3 corner, du(0), dv(0);
+                        corner[axis] = positive ? slice + 1 : slice;
+                        corner[u] = i;
+                        corner[v] = j;
+                        du[u] = width;
+                        dv[v] = height;
+                        // counter-clockwise seen from the side the face points to
+                        glm::ivec3 second = positive ? corner + du : corner + dv, fourth = positive ? corner + dv : corner + du;
+                        uint32_t* quad = vertices + quads * 4;
+                        quad[0] = packVertex(corner, face, material);
+                        quad[1] = packVertex(second, face, material);
+                        quad[2] = packVertex(corner + du + dv, face, material);
+                        quad[3] = packVertex(fourth, face, material);
+                        quads++;
+                        i += width;
+                    }
+                }
+            }
+        }
+        s.Quads = quads;
+    }
+};
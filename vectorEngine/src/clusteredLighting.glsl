@@ -0,0 +1,99 @@
+// Clustered light lookup and shading, included by the forward and deferred lighting shaders. See ClusteredLighting.h
+uniform bool clusteredLighting;
+uniform samplerBuffer lightData;    // 3 texels per light
+uniform usamplerBuffer clusterGrid; // offset and count into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
+uniform vec3 clusterSize;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthScaleBias;
+uniform vec2 depthPlanes;
+uniform vec3 viewPos;
+uniform vec3 ambientLight;
+
+// directional sun with cascaded shadows, see ShadowMaps.h
+const int SHADOW_CASCADES = 4;
+uniform bool sunEnabled;
+uniform vec3 sunDirection; // towards the sun
+uniform vec3 sunColor;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOW_CASCADES];
+uniform vec4 cascadeSplits;    // view depth where each cascade ends
+uniform vec4 cascadeTexelSize; // world size of a shadow texel
+uniform float shadowMapSize;
+
+// Linear view depth from a [0, 1] window depth
+float linearDepth(float windowDepth)
+{
+    float ndcDepth = windowDepth * 2.0 - 1.0;
+    return 2.0 * depthPlanes.x * depthPlanes.y / (depthPlanes.y + depthPlanes.x - ndcDepth * (depthPlanes.y - depthPlanes.x));
+}
+
+// Fraction of the sun reaching position, 3x3 taps of hardware 2x2 PCF in the cascade covering depth
+float sunShadow(vec3 position, vec3 n, float depth)
+{
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    if (depth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+
+    // offset along the normal by about a texel, scales with the cascade so acne and peter-panning stay even
+    vec3 p = position + n * (cascadeTexelSize[cascade] * 1.5);
+    vec3 s = (shadowMatrices[cascade] * vec4(p, 1.0)).xyz;
+    float texel = 1.0 / shadowMapSize;
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowMap, vec4(s.xy + vec2(x, y) * texel, float(cascade), s.z));
+    }
+    return lit / 9.0;
+}
+
+// Ambient, the shadowed sun when enabled, and every light of the fragment's cluster. Normalized Blinn-Phong, the exponent comes from roughness and
+// metals tint the specular with their albedo
+vec3 shadeClustered(vec2 fragCoord, float windowDepth, vec3 position, vec3 n, vec3 albedo, float roughness, float metalness)
+{
+    float depth = linearDepth(windowDepth);
+    vec3 cluster = vec3(floor(fragCoord / clusterTileSize), floor(log(depth) * clusterDepthScaleBias.x + clusterDepthScaleBias.y));
+    ivec3 c = ivec3(clamp(cluster, vec3(0.0), clusterSize - 1.0));
+    uvec2 range = texelFetch(clusterGrid, c.x + int(clusterSize.x) * (c.y + int(clusterSize.y) * c.z)).xy;
+
+    vec3 v = normalize(viewPos - position);
+    vec3 diffuseColor = albedo * (1.0 - metalness);
+    vec3 specularColor = mix(vec3(0.04), albedo, metalness);
+    float alpha = max(roughness * roughness, 0.01);
+    float shininess = 2.0 / (alpha * alpha) - 2.0;
+    float specularNorm = (shininess + 8.0) / 25.1327; // (n + 8) / 8pi
+
+    vec3 lighting = ambientLight * albedo;
+    if (sunEnabled)
+    {
+        float nDotL = max(dot(n, sunDirection), 0.0);
+        if (nDotL > 0.0)
+        {
+            float specular = pow(max(dot(n, normalize(sunDirection + v)), 0.0), shininess) * specularNorm;
+            lighting += sunColor * ((diffuseColor + specularColor * specular) * nDotL * sunShadow(position, n, depth));
+        }
+    }
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r) * 3;
+        vec4 positionRadius = texelFetch(lightData, light);
+        vec4 colorInner = texelFetch(lightData, light + 1);
+        vec4 directionOuter = texelFetch(lightData, light + 2);
+
+        vec3 toLight = positionRadius.xyz - position;
+        float distance2 = dot(toLight, toLight);
+        vec3 l = toLight * inversesqrt(max(distance2, 1e-8));
+        // inverse square with a smooth window that reaches zero at the radius
+        float window = clamp(1.0 - pow(distance2 / (positionRadius.w * positionRadius.w), 2.0), 0.0, 1.0);
+        float attenuation = window * window / (distance2 + 1.0);
+        attenuation *= smoothstep(directionOuter.w, colorInner.w, dot(-l, directionOuter.xyz));
+
+        float nDotL = max(dot(n, l), 0.0);
+        float specular = pow(max(dot(n, normalize(l + v)), 0.0), shininess) * specularNorm;
+        lighting += colorInner.rgb * ((diffuseColor + specularColor * specular) * nDotL * attenuation);
+    }
+    return lighting;
+}
@@ -0,0 +1,42 @@
+#version 330 core
+// Writes the accumulated lighting, or one of the G-buffer channels for debugging, to the output framebuffer along
+// with the G-buffer depth so forward passes drawn afterwards are depth tested against the scene
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D lightAccumulation;
+uniform sampler2D gAlbedoRoughness;
+uniform sampler2D gNormalMetalness;
+uniform sampler2D gDepth;
+uniform int debugView; // Deferred_View
+uniform vec4 background;
+uniform vec2 depthPlanes;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    gl_FragDepth = depth;
+    if (depth == 1.0)
+    {
+        FragColor = background;
+        return;
+    }
+
+    if (debugView == 1)
+        FragColor = vec4(texelFetch(gAlbedoRoughness, pixel, 0).rgb, 1.0);
+    else if (debugView == 2)
+        FragColor = vec4(texelFetch(gNormalMetalness, pixel, 0).rgb, 1.0);
+    else if (debugView == 3)
+        FragColor = vec4(texelFetch(gAlbedoRoughness, pixel, 0).a, texelFetch(gNormalMetalness, pixel, 0).a, 0.0, 1.0);
+    else if (debugView == 4)
+    {
+        // linear depth, near is white
+        float ndcDepth = depth * 2.0 - 1.0;
+        float linear = 2.0 * depthPlanes.x * depthPlanes.y / (depthPlanes.y + depthPlanes.x - ndcDepth * (depthPlanes.y - depthPlanes.x));
+        FragColor = vec4(vec3(1.0 - (linear - depthPlanes.x) / (depthPlanes.y - depthPlanes.x)), 1.0);
+    }
+    else
+        FragColor = vec4(texelFetch(lightAccumulation, pixel, 0).rgb, 1.0);
+}
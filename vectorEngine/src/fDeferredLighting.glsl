@@ -0,0 +1,47 @@
+#version 330 core
+// Accumulates the lighting of every G-buffer pixel into an RGBA16F target
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D gAlbedoRoughness;
+uniform sampler2D gNormalMetalness;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+#include "clusteredLighting.glsl"
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    vec4 albedoRoughness = texelFetch(gAlbedoRoughness, pixel, 0);
+    if (!clusteredLighting)
+    {
+        FragColor = vec4(albedoRoughness.rgb, 1.0);
+        return;
+    }
+
+    vec4 normalMetalness = texelFetch(gNormalMetalness, pixel, 0);
+    uvec3 bytes = uvec3(round(normalMetalness.rgb * 255.0));
+    vec2 e = vec2((bytes.r << 4u) | (bytes.g >> 4u), ((bytes.g & 15u) << 8u) | bytes.b) / 4095.0;
+    vec3 n = octDecode(e * 2.0 - 1.0);
+
+    // world position from depth, there is no position target
+    vec4 viewPosition = inverseProjection * vec4(TexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec3 position = (inverseView * vec4(viewPosition.xyz / viewPosition.w, 1.0)).xyz;
+
+    FragColor = vec4(shadeClustered(gl_FragCoord.xy, depth, position, n, albedoRoughness.rgb, albedoRoughness.a, normalMetalness.a), 1.0);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth-only pre-pass, colour writes are masked off so there is nothing to output
+void main()
+{
+}
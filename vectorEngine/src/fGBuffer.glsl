@@ -0,0 +1,33 @@
+#version 330 core
+// G-buffer layout, 8 bytes per pixel plus depth:
+//   0: RGBA8 albedo, roughness
+//   1: RGBA8 octahedral normal as 2x12 bits in rgb, metalness
+// Position isn't stored, the lighting pass reconstructs it from depth
+layout(location = 0) out vec4 AlbedoRoughness;
+layout(location = 1) out vec4 NormalMetalness;
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+uniform float roughness;
+uniform float metalness;
+
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xy;
+    if (n.z < 0.0)
+        p = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+    return p;
+}
+
+void main()
+{
+    vec4 albedo = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+    AlbedoRoughness = vec4(albedo.rgb, roughness);
+
+    uvec2 e = uvec2(round((octEncode(normalize(Normal)) * 0.5 + 0.5) * 4095.0));
+    NormalMetalness = vec4(vec3(e.x >> 4u, ((e.x & 15u) << 4u) | (e.y >> 8u), e.y & 255u) / 255.0, metalness);
+}
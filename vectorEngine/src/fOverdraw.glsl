@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// every shaded fragment adds one to the additively blended overdraw target
+void main()
+{
+    FragColor = vec4(1.0);
+}
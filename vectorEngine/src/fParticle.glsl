@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Corner;
+in vec4 Color;
+
+// additive, so only rgb matters and the output is premultiplied by the fade and a round falloff
+void main()
+{
+    float falloff = max(1.0 - dot(Corner, Corner), 0.0);
+    FragColor = vec4(Color.rgb * (Color.a * falloff * falloff), 1.0);
+}
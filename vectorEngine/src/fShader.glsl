@@ -3,13 +3,25 @@ out vec4 FragColor;
 
 in vec3 ourColor;
 in vec2 TexCoord;
+in vec3 FragPos;
+in vec3 Normal;
 
 uniform sampler2D texture1;
 uniform sampler2D texture2;
+uniform float roughness;
+uniform float metalness;
+
+// unlit when clusteredLighting is off
+#include "clusteredLighting.glsl"
 
 void main()
 {
-    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+    vec4 albedo = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+    if (clusteredLighting)
+    {
+        albedo.rgb = shadeClustered(gl_FragCoord.xy, gl_FragCoord.z, FragPos, normalize(Normal), albedo.rgb, roughness, metalness);
+    }
+    FragColor = albedo;
 }
 
 // 0.5, 0.2, 1.0, 1.0 -> bright purple
@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 Color;
+
+// signed distance field, 0.5 on the glyph's edge. See TextRenderer.h
+uniform sampler2D glyphAtlas;
+
+// a dark outline keeps the text readable over anything
+const float OUTLINE = 0.15;
+
+void main()
+{
+    float distance = texture(glyphAtlas, TexCoord).r;
+    float width = fwidth(distance);
+    float fill = smoothstep(0.5 - width, 0.5 + width, distance);
+    float outline = smoothstep(0.5 - OUTLINE - width, 0.5 - OUTLINE + width, distance);
+    FragColor = vec4(Color.rgb * fill, Color.a * outline);
+}
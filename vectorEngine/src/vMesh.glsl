@@ -0,0 +1,27 @@
+#version 330 core
+// Unquantized static meshes, e.g. from glTF files. Attributes may be stored as any type glVertexAttribPointer
+// converts to float
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+out vec3 ourColor;
+out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+
+    ourColor = vec3(1.0);
+    TexCoord = aTexCoord;
+    FragPos = worldPos.xyz;
+    // inverse transpose, glTF nodes may scale non-uniformly
+    Normal = transpose(inverse(mat3(model))) * aNormal;
+}
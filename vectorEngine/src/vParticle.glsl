@@ -0,0 +1,26 @@
+#version 330 core
+// One instance per particle, each stream comes from its own section of the instance buffer. The quad is a 4 vertex
+// triangle strip whose corners are derived from gl_VertexID and offset in view space, so it always faces the camera
+layout(location = 0) in float aPosX;
+layout(location = 1) in float aPosY;
+layout(location = 2) in float aPosZ;
+layout(location = 3) in float aAge;     // 0 at birth, 1 at death
+layout(location = 4) in vec4 aColor;    // unorm8
+
+out vec2 Corner;
+out vec4 Color;
+
+uniform mat4 view;
+uniform mat4 projection;
+// half size at birth and at death
+uniform vec2 sizeOverLife;
+
+void main()
+{
+    Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec4 viewPos = view * vec4(aPosX, aPosY, aPosZ, 1.0);
+    viewPos.xy += Corner * mix(sizeOverLife.x, sizeOverLife.y, aAge);
+    gl_Position = projection * viewPos;
+    // quick fade in, linear fade out
+    Color = vec4(aColor.rgb, aColor.a * min(aAge * 10.0, 1.0) * (1.0 - aAge));
+}
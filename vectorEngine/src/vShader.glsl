@@ -1,19 +1,45 @@
 #version 330 core
-layout(location = 0) in vec3 aPos;
+layout(location = 0) in vec4 aPos;      // snorm16, xyz relative to the mesh bounds, w = tangent handedness
 layout(location = 1) in vec3 aColor;
-layout(location = 2) in vec2 aTexCoord;
+layout(location = 2) in vec2 aTexCoord; // unorm16 relative to the mesh UV bounds, or half
+layout(location = 3) in vec2 aNormal;   // octahedral snorm
+layout(location = 4) in vec2 aTangent;  // octahedral snorm
+
+// the depth pre-pass runs this shader with a position-only stream, both passes must produce identical depth
+invariant gl_Position;
 
 out vec3 ourColor;
 out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// per-mesh dequantization
+uniform vec3 posScale;
+uniform vec3 posOffset;
+uniform vec4 texCoordTransform;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 pos = aPos.xyz * posScale + posOffset;
+    vec4 worldPos = model * vec4(pos, 1.0);
+    gl_Position = projection * view * worldPos;
 
     ourColor = aColor;
-    TexCoord = aTexCoord;
+    TexCoord = aTexCoord * texCoordTransform.xy + texCoordTransform.zw;
+    FragPos = worldPos.xyz;
+    Normal = mat3(model) * octDecode(aNormal);
+    Tangent = vec4(mat3(model) * octDecode(aTangent), aPos.w < 0.0 ? -1.0 : 1.0);
 }
@@ -0,0 +1,48 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+layout(location = 3) in uvec4 aJoints;
+layout(location = 4) in vec4 aWeights;  // unorm8, sums to 1
+
+out vec3 ourColor;
+out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// 3 texels per joint, the rows of its world space skinning matrix, jointCount joints per instance. See Animation.h
+uniform samplerBuffer bonePalette;
+uniform int jointCount;
+// positions and normals were skinned on the CPU and are already in world space
+uniform bool preSkinned;
+
+mat4 boneMatrix(uint joint)
+{
+    int base = (gl_InstanceID * jointCount + int(joint)) * 3;
+    vec4 r0 = texelFetch(bonePalette, base);
+    vec4 r1 = texelFetch(bonePalette, base + 1);
+    vec4 r2 = texelFetch(bonePalette, base + 2);
+    return mat4(vec4(r0.x, r1.x, r2.x, 0.0), vec4(r0.y, r1.y, r2.y, 0.0), vec4(r0.z, r1.z, r2.z, 0.0), vec4(r0.w, r1.w, r2.w, 1.0));
+}
+
+void main()
+{
+    vec4 worldPos = vec4(aPos, 1.0);
+    vec3 normal = aNormal;
+    if (!preSkinned)
+    {
+        mat4 skin = boneMatrix(aJoints.x) * aWeights.x + boneMatrix(aJoints.y) * aWeights.y +
+            boneMatrix(aJoints.z) * aWeights.z + boneMatrix(aJoints.w) * aWeights.w;
+        worldPos = skin * worldPos;
+        normal = mat3(skin) * normal;
+    }
+    gl_Position = projection * view * worldPos;
+
+    ourColor = vec3(1.0);
+    TexCoord = aTexCoord;
+    FragPos = worldPos.xyz;
+    Normal = normal;
+}
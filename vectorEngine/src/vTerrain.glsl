@@ -0,0 +1,52 @@
+#version 330 core
+layout(location = 0) in uvec2 aGrid;     // vertex of the shared quarter node grid
+layout(location = 1) in vec4 aNode;      // node origin x, z, vertex spacing, level
+layout(location = 2) in vec4 aTile;      // tile origin in the atlas in texels, quarter offset in grid steps
+
+out vec3 ourColor;
+out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPos;
+
+// R16 tiles of TERRAIN_GRID + 3 heights with a border of one, remapped to heightRange.x + h * heightRange.y
+uniform sampler2D heightAtlas;
+uniform float atlasTexel;
+uniform vec2 heightRange;
+// per level the distance its vertices start morphing into the parent's grid and 1 / the morph length. See Terrain.h
+uniform vec2 morphRanges[16];
+uniform float textureScale;
+
+float height(vec2 grid)
+{
+    return heightRange.x + texture(heightAtlas, (aTile.xy + grid + 1.5) * atlasTexel).r * heightRange.y;
+}
+
+void main()
+{
+    vec2 grid = aTile.zw + vec2(aGrid);
+    float spacing = aNode.z;
+    vec2 world = aNode.xy + grid * spacing;
+    float distance = length(cameraPos - vec3(world.x, height(grid), world.y));
+
+    // odd vertices slide onto the even ones, so at the end of the range the node matches its parent's grid
+    vec2 morph = morphRanges[int(aNode.w)];
+    float k = clamp((distance - morph.x) * morph.y, 0.0, 1.0);
+    grid -= fract(grid * 0.5) * 2.0 * k;
+    world = aNode.xy + grid * spacing;
+    vec3 worldPos = vec3(world.x, height(grid), world.y);
+
+    float left = height(grid - vec2(1.0, 0.0));
+    float right = height(grid + vec2(1.0, 0.0));
+    float down = height(grid - vec2(0.0, 1.0));
+    float up = height(grid + vec2(0.0, 1.0));
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+
+    ourColor = vec3(1.0);
+    TexCoord = world * textureScale;
+    FragPos = worldPos;
+    Normal = normalize(vec3(left - right, 2.0 * spacing, down - up));
+}
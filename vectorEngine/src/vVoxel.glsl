@@ -0,0 +1,31 @@
+#version 330 core
+// x, y, z of the corner in the chunk in 6 bits each, the face in 3 and the material above. See VoxelWorld.h
+layout(location = 0) in uint aPacked;
+
+out vec3 ourColor;
+out vec2 TexCoord;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 chunkOrigin;
+
+const vec3 FACE_NORMALS[6] = vec3[6](vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0));
+
+void main()
+{
+    vec3 corner = vec3(float(aPacked & 63u), float((aPacked >> 6) & 63u), float((aPacked >> 12) & 63u));
+    uint face = (aPacked >> 18) & 7u;
+    uint material = aPacked >> 21;
+    vec3 worldPos = chunkOrigin + corner;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+
+    // the texture repeats every voxel across merged quads, shifted per material so they look apart
+    vec2 uv = face < 2u ? worldPos.zy : face < 4u ? worldPos.xz : worldPos.xy;
+    ourColor = vec3(1.0);
+    TexCoord = uv + float(material) * vec2(0.37, 0.61);
+    FragPos = worldPos;
+    Normal = FACE_NORMALS[face];
+}